@@ -20,13 +20,24 @@
 #include "Path.h"
 #include "FileSystem.h"
 #include "BrowserWidget.h"
+#include "FuzzyMatch.h"
 
 #include "DefaultLayout.h"
 
 static const char* DebugTestPath = "./browser_test/runtime_test";
 static const char* DefaultFontFile = "Roboto-Medium.ttf";
 
-Application::Application() {
+// where file and content indexes are kept between runs
+static Path IndexDirectory() {
+    Path directory = FileSystem::getKnownFolderPath(FileSystem::KnownFolder::LocalAppData);
+    directory.appendName("FileBrowser");
+    if(!FileSystem::doesPathExist(directory)) FileSystem::createDirectory(directory);
+    return directory;
+}
+
+Application::Application()
+    : mFileIndexService(IndexDirectory()),
+    mContentIndexService(IndexDirectory()) {
     glfwInit();
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -88,7 +99,7 @@ Application::Application() {
     baseDir.toAbsolute();
 
     for(int i = 0; i < 2; i++) {
-        mBrowserWidgets.push_back(BrowserWidget(baseDir, &mFileOpsWorker));
+        mBrowserWidgets.push_back(BrowserWidget(baseDir, &mFileOpsWorker, &mFolderSizeService, &mFileIndexService, &mContentIndexService));
     }
 
 }
@@ -134,7 +145,7 @@ void Application::run() {
 
         // ctrl+n for new window
         if(ImGui::IsKeyDown(ImGuiKey_LeftCtrl) && ImGui::IsKeyPressed(ImGuiKey_N)) {
-            mBrowserWidgets.push_back(BrowserWidget(Path(""), &mFileOpsWorker));
+            mBrowserWidgets.push_back(BrowserWidget(Path(""), &mFileOpsWorker, &mFolderSizeService, &mFileIndexService, &mContentIndexService));
         }
 
         std::vector<int> widgetsToClose;
@@ -339,6 +350,26 @@ void Application::run() {
                 }
             }
 
+            // an index being loaded or built takes a while on a big tree
+            const std::string indexingNames = mFileIndexService.busyRoot();
+            if(!indexingNames.empty()) {
+                ImGui::Text("| indexing names of %s...", indexingNames.c_str());
+            }
+            const std::string indexingContent = mContentIndexService.busyRoot();
+            if(!indexingContent.empty()) {
+                ImGui::Text("| indexing %s...", indexingContent.c_str());
+            }
+
+            // throughput of the focused window's grep, while it runs and after
+            if(mCurrentFocusedWidget != -1 && mCurrentFocusedWidget < mBrowserWidgets.size()) {
+                const ContentSearcher& grep = mBrowserWidgets[mCurrentFocusedWidget].contentSearcher();
+                if(grep.isActive()) {
+                    ImGui::Text("| grep: %zu matches in %llu files, %.2f GB/s%s", grep.numResults(),
+                        static_cast<unsigned long long>(grep.numFilesSearched()), grep.bytesPerSecond() / 1e9,
+                        grep.isSearching() ? "..." : "");
+                }
+            }
+
             ImGui::EndMenuBar();
             //ImGui::PopStyleColor();
 
@@ -488,19 +519,16 @@ int Application::CmdPalletInputTextCallback(ImGuiInputTextCallbackData* data) {
     // get all commands
     std::vector<std::string_view> cmdNames = app->mCmdParser.GetCommandNames();
 
-    auto xMatches = [&data, &buffer](const std::string_view cmdName) {
-        if(data->BufTextLen > 0) {
-            return cmdName.find(buffer) != std::string::npos;
-        } else {
-            return true;
-        }
-    };
+    NameArena names;
+    for(std::string_view name : cmdNames) {
+        names.add(name);
+    }
 
-    for(int i = 0; i < cmdNames.size(); i++) {
-        std::string_view name = cmdNames[i];
-        if(xMatches(name)) {
-            app->mCommandCompletionList.push_back(i);
-        }
+    // best first
+    std::vector<FuzzyMatch> matches;
+    FuzzyRank(names, buffer, names.size(), matches);
+    for(const FuzzyMatch& match : matches) {
+        app->mCommandCompletionList.push_back(static_cast<int>(match.index));
     }
 
     if(data->EventKey == ImGuiKey_UpArrow) {
@@ -536,19 +564,15 @@ int Application::QuickAccessInputTextCallback(ImGuiInputTextCallbackData* data)
 
     app->mQuickAccessCompletionList.clear();
 
-    // get all commands
-    auto xMatches = [&data, &buffer](const std::string_view itemName) {
-        if(data->BufTextLen > 0) {
-            return itemName.find(buffer) != std::string::npos;
-        } else {
-            return true;
-        }
-    };
+    NameArena names;
+    for(const auto& link : app->mQuickAccessLinks) {
+        names.add(link.displayName);
+    }
 
-    for(int i = 0; i < app->mQuickAccessLinks.size(); i++) {
-        if(xMatches(app->mQuickAccessLinks[i].displayName)) {
-            app->mQuickAccessCompletionList.push_back(i);
-        }
+    std::vector<FuzzyMatch> matches;
+    FuzzyRank(names, buffer, names.size(), matches);
+    for(const FuzzyMatch& match : matches) {
+        app->mQuickAccessCompletionList.push_back(static_cast<int>(match.index));
     }
 
     if(data->EventKey == ImGuiKey_UpArrow) {
@@ -1,5 +1,8 @@
 #pragma once
 #include "FileOpsWorker.h"
+#include "FolderSizeService.h"
+#include "FileIndexService.h"
+#include "ContentIndexService.h"
 #include "CommandParser.h"
 
 struct GLFWwindow;
@@ -49,6 +52,9 @@ private:
 
     GLFWwindow* mWindow;
     FileOpsWorker mFileOpsWorker;
+    FolderSizeService mFolderSizeService;
+    FileIndexService mFileIndexService;
+    ContentIndexService mContentIndexService;
     CommandParser mCmdParser;
 
     std::vector<QuickAccessLink> mQuickAccessLinks;
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+// number of the lowest / highest set bit of a non zero word
+inline static int LowestSetBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward64(&bit, word);
+    return static_cast<int>(bit);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline static int HighestSetBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse64(&bit, word);
+    return static_cast<int>(bit);
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+inline static size_t CountSetBits(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<size_t>(__popcnt64(word));
+#else
+    return static_cast<size_t>(__builtin_popcountll(word));
+#endif
+}
+
+// Fixed size set of bits, 64 to a word. Finding the next or previous set bit skips empty words whole, so stepping
+// through a handful of matches among a million rows doesn't look at every row
+class BitSet {
+public:
+    static constexpr size_t NPOS = SIZE_MAX;
+
+    // `numBits` bits, all unset
+    inline void reset(size_t numBits) {
+        mNumBits = numBits;
+        mWords.assign((numBits + 63) / 64, 0);
+    }
+
+    inline size_t size() const { return mNumBits; }
+
+    inline void set(size_t bit)     { mWords[bit / 64] |= uint64_t(1) << (bit % 64); }
+    inline void unset(size_t bit)   { mWords[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+
+    // bits past the end read as unset
+    inline bool test(size_t bit) const {
+        return bit < mNumBits && (mWords[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    inline size_t count() const {
+        size_t numSet = 0;
+        for(uint64_t word : mWords) {
+            numSet += CountSetBits(word);
+        }
+        return numSet;
+    }
+
+    // first set bit at or after `bit`, NPOS if there is none
+    inline size_t findNext(size_t bit) const {
+        if(bit >= mNumBits) return NPOS;
+
+        size_t wordIdx = bit / 64;
+        uint64_t word = mWords[wordIdx] & (~uint64_t(0) << (bit % 64));
+        while(word == 0) {
+            if(++wordIdx == mWords.size()) return NPOS;
+            word = mWords[wordIdx];
+        }
+        return wordIdx * 64 + LowestSetBit(word);
+    }
+
+    // last set bit at or before `bit`, NPOS if there is none
+    inline size_t findPrevious(size_t bit) const {
+        if(mNumBits == 0) return NPOS;
+        if(bit >= mNumBits) bit = mNumBits - 1;
+
+        size_t wordIdx = bit / 64;
+        uint64_t word = mWords[wordIdx] & (~uint64_t(0) >> (63 - bit % 64));
+        while(word == 0) {
+            if(wordIdx-- == 0) return NPOS;
+            word = mWords[wordIdx];
+        }
+        return wordIdx * 64 + HighestSetBit(word);
+    }
+
+    // the words themselves, bit `i` is bit `i % 64` of word `i / 64`. Bits past size() have to stay unset
+    inline std::vector<uint64_t>&       words()         { return mWords; }
+    inline const std::vector<uint64_t>& words() const   { return mWords; }
+
+private:
+    std::vector<uint64_t>   mWords;
+    size_t                  mNumBits = 0;
+};
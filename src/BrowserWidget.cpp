@@ -2,10 +2,14 @@
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <misc/cpp/imgui_stdlib.h>
+#include <algorithm>
 #include <regex>
+#include <stdio.h>
 #include "FileSystem.h"
 #include "FileOpsWorker.h"
 #include "DirectoryWatcher.h"
+#include "FileIndexService.h"
+#include "ContentIndexService.h"
 
 #include <tracy/Tracy.hpp>
 
@@ -22,6 +26,10 @@ inline static const char* DISPLAY_COLUMN_ICON = "Icon##DisplayColumn";
 inline static const char* DISPLAY_COLUMN_NAME = "Name##DisplayColumn";
 inline static const char* DISPLAY_COLUMN_LAST_MODIFIED = "LastModified##DisplayColumn";
 inline static const char* DISPLAY_COLUMN_SIZE = "Size##DisplayColumn";
+inline static const char* DISPLAY_COLUMN_FOLDER = "Folder##DisplayColumn";
+inline static const char* DISPLAY_COLUMN_FILE = "File##DisplayColumn";
+inline static const char* DISPLAY_COLUMN_LINE = "Line##DisplayColumn";
+inline static const char* DISPLAY_COLUMN_TEXT = "Text##DisplayColumn";
 
 inline static ImGuiID DISPLAY_COLUMN_NAME_ID;
 inline static ImGuiID DISPLAY_COLUMN_LAST_MODIFIED_ID;
@@ -37,12 +45,15 @@ inline static std::string PrettyPrintSize(uint64_t size) {
     return std::string(std::to_string(size) + " B");
 }
 
-BrowserWidget::BrowserWidget(const Path& path, FileOpsWorker* fileOpsWorker) 
+BrowserWidget::BrowserWidget(const Path& path, FileOpsWorker* fileOpsWorker, FolderSizeService* folderSizeService, FileIndexService* fileIndexService,
+                             ContentIndexService* contentIndexService) 
     : mCurrentDirectory(path),
     mDirectoryChanged(true),
-    mFileOpsWorker(fileOpsWorker)
+    mFileOpsWorker(fileOpsWorker),
+    mFileIndexService(fileIndexService),
+    mContentIndexService(contentIndexService)
 {
-    mDirectoryWatcher.changeDirectory(mCurrentDirectory);
+    mDirectoryWatcher.setFolderSizeService(folderSizeService);
     mID = IDCounter++;
     if(FileSystem::doesPathExist(path)) {
         setCurrentDirectory(path);
@@ -73,7 +84,7 @@ void BrowserWidget::renameSelected(const std::string& from, const std::string& t
 
     BatchFileOperation fileOperation{};
     for(int itemToRename : itemsToRename) {
-        const std::string& name = displayList.getName(itemToRename);
+        const std::string name(displayList.getName(itemToRename));
 
         Path sourcePath(mCurrentDirectory);
         sourcePath.appendName(name);
@@ -92,6 +103,89 @@ void BrowserWidget::renameSelected(const std::string& from, const std::string& t
     mFileOpsWorker->addFileOperation(fileOperation);
 }
 
+bool BrowserWidget::find(const FindQuery& query) {
+    // an index has the names already, only the matches are looked at on disk
+    std::vector<std::string> paths;
+    if(mFileIndexService != nullptr && mFileIndexService->findMatches(mCurrentDirectory, query, mFileFinder.pruneNames(), paths)) {
+        if(!mFileFinder.startListed(mCurrentDirectory, query, std::move(paths))) return false;
+    } else if(!mFileFinder.start(mCurrentDirectory, query)) {
+        return false;
+    }
+
+    mContentSearcher.clear();
+    mDisplayListType = DisplayListType::FIND_RESULTS;
+    mSelection.clear();
+    mFindSelectedIdx = -1;
+    mFindTimestampCache.clear();
+
+    mEditIdx = -1;
+    mEditInput.clear();
+
+    return true;
+}
+
+void BrowserWidget::closeFindResults() {
+    mFileFinder.clear();
+    mFindSelectedIdx = -1;
+    mDisplayListType = DisplayListType::DEFAULT;
+}
+
+bool BrowserWidget::grep(const GrepQuery& query) {
+    // the selection only means something over the listing, results views have their own
+    std::vector<std::string> names;
+    if(mDisplayListType == DisplayListType::DEFAULT) {
+        const FileSystem::SOARecord& displayList = mDirectoryWatcher.mRecords;
+        for(size_t i : mSelection.indexes) {
+            names.emplace_back(displayList.getName(i));
+        }
+    }
+
+    // an index narrows the files down to the ones that may match, they're still searched for real
+    std::vector<std::string> candidates;
+    if(mContentIndexService != nullptr && mContentIndexService->findCandidates(mCurrentDirectory, names, query, candidates)) {
+        if(!mContentSearcher.startListed(mCurrentDirectory, std::move(candidates), query)) return false;
+    } else if(!mContentSearcher.start(mCurrentDirectory, names, query)) {
+        return false;
+    }
+
+    mFileFinder.clear();
+    mDisplayListType = DisplayListType::GREP_RESULTS;
+    mSelection.clear();
+    mGrepSelectedIdx = -1;
+
+    mEditIdx = -1;
+    mEditInput.clear();
+
+    return true;
+}
+
+bool BrowserWidget::index(bool namesOnly, bool drop) {
+    if(mCurrentDirectory.str().empty()) return false;
+
+    const std::string& root = mCurrentDirectory.str();
+    if(mFileIndexService != nullptr) {
+        if(drop) {
+            mFileIndexService->drop(root);
+        } else {
+            mFileIndexService->request(root);
+        }
+    }
+    if(mContentIndexService != nullptr && !namesOnly) {
+        if(drop) {
+            mContentIndexService->drop(root);
+        } else {
+            mContentIndexService->request(root);
+        }
+    }
+    return true;
+}
+
+void BrowserWidget::closeGrepResults() {
+    mContentSearcher.clear();
+    mGrepSelectedIdx = -1;
+    mDisplayListType = DisplayListType::DEFAULT;
+}
+
 bool BeginDrapDropTargetWindow(const char* payload_type) {
     using namespace ImGui;
     ImRect inner_rect = GetCurrentWindow()->InnerRect;
@@ -124,7 +218,7 @@ void BrowserWidget::acceptMovePayload(Path targetPath) {
 
         BatchFileOperation fileOperation{};
         for(int sourceIndex : movePayload->itemsToMove) {
-            const std::string& sourceItemName = sourceDisplayList.getName(sourceIndex);
+            std::string_view sourceItemName = sourceDisplayList.getName(sourceIndex);
 
             Path sourcePath(movePayload->sourcePath); sourcePath.appendName(sourceItemName);
 
@@ -150,6 +244,40 @@ void BrowserWidget::update() {
 
     ImGuiWindowFlags mainWindowFlags = ImGuiWindowFlags_NoCollapse;
 
+    // swap in whatever the watcher finished before anything reads the records this frame
+    if(mDirectoryWatcher.update()) {
+        mSelection.clear();
+    }
+
+    // highlights follow the listing, a background scan's matches show up as it finds them. The highlighted rank
+    // stays, whatever row it lands on after better matches came in or the rows moved. Past the best matches the
+    // highlight stays on its row while that still matches and moves on to the next match otherwise
+    if(mNameFilter.update(mDirectoryWatcher.mRecords, mDirectoryWatcher.listingVersion(), mDirectoryWatcher.orderVersion())) {
+        const int previousHighlightIdx = mCurrentHighlightIdx;
+        if(mIsHighlightPastBest && mNameFilter.numMatches() > 0) {
+            if(mCurrentHighlightIdx < 0 || !mNameFilter.isMatch(mCurrentHighlightIdx)) {
+                size_t row = mNameFilter.nextMatch(std::max(mCurrentHighlightIdx, 0));
+                if(row == BitSet::NPOS) row = mNameFilter.nextMatch(0);
+                mCurrentHighlightIdx = static_cast<int>(row);
+            }
+        } else if(mNameFilter.numBestMatches() > 0) {
+            mIsHighlightPastBest = false;
+            mCurrentHighlightRank = std::min(mCurrentHighlightRank, mNameFilter.numBestMatches() - 1);
+            mCurrentHighlightIdx = static_cast<int>(mNameFilter.bestMatch(mCurrentHighlightRank));
+        } else {
+            mCurrentHighlightIdx = -1;
+        }
+        mHighlightNextItem = mCurrentHighlightIdx >= 0 && mCurrentHighlightIdx != previousHighlightIdx;
+    }
+
+    // results of a find or a grep stream in while the walk goes on
+    mFileFinder.update();
+    mContentSearcher.update();
+
+    if(mDisplayListType == DisplayListType::DEFAULT && mDirectoryWatcher.status() == DirectoryStatus::NOT_FOUND) {
+        mDisplayListType = DisplayListType::PATH_NOT_FOUND_ERROR;
+    }
+
     if(!ImGui::Begin(windowID.c_str(), &mIsOpen, mainWindowFlags)){
         ImGui::End();
         return;
@@ -190,6 +318,14 @@ void BrowserWidget::update() {
             {
                 ImGui::Text("Path not found...");
             } break;
+        case DisplayListType::FIND_RESULTS:
+            {
+                findResultsTable();
+            } break;
+        case DisplayListType::GREP_RESULTS:
+            {
+                grepResultsTable();
+            } break;
     }
 
     updateSearch();
@@ -198,6 +334,8 @@ void BrowserWidget::update() {
 
     if(mTableSortSpecs != nullptr) {
         if(mTableSortSpecs->SpecsDirty && mTableSortSpecs->Specs != nullptr) {
+            // shift-clicking headers adds secondary columns, the specs come in order of precedence
+            std::vector<FileSystem::SortKey> sortKeys;
             for(int i = 0; i < mTableSortSpecs->SpecsCount; i++) {
                 FileSystem::SortDirection dir = mTableSortSpecs->Specs[i].SortDirection == ImGuiSortDirection_Ascending 
                     ? FileSystem::SortDirection::Ascending : FileSystem::SortDirection::Descending;
@@ -205,19 +343,20 @@ void BrowserWidget::update() {
                 switch(mTableSortSpecs->Specs[i].ColumnIndex) {
                     case 1:  // name
                         {
-                            mDirectoryWatcher.setSort(DirectorySortFlags::DIRECTORY_SORT_NAME, dir);
+                            sortKeys.push_back({ FileSystem::SortColumn::Name, dir });
                         } break;
                     case 2:  // date
                         {
-                            mDirectoryWatcher.setSort(DirectorySortFlags::DIRECTORY_SORT_DATE, dir);
+                            sortKeys.push_back({ FileSystem::SortColumn::LastModified, dir });
                         } break;
                     case 3:  // file size
                         {
-                            mDirectoryWatcher.setSort(DirectorySortFlags::DIRECTORY_SORT_FILE_SIZE, dir);
+                            sortKeys.push_back({ FileSystem::SortColumn::Size, dir });
                         } break;
                 }
             }
 
+            mDirectoryWatcher.setSort(sortKeys);
             mTableSortSpecs->SpecsDirty = false;
         }
     }
@@ -240,25 +379,26 @@ void BrowserWidget::update() {
             }
             mDisplayListType = DisplayListType::DRIVE;
         } else {
-            if(FileSystem::doesPathExist(mCurrentDirectory)) {
-                mDisplayListType = DisplayListType::DEFAULT;
-                mDirectoryWatcher.changeDirectory(mCurrentDirectory);
-            } else {
-                mDisplayListType = DisplayListType::PATH_NOT_FOUND_ERROR;
-            }
+            // whether the path exists is found out on the watcher's thread
+            mDisplayListType = DisplayListType::DEFAULT;
+            mDirectoryWatcher.changeDirectory(mCurrentDirectory);
         }
 
         mSelection.clear();
 
-        mHighlighted.assign(mHighlighted.size(), false);
+        mNameFilter.clear();
         mCurrentHighlightIdx = -1;
 
+        mFileFinder.clear();
+        mFindSelectedIdx = -1;
+
+        mContentSearcher.clear();
+        mGrepSelectedIdx = -1;
+
         mEditIdx = -1;
         mEditInput.clear();
-    }
 
-    if(mDirectoryWatcher.update()) {
-        mSelection.clear();
+        mTimestampCache.clear();
     }
 
     ImGui::End();
@@ -272,7 +412,23 @@ void BrowserWidget::handleInput() {
             mSelection.clear();
 
             if(!mSearchWindowOpen) {
-                mHighlighted.assign(mHighlighted.size(), false);
+                mNameFilter.clear();
+
+                // the first one stops a find that's still going, the next one goes back to the listing
+                if(mDisplayListType == DisplayListType::FIND_RESULTS) {
+                    if(mFileFinder.isSearching()) {
+                        mFileFinder.cancel();
+                    } else {
+                        closeFindResults();
+                    }
+                }
+                if(mDisplayListType == DisplayListType::GREP_RESULTS) {
+                    if(mContentSearcher.isSearching()) {
+                        mContentSearcher.cancel();
+                    } else {
+                        closeGrepResults();
+                    }
+                }
             }
 
             mEditIdx = -1;
@@ -413,10 +569,14 @@ void BrowserWidget::directoryTable() {
     FileSystem::SOARecord& displayList = mDirectoryWatcher.mRecords;
 
     mSelection.resize(displayList.size());
-    mHighlighted.resize(displayList.size());
 
     ImGuiIO& io = ImGui::GetIO();
 
+    // rows are shown unsorted while the listing is still arriving
+    if(mDirectoryWatcher.isLoading()) {
+        ImGui::TextDisabled("%zu items so far...", displayList.size());
+    }
+
     // early out if window is being clipped
     ImGuiWindowFlags window_flags = ImGuiWindowFlags_HorizontalScrollbar;
     if(!ImGui::BeginChild("DirectoryView", ImGui::GetContentRegionAvail(), false, window_flags)) {
@@ -431,7 +591,8 @@ void BrowserWidget::directoryTable() {
         | ImGuiTableFlags_Hideable
         | ImGuiTableFlags_ContextMenuInBody 
         | ImGuiTableFlags_Reorderable
-        | ImGuiTableFlags_Sortable;
+        | ImGuiTableFlags_Sortable
+        | ImGuiTableFlags_SortMulti;
 
     // early out if table is being clipped
     if(!ImGui::BeginTable("DirectoryList", 4, tableFlags)) {
@@ -469,15 +630,21 @@ void BrowserWidget::directoryTable() {
 
     ImDrawList* drawList = ImGui::GetWindowDrawList();
     ImGui::PushID("##FileRecords");
+    // the first step may only measure a row, the widest one is what's on screen
+    int firstVisibleRow = 0;
+    int numVisibleRows = 0;
     while(clipper.Step()) {
+        if(clipper.DisplayEnd - clipper.DisplayStart > numVisibleRows) {
+            firstVisibleRow = clipper.DisplayStart;
+            numVisibleRows = clipper.DisplayEnd - clipper.DisplayStart;
+        }
         for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
             ImGui::PushID(i);
 
             bool isSelected = mSelection.selected[i];
 
-            const std::string& itemName = displayList.getName(i);
+            std::string_view itemName = displayList.getName(i);
             const bool itemIsFile = displayList.isFile(i);
-            const FileSystem::Timestamp& itemLastModified = displayList.getLastModifiedDate(i);
             const uint64_t itemSize = displayList.getSize(i);
 
             ImGui::TableNextRow();
@@ -575,10 +742,10 @@ void BrowserWidget::directoryTable() {
                 if (ImGui::IsItemHovered() || (!ImGui::IsAnyItemActive() && !ImGui::IsMouseClicked(0)))
                     ImGui::SetKeyboardFocusHere(-1); // Auto focus previous widget
             } else {
-                ImGui::Text(itemName.c_str());
+                ImGui::TextUnformatted(itemName.data(), itemName.data() + itemName.size());
             }
 
-            if(mHighlighted[i]) {
+            if(mNameFilter.isMatch(i)) {
                 ImVec2 cursor = ImGui::GetCursorScreenPos();
                 ImVec2 max{cursor.x + ImGui::CalcItemWidth(), cursor.y - ImGui::GetTextLineHeightWithSpacing()};
 
@@ -590,16 +757,11 @@ void BrowserWidget::directoryTable() {
             }
 
             ImGui::TableNextColumn();
-            ImGui::Text("%u-%02u-%02u  %02u:%02u %s",
-                    itemLastModified.year,
-                    itemLastModified.month,
-                    itemLastModified.day,
-                    itemLastModified.hour,
-                    itemLastModified.minute,
-                    itemLastModified.isPM ? "PM" : "AM");
+            ImGui::TextUnformatted(mTimestampCache.format(i, displayList.getLastModifiedNumber(i)));
 
             ImGui::TableNextColumn();
-            if(itemIsFile) {
+            // folder totals show up once the background scan got to them
+            if(itemIsFile || itemSize > 0) {
                 ImGui::TextUnformatted(PrettyPrintSize(itemSize).c_str());
             }
 
@@ -610,6 +772,9 @@ void BrowserWidget::directoryTable() {
 
     clipper.End();
 
+    // big listings get these rows sorted first, the rest of the order follows without moving them
+    mDirectoryWatcher.setVisibleRows(firstVisibleRow, numVisibleRows);
+
     if(mCurrentHighlightIdx >= 0 && mHighlightNextItem) {
         mHighlightNextItem = false;
         float item_pos_y = clipper.StartPosY + (clipper.ItemsHeight * mCurrentHighlightIdx);
@@ -706,6 +871,257 @@ void BrowserWidget::driveList() {
     ImGui::EndChild();
 }
 
+void BrowserWidget::findResultsTable() {
+    const FileSystem::SOARecord& results = mFileFinder.results();
+
+    // nothing here sorts, the specs of the listing's table would be stale by the time it's back
+    mTableSortSpecs = nullptr;
+
+    const char* status = mFileFinder.isSearching() ? ", searching..." : (mFileFinder.wasStopped() ? ", stopped" : "");
+    if(mFileFinder.isListed()) {
+        ImGui::TextDisabled("find %s: %zu found of %zu indexed names, %.2f s%s", mFileFinder.query().text.c_str(), results.size(),
+            mFileFinder.numListedPaths(), mFileFinder.elapsedSeconds(), status);
+    } else {
+        ImGui::TextDisabled("find %s: %zu found in %zu folders, %.2f s%s", mFileFinder.query().text.c_str(), results.size(),
+            mFileFinder.numDirectoriesSearched(), mFileFinder.elapsedSeconds(), status);
+    }
+
+    ImGui::SameLine();
+    if(mFileFinder.isSearching()) {
+        if(ImGui::SmallButton("Cancel")) {
+            mFileFinder.cancel();
+        }
+    } else if(ImGui::SmallButton("Close")) {
+        closeFindResults();
+        return;
+    }
+
+    // early out if window is being clipped
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_HorizontalScrollbar;
+    if(!ImGui::BeginChild("FindResultsView", ImGui::GetContentRegionAvail(), false, window_flags)) {
+        ImGui::EndChild();
+        return;
+    }
+
+    static ImGuiTableFlags tableFlags = 
+        ImGuiTableFlags_SizingStretchSame 
+        | ImGuiTableFlags_NoBordersInBodyUntilResize
+        | ImGuiTableFlags_Resizable 
+        | ImGuiTableFlags_Hideable
+        | ImGuiTableFlags_Reorderable;
+
+    // early out if table is being clipped
+    if(!ImGui::BeginTable("FindResults", 5, tableFlags)) {
+        ImGui::EndTable();
+        return;
+    }
+
+    int iconColumnFlags = 
+        ImGuiTableColumnFlags_NoHeaderLabel 
+        | ImGuiTableColumnFlags_WidthFixed 
+        | ImGuiTableColumnFlags_NoReorder
+        | ImGuiTableColumnFlags_NoResize 
+        | ImGuiTableColumnFlags_NoHide 
+        | ImGuiTableColumnFlags_IndentDisable;
+
+    ImVec2 iconColumnSize = ImGui::CalcTextSize(ICON_FK_FOLDER);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_ICON, iconColumnFlags, iconColumnSize.x);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_NAME, ImGuiTableColumnFlags_IndentDisable | ImGuiTableColumnFlags_NoHide);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_FOLDER, ImGuiTableColumnFlags_IndentDisable);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_LAST_MODIFIED, ImGuiTableColumnFlags_IndentDisable);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_SIZE, ImGuiTableColumnFlags_IndentDisable);
+
+    ImGui::TableHeadersRow();
+
+    // folders are shown relative to where the find started
+    const std::string& root = mFileFinder.root().str();
+
+    ImGuiListClipper clipper;
+    clipper.Begin(results.size());
+
+    ImGui::PushID("##FindResults");
+    while(clipper.Step()) {
+        for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            ImGui::PushID(i);
+
+            std::string_view itemName = results.getName(i);
+            const bool itemIsFile = results.isFile(i);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if(ImGui::Selectable("##selectable", i == mFindSelectedIdx, ImGuiSelectableFlags_AllowDoubleClick | ImGuiSelectableFlags_SpanAllColumns )) {
+                mFindSelectedIdx = i;
+
+                if(ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+                    const Path itemPath = mFileFinder.resultPath(i);
+                    if(itemIsFile) {
+                        FileSystem::openFile(itemPath);
+                    } else {
+                        mPreviousDirectory = mCurrentDirectory;
+                        mCurrentDirectory = itemPath;
+                        mDirectoryChanged = true;
+                    }
+                }
+            }
+
+            ImGui::SameLine(0.0f, 0.0f);
+
+            if(itemIsFile) {
+                ImGui::Text(ICON_FK_FILE_TEXT);
+            } else {
+                ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(222, 199, 53, 255));
+                ImGui::Text(ICON_FK_FOLDER);
+                ImGui::PopStyleColor();
+            }
+
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(itemName.data(), itemName.data() + itemName.size());
+
+            ImGui::TableNextColumn();
+            std::string_view folder = mFileFinder.resultDirectory(i);
+            folder.remove_prefix(std::min(root.size(), folder.size()));
+            if(!folder.empty() && folder.front() == Path::SEPARATOR) {
+                folder.remove_prefix(1);
+            }
+            if(folder.empty()) {
+                ImGui::TextDisabled(".");
+            } else {
+                ImGui::TextUnformatted(folder.data(), folder.data() + folder.size());
+            }
+
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(mFindTimestampCache.format(i, results.getLastModifiedNumber(i)));
+
+            ImGui::TableNextColumn();
+            if(itemIsFile) {
+                ImGui::TextUnformatted(PrettyPrintSize(results.getSize(i)).c_str());
+            }
+
+            ImGui::PopID();
+        }
+    }
+    ImGui::PopID();
+
+    clipper.End();
+
+    ImGui::EndTable();
+
+    ImGui::EndChild();
+}
+
+void BrowserWidget::grepResultsTable() {
+    // nothing here sorts, the specs of the listing's table would be stale by the time it's back
+    mTableSortSpecs = nullptr;
+
+    // the throughput goes in the status bar
+    const char* status = mContentSearcher.isSearching() ? ", searching..." : (mContentSearcher.wasStopped() ? ", stopped" : "");
+    if(mContentSearcher.isListed()) {
+        ImGui::TextDisabled("grep %s: %zu lines in %llu of %zu indexed candidates, %llu binary skipped, %.2f s%s", mContentSearcher.query().text.c_str(),
+            mContentSearcher.numResults(), static_cast<unsigned long long>(mContentSearcher.numFilesSearched()), mContentSearcher.numListedFiles(),
+            static_cast<unsigned long long>(mContentSearcher.numBinaryFilesSkipped()), mContentSearcher.elapsedSeconds(), status);
+    } else {
+        ImGui::TextDisabled("grep %s: %zu lines in %llu files, %llu binary skipped, %.2f s%s", mContentSearcher.query().text.c_str(),
+            mContentSearcher.numResults(), static_cast<unsigned long long>(mContentSearcher.numFilesSearched()),
+            static_cast<unsigned long long>(mContentSearcher.numBinaryFilesSkipped()), mContentSearcher.elapsedSeconds(), status);
+    }
+
+    ImGui::SameLine();
+    if(mContentSearcher.isSearching()) {
+        if(ImGui::SmallButton("Cancel")) {
+            mContentSearcher.cancel();
+        }
+    } else if(ImGui::SmallButton("Close")) {
+        closeGrepResults();
+        return;
+    }
+
+    // early out if window is being clipped
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_HorizontalScrollbar;
+    if(!ImGui::BeginChild("GrepResultsView", ImGui::GetContentRegionAvail(), false, window_flags)) {
+        ImGui::EndChild();
+        return;
+    }
+
+    static ImGuiTableFlags tableFlags = 
+        ImGuiTableFlags_SizingStretchProp 
+        | ImGuiTableFlags_NoBordersInBodyUntilResize
+        | ImGuiTableFlags_Resizable 
+        | ImGuiTableFlags_Hideable
+        | ImGuiTableFlags_Reorderable;
+
+    // early out if table is being clipped
+    if(!ImGui::BeginTable("GrepResults", 3, tableFlags)) {
+        ImGui::EndTable();
+        return;
+    }
+
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_FILE, ImGuiTableColumnFlags_IndentDisable | ImGuiTableColumnFlags_NoHide, 2.0f);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_LINE, ImGuiTableColumnFlags_IndentDisable, 0.5f);
+    ImGui::TableSetupColumn(DISPLAY_COLUMN_TEXT, ImGuiTableColumnFlags_IndentDisable | ImGuiTableColumnFlags_NoHide, 5.0f);
+
+    ImGui::TableHeadersRow();
+
+    // files are shown relative to where the grep started
+    const std::string& root = mContentSearcher.directory().str();
+
+    ImGuiListClipper clipper;
+    clipper.Begin(mContentSearcher.numResults());
+
+    ImGui::PushID("##GrepResults");
+    while(clipper.Step()) {
+        for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            ImGui::PushID(i);
+
+            const GrepResult& result = mContentSearcher.result(i);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if(ImGui::Selectable("##selectable", i == mGrepSelectedIdx, ImGuiSelectableFlags_AllowDoubleClick | ImGuiSelectableFlags_SpanAllColumns )) {
+                mGrepSelectedIdx = i;
+
+                if(ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+                    FileSystem::openFile(Path(mContentSearcher.filePath(result.file)));
+                }
+            }
+
+            ImGui::SameLine(0.0f, 0.0f);
+
+            std::string_view file = mContentSearcher.filePath(result.file);
+            file.remove_prefix(std::min(root.size(), file.size()));
+            if(!file.empty() && file.front() == Path::SEPARATOR) {
+                file.remove_prefix(1);
+            }
+            ImGui::TextUnformatted(file.data(), file.data() + file.size());
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(result.lineNumber));
+
+            // the match in the highlight color between the rest of the line
+            ImGui::TableNextColumn();
+            const std::string_view preview = mContentSearcher.preview(i);
+            const char* matchBegin = preview.data() + result.matchBegin;
+            const char* matchEnd = matchBegin + result.matchLength;
+
+            ImGui::TextUnformatted(preview.data(), matchBegin);
+            ImGui::SameLine(0.0f, 0.0f);
+            ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(222, 199, 53, 255));
+            ImGui::TextUnformatted(matchBegin, matchEnd);
+            ImGui::PopStyleColor();
+            ImGui::SameLine(0.0f, 0.0f);
+            ImGui::TextUnformatted(matchEnd, preview.data() + preview.size());
+
+            ImGui::PopID();
+        }
+    }
+    ImGui::PopID();
+
+    clipper.End();
+
+    ImGui::EndTable();
+
+    ImGui::EndChild();
+}
+
 void BrowserWidget::updateSearch() {
     FileSystem::SOARecord& displayList = mDirectoryWatcher.mRecords;
 
@@ -724,28 +1140,35 @@ void BrowserWidget::updateSearch() {
 
         int inputFlags = ImGuiInputTextFlags_AutoSelectAll;
 
-        ImGui::SetNextItemWidth(-1.0f);
+        // room for the match count on the right
+        char matchCount[64] = "";
+        if(mNameFilter.isActive()) {
+            snprintf(matchCount, sizeof(matchCount), "%zu matches%s", mNameFilter.numMatches(), mNameFilter.isScanning() ? " so far..." : "");
+        }
+        const float matchCountWidth = ImGui::CalcTextSize(matchCount).x + ImGui::GetStyle().ItemSpacing.x;
+
+        ImGui::SetNextItemWidth(-matchCountWidth);
         ImGui::SetKeyboardFocusHere(0);
         if(ImGui::InputText("###SearchInput", &mSearchFilter, inputFlags) && !mSearchFilter.empty()) {
-            mHighlighted.assign(mHighlighted.size(), false);
-            mCurrentHighlightIdx = -1;
-            for(int i = 0; i < displayList.size(); i++) {
-                const std::string& name = displayList.getName(i);
-                if(name.find(mSearchFilter) != std::string::npos) {
-                    if(mCurrentHighlightIdx < 0) mCurrentHighlightIdx = i;
-                    mHighlighted[i] = true;
-                }
-            }
+            // a query that extends the last one only looks at its matches again
+            mNameFilter.setQuery(mSearchFilter, displayList, mDirectoryWatcher.listingVersion(), mDirectoryWatcher.orderVersion());
+
+            mCurrentHighlightRank = 0;
+            mIsHighlightPastBest = false;
+            mCurrentHighlightIdx = mNameFilter.numBestMatches() > 0 ? static_cast<int>(mNameFilter.bestMatch(0)) : -1;
             mHighlightNextItem = true;
         }
 
+        ImGui::SameLine();
+        ImGui::TextDisabled("%s", matchCount);
+
         if(ImGui::IsKeyPressed(ImGuiKey_Enter)) {
             mSearchWindowOpen = false;
         }
 
         if(ImGui::IsKeyPressed(ImGuiKey_Escape)) {
             if(mSearchFilter.empty()) {
-                mHighlighted.assign(mHighlighted.size(), false);
+                mNameFilter.clear();
                 mCurrentHighlightIdx = -1;
             }
             mSearchWindowOpen = false;
@@ -753,23 +1176,31 @@ void BrowserWidget::updateSearch() {
         ImGui::End();
     }
 
-    if(mCurrentHighlightIdx >= 0 && ImGui::IsKeyPressed(ImGuiKey_N)) {
-        int start = mCurrentHighlightIdx + 1;
-        int end = mHighlighted.size();
-        int diff = 1;
-
-        if(ImGui::IsKeyDown(ImGuiKey_LeftShift)) {
-            start = mCurrentHighlightIdx - 1;
-            end = 0;
-            diff = -1;
-        }
-
-        for(int i = start; i != end; i += diff) {
-            if(mHighlighted[i]) {
-                mCurrentHighlightIdx = i;
-                break;
+    if(mCurrentHighlightIdx >= 0 && mNameFilter.numBestMatches() > 0 && ImGui::IsKeyPressed(ImGuiKey_N)) {
+        const bool isBackward = ImGui::IsKeyDown(ImGuiKey_LeftShift);
+        const size_t highlightRow = static_cast<size_t>(mCurrentHighlightIdx);
+
+        if(mIsHighlightPastBest) {
+            // every match by row, around the listing at either end
+            size_t row = isBackward ? (highlightRow > 0 ? mNameFilter.previousMatch(highlightRow - 1) : BitSet::NPOS) : mNameFilter.nextMatch(highlightRow + 1);
+            if(row == BitSet::NPOS) row = isBackward ? mNameFilter.previousMatch(displayList.size()) : mNameFilter.nextMatch(0);
+            if(row != BitSet::NPOS) mCurrentHighlightIdx = static_cast<int>(row);
+        } else if(isBackward) {
+            if(mCurrentHighlightRank > 0) {
+                mCurrentHighlightRank--;
             }
+            mCurrentHighlightIdx = static_cast<int>(mNameFilter.bestMatch(std::min(mCurrentHighlightRank, mNameFilter.numBestMatches() - 1)));
+        } else if(mCurrentHighlightRank + 1 < mNameFilter.numBestMatches()) {
+            mCurrentHighlightRank++;
+            mCurrentHighlightIdx = static_cast<int>(mNameFilter.bestMatch(mCurrentHighlightRank));
+        } else if(mNameFilter.numMatches() > mNameFilter.numBestMatches()) {
+            // the ranking stops at MAX_BEST_MATCHES, the rest are reached by row from here
+            mIsHighlightPastBest = true;
+            size_t row = mNameFilter.nextMatch(highlightRow + 1);
+            if(row == BitSet::NPOS) row = mNameFilter.nextMatch(0);
+            mCurrentHighlightIdx = static_cast<int>(row);
         }
+
         mHighlightNextItem = true;
     }
 }
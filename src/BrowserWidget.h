@@ -3,6 +3,10 @@
 #include "Path.h"
 #include "SortDirection.h"
 #include "DirectoryWatcher.h"
+#include "TimestampCache.h"
+#include "NameFilter.h"
+#include "FileFinder.h"
+#include "ContentSearch.h"
 
 #include <vector>
 #include <unordered_map>
@@ -15,6 +19,9 @@ namespace FileSystem {
 }
 
 class FileOpsWorker;
+class FolderSizeService;
+class ContentIndexService;
+class FileIndexService;
 class DirectoryWatcher;
 
 struct ImGuiTableSortSpecs;
@@ -36,7 +43,9 @@ class BrowserWidget
     enum class DisplayListType {
         DEFAULT = 0, // typical folders and files 
         DRIVE,       // list of drive 
-        PATH_NOT_FOUND_ERROR        // path wasn't found, display error
+        PATH_NOT_FOUND_ERROR,       // path wasn't found, display error
+        FIND_RESULTS,               // what a find below the current directory turned up
+        GREP_RESULTS                // lines a grep below the current directory turned up
     };
 
     struct Selection {
@@ -92,7 +101,8 @@ class BrowserWidget
     };
 
 public:
-    BrowserWidget(const Path& path, FileOpsWorker* fileOpsWorker);
+    BrowserWidget(const Path& path, FileOpsWorker* fileOpsWorker, FolderSizeService* folderSizeService, FileIndexService* fileIndexService,
+                  ContentIndexService* contentIndexService);
 
     void setCurrentDirectory(const Path& path);
     void update();
@@ -100,6 +110,17 @@ public:
     Path getCurrentDirectory() const;
 
     void renameSelected(const std::string& from, const std::string& to);
+    // looks for `query` below the current directory and shows the results in place of the listing as they come in.
+    // Below an indexed root the names come from the index. False if there's no directory to look in
+    bool find(const FindQuery& query);
+    // looks for `query` in the files below the current directory, or in the selected ones and below them, and shows
+    // the matching lines in place of the listing as they come in. Below an indexed root only the files the index
+    // turns up are read. False if there's no directory to look in
+    bool grep(const GrepQuery& query);
+    // has the index services index the names and, unless `namesOnly`, the contents below the current directory, or
+    // forget those indexes with `drop`. False if there's no directory
+    bool index(bool namesOnly, bool drop);
+    inline const ContentSearcher& contentSearcher() const { return mContentSearcher; }
 
     inline bool isOpen() const { return mIsOpen; }
     inline bool isFocused() const { return mIsFocused; }
@@ -108,12 +129,18 @@ private:
     void directorySegments();
     void directoryTable();
     void driveList();
+    void findResultsTable();
+    void closeFindResults();
+    void grepResultsTable();
+    void closeGrepResults();
 
     void updateSearch();
     void acceptMovePayload(Path target);
     void handleInput();
 
     FileOpsWorker* mFileOpsWorker;
+    FileIndexService* mFileIndexService;
+    ContentIndexService* mContentIndexService;
     DirectoryWatcher mDirectoryWatcher;
     Path mCurrentDirectory;
     Path mPreviousDirectory;
@@ -121,13 +148,28 @@ private:
     DisplayListType mDisplayListType = DisplayListType::DEFAULT;
     std::vector<DriveRecord> mDriveList;
 
+    TimestampCache mTimestampCache;
+
     // SEARCH
-    std::vector<bool> mHighlighted;
+    NameFilter mNameFilter;
     int mCurrentHighlightIdx = -1;
+    // of the highlighted row among the best matches, N / Shift+N step through them best first
+    size_t mCurrentHighlightRank = 0;
+    // N went past the last of the best matches, from there on N / Shift+N step through all of them by row
+    bool mIsHighlightPastBest = false;
     bool mHighlightNextItem = false;
     bool mSearchWindowOpen = false;
     std::string mSearchFilter;
 
+    // FIND
+    FileFinder mFileFinder;
+    TimestampCache mFindTimestampCache;
+    int mFindSelectedIdx = -1;
+
+    // GREP
+    ContentSearcher mContentSearcher;
+    int mGrepSelectedIdx = -1;
+
     Selection mSelection;
 
     // EDIT file name
@@ -1,6 +1,9 @@
 #include "CommandParser.h"
 #include "BrowserWidget.h"
 #include "FileSystem.h"
+#include "FileFinder.h"
+#include "ContentSearch.h"
+#include <algorithm>
 #include <sstream>
 #include <unordered_map>
 #include <assert.h>
@@ -29,6 +32,15 @@ CommandParser::CommandParser()
         xRegister(CommandType::REPLACE, "replace", "replace <arg1> <arg2>\nReplaces text matching arg1 with arg2 for the given selection.");
         xRegister(CommandType::MKDIR, "mkdir", "mkdir <args...>\nCreates a directory in the currently selected window.");
         xRegister(CommandType::MAKE_DEBUG_DIR, "make_debug_dir", "Makes a testing directory called 'browser_test' in the selected window.");
+        xRegister(CommandType::FIND, "find", "find <pattern> [size>10M] [size<1k] [mtime<7d] [mtime>2h] [prune=dir,...] [noprune]\n"
+            "Lists everything below the selected window's directory whose name matches: a glob if the pattern has * ? or [ in it,\n"
+            "a regex after re:, a substring otherwise. .git, node_modules and the like aren't walked into unless noprune is given.");
+        xRegister(CommandType::GREP, "grep", "grep <pattern> [files=*.cpp,...] [prune=dir,...] [noprune]\n"
+            "Lists the lines of files below the selected window's directory, or below its selected entries, that contain the pattern:\n"
+            "a regex after re:, a literal otherwise. Binary files are skipped, .git, node_modules and the like aren't walked into unless noprune is given.");
+        xRegister(CommandType::INDEX, "index", "index [names] [drop]\n"
+            "Keeps a name and a content index of the selected window's directory that find and grep answer from below it, updated as files change.\n"
+            "names keeps only the name index, drop forgets the indexes and deletes their files.");
     }
 }
 
@@ -102,6 +114,52 @@ void CommandParser::execute(const std::string& input, BrowserWidget* focusedWidg
                     }
                 }
             } break;
+        case CommandType::FIND:
+            {
+                printf("[CMD] find ");
+                for(const auto& arg : cmd.args) {
+                    printf("%s ", arg.c_str());
+                }
+                printf("\n");
+
+                FindQuery query;
+                if(!ParseFindQuery(cmd.args, FileSystem::getCurrentFileTime(), query)) {
+                    printf("[CMD] find: invalid arguments\n");
+                    break;
+                }
+
+                if(!focusedWidget->find(query)) {
+                    printf("[CMD] find: no directory to search\n");
+                }
+            } break;
+        case CommandType::GREP:
+            {
+                printf("[CMD] grep ");
+                for(const auto& arg : cmd.args) {
+                    printf("%s ", arg.c_str());
+                }
+                printf("\n");
+
+                GrepQuery query;
+                if(!ParseGrepQuery(cmd.args, query)) {
+                    printf("[CMD] grep: invalid arguments\n");
+                    break;
+                }
+
+                if(!focusedWidget->grep(query)) {
+                    printf("[CMD] grep: no directory to search\n");
+                }
+            } break;
+        case CommandType::INDEX:
+            {
+                const bool namesOnly = std::find(cmd.args.begin(), cmd.args.end(), "names") != cmd.args.end();
+                const bool drop = std::find(cmd.args.begin(), cmd.args.end(), "drop") != cmd.args.end();
+                printf("[CMD] index%s%s\n", namesOnly ? " names" : "", drop ? " drop" : "");
+
+                if(!focusedWidget->index(namesOnly, drop)) {
+                    printf("[CMD] index: no directory to index\n");
+                }
+            } break;
         case CommandType::UNKNOWN:
             {
                 printf("[CMD] UNKNOWN_CMD... \n");
@@ -182,6 +240,29 @@ void CommandParser::parseArguments(Command& cmd, std::string_view args) {
 
                 if(cmd.args.empty()) cmd.type = CommandType::UNKNOWN;
             } break;
+        case CommandType::FIND:
+            {
+                // find <pattern> [predicates...], checked when it runs
+                split(args, ' ', cmd.args);
+
+                if(cmd.args.empty()) cmd.type = CommandType::UNKNOWN;
+            } break;
+        case CommandType::GREP:
+            {
+                // grep <pattern> [options...], checked when it runs
+                split(args, ' ', cmd.args);
+
+                if(cmd.args.empty()) cmd.type = CommandType::UNKNOWN;
+            } break;
+        case CommandType::INDEX:
+            {
+                // index [names] [drop]
+                split(args, ' ', cmd.args);
+
+                const bool hasNames = std::count(cmd.args.begin(), cmd.args.end(), "names") == 1;
+                const bool hasDrop = std::count(cmd.args.begin(), cmd.args.end(), "drop") == 1;
+                if(cmd.args.size() != static_cast<size_t>(hasNames) + static_cast<size_t>(hasDrop)) cmd.type = CommandType::UNKNOWN;
+            } break;
         default:
             return;
     }
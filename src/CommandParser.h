@@ -7,6 +7,9 @@ enum class CommandType {
     REPLACE = 0,
     MKDIR,
     MAKE_DEBUG_DIR,
+    FIND,
+    GREP,
+    INDEX,
     UNKNOWN,
 };
 
@@ -0,0 +1,1164 @@
+#include "ContentIndex.h"
+#include "ContentSearch.h"
+#include "Path.h"
+#include "WatchRegistry.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+#include <stdio.h>
+#include <string.h>
+
+// Everything is stored in native byte order and every table starts 8 byte aligned, so the mapped file can be
+// read in place. Paths aren't terminated, the next offset says where one ends
+struct ContentIndex::Header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    numFiles;
+    uint64_t    imageSize;
+    uint64_t    numTrigrams;
+    uint64_t    rootSize;
+    uint64_t    pathArenaSize;
+    uint64_t    postingsSize;
+
+    // byte offsets of the tables from the start of the image
+    uint64_t    root;
+    uint64_t    pathOffsets;
+    uint64_t    sizes;
+    uint64_t    lastModifiedNumbers;
+    uint64_t    flags;
+    uint64_t    trigrams;
+    uint64_t    postingOffsets;
+    uint64_t    postingCounts;
+    uint64_t    pathArena;
+    uint64_t    postings;
+};
+
+// the files of an image before it's written, in path order
+struct ContentIndex::Files {
+    std::vector<char>       pathArena;
+    std::vector<uint32_t>   pathOffsets = { 0 };
+    std::vector<uint64_t>   sizes;
+    std::vector<uint64_t>   lastModifiedNumbers;
+    std::vector<uint8_t>    flags;
+
+    inline size_t size() const { return flags.size(); }
+
+    void add(std::string_view path, uint64_t size, uint64_t lastModifiedNumber, uint8_t fileFlags) {
+        pathArena.insert(pathArena.end(), path.begin(), path.end());
+        pathOffsets.push_back(static_cast<uint32_t>(pathArena.size()));
+        sizes.push_back(size);
+        lastModifiedNumbers.push_back(lastModifiedNumber);
+        flags.push_back(fileFlags);
+    }
+};
+
+// a file a walk turned up, by its path relative to the root
+struct ContentIndex::FoundFile {
+    std::string path;
+    uint64_t    size = 0;
+    uint64_t    lastModifiedNumber = 0;
+};
+
+// what reading a file turned up
+struct ContentIndex::IndexedFile {
+    uint8_t                 flags = 0;
+    // distinct, ascending
+    std::vector<uint32_t>   trigrams;
+};
+
+static constexpr char INDEX_MAGIC[8] = { 'F', 'B', 'C', 'I', 'N', 'D', 'E', 'X' };
+// three bytes
+static constexpr uint32_t NUM_TRIGRAMS = 1 << 24;
+// posting lists are put together on the pool in this many runs of trigrams, by their first byte
+static constexpr uint32_t NUM_TRIGRAM_BUCKETS = 256;
+// files read per task
+static constexpr size_t INDEX_CHUNK_SIZE = 16;
+
+inline static unsigned char FoldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+inline static size_t AlignUp(size_t offset) {
+    return (offset + 7) & ~size_t(7);
+}
+
+inline static std::string JoinPath(std::string_view directory, std::string_view name) {
+    std::string path(directory);
+    if(!path.empty() && path.back() != Path::SEPARATOR) path.push_back(Path::SEPARATOR);
+    path.append(name);
+    return path;
+}
+
+inline static Path PartPath(const Path& path, size_t part) {
+    return Path(path.str() + ".part" + std::to_string(part));
+}
+
+inline static bool IsPrunedName(std::string_view name) {
+    for(const std::string& pruneName : ContentSearcher::DefaultPruneNames()) {
+        if(name == pruneName) return true;
+    }
+    return false;
+}
+
+// the distinct folded trigrams of `text`, ascending. `seen` has a bit per trigram, all unset before and after
+inline static void CollectTrigrams(std::string_view text, BitSet& seen, std::vector<uint32_t>& out_Trigrams) {
+    out_Trigrams.clear();
+    if(text.size() < 3) return;
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text.data());
+    uint32_t trigram = (FoldAscii(bytes[0]) << 8) | FoldAscii(bytes[1]);
+    for(size_t i = 2; i < text.size(); i++) {
+        trigram = ((trigram << 8) | FoldAscii(bytes[i])) & (NUM_TRIGRAMS - 1);
+        if(!seen.test(trigram)) {
+            seen.set(trigram);
+            out_Trigrams.push_back(trigram);
+        }
+    }
+
+    for(uint32_t found : out_Trigrams) {
+        seen.unset(found);
+    }
+    std::sort(out_Trigrams.begin(), out_Trigrams.end());
+}
+
+// ascending `files` as the differences between neighbours, 7 bits to a byte with the high bit set on all but the last
+inline static void EncodePostings(const uint32_t* files, size_t numFiles, std::vector<uint8_t>& out_Data) {
+    uint32_t previous = 0;
+    for(size_t i = 0; i < numFiles; i++) {
+        uint32_t delta = files[i] - previous;
+        previous = files[i];
+
+        while(delta >= 0x80) {
+            out_Data.push_back(static_cast<uint8_t>(delta | 0x80));
+            delta >>= 7;
+        }
+        out_Data.push_back(static_cast<uint8_t>(delta));
+    }
+}
+
+inline static void DecodePostings(const uint8_t* data, size_t numFiles, std::vector<uint32_t>& out_Files) {
+    uint32_t file = 0;
+    for(size_t i = 0; i < numFiles; i++) {
+        uint32_t delta = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = *data++;
+            delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            shift += 7;
+        } while(byte & 0x80);
+
+        file += delta;
+        out_Files.push_back(file);
+    }
+}
+
+// the posting lists of an image before it's written, trigrams ascending
+struct ContentIndex::Postings {
+    std::vector<uint32_t>   trigrams;
+    std::vector<uint64_t>   offsets = { 0 };
+    std::vector<uint32_t>   counts;
+    std::vector<uint8_t>    data;
+
+    // `files` ascending
+    void add(uint32_t trigram, const uint32_t* files, size_t numFiles) {
+        trigrams.push_back(trigram);
+        counts.push_back(static_cast<uint32_t>(numFiles));
+        EncodePostings(files, numFiles, data);
+        offsets.push_back(data.size());
+    }
+
+    // `other`'s trigrams all come after these
+    void append(const Postings& other) {
+        const uint64_t base = data.size();
+        trigrams.insert(trigrams.end(), other.trigrams.begin(), other.trigrams.end());
+        counts.insert(counts.end(), other.counts.begin(), other.counts.end());
+        for(size_t i = 1; i < other.offsets.size(); i++) {
+            offsets.push_back(base + other.offsets[i]);
+        }
+        data.insert(data.end(), other.data.begin(), other.data.end());
+    }
+};
+
+// runs `fn(bucket)` for every trigram bucket, spread over `pool` if it's given
+template<typename Fn>
+inline static void ForEachTrigramBucket(WorkStealingPool* pool, Fn&& fn) {
+    if(pool == nullptr) {
+        for(uint32_t bucket = 0; bucket < NUM_TRIGRAM_BUCKETS; bucket++) {
+            fn(bucket);
+        }
+        return;
+    }
+
+    WorkStealingPool::TaskGroup group;
+    for(uint32_t bucket = 0; bucket < NUM_TRIGRAM_BUCKETS; bucket++) {
+        pool->submit(group, [&fn, bucket](size_t) { fn(bucket); });
+    }
+    pool->wait(group);
+}
+
+bool ContentIndex::Image::set(const char* image, size_t size) {
+    if(image == nullptr || size < sizeof(Header)) return false;
+
+    Header header;
+    memcpy(&header, image, sizeof(Header));
+
+    if(memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) return false;
+    if(header.version != FORMAT_VERSION || header.imageSize != size) return false;
+    if(header.rootSize == 0 || header.numTrigrams > NUM_TRIGRAMS) return false;
+
+    const uint64_t numFiles = header.numFiles;
+    const uint64_t numTrigrams = header.numTrigrams;
+    const auto xFits = [&](uint64_t offset, uint64_t bytes) {
+        return offset % 8 == 0 && offset >= sizeof(Header) && offset <= size && bytes <= size - offset;
+    };
+    if(!xFits(header.root, header.rootSize) || !xFits(header.pathOffsets, (numFiles + 1) * 4) ||
+       !xFits(header.sizes, numFiles * 8) || !xFits(header.lastModifiedNumbers, numFiles * 8) || !xFits(header.flags, numFiles) ||
+       !xFits(header.trigrams, numTrigrams * 4) || !xFits(header.postingOffsets, (numTrigrams + 1) * 8) ||
+       !xFits(header.postingCounts, numTrigrams * 4) || !xFits(header.pathArena, header.pathArenaSize) ||
+       !xFits(header.postings, header.postingsSize)) {
+        return false;
+    }
+
+    // the last offsets close the arenas, everything before them is read unchecked
+    const uint32_t* fileOffsets = reinterpret_cast<const uint32_t*>(image + header.pathOffsets);
+    const uint64_t* listOffsets = reinterpret_cast<const uint64_t*>(image + header.postingOffsets);
+    if(fileOffsets[numFiles] != header.pathArenaSize || listOffsets[numTrigrams] != header.postingsSize) return false;
+
+    root = std::string_view(image + header.root, header.rootSize);
+    this->numFiles = header.numFiles;
+    this->numTrigrams = header.numTrigrams;
+    pathOffsets = fileOffsets;
+    sizes = reinterpret_cast<const uint64_t*>(image + header.sizes);
+    lastModifiedNumbers = reinterpret_cast<const uint64_t*>(image + header.lastModifiedNumbers);
+    flags = reinterpret_cast<const uint8_t*>(image + header.flags);
+    trigrams = reinterpret_cast<const uint32_t*>(image + header.trigrams);
+    postingOffsets = listOffsets;
+    postingCounts = reinterpret_cast<const uint32_t*>(image + header.postingCounts);
+    pathArena = image + header.pathArena;
+    postings = reinterpret_cast<const uint8_t*>(image + header.postings);
+    return true;
+}
+
+bool ContentIndex::Image::find(uint32_t trigram, size_t& out_Idx) const {
+    const uint32_t* end = trigrams + numTrigrams;
+    const uint32_t* found = std::lower_bound(trigrams, end, trigram);
+    if(found == end || *found != trigram) return false;
+
+    out_Idx = static_cast<size_t>(found - trigrams);
+    return true;
+}
+
+ContentIndex::ContentIndex() {
+    resetChanges();
+}
+
+ContentIndex::~ContentIndex() = default;
+ContentIndex::ContentIndex(ContentIndex&&) = default;
+ContentIndex& ContentIndex::operator=(ContentIndex&&) = default;
+
+bool ContentIndex::walkFiles(WorkStealingPool& pool, std::string_view root, std::string_view directory, std::vector<FoundFile>& out_Found,
+                             const std::atomic<bool>* cancel) {
+    out_Found.clear();
+
+    // indexed by worker
+    std::vector<std::vector<FoundFile>> found(pool.numThreads());
+
+    FileSystem::TraverseOptions options;
+    options.fields = FileSystem::ENUMERATE_ALL;
+    options.cancel = cancel;
+    options.descend = [](const FileSystem::TraverseBatch& batch, size_t recordIdx) {
+        return !IsPrunedName(batch.entries.getRecordName(recordIdx));
+    };
+
+    const bool walked = FileSystem::traverseDirectory(pool, Path(std::string(directory)), options, [&](const FileSystem::TraverseBatch& batch) {
+        std::string_view relative = batch.directory.substr(std::min(root.size(), batch.directory.size()));
+        if(!relative.empty() && relative.front() == Path::SEPARATOR) relative.remove_prefix(1);
+
+        const FileSystem::SOARecord& entries = batch.entries;
+        std::vector<FoundFile>& local = found[batch.workerIdx];
+        for(size_t i = 0; i < entries.nameOffsets.size(); i++) {
+            // a link to a directory isn't walked and can't be read
+            if(entries.attributes[i] & FileSystem::FileAttributes::DIRECTORY) continue;
+
+            FoundFile file;
+            file.path = relative.empty() ? std::string(entries.getRecordName(i)) : JoinPath(relative, entries.getRecordName(i));
+            file.size = entries.sizes[i];
+            file.lastModifiedNumber = entries.lastModifiedNumbers[i];
+            local.push_back(std::move(file));
+        }
+    });
+    if(!walked || (cancel != nullptr && cancel->load())) return false;
+
+    for(std::vector<FoundFile>& local : found) {
+        std::move(local.begin(), local.end(), std::back_inserter(out_Found));
+    }
+    std::sort(out_Found.begin(), out_Found.end(), [](const FoundFile& lhs, const FoundFile& rhs) { return lhs.path < rhs.path; });
+    return true;
+}
+
+bool ContentIndex::indexFiles(WorkStealingPool& pool, std::string_view root, const std::vector<FoundFile>& found,
+                              std::vector<IndexedFile>& out_Indexed, const std::atomic<bool>* cancel) {
+    out_Indexed.clear();
+    out_Indexed.resize(found.size());
+
+    struct Scratch {
+        BitSet              seen;
+        std::vector<char>   buffer;
+    };
+    // indexed by worker
+    std::vector<Scratch> scratch(pool.numThreads());
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t chunkStart = 0; chunkStart < found.size(); chunkStart += INDEX_CHUNK_SIZE) {
+        pool.submit(group, [&, chunkStart](size_t workerIdx) {
+            Scratch& local = scratch[workerIdx];
+            if(local.seen.size() == 0) local.seen.reset(NUM_TRIGRAMS);
+
+            const size_t chunkEnd = std::min(chunkStart + INDEX_CHUNK_SIZE, found.size());
+            for(size_t i = chunkStart; i < chunkEnd; i++) {
+                if(cancel != nullptr && cancel->load()) return;
+
+                // big ones are left to grep
+                const FoundFile& file = found[i];
+                if(file.size > MAX_INDEXED_FILE_SIZE) continue;
+
+                uint64_t size = 0;
+                if(!FileSystem::readFile(Path(JoinPath(root, file.path)), local.buffer, MAX_INDEXED_FILE_SIZE, size)) continue;
+                if(size > MAX_INDEXED_FILE_SIZE) continue;
+
+                const std::string_view text(local.buffer.data(), local.buffer.size());
+                IndexedFile& indexed = out_Indexed[i];
+                if(LooksBinary(text)) {
+                    indexed.flags = FILE_BINARY;
+                    continue;
+                }
+
+                CollectTrigrams(text, local.seen, indexed.trigrams);
+                indexed.flags = FILE_INDEXED;
+            }
+        });
+    }
+    pool.wait(group);
+
+    return cancel == nullptr || !cancel->load();
+}
+
+void ContentIndex::invertTrigrams(WorkStealingPool* pool, const std::vector<IndexedFile>& indexed, Postings& out_Postings) {
+    std::vector<Postings> buckets(NUM_TRIGRAM_BUCKETS);
+    ForEachTrigramBucket(pool, [&](uint32_t bucket) {
+        const uint32_t low = bucket << 16;
+        const uint32_t high = (bucket + 1) << 16;
+
+        // trigram in the high half, file in the low one, so sorting puts every list together and in order
+        std::vector<uint64_t> pairs;
+        for(size_t file = 0; file < indexed.size(); file++) {
+            const std::vector<uint32_t>& trigrams = indexed[file].trigrams;
+            auto it = std::lower_bound(trigrams.begin(), trigrams.end(), low);
+            for(; it != trigrams.end() && *it < high; ++it) {
+                pairs.push_back((static_cast<uint64_t>(*it) << 32) | file);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+
+        std::vector<uint32_t> files;
+        for(size_t i = 0; i < pairs.size();) {
+            const uint32_t trigram = static_cast<uint32_t>(pairs[i] >> 32);
+            files.clear();
+            for(; i < pairs.size() && static_cast<uint32_t>(pairs[i] >> 32) == trigram; i++) {
+                files.push_back(static_cast<uint32_t>(pairs[i]));
+            }
+            buckets[bucket].add(trigram, files.data(), files.size());
+        }
+    });
+
+    out_Postings = Postings();
+    for(const Postings& bucket : buckets) {
+        out_Postings.append(bucket);
+    }
+}
+
+void ContentIndex::writeImage(std::string_view root, const Files& files, const Postings& postings, std::vector<char>& out_Image) {
+    const size_t numFiles = files.size();
+    const size_t numTrigrams = postings.trigrams.size();
+
+    Header header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.numFiles = static_cast<uint32_t>(numFiles);
+    header.numTrigrams = numTrigrams;
+    header.rootSize = root.size();
+    header.pathArenaSize = files.pathArena.size();
+    header.postingsSize = postings.data.size();
+
+    size_t offset = AlignUp(sizeof(Header));
+    const auto xPlace = [&](uint64_t& out_Offset, size_t bytes) {
+        out_Offset = offset;
+        offset = AlignUp(offset + bytes);
+    };
+    xPlace(header.root, root.size());
+    xPlace(header.pathOffsets, (numFiles + 1) * sizeof(uint32_t));
+    xPlace(header.sizes, numFiles * sizeof(uint64_t));
+    xPlace(header.lastModifiedNumbers, numFiles * sizeof(uint64_t));
+    xPlace(header.flags, numFiles);
+    xPlace(header.trigrams, numTrigrams * sizeof(uint32_t));
+    xPlace(header.postingOffsets, (numTrigrams + 1) * sizeof(uint64_t));
+    xPlace(header.postingCounts, numTrigrams * sizeof(uint32_t));
+    xPlace(header.pathArena, files.pathArena.size());
+    xPlace(header.postings, postings.data.size());
+    header.imageSize = offset;
+
+    out_Image.assign(offset, '\0');
+    memcpy(out_Image.data(), &header, sizeof(header));
+    memcpy(&out_Image[header.root], root.data(), root.size());
+    memcpy(&out_Image[header.pathOffsets], files.pathOffsets.data(), (numFiles + 1) * sizeof(uint32_t));
+    memcpy(&out_Image[header.sizes], files.sizes.data(), numFiles * sizeof(uint64_t));
+    memcpy(&out_Image[header.lastModifiedNumbers], files.lastModifiedNumbers.data(), numFiles * sizeof(uint64_t));
+    memcpy(&out_Image[header.flags], files.flags.data(), numFiles);
+    memcpy(&out_Image[header.trigrams], postings.trigrams.data(), numTrigrams * sizeof(uint32_t));
+    memcpy(&out_Image[header.postingOffsets], postings.offsets.data(), (numTrigrams + 1) * sizeof(uint64_t));
+    memcpy(&out_Image[header.postingCounts], postings.counts.data(), numTrigrams * sizeof(uint32_t));
+    memcpy(&out_Image[header.pathArena], files.pathArena.data(), files.pathArena.size());
+    memcpy(&out_Image[header.postings], postings.data.data(), postings.data.size());
+}
+
+void ContentIndex::mergeImages(WorkStealingPool* pool, const std::vector<const Image*>& images, const std::vector<const BitSet*>& dropped,
+                               std::vector<char>& out_Image) {
+    struct Entry {
+        uint32_t image;
+        uint32_t file;
+    };
+    const auto xPath = [&](const Entry& entry) {
+        return images[entry.image]->path(entry.file);
+    };
+
+    // every image is in path order already, merging their runs pairwise keeps equal paths in image order
+    std::vector<Entry> entries;
+    std::vector<size_t> runs = { 0 };
+    for(uint32_t image = 0; image < images.size(); image++) {
+        for(uint32_t file = 0; file < images[image]->numFiles; file++) {
+            if(dropped[image] == nullptr || !dropped[image]->test(file)) {
+                entries.push_back({ image, file });
+            }
+        }
+        runs.push_back(entries.size());
+    }
+    while(runs.size() > 2) {
+        const size_t numRuns = runs.size() - 1;
+        std::vector<size_t> merged = { 0 };
+        for(size_t run = 0; run < numRuns; run += 2) {
+            if(run + 1 < numRuns) {
+                std::inplace_merge(entries.begin() + runs[run], entries.begin() + runs[run + 1], entries.begin() + runs[run + 2],
+                                   [&](const Entry& lhs, const Entry& rhs) { return xPath(lhs) < xPath(rhs); });
+            }
+            merged.push_back(runs[std::min(run + 2, numRuns)]);
+        }
+        runs = std::move(merged);
+    }
+
+    // the new ids, of the last image's file where a path is in several
+    std::vector<std::vector<uint32_t>> newIds(images.size());
+    for(uint32_t image = 0; image < images.size(); image++) {
+        newIds[image].assign(images[image]->numFiles, NO_FILE);
+    }
+
+    Files files;
+    for(size_t i = 0; i < entries.size(); i++) {
+        if(i + 1 < entries.size() && xPath(entries[i]) == xPath(entries[i + 1])) continue;
+
+        const Entry& entry = entries[i];
+        const Image& image = *images[entry.image];
+        newIds[entry.image][entry.file] = static_cast<uint32_t>(files.size());
+        files.add(image.path(entry.file), image.sizes[entry.file], image.lastModifiedNumbers[entry.file], image.flags[entry.file]);
+    }
+
+    std::vector<Postings> buckets(NUM_TRIGRAM_BUCKETS);
+    ForEachTrigramBucket(pool, [&](uint32_t bucket) {
+        const uint32_t low = bucket << 16;
+        const uint32_t high = (bucket + 1) << 16;
+
+        // the bucket's lists of every image, sorted by trigram and then by image
+        struct List {
+            uint32_t trigram;
+            uint32_t image;
+            size_t   idx;
+        };
+        std::vector<List> lists;
+        for(uint32_t image = 0; image < images.size(); image++) {
+            const uint32_t* trigrams = images[image]->trigrams;
+            const uint32_t* end = trigrams + images[image]->numTrigrams;
+            for(const uint32_t* it = std::lower_bound(trigrams, end, low); it != end && *it < high; ++it) {
+                lists.push_back({ *it, image, static_cast<size_t>(it - trigrams) });
+            }
+        }
+        std::sort(lists.begin(), lists.end(), [](const List& lhs, const List& rhs) {
+            return lhs.trigram != rhs.trigram ? lhs.trigram < rhs.trigram : lhs.image < rhs.image;
+        });
+
+        std::vector<uint32_t> decoded;
+        std::vector<uint32_t> merged;
+        for(size_t i = 0; i < lists.size();) {
+            const uint32_t trigram = lists[i].trigram;
+            merged.clear();
+
+            size_t numImages = 0;
+            for(; i < lists.size() && lists[i].trigram == trigram; i++, numImages++) {
+                const Image& image = *images[lists[i].image];
+                decoded.clear();
+                DecodePostings(image.postings + image.postingOffsets[lists[i].idx], image.postingCounts[lists[i].idx], decoded);
+
+                // the new ids keep the order of an image's own
+                const std::vector<uint32_t>& ids = newIds[lists[i].image];
+                for(uint32_t file : decoded) {
+                    if(ids[file] != NO_FILE) merged.push_back(ids[file]);
+                }
+            }
+
+            if(numImages > 1) std::sort(merged.begin(), merged.end());
+            if(!merged.empty()) buckets[bucket].add(trigram, merged.data(), merged.size());
+        }
+    });
+
+    Postings postings;
+    for(const Postings& bucket : buckets) {
+        postings.append(bucket);
+    }
+
+    writeImage(images.front()->root, files, postings, out_Image);
+}
+
+bool ContentIndex::build(WorkStealingPool& pool, const Path& root, const Path& path, const std::atomic<bool>* cancel) {
+    const std::string rootPath = root.str();
+
+    std::vector<FoundFile> found;
+    if(!walkFiles(pool, rootPath, rootPath, found, cancel)) {
+        if(cancel == nullptr || !cancel->load()) printf("Failed to walk %s for the content index\n", rootPath.c_str());
+        return false;
+    }
+
+    // parts an earlier build left, their files that are still the same on disk are kept
+    std::vector<FileSystem::MappedFile> partFiles;
+    std::vector<Image> parts;
+    std::vector<BitSet> stale;
+    std::vector<bool> isCovered(found.size(), false);
+    for(size_t part = 0;; part++) {
+        FileSystem::MappedFile file;
+        Image image;
+        if(!file.open(PartPath(path, part)) || !image.set(file.data(), file.size()) || image.root != rootPath) break;
+
+        BitSet dropped;
+        dropped.reset(image.numFiles);
+        for(uint32_t idx = 0; idx < image.numFiles; idx++) {
+            const std::string_view filePath = image.path(idx);
+            const auto it = std::lower_bound(found.begin(), found.end(), filePath, [](const FoundFile& lhs, std::string_view rhs) { return lhs.path < rhs; });
+            const size_t foundIdx = static_cast<size_t>(it - found.begin());
+            if(it != found.end() && it->path == filePath && !isCovered[foundIdx]
+               && it->size == image.sizes[idx] && it->lastModifiedNumber == image.lastModifiedNumbers[idx]) {
+                isCovered[foundIdx] = true;
+            } else {
+                dropped.set(idx);
+            }
+        }
+
+        partFiles.push_back(std::move(file));
+        parts.push_back(image);
+        stale.push_back(std::move(dropped));
+    }
+
+    // the rest in new parts, each written as soon as it's indexed
+    std::vector<FoundFile> batch;
+    std::vector<IndexedFile> indexed;
+    uint64_t batchSize = 0;
+    const auto xWritePart = [&]() {
+        if(!indexFiles(pool, rootPath, batch, indexed, cancel)) return false;
+
+        Files files;
+        for(size_t i = 0; i < batch.size(); i++) {
+            files.add(batch[i].path, batch[i].size, batch[i].lastModifiedNumber, indexed[i].flags);
+        }
+        Postings postings;
+        invertTrigrams(&pool, indexed, postings);
+
+        std::vector<char> image;
+        writeImage(rootPath, files, postings, image);
+
+        const Path partPath = PartPath(path, parts.size());
+        FileSystem::MappedFile file;
+        Image part;
+        if(!FileSystem::writeFileAtomically(partPath, image.data(), image.size()) || !file.open(partPath) || !part.set(file.data(), file.size())) {
+            printf("Failed to write the content index part %s\n", partPath.str().c_str());
+            return false;
+        }
+
+        partFiles.push_back(std::move(file));
+        parts.push_back(part);
+        stale.emplace_back();
+
+        batch.clear();
+        batchSize = 0;
+        return true;
+    };
+
+    for(size_t i = 0; i < found.size(); i++) {
+        if(isCovered[i]) continue;
+
+        batchSize += found[i].size <= MAX_INDEXED_FILE_SIZE ? found[i].size : 0;
+        batch.push_back(std::move(found[i]));
+        if(batchSize >= PART_TEXT_SIZE && !xWritePart()) return false;
+    }
+    if(!batch.empty() && !xWritePart()) return false;
+
+    std::vector<char> image;
+    if(parts.empty()) {
+        writeImage(rootPath, Files(), Postings(), image);
+    } else {
+        std::vector<const Image*> images;
+        std::vector<const BitSet*> dropped;
+        for(size_t part = 0; part < parts.size(); part++) {
+            images.push_back(&parts[part]);
+            dropped.push_back(&stale[part]);
+        }
+        mergeImages(&pool, images, dropped, image);
+    }
+
+    mFile.close();
+    mBuffer = std::move(image);
+    setImage(mBuffer.data(), mBuffer.size());
+    resetChanges();
+
+    if(!FileSystem::writeFileAtomically(path, mBuffer.data(), mBuffer.size())) {
+        printf("Failed to write the content index %s\n", path.str().c_str());
+        return false;
+    }
+
+    // the index has everything the parts had, they're unmapped first since windows won't delete a mapped file
+    const size_t numParts = parts.size();
+    parts.clear();
+    partFiles.clear();
+    for(size_t part = 0; part < numParts; part++) {
+        FileSystem::removeFile(PartPath(path, part));
+    }
+
+    FileSystem::MappedFile file;
+    if(file.open(path) && setImage(file.data(), file.size())) {
+        mFile = std::move(file);
+        mBuffer = std::vector<char>();
+    }
+    return true;
+}
+
+bool ContentIndex::load(const Path& path) {
+    FileSystem::MappedFile file;
+    if(!file.open(path)) return false;
+
+    if(!setImage(file.data(), file.size())) {
+        printf("%s isn't a content index of version %u\n", path.str().c_str(), FORMAT_VERSION);
+        return false;
+    }
+
+    // the tables point into the mapping, which stays where it is when the file is moved
+    mFile = std::move(file);
+    mBuffer = std::vector<char>();
+    resetChanges();
+    return true;
+}
+
+bool ContentIndex::save(const Path& path, WorkStealingPool* pool) {
+    if(isEmpty()) return false;
+
+    // the added files that are still there become an image of their own, in path order
+    const uint32_t base = mImage.numFiles;
+    std::vector<uint32_t> added;
+    for(uint32_t file = base; file < numFiles(); file++) {
+        if(!mAddedRemoved[file - base]) added.push_back(file);
+    }
+    std::sort(added.begin(), added.end(), [&](uint32_t lhs, uint32_t rhs) { return getRelativePath(lhs) < getRelativePath(rhs); });
+
+    std::vector<uint32_t> localIds(numFiles() - base, NO_FILE);
+    Files files;
+    for(uint32_t file : added) {
+        localIds[file - base] = static_cast<uint32_t>(files.size());
+        files.add(getRelativePath(file), getSize(file), getLastModifiedNumber(file), getFlags(file));
+    }
+
+    std::vector<uint32_t> trigrams;
+    for(const auto& [trigram, postingFiles] : mAddedPostings) {
+        trigrams.push_back(trigram);
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+
+    Postings postings;
+    std::vector<uint32_t> ids;
+    for(uint32_t trigram : trigrams) {
+        ids.clear();
+        for(uint32_t file : mAddedPostings.at(trigram)) {
+            if(localIds[file - base] != NO_FILE) ids.push_back(localIds[file - base]);
+        }
+        std::sort(ids.begin(), ids.end());
+        if(!ids.empty()) postings.add(trigram, ids.data(), ids.size());
+    }
+
+    std::vector<char> addedImage;
+    writeImage(mRoot, files, postings, addedImage);
+    Image addedTables;
+    addedTables.set(addedImage.data(), addedImage.size());
+
+    std::vector<char> image;
+    mergeImages(pool, { &mImage, &addedTables }, { &mRemovedImageFiles, nullptr }, image);
+
+    // windows won't replace a file that's still mapped, the new image is used from memory until it's mapped again
+    mFile.close();
+    mBuffer = std::move(image);
+    setImage(mBuffer.data(), mBuffer.size());
+    resetChanges();
+
+    if(!FileSystem::writeFileAtomically(path, mBuffer.data(), mBuffer.size())) {
+        printf("Failed to write the content index %s\n", path.str().c_str());
+        return false;
+    }
+
+    // mapped, the pages are shared with the page cache instead of being a private copy
+    FileSystem::MappedFile file;
+    if(file.open(path) && setImage(file.data(), file.size())) {
+        mFile = std::move(file);
+        mBuffer = std::vector<char>();
+    }
+    return true;
+}
+
+void ContentIndex::clear() {
+    mFile.close();
+    mBuffer = std::vector<char>();
+    mImageSize = 0;
+    mRoot.clear();
+    mImage = Image();
+
+    resetChanges();
+}
+
+void ContentIndex::removeFiles(const Path& path) {
+    FileSystem::removeFile(path);
+    for(size_t part = 0; FileSystem::removeFile(PartPath(path, part)); part++) {
+    }
+}
+
+bool ContentIndex::setImage(const char* image, size_t size) {
+    Image tables;
+    if(!tables.set(image, size)) return false;
+
+    mImage = tables;
+    mImageSize = size;
+    mRoot = std::string(tables.root);
+    return true;
+}
+
+void ContentIndex::resetChanges() {
+    mRemovedImageFiles.reset(mImage.numFiles);
+    mAddedPathArena = std::vector<char>();
+    mAddedPathOffsets = { 0 };
+    mAddedSizes = std::vector<uint64_t>();
+    mAddedLastModifiedNumbers = std::vector<uint64_t>();
+    mAddedFlags = std::vector<uint8_t>();
+    mAddedRemoved = std::vector<bool>();
+    mAddedPostings.clear();
+    mAddedIds.clear();
+
+    mNumEntries = mImage.numFiles;
+    mNumChanges = 0;
+}
+
+std::string_view ContentIndex::getRelativePath(uint32_t file) const {
+    if(file < mImage.numFiles) return mImage.path(file);
+
+    const uint32_t added = file - mImage.numFiles;
+    return std::string_view(mAddedPathArena.data() + mAddedPathOffsets[added], mAddedPathOffsets[added + 1] - mAddedPathOffsets[added]);
+}
+
+uint64_t ContentIndex::getSize(uint32_t file) const {
+    return file < mImage.numFiles ? mImage.sizes[file] : mAddedSizes[file - mImage.numFiles];
+}
+
+uint64_t ContentIndex::getLastModifiedNumber(uint32_t file) const {
+    return file < mImage.numFiles ? mImage.lastModifiedNumbers[file] : mAddedLastModifiedNumbers[file - mImage.numFiles];
+}
+
+uint8_t ContentIndex::getFlags(uint32_t file) const {
+    return file < mImage.numFiles ? mImage.flags[file] : mAddedFlags[file - mImage.numFiles];
+}
+
+bool ContentIndex::isRemoved(uint32_t file) const {
+    return file < mImage.numFiles ? mRemovedImageFiles.test(file) : mAddedRemoved[file - mImage.numFiles];
+}
+
+void ContentIndex::buildPath(uint32_t file, std::string& out) const {
+    out.assign(mRoot);
+    if(!out.empty() && out.back() != Path::SEPARATOR) out.push_back(Path::SEPARATOR);
+    out.append(getRelativePath(file));
+}
+
+std::string ContentIndex::getPath(uint32_t file) const {
+    std::string path;
+    buildPath(file, path);
+    return path;
+}
+
+// the first of `numFiles` files in path order whose path `xPath(file)` doesn't sort before `key`
+template<typename PathFn>
+inline static uint32_t LowerBoundPath(uint32_t numFiles, std::string_view key, PathFn&& xPath) {
+    uint32_t low = 0;
+    uint32_t high = numFiles;
+    while(low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if(xPath(middle) < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+uint32_t ContentIndex::findFile(std::string_view relativePath) const {
+    const uint32_t file = LowerBoundPath(mImage.numFiles, relativePath, [this](uint32_t idx) { return mImage.path(idx); });
+    if(file < mImage.numFiles && mImage.path(file) == relativePath && !mRemovedImageFiles.test(file)) return file;
+
+    const auto added = mAddedIds.find(std::string(relativePath));
+    if(added != mAddedIds.end() && !isRemoved(added->second)) return added->second;
+    return NO_FILE;
+}
+
+void ContentIndex::collectFilesBelow(std::string_view relativeDirectory, std::vector<uint32_t>& out_Files) const {
+    std::string prefix(relativeDirectory);
+    if(!prefix.empty()) prefix.push_back(Path::SEPARATOR);
+
+    // a directory's files are one run of the path order
+    const auto xPath = [this](uint32_t idx) { return mImage.path(idx); };
+    for(uint32_t file = LowerBoundPath(mImage.numFiles, prefix, xPath); file < mImage.numFiles; file++) {
+        if(mImage.path(file).substr(0, prefix.size()) != prefix) break;
+        if(!mRemovedImageFiles.test(file)) out_Files.push_back(file);
+    }
+
+    for(uint32_t file = mImage.numFiles; file < numFiles(); file++) {
+        if(!isRemoved(file) && getRelativePath(file).substr(0, prefix.size()) == prefix) out_Files.push_back(file);
+    }
+}
+
+bool ContentIndex::toRelative(std::string_view path, std::string_view& out_Relative) const {
+    if(isEmpty() || path.substr(0, mRoot.size()) != mRoot) return false;
+
+    std::string_view relative = path.substr(mRoot.size());
+    if(!relative.empty() && mRoot.back() != Path::SEPARATOR) {
+        // a sibling that only starts like the root
+        if(relative.front() != Path::SEPARATOR) return false;
+        relative.remove_prefix(1);
+    }
+    out_Relative = relative;
+    return true;
+}
+
+// the files of the ascending `lists` that are in all of them
+inline static void IntersectPostings(std::vector<std::vector<uint32_t>>& lists, std::vector<uint32_t>& out_Files) {
+    out_Files.clear();
+    if(lists.empty()) return;
+
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>& lhs, const std::vector<uint32_t>& rhs) { return lhs.size() < rhs.size(); });
+    out_Files = lists.front();
+
+    std::vector<uint32_t> kept;
+    for(size_t i = 1; i < lists.size() && !out_Files.empty(); i++) {
+        kept.clear();
+        std::set_intersection(out_Files.begin(), out_Files.end(), lists[i].begin(), lists[i].end(), std::back_inserter(kept));
+        out_Files.swap(kept);
+    }
+}
+
+void ContentIndex::findCandidates(std::string_view literal, std::vector<uint32_t>& out_Files) const {
+    if(isEmpty()) return;
+
+    // the literal's trigrams, folded like the index's
+    std::vector<uint32_t> trigrams;
+    if(literal.size() >= 3) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(literal.data());
+        uint32_t trigram = (FoldAscii(bytes[0]) << 8) | FoldAscii(bytes[1]);
+        for(size_t i = 2; i < literal.size(); i++) {
+            trigram = ((trigram << 8) | FoldAscii(bytes[i])) & (NUM_TRIGRAMS - 1);
+            trigrams.push_back(trigram);
+        }
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    }
+
+    // files that weren't indexed may have it as much as any, binary ones are skipped by grep anyway
+    const auto xAlwaysCandidate = [](uint8_t flags) {
+        return !(flags & (FILE_INDEXED | FILE_BINARY));
+    };
+    const auto xAnyCandidate = [](uint8_t flags) {
+        return !(flags & FILE_BINARY);
+    };
+
+    std::vector<std::vector<uint32_t>> lists;
+    std::vector<uint32_t> matches;
+
+    // the image's files
+    if(trigrams.empty()) {
+        for(uint32_t file = 0; file < mImage.numFiles; file++) {
+            if(xAnyCandidate(mImage.flags[file]) && !mRemovedImageFiles.test(file)) out_Files.push_back(file);
+        }
+    } else {
+        for(uint32_t trigram : trigrams) {
+            size_t idx = 0;
+            if(!mImage.find(trigram, idx)) {
+                lists.clear();
+                break;
+            }
+            lists.emplace_back();
+            lists.back().reserve(mImage.postingCounts[idx]);
+            DecodePostings(mImage.postings + mImage.postingOffsets[idx], mImage.postingCounts[idx], lists.back());
+        }
+        IntersectPostings(lists, matches);
+
+        // merged with the ones that weren't indexed, in id order
+        size_t next = 0;
+        for(uint32_t file = 0; file < mImage.numFiles; file++) {
+            const bool isMatch = next < matches.size() && matches[next] == file;
+            if(isMatch) next++;
+            if((isMatch || xAlwaysCandidate(mImage.flags[file])) && !mRemovedImageFiles.test(file)) out_Files.push_back(file);
+        }
+    }
+
+    // the added ones
+    const uint32_t base = mImage.numFiles;
+    if(trigrams.empty()) {
+        for(uint32_t file = base; file < numFiles(); file++) {
+            if(xAnyCandidate(mAddedFlags[file - base]) && !mAddedRemoved[file - base]) out_Files.push_back(file);
+        }
+        return;
+    }
+
+    lists.clear();
+    for(uint32_t trigram : trigrams) {
+        const auto found = mAddedPostings.find(trigram);
+        if(found == mAddedPostings.end()) {
+            lists.clear();
+            break;
+        }
+        lists.push_back(found->second);
+    }
+    IntersectPostings(lists, matches);
+
+    size_t next = 0;
+    for(uint32_t file = base; file < numFiles(); file++) {
+        const bool isMatch = next < matches.size() && matches[next] == file;
+        if(isMatch) next++;
+        if((isMatch || xAlwaysCandidate(mAddedFlags[file - base])) && !mAddedRemoved[file - base]) out_Files.push_back(file);
+    }
+}
+
+uint32_t ContentIndex::addFile(const FoundFile& found, const IndexedFile& indexed) {
+    const uint32_t file = numFiles();
+
+    mAddedPathArena.insert(mAddedPathArena.end(), found.path.begin(), found.path.end());
+    mAddedPathOffsets.push_back(static_cast<uint32_t>(mAddedPathArena.size()));
+    mAddedSizes.push_back(found.size);
+    mAddedLastModifiedNumbers.push_back(found.lastModifiedNumber);
+    mAddedFlags.push_back(indexed.flags);
+    mAddedRemoved.push_back(false);
+    for(uint32_t trigram : indexed.trigrams) {
+        mAddedPostings[trigram].push_back(file);
+    }
+    mAddedIds[found.path] = file;
+
+    mNumEntries++;
+    mNumChanges++;
+    return file;
+}
+
+void ContentIndex::removeFile(uint32_t file) {
+    if(isRemoved(file)) return;
+
+    // the added postings keep the id, queries and save() skip removed files
+    if(file < mImage.numFiles) {
+        mRemovedImageFiles.set(file);
+    } else {
+        mAddedRemoved[file - mImage.numFiles] = true;
+    }
+    mNumEntries--;
+    mNumChanges++;
+}
+
+void ContentIndex::updateFiles(WorkStealingPool& pool, const std::vector<FoundFile>& changed) {
+    if(changed.empty()) return;
+
+    std::vector<IndexedFile> indexed;
+    indexFiles(pool, mRoot, changed, indexed, nullptr);
+
+    for(size_t i = 0; i < changed.size(); i++) {
+        const uint32_t previous = findFile(changed[i].path);
+        if(previous != NO_FILE) removeFile(previous);
+        addFile(changed[i], indexed[i]);
+    }
+}
+
+bool ContentIndex::applyChanges(WorkStealingPool& pool, std::string_view directory, const std::vector<std::string>& names) {
+    std::string_view relative;
+    if(!toRelative(directory, relative)) return false;
+
+    const Path directoryPath{ std::string(directory) };
+    std::vector<FoundFile> changed;
+    std::vector<uint32_t> below;
+    for(const std::string& name : names) {
+        const std::string relativePath = relative.empty() ? name : JoinPath(relative, name);
+        const uint32_t file = findFile(relativePath);
+
+        FileSystem::EntryChange entry;
+        if(!FileSystem::getEntryInfo(directoryPath, name, entry)) {
+            // gone, and everything below it if it was a directory
+            if(file != NO_FILE) removeFile(file);
+            below.clear();
+            collectFilesBelow(relativePath, below);
+            for(uint32_t belowFile : below) {
+                removeFile(belowFile);
+            }
+            continue;
+        }
+
+        if(entry.attributes & FileSystem::FileAttributes::DIRECTORY) {
+            if(file != NO_FILE) removeFile(file);
+            // links aren't walked, pruned directories weren't indexed in the first place
+            if(!(entry.attributes & FileSystem::FileAttributes::SYMLINK) && !IsPrunedName(name)) {
+                rescan(pool, JoinPath(directory, name));
+            }
+            continue;
+        }
+
+        // watches report more than content changes
+        if(file != NO_FILE && getSize(file) == entry.size && getLastModifiedNumber(file) == entry.lastModifiedNumber) continue;
+
+        FoundFile found;
+        found.path = relativePath;
+        found.size = entry.size;
+        found.lastModifiedNumber = entry.lastModifiedNumber;
+        changed.push_back(std::move(found));
+    }
+
+    updateFiles(pool, changed);
+    return true;
+}
+
+bool ContentIndex::rescan(WorkStealingPool& pool, std::string_view directory) {
+    std::string_view relative;
+    if(!toRelative(directory, relative)) return false;
+
+    // nothing is found if the directory itself went away, its files are all removed then
+    std::vector<FoundFile> found;
+    walkFiles(pool, mRoot, directory, found, nullptr);
+
+    std::vector<uint32_t> indexed;
+    collectFilesBelow(relative, indexed);
+    for(uint32_t file : indexed) {
+        const std::string_view filePath = getRelativePath(file);
+        const auto it = std::lower_bound(found.begin(), found.end(), filePath, [](const FoundFile& lhs, std::string_view rhs) { return lhs.path < rhs; });
+        if(it == found.end() || it->path != filePath) removeFile(file);
+    }
+
+    std::vector<FoundFile> changed;
+    for(FoundFile& file : found) {
+        const uint32_t previous = findFile(file.path);
+        if(previous == NO_FILE || getSize(previous) != file.size || getLastModifiedNumber(previous) != file.lastModifiedNumber) {
+            changed.push_back(std::move(file));
+        }
+    }
+    updateFiles(pool, changed);
+    return true;
+}
+
+bool ContentIndex::watch(WatchRegistry& registry, const std::string& directory) {
+    uint64_t generation = 0;
+    if(!registry.subscribe(directory, generation)) return false;
+
+    // one subscription per directory, a second one would never be given back
+    if(!mWatches.emplace(directory, generation).second) {
+        registry.unsubscribe(directory);
+    }
+    return true;
+}
+
+size_t ContentIndex::watchTree(WatchRegistry& registry, size_t maxWatches) {
+    if(isEmpty()) return mWatches.size();
+
+    // the directories files are in and the ones above them, the root being the empty one
+    std::unordered_set<std::string_view> directories = { std::string_view() };
+    for(uint32_t file = 0; file < numFiles(); file++) {
+        if(isRemoved(file)) continue;
+
+        std::string_view directory = getRelativePath(file);
+        for(size_t separator = directory.rfind(Path::SEPARATOR); separator != std::string_view::npos; separator = directory.rfind(Path::SEPARATOR)) {
+            directory = directory.substr(0, separator);
+            if(!directories.insert(directory).second) break;
+        }
+    }
+
+    const auto xDepth = [](std::string_view directory) {
+        return directory.empty() ? 0 : std::count(directory.begin(), directory.end(), Path::SEPARATOR) + 1;
+    };
+    std::vector<std::string_view> ordered(directories.begin(), directories.end());
+    std::sort(ordered.begin(), ordered.end(), [&](std::string_view lhs, std::string_view rhs) {
+        const auto lhsDepth = xDepth(lhs);
+        const auto rhsDepth = xDepth(rhs);
+        return lhsDepth != rhsDepth ? lhsDepth < rhsDepth : lhs < rhs;
+    });
+
+    for(size_t i = 0; i < ordered.size() && mWatches.size() < maxWatches; i++) {
+        watch(registry, ordered[i].empty() ? mRoot : JoinPath(mRoot, ordered[i]));
+    }
+    return mWatches.size();
+}
+
+void ContentIndex::unwatchAll(WatchRegistry& registry) {
+    for(const auto& [directory, generation] : mWatches) {
+        registry.unsubscribe(directory);
+    }
+    mWatches.clear();
+}
+
+size_t ContentIndex::pollWatches(WatchRegistry& registry, WorkStealingPool& pool) {
+    size_t numChanged = 0;
+    std::vector<std::string> names;
+    for(auto& [directory, generation] : mWatches) {
+        const uint64_t current = registry.poll(directory);
+        if(current == 0 || current == generation) continue;
+
+        names.clear();
+        uint64_t upTo = current;
+        if(registry.changesSince(directory, generation, names, upTo) && applyChanges(pool, directory, names)) {
+            generation = upTo;
+        } else {
+            rescan(pool, directory);
+            generation = current;
+        }
+        numChanged++;
+    }
+    return numChanged;
+}
+
+size_t ContentIndex::changesMemoryUsage() const {
+    size_t postings = mAddedPostings.bucket_count() * sizeof(void*);
+    for(const auto& [trigram, files] : mAddedPostings) {
+        postings += sizeof(std::pair<uint32_t, std::vector<uint32_t>>) + 2 * sizeof(void*) + files.capacity() * sizeof(uint32_t);
+    }
+
+    size_t ids = mAddedIds.bucket_count() * sizeof(void*);
+    for(const auto& [path, file] : mAddedIds) {
+        ids += sizeof(std::pair<std::string, uint32_t>) + 2 * sizeof(void*) + path.capacity();
+    }
+
+    return mRemovedImageFiles.words().capacity() * sizeof(uint64_t)
+        + mAddedPathArena.capacity()
+        + mAddedPathOffsets.capacity() * sizeof(uint32_t)
+        + (mAddedSizes.capacity() + mAddedLastModifiedNumbers.capacity()) * sizeof(uint64_t)
+        + mAddedFlags.capacity()
+        + mAddedRemoved.capacity() / 8
+        + postings + ids;
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "BitSet.h"
+#include "FileSystem.h"
+
+class Path;
+class WatchRegistry;
+class WorkStealingPool;
+
+// Which files below a root contain which trigrams, so `grep` can skip the files that can't match instead of reading
+// every one of them. Trigrams are three bytes in a row with A-Z folded, so one index serves queries of either case.
+// The index is one image of flat tables, mapped from its file the way FileIndex's is:
+//   - the files with their paths relative to the root, sorted byte wise, with the size and modification time they
+//     were indexed at. A directory's files are one run of that order
+//   - the trigrams that occur, sorted, each with a posting list: the ids of the files it's in, ascending, stored as
+//     the differences between neighbours in LEB128 varints
+// A query only narrows things down, the files it lists still have to be searched for real.
+// Changes after a build or load are kept next to the image like FileIndex's: changed files are flagged removed and
+// indexed again into small tables with ids following the image's. save() merges them into a new image.
+// Queries are const and may run concurrently with each other, but not with anything that changes the index
+class ContentIndex {
+public:
+    static constexpr uint32_t NO_FILE = UINT32_MAX;
+    // bumped whenever the layout of the file changes, older files are rebuilt instead of read
+    static constexpr uint32_t FORMAT_VERSION = 1;
+    // bigger files are listed but not indexed, every query has them as candidates
+    static constexpr uint64_t MAX_INDEXED_FILE_SIZE = 16 * 1024 * 1024;
+    // a build writes what it indexed to a part file every this many bytes of text, a stopped build loses less than that
+    static constexpr uint64_t PART_TEXT_SIZE = 32 * 1024 * 1024;
+
+    // the trigrams of the file are in the index
+    static constexpr uint8_t FILE_INDEXED = 1 << 0;
+    // the file looked binary, grep skips it and so do queries
+    static constexpr uint8_t FILE_BINARY = 1 << 1;
+
+    ContentIndex();
+    ~ContentIndex();
+
+    ContentIndex(const ContentIndex&) = delete;
+    ContentIndex& operator=(const ContentIndex&) = delete;
+    ContentIndex(ContentIndex&&);
+    ContentIndex& operator=(ContentIndex&&);
+
+    // Indexes the files below `root` on `pool`, directories grep prunes by default left out, writes the index to
+    // `path` and maps it. What's indexed goes to part files next to `path` as it's done, so a build that was
+    // stopped through `cancel` or never finished picks up where it was: parts whose files didn't change since are
+    // kept and only the rest is read. False if it was stopped or the index couldn't be written
+    bool build(WorkStealingPool& pool, const Path& root, const Path& path, const std::atomic<bool>* cancel = nullptr);
+
+    // maps an index saved before, false if there's no such file or it isn't an index of this version
+    bool load(const Path& path);
+    // writes the index with the changes since it was built or loaded merged in and maps the new file
+    bool save(const Path& path, WorkStealingPool* pool = nullptr);
+    void clear();
+    // deletes the index at `path` and the parts a build left next to it
+    static void removeFiles(const Path& path);
+
+    inline bool isEmpty() const { return mRoot.empty(); }
+    // the full path the index was built from
+    inline const std::string& rootPath() const { return mRoot; }
+
+    // ids go up to numFiles() and stay valid until the next build, load or save. Some may be removed ones
+    inline uint32_t numFiles() const { return mImage.numFiles + static_cast<uint32_t>(mAddedFlags.size()); }
+    // files that aren't removed
+    inline size_t numEntries() const { return mNumEntries; }
+    // files added or removed since the last build, load or save
+    inline size_t numChanges() const { return mNumChanges; }
+    // distinct trigrams of the image
+    inline size_t numTrigrams() const { return mImage.numTrigrams; }
+    // true while the image is a mapped file rather than a buffer
+    inline bool isMapped() const { return mFile.isOpen(); }
+
+    std::string_view getRelativePath(uint32_t file) const;
+    uint64_t getSize(uint32_t file) const;
+    uint64_t getLastModifiedNumber(uint32_t file) const;
+    uint8_t getFlags(uint32_t file) const;
+    bool isRemoved(uint32_t file) const;
+
+    // writes the full path of `file` into `out`, reusing its capacity
+    void buildPath(uint32_t file, std::string& out) const;
+    std::string getPath(uint32_t file) const;
+
+    // the part of `path` below the root, empty for the root itself. False if `path` isn't the root or below it
+    bool toRelative(std::string_view path, std::string_view& out_Relative) const;
+    // the file at `relativePath`, NO_FILE if it isn't in the index
+    uint32_t findFile(std::string_view relativePath) const;
+
+    // Files that may contain `literal`, the ones that weren't indexed included and binary ones left out. With fewer
+    // than three characters nothing can be ruled out and every file is listed. The image's files come first, in
+    // path order, then the added ones
+    void findCandidates(std::string_view literal, std::vector<uint32_t>& out_Files) const;
+
+    // Brings entries `names` of `directory` up to date with the disk, the way a directory watch reports changes:
+    // files that changed are indexed again, ones that went away are removed, directories walked like rescan() does.
+    // False if `directory` isn't below the root
+    bool applyChanges(WorkStealingPool& pool, std::string_view directory, const std::vector<std::string>& names);
+    // walks `directory` again and indexes the files whose size or modification time isn't what was indexed, for
+    // changes nobody knows the names of and for an index that was loaded after the files could have changed
+    bool rescan(WorkStealingPool& pool, std::string_view directory);
+
+    // Follows `directory` through `registry`, pollWatches() patches in what changed there. Watches are per
+    // directory and the OS limits how many there can be, so watch the directories that matter
+    bool watch(WatchRegistry& registry, const std::string& directory);
+    // watches the directories indexed files are in, and the ones above them, shallowest first until `maxWatches`
+    // are watched. Returns how many are
+    size_t watchTree(WatchRegistry& registry, size_t maxWatches);
+    void unwatchAll(WatchRegistry& registry);
+    inline size_t numWatches() const { return mWatches.size(); }
+    // applies whatever the watched directories reported since the last call, returns how many changed
+    size_t pollWatches(WatchRegistry& registry, WorkStealingPool& pool);
+
+    // bytes of the image, mapped or not, and of the changes next to it
+    inline size_t imageSize() const { return mImageSize; }
+    size_t changesMemoryUsage() const;
+
+private:
+    struct Header;
+    struct Files;
+    struct Postings;
+    struct FoundFile;
+    struct IndexedFile;
+
+    // the tables of one image, read in place
+    struct Image {
+        std::string_view root;
+        uint32_t numFiles = 0;
+        size_t numTrigrams = 0;
+        // numFiles + 1 of them, a path ends where the next one starts
+        const uint32_t* pathOffsets = nullptr;
+        const uint64_t* sizes = nullptr;
+        const uint64_t* lastModifiedNumbers = nullptr;
+        const uint8_t* flags = nullptr;
+        const uint32_t* trigrams = nullptr;
+        // numTrigrams + 1 of them, into postings
+        const uint64_t* postingOffsets = nullptr;
+        const uint32_t* postingCounts = nullptr;
+        const char* pathArena = nullptr;
+        const uint8_t* postings = nullptr;
+
+        // false and nothing changed if the header doesn't check out
+        bool set(const char* image, size_t size);
+        inline std::string_view path(uint32_t file) const {
+            return std::string_view(pathArena + pathOffsets[file], pathOffsets[file + 1] - pathOffsets[file]);
+        }
+        // the posting list of `trigram`, false if no file has it
+        bool find(uint32_t trigram, size_t& out_Idx) const;
+    };
+
+    // lays `files` and `postings` out in one image the way Header describes it
+    static void writeImage(std::string_view root, const Files& files, const Postings& postings, std::vector<char>& out_Image);
+    // merges the files of `images` that aren't in their `dropped` sets (null for none) into one image in path order.
+    // A path in more than one of them is taken from the last
+    static void mergeImages(WorkStealingPool* pool, const std::vector<const Image*>& images, const std::vector<const BitSet*>& dropped,
+                            std::vector<char>& out_Image);
+    // reads `found` on `pool` and collects the trigrams of each, stops early through `cancel`
+    static bool indexFiles(WorkStealingPool& pool, std::string_view root, const std::vector<FoundFile>& found,
+                           std::vector<IndexedFile>& out_Indexed, const std::atomic<bool>* cancel);
+    // the files below `directory` by their paths relative to `root`, sorted
+    static bool walkFiles(WorkStealingPool& pool, std::string_view root, std::string_view directory, std::vector<FoundFile>& out_Found,
+                          const std::atomic<bool>* cancel);
+    // the posting lists of `indexed`, file `i` of it with id `i`
+    static void invertTrigrams(WorkStealingPool* pool, const std::vector<IndexedFile>& indexed, Postings& out_Postings);
+
+    // points the tables at `image` once its header checks out, false and nothing changed if it doesn't
+    bool setImage(const char* image, size_t size);
+    void resetChanges();
+
+    uint32_t addFile(const FoundFile& found, const IndexedFile& indexed);
+    void removeFile(uint32_t file);
+    // indexes `changed` again in place of what's in the index for their paths
+    void updateFiles(WorkStealingPool& pool, const std::vector<FoundFile>& changed);
+    // the ids of the files that aren't removed whose paths start with `relativeDirectory` and a separator
+    void collectFilesBelow(std::string_view relativeDirectory, std::vector<uint32_t>& out_Files) const;
+
+    FileSystem::MappedFile mFile;
+    std::vector<char> mBuffer;
+    size_t mImageSize = 0;
+    std::string mRoot;
+
+    Image mImage;
+
+    // changes since, added files have ids from mImage.numFiles on
+    BitSet mRemovedImageFiles;
+    std::vector<char> mAddedPathArena;
+    std::vector<uint32_t> mAddedPathOffsets;
+    std::vector<uint64_t> mAddedSizes;
+    std::vector<uint64_t> mAddedLastModifiedNumbers;
+    std::vector<uint8_t> mAddedFlags;
+    std::vector<bool> mAddedRemoved;
+    // trigram -> added files it's in, ascending
+    std::unordered_map<uint32_t, std::vector<uint32_t>> mAddedPostings;
+    // relative path -> the added file that's current for it
+    std::unordered_map<std::string, uint32_t> mAddedIds;
+
+    size_t mNumEntries = 0;
+    size_t mNumChanges = 0;
+
+    // watched directory -> generation its changes were applied up to
+    std::unordered_map<std::string, uint64_t> mWatches;
+};
@@ -0,0 +1,226 @@
+#include "ContentIndexService.h"
+#include "ContentSearch.h"
+#include "WatchRegistry.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+ContentIndexService::ContentIndexService(const Path& directory, size_t numThreads)
+    : mDirectory(directory),
+    mPool(numThreads) {
+    mThread = std::thread(&ContentIndexService::run, this);
+}
+
+ContentIndexService::~ContentIndexService() {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        mAlive = false;
+    }
+    mCancel = true;
+    mWakeCondition.notify_all();
+    mThread.join();
+}
+
+void ContentIndexService::request(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        if(root == mBusyRoot) return;
+        for(const Request& queued : mQueue) {
+            if(queued.root == root && !queued.isDrop) return;
+        }
+        mQueue.push_back({ root, false });
+    }
+    mWakeCondition.notify_one();
+}
+
+void ContentIndexService::drop(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(), [&](const Request& queued) { return queued.root == root; }), mQueue.end());
+        mQueue.push_back({ root, true });
+
+        // the build in flight only notices between files
+        if(root == mBusyRoot) mCancel = true;
+    }
+    mWakeCondition.notify_one();
+}
+
+std::vector<std::string> ContentIndexService::readyRoots() const {
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+
+    std::vector<std::string> roots;
+    for(const auto& [root, index] : mIndexes) {
+        roots.push_back(root);
+    }
+    std::sort(roots.begin(), roots.end());
+    return roots;
+}
+
+std::string ContentIndexService::busyRoot() const {
+    std::scoped_lock<std::mutex> lock(mQueueMutex);
+    return mBusyRoot;
+}
+
+bool ContentIndexService::findCandidates(const Path& directory, const std::vector<std::string>& names, const GrepQuery& query,
+                                         std::vector<std::string>& out_Files) const {
+    // the index has what a walk with the default pruning turns up, nothing else
+    if(!query.useDefaultPrune) return false;
+
+    const GrepMatcher matcher(query);
+    if(!matcher.isValid()) return false;
+
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+
+    // the innermost root has the fewest files to go through
+    const ContentIndex* index = nullptr;
+    std::string_view relative;
+    for(const auto& [root, candidate] : mIndexes) {
+        std::string_view candidateRelative;
+        if(candidate.toRelative(directory.str(), candidateRelative) && (index == nullptr || root.size() > index->rootPath().size())) {
+            index = &candidate;
+            relative = candidateRelative;
+        }
+    }
+    if(index == nullptr) return false;
+
+    // what the search covers relative to the root, a file or a directory each
+    std::vector<std::string> scopes;
+    if(names.empty()) {
+        scopes.emplace_back(relative);
+    }
+    for(const std::string& name : names) {
+        scopes.push_back(relative.empty() ? name : std::string(relative) + Path::SEPARATOR + name);
+    }
+
+    std::vector<uint32_t> candidates;
+    index->findCandidates(matcher.literal(), candidates);
+
+    for(uint32_t file : candidates) {
+        const std::string_view path = index->getRelativePath(file);
+
+        bool isInScope = false;
+        for(const std::string& scope : scopes) {
+            if(scope.empty() || path == scope || (path.size() > scope.size() && path.substr(0, scope.size()) == scope && path[scope.size()] == Path::SEPARATOR)) {
+                isInScope = true;
+                break;
+            }
+        }
+        if(!isInScope) continue;
+
+        // directories pruned by the query, below the one searched
+        const size_t nameStart = path.rfind(Path::SEPARATOR) + 1;
+        bool isPruned = false;
+        for(size_t segmentStart = relative.empty() ? 0 : relative.size() + 1; segmentStart < nameStart && !isPruned;) {
+            const size_t segmentEnd = path.find(Path::SEPARATOR, segmentStart);
+            const std::string_view segment = path.substr(segmentStart, segmentEnd - segmentStart);
+            isPruned = std::find(query.pruneNames.begin(), query.pruneNames.end(), segment) != query.pruneNames.end();
+            segmentStart = segmentEnd + 1;
+        }
+        if(isPruned || !matcher.matchesFileName(path.substr(nameStart))) continue;
+
+        out_Files.push_back(index->getPath(file));
+    }
+    return true;
+}
+
+Path ContentIndexService::indexPath(const std::string& root) const {
+    // FNV-1a of the root, the same root always gets the same file
+    uint64_t hash = 14695981039346656037ull;
+    for(char c : root) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cidx", static_cast<unsigned long long>(hash));
+
+    Path path = mDirectory;
+    path.appendName(name);
+    return path;
+}
+
+void ContentIndexService::run() {
+    while(true) {
+        Request request;
+        bool hasRequest = false;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mWakeCondition.wait_for(lock, POLL_INTERVAL, [this]() { return !mAlive || !mQueue.empty(); });
+
+            if(!mAlive) break;
+
+            if(!mQueue.empty()) {
+                request = std::move(mQueue.front());
+                mQueue.pop_front();
+                hasRequest = true;
+
+                // a drop of the root before this one is done with it
+                mCancel = false;
+                mBusyRoot = request.isDrop ? std::string() : request.root;
+            }
+        }
+
+        if(hasRequest) {
+            if(request.isDrop) {
+                dropIndex(request.root);
+            } else {
+                loadIndex(request.root);
+            }
+
+            std::scoped_lock<std::mutex> lock(mQueueMutex);
+            mBusyRoot.clear();
+        }
+
+        pollIndexes();
+    }
+
+    // what changed since the last save, a build that was stopped is picked up from its parts next time
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    for(auto& [root, index] : mIndexes) {
+        index.unwatchAll(WatchRegistry::shared());
+        if(index.numChanges() > 0) index.save(indexPath(root), &mPool);
+    }
+}
+
+void ContentIndexService::loadIndex(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mIndexMutex);
+        if(mIndexes.count(root) > 0) return;
+    }
+
+    const Path path = indexPath(root);
+    ContentIndex index;
+    const bool isLoaded = index.load(path) && index.rootPath() == root;
+    if(!isLoaded && !index.build(mPool, Path(root), path, &mCancel)) return;
+
+    // watched first, so nothing that changes during the rescan slips through
+    index.watchTree(WatchRegistry::shared(), MAX_WATCHES_PER_INDEX);
+    index.rescan(mPool, root);
+    if(index.numChanges() > 0) index.save(path, &mPool);
+
+    printf("Content index of %s: %zu files, %zu trigrams, %zu kB\n", root.c_str(), index.numEntries(), index.numTrigrams(), index.imageSize() / 1024);
+
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    mIndexes.emplace(root, std::move(index));
+}
+
+void ContentIndexService::dropIndex(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mIndexMutex);
+        auto it = mIndexes.find(root);
+        if(it != mIndexes.end()) {
+            it->second.unwatchAll(WatchRegistry::shared());
+            mIndexes.erase(it);
+        }
+    }
+
+    // unmapped by now, windows won't delete a mapped file
+    ContentIndex::removeFiles(indexPath(root));
+}
+
+void ContentIndexService::pollIndexes() {
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    for(auto& [root, index] : mIndexes) {
+        index.pollWatches(WatchRegistry::shared(), mPool);
+        if(index.numChanges() >= SAVE_AFTER_CHANGES) index.save(indexPath(root), &mPool);
+    }
+}
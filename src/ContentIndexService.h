@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ContentIndex.h"
+#include "Path.h"
+#include "WorkStealingPool.h"
+
+struct GrepQuery;
+
+// Keeps a ContentIndex of every root it's asked to, so a grep below one of them only reads the files that may match.
+// An index built before is loaded from its file, otherwise it's built, picking up a build that was stopped. Either
+// way its directories are watched and it's rescanned once for what changed while nobody was looking, after that
+// the watches keep it current. Changes are saved every so often and on shutdown.
+// One instance is shared by all browser widgets
+class ContentIndexService {
+public:
+    // how often the watched directories of the indexes are looked at
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{ 500 };
+    // watches per index, the OS limits how many there can be
+    static constexpr size_t MAX_WATCHES_PER_INDEX = 4096;
+    // an index is saved again once it has this many changes next to its image
+    static constexpr size_t SAVE_AFTER_CHANGES = 1000;
+
+    // index files go to `directory`. 0 threads means one per hardware thread
+    explicit ContentIndexService(const Path& directory, size_t numThreads = 0);
+    ~ContentIndexService();
+
+    ContentIndexService(const ContentIndexService&) = delete;
+    ContentIndexService& operator=(const ContentIndexService&) = delete;
+
+    // queues loading or building the index of `root`, nothing happens if it has one already
+    void request(const std::string& root);
+    // forgets the index of `root` and deletes its files, stopping its build if it's the one running
+    void drop(const std::string& root);
+
+    // roots whose index is ready to be queried
+    std::vector<std::string> readyRoots() const;
+    // the root being loaded or built right now, empty if there's none
+    std::string busyRoot() const;
+
+    // Full paths of the files below `directory`, or below its entries `names` if any are given, that may match
+    // `query`, from the index of a root `directory` is in. False if there's no ready index there or the query wants
+    // files the index leaves out, grep has to walk then
+    bool findCandidates(const Path& directory, const std::vector<std::string>& names, const GrepQuery& query,
+                        std::vector<std::string>& out_Files) const;
+
+    // the file the index of `root` is kept in
+    Path indexPath(const std::string& root) const;
+
+private:
+    struct Request {
+        std::string root;
+        bool        isDrop = false;
+    };
+
+    void run();
+    void loadIndex(const std::string& root);
+    void dropIndex(const std::string& root);
+    // applies what the watches reported and saves indexes that piled up changes
+    void pollIndexes();
+
+    Path mDirectory;
+    WorkStealingPool mPool;
+
+    mutable std::mutex                              mIndexMutex;
+    std::unordered_map<std::string, ContentIndex>   mIndexes;
+
+    mutable std::mutex      mQueueMutex;
+    std::condition_variable mWakeCondition;
+    std::deque<Request>     mQueue;
+    std::string             mBusyRoot;
+    bool                    mAlive = true;
+
+    // stops the build in flight when its index is dropped or shutting down
+    std::atomic<bool>   mCancel{ false };
+
+    std::thread mThread;
+};
@@ -0,0 +1,728 @@
+#include "ContentSearch.h"
+#include "FileFinder.h"
+#include "FileSystem.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+inline static bool HasUpperCase(std::string_view text) {
+    for(char c : text) {
+        if(c >= 'A' && c <= 'Z') return true;
+    }
+    return false;
+}
+
+inline static void SplitNames(std::string_view text, std::vector<std::string>& out_Names) {
+    size_t start = 0;
+    while(start <= text.size()) {
+        size_t end = text.find(',', start);
+        if(end == std::string_view::npos) end = text.size();
+
+        if(end > start) out_Names.emplace_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+bool ParseGrepQuery(const std::vector<std::string>& args, GrepQuery& out_Query) {
+    GrepQuery query;
+    bool hasPattern = false;
+
+    for(const std::string& arg : args) {
+        if(!query.text.empty()) query.text.push_back(' ');
+        query.text.append(arg);
+
+        const std::string_view token(arg);
+        if(token.substr(0, 6) == "files=") {
+            SplitNames(token.substr(6), query.fileGlobs);
+        } else if(token.substr(0, 6) == "prune=") {
+            SplitNames(token.substr(6), query.pruneNames);
+        } else if(token == "noprune") {
+            query.useDefaultPrune = false;
+        } else {
+            if(hasPattern) return false;
+            hasPattern = true;
+
+            if(token.substr(0, 3) == "re:") {
+                query.isRegex = true;
+                query.pattern = token.substr(3);
+                query.isCaseSensitive = true;
+            } else {
+                query.pattern = token;
+                query.isCaseSensitive = HasUpperCase(token);
+            }
+        }
+    }
+
+    // every line would match, that's not a search
+    if(query.pattern.empty()) return false;
+    if(!GrepMatcher(query).isValid()) return false;
+
+    out_Query = std::move(query);
+    return true;
+}
+
+bool LooksBinary(std::string_view contents) {
+    return memchr(contents.data(), '\0', std::min(contents.size(), GREP_SNIFF_SIZE)) != nullptr;
+}
+
+// The longest run of plain characters every match of an ECMAScript `pattern` has to contain, empty if there's none
+// worth looking for. Runs inside groups and classes don't count, they may be optional, and neither does anything in a
+// pattern with an alternative in it
+inline static std::string RequiredRegexLiteral(std::string_view pattern) {
+    if(pattern.find('|') != std::string_view::npos) return std::string();
+
+    std::string longest;
+    std::string run;
+    const auto xEndRun = [&]() {
+        if(run.size() > longest.size()) longest = run;
+        run.clear();
+    };
+
+    int depth = 0;
+    for(size_t i = 0; i < pattern.size(); i++) {
+        const char c = pattern[i];
+        switch(c) {
+            case '\\':
+                // \d, \w, \b and friends aren't plain, an escaped punctuation character is but it's not worth telling apart
+                xEndRun();
+                i++;
+                break;
+            case '[':
+                xEndRun();
+                // a ] right after the opening bracket or its ^ is part of the class
+                i++;
+                if(i < pattern.size() && pattern[i] == '^') i++;
+                if(i < pattern.size() && pattern[i] == ']') i++;
+                while(i < pattern.size() && pattern[i] != ']') {
+                    if(pattern[i] == '\\') i++;
+                    i++;
+                }
+                break;
+            case '(':
+                xEndRun();
+                depth++;
+                break;
+            case ')':
+                xEndRun();
+                depth--;
+                break;
+            case '*':
+            case '?':
+            case '{':
+                // the character before may not be there at all
+                if(!run.empty()) run.pop_back();
+                xEndRun();
+                if(c == '{') {
+                    while(i < pattern.size() && pattern[i] != '}') i++;
+                }
+                break;
+            case '+':
+            case '.':
+            case '^':
+            case '$':
+                xEndRun();
+                break;
+            default:
+                if(depth == 0) {
+                    run.push_back(c);
+                }
+                break;
+        }
+    }
+    xEndRun();
+
+    // short runs match nearly every line of source code, the prefilter would only cost time
+    return longest.size() >= 3 ? longest : std::string();
+}
+
+GrepMatcher::GrepMatcher(const GrepQuery& query)
+    : mQuery(query) {
+    if(mQuery.isRegex) {
+        try {
+            mRegex = std::regex(mQuery.pattern, std::regex::ECMAScript | std::regex::optimize);
+        } catch(const std::regex_error& error) {
+            printf("[GREP] invalid regex '%s': %s\n", mQuery.pattern.c_str(), error.what());
+            mIsValid = false;
+        }
+        mLiteral = RequiredRegexLiteral(mQuery.pattern);
+        mLiteralCase = SubstringCase::Sensitive;
+    } else {
+        mLiteral = mQuery.pattern;
+        mLiteralCase = mQuery.isCaseSensitive ? SubstringCase::Sensitive : SubstringCase::AsciiInsensitive;
+    }
+}
+
+bool GrepMatcher::matchesFileName(std::string_view name) const {
+    if(mQuery.fileGlobs.empty()) return true;
+
+    for(const std::string& glob : mQuery.fileGlobs) {
+        if(GlobMatch(name, glob, true)) return true;
+    }
+    return false;
+}
+
+bool GrepMatcher::matchLine(std::string_view text, size_t lineBegin, size_t lineEnd, size_t& out_MatchBegin, size_t& out_MatchEnd) const {
+    if(!mQuery.isRegex) {
+        const size_t found = FindSubstring(text.substr(0, lineEnd), mLiteral, lineBegin, mLiteralCase);
+        if(found == std::string_view::npos) return false;
+
+        out_MatchBegin = found;
+        out_MatchEnd = found + mLiteral.size();
+        return true;
+    }
+
+    // windows in order, the first match of the earliest one is the first match of the line
+    std::cmatch match;
+    for(size_t windowBegin = lineBegin;; windowBegin += GREP_REGEX_WINDOW / 2) {
+        const size_t windowEnd = std::min(lineEnd, windowBegin + GREP_REGEX_WINDOW);
+
+        // ^, $ and \b still see the line around the window
+        auto flags = std::regex_constants::match_default;
+        if(windowBegin > lineBegin) flags |= std::regex_constants::match_not_bol | std::regex_constants::match_prev_avail;
+        if(windowEnd < lineEnd) flags |= std::regex_constants::match_not_eol;
+
+        if(std::regex_search(text.data() + windowBegin, text.data() + windowEnd, match, mRegex, flags)) {
+            out_MatchBegin = windowBegin + static_cast<size_t>(match.position(0));
+            out_MatchEnd = out_MatchBegin + static_cast<size_t>(match.length(0));
+            return true;
+        }
+        if(windowEnd == lineEnd) return false;
+    }
+}
+
+size_t GrepMatcher::searchText(std::string_view text, std::vector<GrepLineMatch>& out_Lines, size_t maxLines) const {
+    if(!mIsValid || maxLines == 0) return 0;
+
+    size_t numFound = 0;
+    // lines before `pos` are done with, it's always at the start of one
+    size_t pos = 0;
+    uint64_t lineNumber = 1;
+
+    // the end of the line `from` is in, at its '\n' or the end of the text
+    const auto xLineEnd = [&](size_t from) {
+        const void* newline = memchr(text.data() + from, '\n', text.size() - from);
+        return newline != nullptr ? static_cast<size_t>(static_cast<const char*>(newline) - text.data()) : text.size();
+    };
+
+    // tries the line [lineBegin, lineEnd), returns false once there are enough
+    const auto xTryLine = [&](size_t lineBegin, size_t lineEnd) {
+        // CRLF files show their lines without the CR
+        const size_t contentEnd = (lineEnd > lineBegin && text[lineEnd - 1] == '\r') ? lineEnd - 1 : lineEnd;
+
+        GrepLineMatch line;
+        if(!matchLine(text, lineBegin, contentEnd, line.matchBegin, line.matchEnd)) return true;
+
+        line.lineNumber = lineNumber;
+        line.lineBegin = lineBegin;
+        line.lineEnd = contentEnd;
+        out_Lines.push_back(line);
+        return ++numFound < maxLines;
+    };
+
+    if(mLiteral.empty()) {
+        // nothing to look for first, every line gets the regex
+        while(pos < text.size()) {
+            const size_t lineEnd = xLineEnd(pos);
+            if(!xTryLine(pos, lineEnd)) break;
+
+            pos = lineEnd + 1;
+            lineNumber++;
+        }
+        return numFound;
+    }
+
+    while(pos < text.size()) {
+        const size_t found = FindSubstring(text, mLiteral, pos, mLiteralCase);
+        if(found == std::string_view::npos) break;
+
+        // back to the start of the line the match is in, lines are short next to the gaps between matches
+        size_t lineBegin = found;
+        while(lineBegin > pos && text[lineBegin - 1] != '\n') {
+            lineBegin--;
+        }
+        lineNumber += CountNewlines(text.substr(pos, lineBegin - pos));
+
+        const size_t lineEnd = xLineEnd(found);
+        if(!xTryLine(lineBegin, lineEnd)) break;
+
+        pos = lineEnd + 1;
+        lineNumber++;
+    }
+    return numFound;
+}
+
+// everything below `mutex` is shared between the UI thread and the worker and guarded by it
+struct ContentSearcher::Worker {
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool alive = true;
+
+    // latest request from the UI thread
+    Path directory;
+    std::vector<std::string> names;
+    // searched instead of walking when `isListed`
+    std::vector<std::string> listedFiles;
+    bool isListed = false;
+    std::shared_ptr<const GrepMatcher> matcher;
+    std::vector<std::string> pruneNames;
+    bool searchRequested = false;
+    // bumped by every request, results of older ones are thrown away
+    std::atomic<uint64_t> generation{ 0 };
+    // stops the search in flight, cleared when the worker takes the next request
+    std::atomic<bool> cancel{ false };
+
+    // found since the last update(), always by the latest request
+    std::vector<GrepResult> results;
+    NameArena previews;
+    std::vector<std::string> files;
+    uint64_t numFilesSearched = 0;
+    uint64_t numBinaryFilesSkipped = 0;
+    uint64_t numBytesSearched = 0;
+    size_t numResults = 0;
+    bool isDone = false;
+    bool wasStopped = false;
+
+    // what one thread found in one directory before it's handed over
+    struct Scratch {
+        std::vector<char>           buffer;
+        std::vector<GrepLineMatch>  lines;
+
+        std::vector<GrepResult>     results;
+        NameArena                   previews;
+        std::vector<std::string>    files;
+        uint64_t                    numFilesSearched = 0;
+        uint64_t                    numBinaryFilesSkipped = 0;
+        uint64_t                    numBytesSearched = 0;
+    };
+
+    ~Worker();
+
+    void run();
+    void search(const Path& searchDirectory, const std::vector<std::string>& searchNames, const GrepMatcher& searchMatcher,
+                const std::vector<std::string>& searchPruneNames, uint64_t searchGeneration);
+    void searchListed(const std::vector<std::string>& searchFiles, const GrepMatcher& searchMatcher, uint64_t searchGeneration);
+    void searchFile(std::string path, const GrepMatcher& searchMatcher, Scratch& local);
+    // hands what `local` collected over to the UI thread and clears it
+    void flush(Scratch& local, uint64_t searchGeneration);
+};
+
+// searches of all widgets share one pool, it's rare for two to run at once
+inline static WorkStealingPool& SharedGrepPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+// listed files searched per task
+static constexpr size_t LISTED_CHUNK_SIZE = 32;
+
+inline static std::string JoinPath(std::string_view directory, std::string_view name) {
+    std::string path(directory);
+    if(!path.empty() && path.back() != Path::SEPARATOR) path.push_back(Path::SEPARATOR);
+    path.append(name);
+    return path;
+}
+
+ContentSearcher::Worker::~Worker() {
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        alive = false;
+        generation++;
+    }
+    cancel = true;
+    wake.notify_all();
+    thread.join();
+}
+
+void ContentSearcher::Worker::run() {
+    while(true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !alive || searchRequested; });
+
+        if(!alive) break;
+
+        searchRequested = false;
+        cancel = false;
+        const Path searchDirectory = directory;
+        const std::vector<std::string> searchNames = names;
+        const std::vector<std::string> searchFiles = std::move(listedFiles);
+        const bool searchIsListed = isListed;
+        const std::shared_ptr<const GrepMatcher> searchMatcher = std::move(matcher);
+        const std::vector<std::string> searchPruneNames = pruneNames;
+        const uint64_t searchGeneration = generation;
+        lock.unlock();
+
+        if(searchIsListed) {
+            searchListed(searchFiles, *searchMatcher, searchGeneration);
+        } else {
+            search(searchDirectory, searchNames, *searchMatcher, searchPruneNames, searchGeneration);
+        }
+    }
+}
+
+void ContentSearcher::Worker::searchFile(std::string path, const GrepMatcher& searchMatcher, Scratch& local) {
+    const Path filePath(path);
+
+    // small files in one read into a buffer that's reused, big ones mapped so they're never copied
+    uint64_t size = 0;
+    if(!FileSystem::readFile(filePath, local.buffer, MAP_MIN_SIZE, size)) return;
+
+    FileSystem::MappedFile mapped;
+    std::string_view text(local.buffer.data(), local.buffer.size());
+    if(size > MAP_MIN_SIZE) {
+        if(!mapped.open(filePath)) return;
+        text = std::string_view(mapped.data(), mapped.size());
+    }
+
+    local.numFilesSearched++;
+    if(LooksBinary(text)) {
+        local.numBinaryFilesSkipped++;
+        return;
+    }
+    local.numBytesSearched += text.size();
+
+    local.lines.clear();
+    if(searchMatcher.searchText(text, local.lines, MAX_RESULTS) == 0) return;
+
+    const uint32_t fileIdx = static_cast<uint32_t>(local.files.size());
+    local.files.push_back(std::move(path));
+
+    for(const GrepLineMatch& line : local.lines) {
+        // a long line is cut down to a window that starts a little before the match
+        size_t previewBegin = line.lineBegin;
+        size_t previewEnd = line.lineEnd;
+        if(previewEnd - previewBegin > MAX_PREVIEW_LENGTH) {
+            previewBegin = std::max(line.lineBegin, line.matchBegin - std::min(line.matchBegin, MAX_PREVIEW_LENGTH / 4));
+            previewEnd = std::min(line.lineEnd, previewBegin + MAX_PREVIEW_LENGTH);
+        }
+
+        GrepResult result;
+        result.file = fileIdx;
+        result.lineNumber = line.lineNumber;
+        result.matchBegin = static_cast<uint32_t>(line.matchBegin - previewBegin);
+        result.matchLength = static_cast<uint32_t>(std::min(line.matchEnd, previewEnd) - line.matchBegin);
+        local.results.push_back(result);
+        local.previews.add(text.substr(previewBegin, previewEnd - previewBegin));
+    }
+}
+
+void ContentSearcher::Worker::flush(Scratch& local, uint64_t searchGeneration) {
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if(generation == searchGeneration) {
+            numFilesSearched += local.numFilesSearched;
+            numBinaryFilesSkipped += local.numBinaryFilesSkipped;
+            numBytesSearched += local.numBytesSearched;
+
+            const size_t numFound = std::min(local.results.size(), MAX_RESULTS - std::min(numResults, MAX_RESULTS));
+            if(numFound > 0) {
+                const uint32_t fileBase = static_cast<uint32_t>(files.size());
+                const uint32_t numFiles = local.results[numFound - 1].file + 1;
+                for(uint32_t file = 0; file < numFiles; file++) {
+                    files.push_back(std::move(local.files[file]));
+                }
+                for(size_t i = 0; i < numFound; i++) {
+                    GrepResult result = local.results[i];
+                    result.file += fileBase;
+                    results.push_back(result);
+                    previews.add(std::string_view(&local.previews.arena[local.previews.offsets[i]], (i + 1 < local.previews.size()
+                        ? local.previews.offsets[i + 1] : local.previews.arena.size()) - local.previews.offsets[i] - 1));
+                }
+
+                numResults += numFound;
+                if(numResults >= MAX_RESULTS) {
+                    cancel = true;
+                }
+            }
+        }
+    }
+
+    local.results.clear();
+    local.previews.clear();
+    local.files.clear();
+    local.numFilesSearched = 0;
+    local.numBinaryFilesSkipped = 0;
+    local.numBytesSearched = 0;
+}
+
+void ContentSearcher::Worker::search(const Path& searchDirectory, const std::vector<std::string>& searchNames, const GrepMatcher& searchMatcher,
+                                     const std::vector<std::string>& searchPruneNames, uint64_t searchGeneration) {
+    WorkStealingPool& pool = SharedGrepPool();
+
+    // indexed by worker
+    std::vector<Scratch> scratch(pool.numThreads());
+
+    FileSystem::TraverseOptions options;
+    options.cancel = &cancel;
+    options.descend = [&](const FileSystem::TraverseBatch& batch, size_t recordIdx) {
+        const std::string_view name = batch.entries.getRecordName(recordIdx);
+        for(const std::string& pruneName : searchPruneNames) {
+            if(name == pruneName) return false;
+        }
+        return true;
+    };
+
+    const auto xSearchTree = [&](const Path& root) {
+        FileSystem::traverseDirectory(pool, root, options, [&](const FileSystem::TraverseBatch& batch) {
+            if(generation.load() != searchGeneration) return;
+
+            const FileSystem::SOARecord& entries = batch.entries;
+            Scratch& local = scratch[batch.workerIdx];
+
+            for(size_t i = 0; i < entries.nameOffsets.size() && !cancel.load(); i++) {
+                // a link to a directory isn't a directory here, reading it fails
+                if(entries.attributes[i] & FileSystem::FileAttributes::DIRECTORY) continue;
+
+                const std::string_view name = entries.getRecordName(i);
+                if(!searchMatcher.matchesFileName(name)) continue;
+
+                searchFile(JoinPath(batch.directory, name), searchMatcher, local);
+            }
+
+            flush(local, searchGeneration);
+        });
+    };
+
+    if(searchNames.empty()) {
+        xSearchTree(searchDirectory);
+    } else {
+        // selected files are searched here, selected directories walked like the whole tree
+        Scratch local;
+        for(const std::string& name : searchNames) {
+            if(cancel.load()) break;
+
+            FileSystem::EntryChange entry;
+            if(!FileSystem::getEntryInfo(searchDirectory, name, entry)) continue;
+
+            if(entry.attributes & FileSystem::FileAttributes::DIRECTORY) {
+                xSearchTree(Path(JoinPath(searchDirectory.str(), name)));
+            } else {
+                searchFile(JoinPath(searchDirectory.str(), name), searchMatcher, local);
+                flush(local, searchGeneration);
+            }
+        }
+    }
+
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != searchGeneration) return;
+
+    isDone = true;
+    wasStopped = cancel.load();
+}
+
+void ContentSearcher::Worker::searchListed(const std::vector<std::string>& searchFiles, const GrepMatcher& searchMatcher, uint64_t searchGeneration) {
+    WorkStealingPool& pool = SharedGrepPool();
+
+    // indexed by worker
+    std::vector<Scratch> scratch(pool.numThreads());
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t chunkStart = 0; chunkStart < searchFiles.size(); chunkStart += LISTED_CHUNK_SIZE) {
+        pool.submit(group, [&, chunkStart](size_t workerIdx) {
+            if(cancel.load() || generation.load() != searchGeneration) return;
+
+            Scratch& local = scratch[workerIdx];
+            const size_t chunkEnd = std::min(chunkStart + LISTED_CHUNK_SIZE, searchFiles.size());
+            for(size_t i = chunkStart; i < chunkEnd && !cancel.load(); i++) {
+                searchFile(searchFiles[i], searchMatcher, local);
+            }
+
+            flush(local, searchGeneration);
+        });
+    }
+    pool.wait(group);
+
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != searchGeneration) return;
+
+    isDone = true;
+    wasStopped = cancel.load();
+}
+
+ContentSearcher::ContentSearcher()
+    : mWorker(std::make_unique<Worker>()),
+    mPruneNames(DefaultPruneNames()) {
+    mWorker->thread = std::thread(&Worker::run, mWorker.get());
+}
+
+ContentSearcher::~ContentSearcher() = default;
+
+ContentSearcher::ContentSearcher(ContentSearcher&&) = default;
+ContentSearcher& ContentSearcher::operator=(ContentSearcher&&) = default;
+
+const std::vector<std::string>& ContentSearcher::DefaultPruneNames() {
+    return FileFinder::DefaultPruneNames();
+}
+
+void ContentSearcher::setPruneNames(const std::vector<std::string>& names) {
+    mPruneNames = names;
+}
+
+bool ContentSearcher::start(const Path& directory, const std::vector<std::string>& names, const GrepQuery& query) {
+    return startSearch(directory, names, std::vector<std::string>(), false, query);
+}
+
+bool ContentSearcher::startListed(const Path& directory, std::vector<std::string> files, const GrepQuery& query) {
+    return startSearch(directory, std::vector<std::string>(), std::move(files), true, query);
+}
+
+bool ContentSearcher::startSearch(const Path& directory, const std::vector<std::string>& names, std::vector<std::string> files, bool isListed,
+                                  const GrepQuery& query) {
+    auto matcher = std::make_shared<const GrepMatcher>(query);
+    if(directory.isEmpty() || query.pattern.empty() || !matcher->isValid()) return false;
+
+    std::vector<std::string> pruneNames = query.pruneNames;
+    if(query.useDefaultPrune) {
+        pruneNames.insert(pruneNames.end(), mPruneNames.begin(), mPruneNames.end());
+    }
+
+    mDirectory = directory;
+    mQuery = query;
+    mResults.clear();
+    mPreviews.clear();
+    mFiles.clear();
+    mNumFilesSearched = 0;
+    mNumBinaryFilesSkipped = 0;
+    mNumBytesSearched = 0;
+    mNumListedFiles = files.size();
+    mIsListed = isListed;
+    mIsActive = true;
+    mIsSearching = true;
+    mWasStopped = false;
+    mStartTime = std::chrono::steady_clock::now();
+
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mGeneration = ++mWorker->generation;
+        mWorker->cancel = true;
+
+        mWorker->directory = directory;
+        mWorker->names = names;
+        mWorker->listedFiles = std::move(files);
+        mWorker->isListed = isListed;
+        mWorker->matcher = std::move(matcher);
+        mWorker->pruneNames = std::move(pruneNames);
+        mWorker->searchRequested = true;
+
+        mWorker->results.clear();
+        mWorker->previews.clear();
+        mWorker->files.clear();
+        mWorker->numFilesSearched = 0;
+        mWorker->numBinaryFilesSkipped = 0;
+        mWorker->numBytesSearched = 0;
+        mWorker->numResults = 0;
+        mWorker->isDone = false;
+        mWorker->wasStopped = false;
+    }
+    mWorker->wake.notify_one();
+
+    return true;
+}
+
+void ContentSearcher::cancel() {
+    if(!mIsSearching) return;
+
+    // a request the worker didn't take yet is dropped, the worker clears the flag when it takes one
+    std::scoped_lock<std::mutex> lock(mWorker->mutex);
+    if(mWorker->searchRequested) {
+        mWorker->searchRequested = false;
+        mWorker->isDone = true;
+        mWorker->wasStopped = true;
+    } else {
+        mWorker->cancel = true;
+    }
+}
+
+void ContentSearcher::clear() {
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->generation++;
+        mWorker->cancel = true;
+        mWorker->searchRequested = false;
+        mWorker->results.clear();
+        mWorker->previews.clear();
+        mWorker->files.clear();
+        mWorker->listedFiles.clear();
+    }
+
+    mQuery = GrepQuery();
+    mResults.clear();
+    mPreviews.clear();
+    mFiles.clear();
+    mNumFilesSearched = 0;
+    mNumBinaryFilesSkipped = 0;
+    mNumBytesSearched = 0;
+    mNumListedFiles = 0;
+    mIsListed = false;
+    mIsActive = false;
+    mIsSearching = false;
+    mWasStopped = false;
+}
+
+bool ContentSearcher::update() {
+    if(!mIsSearching) return false;
+
+    std::scoped_lock<std::mutex> lock(mWorker->mutex);
+    Worker& worker = *mWorker;
+
+    bool changed = false;
+    mNumFilesSearched = worker.numFilesSearched;
+    mNumBinaryFilesSkipped = worker.numBinaryFilesSkipped;
+    mNumBytesSearched = worker.numBytesSearched;
+
+    if(!worker.results.empty()) {
+        const uint32_t fileBase = static_cast<uint32_t>(mFiles.size());
+        for(std::string& file : worker.files) {
+            mFiles.push_back(std::move(file));
+        }
+
+        // previews are NUL terminated back to back, the offsets move by what's there already
+        const uint32_t previewBase = static_cast<uint32_t>(mPreviews.arena.size());
+        mPreviews.arena.insert(mPreviews.arena.end(), worker.previews.arena.begin(), worker.previews.arena.end());
+        for(uint32_t offset : worker.previews.offsets) {
+            mPreviews.offsets.push_back(previewBase + offset);
+        }
+
+        for(GrepResult result : worker.results) {
+            result.file += fileBase;
+            mResults.push_back(result);
+        }
+
+        worker.results.clear();
+        worker.previews.clear();
+        worker.files.clear();
+        changed = true;
+    }
+
+    if(worker.isDone) {
+        mIsSearching = false;
+        mWasStopped = worker.wasStopped;
+        mEndTime = std::chrono::steady_clock::now();
+        changed = true;
+    }
+
+    return changed;
+}
+
+std::string_view ContentSearcher::preview(size_t i) const {
+    const size_t begin = mPreviews.offsets[i];
+    const size_t end = i + 1 < mPreviews.size() ? mPreviews.offsets[i + 1] : mPreviews.arena.size();
+    return std::string_view(&mPreviews.arena[begin], end - begin - 1);
+}
+
+double ContentSearcher::elapsedSeconds() const {
+    const auto end = mIsSearching ? std::chrono::steady_clock::now() : mEndTime;
+    return std::chrono::duration<double>(end - mStartTime).count();
+}
+
+double ContentSearcher::bytesPerSecond() const {
+    const double seconds = elapsedSeconds();
+    return seconds > 0.0 ? static_cast<double>(mNumBytesSearched) / seconds : 0.0;
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Path.h"
+#include "SubstringSearch.h"
+
+// What the `grep` command looks for in the contents of files
+struct GrepQuery {
+    // a literal, or a std::regex ECMAScript that's matched line by line when `isRegex`
+    std::string pattern;
+    bool isRegex = false;
+    // smart case for literals like FindQuery, regexes are taken as written
+    bool isCaseSensitive = false;
+
+    // globs of the file names to look in, every file when there are none
+    std::vector<std::string> fileGlobs;
+    // directory names that aren't walked into on top of the searcher's own, or instead of them without the defaults
+    std::vector<std::string> pruneNames;
+    bool useDefaultPrune = true;
+
+    // the arguments as typed, to show what the results are for
+    std::string text;
+};
+
+// Parses `grep` arguments: a pattern and any of
+//   files=*.cpp,*.h        only look in files with names matching one of these globs
+//   prune=build,out        more directory names not to walk into
+//   noprune                walk into the directories the searcher prunes by default too
+// The pattern is a regex after "re:" and a literal otherwise. Returns false for no pattern, arguments it doesn't
+// understand, a second pattern or a bad regex
+bool ParseGrepQuery(const std::vector<std::string>& args, GrepQuery& out_Query);
+
+// how much of the start of a file is sniffed for binary content
+static constexpr size_t GREP_SNIFF_SIZE = 8 * 1024;
+
+// std::regex recurses once per character or more, a line of a minified file takes a 1 MB stack down at a few KB.
+// Longer lines are tried in windows this long that overlap by half, a match has to fit in half a window
+static constexpr size_t GREP_REGEX_WINDOW = 1024;
+
+// a NUL in the sniffed start of a file makes it binary, the same test git and grep use
+bool LooksBinary(std::string_view contents);
+
+// a line of a file with a match in it, offsets into the text that was searched
+struct GrepLineMatch {
+    // starting at 1
+    uint64_t    lineNumber;
+    size_t      lineBegin;
+    // at the '\n' or the end of the text, a '\r' before it is left out
+    size_t      lineEnd;
+    // the first match of the line
+    size_t      matchBegin;
+    size_t      matchEnd;
+};
+
+// A GrepQuery ready to search texts with from several threads at once
+class GrepMatcher {
+public:
+    explicit GrepMatcher(const GrepQuery& query);
+
+    // false if the query is a regex that doesn't compile, nothing matches then
+    inline bool isValid() const { return mIsValid; }
+
+    bool matchesFileName(std::string_view name) const;
+    // a run of characters every match contains, empty if the query has none worth looking for
+    inline const std::string& literal() const { return mLiteral; }
+
+    // Appends the lines of `text` that match, in order, until `maxLines` were appended. A literal is looked for in
+    // the whole text at once with FindSubstring and only the lines it turns up in are looked at, newlines before a
+    // match are counted with CountNewlines. A regex gets the same treatment when it has a run of plain characters
+    // every match contains, otherwise it's tried on every line, long lines GREP_REGEX_WINDOW at a time. Returns the
+    // number of lines appended
+    size_t searchText(std::string_view text, std::vector<GrepLineMatch>& out_Lines, size_t maxLines = SIZE_MAX) const;
+
+private:
+    // the first match in line [lineBegin, lineEnd), false if there's none
+    bool matchLine(std::string_view text, size_t lineBegin, size_t lineEnd, size_t& out_MatchBegin, size_t& out_MatchEnd) const;
+
+    GrepQuery mQuery;
+    std::regex mRegex;
+    // looked for across the whole text before anything is matched line by line, empty if there's nothing to look for
+    std::string mLiteral;
+    SubstringCase mLiteralCase = SubstringCase::Sensitive;
+    bool mIsValid = true;
+};
+
+// A line of a file that matched, as ContentSearcher hands it out
+struct GrepResult {
+    // into ContentSearcher::filePath()
+    uint32_t    file;
+    uint64_t    lineNumber;
+    // the matched part of preview()
+    uint32_t    matchBegin;
+    uint32_t    matchLength;
+};
+
+// Runs `grep` below a directory or over some of its entries. The tree is walked on a shared pool with a task per
+// directory and the files of a directory are searched on the task that read it: small ones read into a buffer of the
+// worker's in one go, big ones mapped. Files that look binary are skipped. Matching lines are handed to update()
+// directory by directory, so the first ones show while the rest of the tree is still being searched. A new search
+// cancels the one in flight, results of a cancelled one stay
+class ContentSearcher {
+public:
+    // a search stops once it has this many matching lines
+    static constexpr size_t MAX_RESULTS = 200000;
+    // files up to this size are read, bigger ones mapped
+    static constexpr uint64_t MAP_MIN_SIZE = 1024 * 1024;
+    // the part of a long line kept around its match
+    static constexpr size_t MAX_PREVIEW_LENGTH = 200;
+
+    ContentSearcher();
+    ~ContentSearcher();
+
+    ContentSearcher(ContentSearcher&&);
+    ContentSearcher& operator=(ContentSearcher&&);
+
+    // the same as FileFinder's
+    static const std::vector<std::string>& DefaultPruneNames();
+    void setPruneNames(const std::vector<std::string>& names);
+    inline const std::vector<std::string>& pruneNames() const { return mPruneNames; }
+
+    // Drops the results so far and starts looking for `query` in the files below `directory`, or only in entries
+    // `names` of it and below them if any are given. False if the query can't match
+    bool start(const Path& directory, const std::vector<std::string>& names, const GrepQuery& query);
+    // The same for exactly `files`, full paths below `directory`, instead of walking for them. For the candidates a
+    // ContentIndex turned up, they're searched in chunks spread over the pool
+    bool startListed(const Path& directory, std::vector<std::string> files, const GrepQuery& query);
+    // stops the search, the results found so far stay
+    void cancel();
+    // cancels and drops the results
+    void clear();
+
+    // picks up the matches found since the last call, returns true if there were any or the search finished
+    bool update();
+
+    // true from start() until clear()
+    inline bool isActive() const { return mIsActive; }
+    inline bool isSearching() const { return mIsSearching; }
+    // true if the search stopped early, cancelled or at MAX_RESULTS
+    inline bool wasStopped() const { return mWasStopped; }
+
+    inline const Path& directory() const { return mDirectory; }
+    // true if the search was handed its files by startListed()
+    inline bool isListed() const { return mIsListed; }
+    inline size_t numListedFiles() const { return mNumListedFiles; }
+    inline const GrepQuery& query() const { return mQuery; }
+
+    inline size_t numResults() const { return mResults.size(); }
+    // in the order they were found, the lines of one file together and in order
+    inline const GrepResult& result(size_t i) const { return mResults[i]; }
+    // the line of result `i`, cut down around the match if it's long
+    std::string_view preview(size_t i) const;
+    inline const std::string& filePath(uint32_t file) const { return mFiles[file]; }
+
+    inline uint64_t numFilesSearched() const { return mNumFilesSearched; }
+    inline uint64_t numBinaryFilesSkipped() const { return mNumBinaryFilesSkipped; }
+    inline uint64_t numBytesSearched() const { return mNumBytesSearched; }
+    // since start(), up to when the search ended once it did
+    double elapsedSeconds() const;
+    // bytes searched per second so far
+    double bytesPerSecond() const;
+
+private:
+    struct Worker;
+
+    bool startSearch(const Path& directory, const std::vector<std::string>& names, std::vector<std::string> files, bool isListed, const GrepQuery& query);
+
+    std::unique_ptr<Worker> mWorker;
+
+    Path mDirectory;
+    GrepQuery mQuery;
+    std::vector<std::string> mPruneNames;
+
+    std::vector<GrepResult> mResults;
+    // one per result
+    NameArena mPreviews;
+    std::vector<std::string> mFiles;
+
+    uint64_t mNumFilesSearched = 0;
+    uint64_t mNumBinaryFilesSkipped = 0;
+    uint64_t mNumBytesSearched = 0;
+    size_t mNumListedFiles = 0;
+    bool mIsListed = false;
+
+    // results tagged with older generations belong to searches that were replaced
+    uint64_t mGeneration = 0;
+    bool mIsActive = false;
+    bool mIsSearching = false;
+    bool mWasStopped = false;
+
+    std::chrono::steady_clock::time_point mStartTime;
+    std::chrono::steady_clock::time_point mEndTime;
+};
@@ -0,0 +1,145 @@
+#include "DirectoryCache.h"
+
+#include <chrono>
+
+// how often a waiting acquire() checks whether its caller still wants the result
+static constexpr std::chrono::milliseconds ACQUIRE_POLL_INTERVAL(10);
+
+DirectoryCache::DirectoryCache(size_t capacityBytes)
+    : mCapacity(capacityBytes) {
+}
+
+DirectoryCache& DirectoryCache::shared() {
+    static DirectoryCache cache;
+    return cache;
+}
+
+DirectoryCache::Snapshot DirectoryCache::find(const std::string& path, uint64_t changeStamp) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    auto it = mEntries.find(path);
+    if(it == mEntries.end() || it->second.snapshot == nullptr || it->second.changeStamp != changeStamp) return nullptr;
+
+    touch(it->second);
+    return it->second.snapshot;
+}
+
+DirectoryCache::Snapshot DirectoryCache::acquire(const std::string& path, uint64_t changeStamp, const std::function<bool()>& isCancelled, bool& out_ShouldLoad) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    out_ShouldLoad = false;
+
+    while(true) {
+        auto it = mEntries.find(path);
+        if(it == mEntries.end()) {
+            // nobody has it, the caller loads it
+            Entry& entry = mEntries[path];
+            entry.isLoading = true;
+            mLru.push_front(path);
+            entry.lruPosition = mLru.begin();
+            out_ShouldLoad = true;
+            return nullptr;
+        }
+
+        Entry& entry = it->second;
+        if(!entry.isLoading) {
+            if(entry.snapshot != nullptr && entry.changeStamp == changeStamp) {
+                touch(entry);
+                return entry.snapshot;
+            }
+
+            // stale, the caller reloads it while the old snapshot stays up for others
+            entry.isLoading = true;
+            out_ShouldLoad = true;
+            return nullptr;
+        }
+
+        if(isCancelled && isCancelled()) return nullptr;
+        mLoaded.wait_for(lock, ACQUIRE_POLL_INTERVAL);
+    }
+}
+
+void DirectoryCache::insert(const std::string& path, uint64_t changeStamp, Snapshot snapshot) {
+    {
+        std::scoped_lock<std::mutex> lock(mMutex);
+
+        auto it = mEntries.find(path);
+        if(it == mEntries.end()) {
+            it = mEntries.emplace(path, Entry{}).first;
+            mLru.push_front(path);
+            it->second.lruPosition = mLru.begin();
+        }
+
+        Entry& entry = it->second;
+        mMemoryUsage -= entry.bytes;
+
+        entry.bytes = snapshot != nullptr ? snapshot->memoryUsage() : 0;
+        entry.snapshot = std::move(snapshot);
+        entry.changeStamp = changeStamp;
+        entry.isLoading = false;
+
+        mMemoryUsage += entry.bytes;
+        touch(entry);
+        evict();
+    }
+    mLoaded.notify_all();
+}
+
+void DirectoryCache::abandon(const std::string& path) {
+    {
+        std::scoped_lock<std::mutex> lock(mMutex);
+
+        auto it = mEntries.find(path);
+        if(it == mEntries.end()) return;
+
+        Entry& entry = it->second;
+        entry.isLoading = false;
+
+        // nothing was ever loaded, don't keep an empty placeholder around
+        if(entry.snapshot == nullptr) {
+            mLru.erase(entry.lruPosition);
+            mEntries.erase(it);
+        }
+    }
+    mLoaded.notify_all();
+}
+
+void DirectoryCache::setCapacity(size_t capacityBytes) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+    mCapacity = capacityBytes;
+    evict();
+}
+
+size_t DirectoryCache::memoryUsage() const {
+    std::scoped_lock<std::mutex> lock(mMutex);
+    return mMemoryUsage;
+}
+
+size_t DirectoryCache::numSnapshots() const {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    size_t count = 0;
+    for(const auto& [path, entry] : mEntries) {
+        count += entry.snapshot != nullptr;
+    }
+    return count;
+}
+
+void DirectoryCache::touch(Entry& entry) {
+    mLru.splice(mLru.begin(), mLru, entry.lruPosition);
+}
+
+void DirectoryCache::evict() {
+    // least recently used first, entries that are being loaded stay so their waiters get the result
+    auto it = mLru.end();
+    while(mMemoryUsage > mCapacity && it != mLru.begin()) {
+        --it;
+
+        auto entryIt = mEntries.find(*it);
+        Entry& entry = entryIt->second;
+        if(entry.isLoading) continue;
+
+        mMemoryUsage -= entry.bytes;
+        it = mLru.erase(it);
+        mEntries.erase(entryIt);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "FileSystem.h"
+
+// Process wide LRU of directory listings, keyed by path and bounded by memory. Listings are immutable snapshots
+// shared by reference count, a snapshot that's evicted stays alive for whoever still holds it.
+// A snapshot is only handed out while the change stamp it was taken with still matches the directory's
+class DirectoryCache {
+public:
+    using Snapshot = std::shared_ptr<const FileSystem::SOARecord>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024 * 1024;
+
+    explicit DirectoryCache(size_t capacityBytes = DEFAULT_CAPACITY);
+
+    static DirectoryCache& shared();
+
+    // valid snapshot of `path`, or null
+    Snapshot find(const std::string& path, uint64_t changeStamp);
+
+    // like find, but if another thread is loading `path` right now this waits for its result instead of
+    // enumerating the same directory twice. Returns null with `out_ShouldLoad` set when the caller is expected to
+    // load the directory and finish with insert() or abandon(). `isCancelled` is polled while waiting
+    Snapshot acquire(const std::string& path, uint64_t changeStamp, const std::function<bool()>& isCancelled, bool& out_ShouldLoad);
+
+    void insert(const std::string& path, uint64_t changeStamp, Snapshot snapshot);
+
+    // the load acquire() asked for isn't coming, wakes up anyone waiting on it
+    void abandon(const std::string& path);
+
+    void setCapacity(size_t capacityBytes);
+
+    size_t memoryUsage() const;
+    size_t numSnapshots() const;
+
+private:
+    struct Entry {
+        Snapshot    snapshot;
+        uint64_t    changeStamp = 0;
+        size_t      bytes = 0;
+        bool        isLoading = false;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    void touch(Entry& entry);
+    void evict();
+
+    mutable std::mutex                      mMutex;
+    std::condition_variable                 mLoaded;
+    std::unordered_map<std::string, Entry>  mEntries;
+    // most recently used at the front
+    std::list<std::string>                  mLru;
+
+    size_t mCapacity;
+    size_t mMemoryUsage = 0;
+};
@@ -0,0 +1,217 @@
+#include "DirectoryTree.h"
+#include "Path.h"
+#include "WorkStealingPool.h"
+
+#include <mutex>
+#include <string.h>
+
+namespace FileSystem {
+
+// what the traversal callbacks collect, in whatever order the batches arrive. build() reorders it into level order
+struct TreeStaging {
+    std::vector<char>       nameArena;
+    std::vector<uint32_t>   nameOffsets;
+    std::vector<uint16_t>   nameLengths;
+    std::vector<uint32_t>   parents;
+    std::vector<uint8_t>    attributes;
+    std::vector<uint16_t>   depths;
+    std::vector<uint64_t>   sizes;
+    std::vector<uint64_t>   lastModifiedNumbers;
+
+    std::vector<uint32_t>   firstChildren;
+    std::vector<uint32_t>   numChildren;
+
+    // staging index of the first entry of every batch, by directory id
+    std::vector<uint32_t>   batchStarts;
+
+    void add(std::string_view name, uint32_t parent, int attribute, int depth, uint64_t size, uint64_t lastModifiedNumber, bool keepSize, bool keepTime) {
+        const size_t offset = nameArena.size();
+        nameArena.resize(offset + name.size() + 1);
+        memcpy(&nameArena[offset], name.data(), name.size());
+        nameArena[offset + name.size()] = '\0';
+
+        nameOffsets.push_back(static_cast<uint32_t>(offset));
+        nameLengths.push_back(static_cast<uint16_t>(name.size()));
+        parents.push_back(parent);
+        attributes.push_back(static_cast<uint8_t>(attribute));
+        depths.push_back(static_cast<uint16_t>(depth));
+        firstChildren.push_back(0);
+        numChildren.push_back(0);
+
+        if(keepSize) sizes.push_back(size);
+        if(keepTime) lastModifiedNumbers.push_back(lastModifiedNumber);
+    }
+};
+
+bool DirectoryTree::build(WorkStealingPool& pool, const Path& path, const TraverseOptions& options) {
+    clear();
+
+    const bool keepSize = options.fields & ENUMERATE_SIZE;
+    const bool keepTime = options.fields & ENUMERATE_LAST_MODIFIED;
+
+    TreeStaging staging;
+    staging.add(path.str(), NO_NODE, FileAttributes::DIRECTORY, 0, 0, 0, keepSize, keepTime);
+
+    std::mutex stagingMutex;
+
+    bool success = traverseDirectory(pool, path, options, [&](const TraverseBatch& batch) {
+        const SOARecord& entries = batch.entries;
+        const uint32_t numEntries = static_cast<uint32_t>(entries.nameOffsets.size());
+
+        std::scoped_lock<std::mutex> lock(stagingMutex);
+
+        // the parent's batch is always in already, so the directory's own node can be looked up
+        const uint32_t directoryNode = batch.parentId == NO_TRAVERSE_PARENT ? ROOT : staging.batchStarts[batch.parentId] + batch.entryInParent;
+        const uint32_t firstEntry = static_cast<uint32_t>(staging.parents.size());
+
+        if(staging.batchStarts.size() <= batch.directoryId) {
+            staging.batchStarts.resize(batch.directoryId + 1, NO_NODE);
+        }
+        staging.batchStarts[batch.directoryId] = firstEntry;
+
+        staging.firstChildren[directoryNode] = firstEntry;
+        staging.numChildren[directoryNode] = numEntries;
+
+        for(uint32_t i = 0; i < numEntries; i++) {
+            staging.add(entries.getRecordName(i), directoryNode, entries.attributes[i], batch.depth + 1,
+                    entries.sizes[i], entries.lastModifiedNumbers[i], keepSize, keepTime);
+        }
+    });
+
+    if(!success) return false;
+
+    // breadth first from the root, new index = position in `order`
+    const size_t numNodes = staging.parents.size();
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> newIndexes(numNodes);
+    order.reserve(numNodes);
+    order.push_back(ROOT);
+
+    mFirstChildren.resize(numNodes);
+    mNumChildren.resize(numNodes);
+
+    for(size_t i = 0; i < order.size(); i++) {
+        const uint32_t node = order[i];
+        newIndexes[node] = static_cast<uint32_t>(i);
+
+        mFirstChildren[i] = static_cast<uint32_t>(order.size());
+        mNumChildren[i] = staging.numChildren[node];
+
+        const uint32_t firstChild = staging.firstChildren[node];
+        for(uint32_t child = firstChild; child < firstChild + staging.numChildren[node]; child++) {
+            order.push_back(child);
+        }
+    }
+
+    mNameArena.reserve(staging.nameArena.size());
+    mNameOffsets.reserve(numNodes);
+    mNameLengths.reserve(numNodes);
+    mParents.reserve(numNodes);
+    mAttributes.reserve(numNodes);
+    mDepths.reserve(numNodes);
+    if(keepSize) mSizes.reserve(numNodes);
+    if(keepTime) mLastModifiedNumbers.reserve(numNodes);
+
+    for(uint32_t node : order) {
+        const uint32_t offset = static_cast<uint32_t>(mNameArena.size());
+        const uint16_t length = staging.nameLengths[node];
+        const char* name = &staging.nameArena[staging.nameOffsets[node]];
+        mNameArena.insert(mNameArena.end(), name, name + length + 1);
+
+        mNameOffsets.push_back(offset);
+        mNameLengths.push_back(length);
+        mParents.push_back(staging.parents[node] == NO_NODE ? NO_NODE : newIndexes[staging.parents[node]]);
+        mAttributes.push_back(staging.attributes[node]);
+        mDepths.push_back(staging.depths[node]);
+        if(keepSize) mSizes.push_back(staging.sizes[node]);
+        if(keepTime) mLastModifiedNumbers.push_back(staging.lastModifiedNumbers[node]);
+
+        if(mDepthStarts.size() <= mDepths.back()) {
+            mDepthStarts.push_back(static_cast<uint32_t>(mParents.size() - 1));
+        }
+    }
+    mDepthStarts.push_back(static_cast<uint32_t>(mParents.size()));
+
+    return true;
+}
+
+void DirectoryTree::clear() {
+    mNameArena.clear();
+    mNameOffsets.clear();
+    mNameLengths.clear();
+    mParents.clear();
+    mAttributes.clear();
+    mDepths.clear();
+    mFirstChildren.clear();
+    mNumChildren.clear();
+    mSizes.clear();
+    mLastModifiedNumbers.clear();
+    mDepthStarts.clear();
+}
+
+DirectoryTree::NodeRange DirectoryTree::getDepthRange(int depth) const {
+    if(depth < 0 || depth + 1 >= static_cast<int>(mDepthStarts.size())) {
+        return { 0, 0 };
+    }
+
+    return { mDepthStarts[depth], mDepthStarts[depth + 1] };
+}
+
+void DirectoryTree::buildPath(uint32_t node, std::string& out) const {
+    // only the root path can end in a separator, e.g. "/" or "C:\"
+    const std::string_view rootName = getName(ROOT);
+    const bool rootHasSeparator = !rootName.empty() && rootName.back() == Path::SEPARATOR;
+
+    // walk up twice, once to measure and once to fill the string back to front
+    size_t length = 0;
+    for(uint32_t current = node; current != ROOT; current = mParents[current]) {
+        length += mNameLengths[current] + 1;
+    }
+    length += rootName.size();
+    if(node != ROOT && rootHasSeparator) length--;
+
+    out.resize(length);
+
+    size_t end = length;
+    for(uint32_t current = node; current != ROOT; current = mParents[current]) {
+        const std::string_view name = getName(current);
+        end -= name.size();
+        memcpy(&out[end], name.data(), name.size());
+
+        if(mParents[current] != ROOT || !rootHasSeparator) {
+            out[--end] = Path::SEPARATOR;
+        }
+    }
+    memcpy(&out[0], rootName.data(), rootName.size());
+}
+
+std::string DirectoryTree::getPath(uint32_t node) const {
+    std::string result;
+    buildPath(node, result);
+    return result;
+}
+
+void DirectoryTree::search(std::string_view needle, std::vector<uint32_t>& out_Nodes) const {
+    // the root's name is the whole path, it's not a match candidate
+    for(uint32_t node = ROOT + 1; node < mParents.size(); node++) {
+        if(getName(node).find(needle) != std::string_view::npos) {
+            out_Nodes.push_back(node);
+        }
+    }
+}
+
+size_t DirectoryTree::memoryUsage() const {
+    return mNameArena.capacity()
+        + mNameOffsets.capacity()           * sizeof(uint32_t)
+        + mNameLengths.capacity()           * sizeof(uint16_t)
+        + mParents.capacity()               * sizeof(uint32_t)
+        + mAttributes.capacity()            * sizeof(uint8_t)
+        + mDepths.capacity()                * sizeof(uint16_t)
+        + mFirstChildren.capacity()         * sizeof(uint32_t)
+        + mNumChildren.capacity()           * sizeof(uint32_t)
+        + mSizes.capacity()                 * sizeof(uint64_t)
+        + mLastModifiedNumbers.capacity()   * sizeof(uint64_t)
+        + mDepthStarts.capacity()           * sizeof(uint32_t);
+}
+
+}
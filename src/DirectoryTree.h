@@ -0,0 +1,93 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "FileSystem.h"
+
+class Path;
+class WorkStealingPool;
+
+namespace FileSystem {
+
+    // Flat result of a recursive walk. A node is a parent index, a name in a shared arena and its attributes,
+    // full paths are only put together when asked for. Nodes are kept in level order: a parent always comes
+    // before its children, the children of a directory are contiguous and every depth is one contiguous range.
+    // So a forward loop visits parents first (copy order) and a backward loop children first (delete order)
+    class DirectoryTree {
+    public:
+        static constexpr uint32_t NO_NODE = UINT32_MAX;
+        static constexpr uint32_t ROOT = 0;
+
+        struct NodeRange {
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        // walks `path` on `pool` and replaces the tree with the result. Sizes and times are only kept
+        // when `options.fields` asks for them
+        bool build(WorkStealingPool& pool, const Path& path, const TraverseOptions& options = TraverseOptions{});
+
+        void clear();
+
+        inline size_t   size() const                        { return mParents.size(); }
+        inline bool     isEmpty() const                     { return mParents.empty(); }
+
+        // the root's name is the full path the tree was built from
+        inline std::string_view getName(uint32_t node) const        { return std::string_view(&mNameArena[mNameOffsets[node]], mNameLengths[node]); }
+        inline uint32_t         getParent(uint32_t node) const      { return mParents[node]; }
+        inline int              getAttributes(uint32_t node) const  { return mAttributes[node]; }
+        inline bool             isDirectory(uint32_t node) const    { return mAttributes[node] & FileAttributes::DIRECTORY; }
+        inline int              getDepth(uint32_t node) const       { return mDepths[node]; }
+        inline uint64_t         getSize(uint32_t node) const        { return mSizes.empty() ? 0 : mSizes[node]; }
+        inline uint64_t         getLastModifiedNumber(uint32_t node) const { return mLastModifiedNumbers.empty() ? 0 : mLastModifiedNumbers[node]; }
+
+        inline NodeRange        getChildren(uint32_t node) const    { return { mFirstChildren[node], mFirstChildren[node] + mNumChildren[node] }; }
+
+        // depth 0 is the root alone, depth 1 its entries and so on. Empty past the deepest level
+        NodeRange getDepthRange(int depth) const;
+        inline int getMaxDepth() const { return static_cast<int>(mDepthStarts.size()) - 2; }
+
+        // writes the full path of `node` into `out`, reusing its capacity
+        void buildPath(uint32_t node, std::string& out) const;
+        std::string getPath(uint32_t node) const;
+
+        // pre-order walk of `node` and everything below it. `fn(uint32_t node)` returns false to skip a node's children
+        template<typename Fn>
+        void forEachInSubtree(uint32_t node, Fn&& fn) const {
+            std::vector<uint32_t> stack = { node };
+            while(!stack.empty()) {
+                const uint32_t current = stack.back();
+                stack.pop_back();
+
+                if(!fn(current)) continue;
+
+                const NodeRange children = getChildren(current);
+                for(uint32_t child = children.end; child > children.begin; child--) {
+                    stack.push_back(child - 1);
+                }
+            }
+        }
+
+        // nodes whose name contains `needle`, in level order
+        void search(std::string_view needle, std::vector<uint32_t>& out_Nodes) const;
+
+        // bytes held by the tree including unused capacity
+        size_t memoryUsage() const;
+
+    private:
+        std::vector<char>       mNameArena;
+        std::vector<uint32_t>   mNameOffsets;
+        std::vector<uint16_t>   mNameLengths;
+        std::vector<uint32_t>   mParents;
+        std::vector<uint8_t>    mAttributes;
+        std::vector<uint16_t>   mDepths;
+        std::vector<uint32_t>   mFirstChildren;
+        std::vector<uint32_t>   mNumChildren;
+        std::vector<uint64_t>   mSizes;
+        std::vector<uint64_t>   mLastModifiedNumbers;
+
+        // depth d covers [mDepthStarts[d], mDepthStarts[d + 1])
+        std::vector<uint32_t>   mDepthStarts;
+    };
+}
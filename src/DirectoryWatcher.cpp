@@ -1,79 +1,677 @@
 #include "DirectoryWatcher.h"
 #include "Path.h"
 #include "FileSystem.h"
+#include "FolderSizeService.h"
+#include "DirectoryCache.h"
+#include "WatchRegistry.h"
+#include "WorkStealingPool.h"
 #include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <utility>
+#include <algorithm>
 
-#ifndef WIN32_LEAN_AND_MEAN
-    #define WIN32_LEAN_AND_MEAN
-#endif
-#include <windows.h>
+// entries the worker enumerates between cancellation checks and hand-offs to the UI thread
+static constexpr size_t ENUMERATION_CHUNK_SIZE = 4096;
+// past this many changed entries a refresh enumerates the directory again instead of looking each one up
+static constexpr size_t MAX_REFRESH_CHANGES = 1024;
+// rows assumed on screen until the UI thread reports what it actually shows
+static constexpr size_t DEFAULT_VISIBLE_ROWS = 64;
 
+enum class WorkerResult {
+    NONE,
+    LISTING,        // a complete, sorted listing is waiting in `ready`
+    ORDER,          // only the sort order changed, new indexes are waiting in `ready.indexes`
+    FAILED,         // the directory couldn't be opened
+};
 
-bool DirectoryWatcher::update() {
+// everything below `mutex` is shared between the UI thread and the worker and guarded by it,
+// `back` and `enumerator` belong to the worker alone. Listings themselves come from DirectoryCache::shared()
+struct DirectoryWatcher::Worker {
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool alive = true;
+
+    // latest request from the UI thread
+    Path directory;
+    std::vector<FileSystem::SortKey> sortKeys = { DEFAULT_SORT_KEY };
+    bool loadRequested = false;
+    bool refreshRequested = false;
+    bool sortRequested = false;
+    bool streamEntries = false;
+    // bumped by every request, the worker compares against them between chunks to drop stale work
+    std::atomic<uint64_t> loadGeneration{ 0 };
+    std::atomic<uint64_t> sortGeneration{ 0 };
+    // set by requests that make the sort in flight pointless (another directory, other keys), which then stops
+    // between passes. Cleared whenever the worker picks up the keys to sort by
+    std::atomic<bool> cancelSort{ false };
+
+    // entries of the load in flight that the UI thread hasn't picked up yet
+    FileSystem::SOARecord streamed;
+    uint64_t streamedGeneration = 0;
+
+    // finished work waiting for the next update()
+    WorkerResult result = WorkerResult::NONE;
+    FileSystem::SOARecord ready;
+    uint64_t resultLoadGeneration = 0;
+    uint64_t resultSortGeneration = 0;
+    // generation of the directory's watch the listing was taken at, 0 if it isn't watched
+    uint64_t resultWatchGeneration = 0;
+
+    // changes to the listing the UI thread already has, applied to both sides so neither copies the whole listing.
+    // Both apply the same changes in the same order, so records keep the same positions in the columns and
+    // `ready.indexes` from either side stays valid for the other
+    struct Delta {
+        std::vector<FileSystem::EntryChange>    changes;
+        std::vector<FileSystem::SortKey>        sortKeys;
+    };
+    std::vector<Delta> deltas;
+    uint64_t deltasLoadGeneration = 0;
+
+    FileSystem::SOARecord back;
+    // what `back` is sorted by and the watch generation it's up to date with, 0 if it can't be patched
+    std::vector<FileSystem::SortKey> backSortKeys;
+    uint64_t backWatchGeneration = 0;
+    FileSystem::DirectoryEnumerator enumerator;
+    FolderSizeService* folderSizes = nullptr;
+    // big sorts go to the shared sort pool while this is null
+    std::atomic<WorkStealingPool*> sortPool{ nullptr };
+    // listings this big are sorted on the shared sort pool
+    std::atomic<size_t> parallelSortThreshold{ FileSystem::PARALLEL_SORT_THRESHOLD };
+    // listings this big hand over the rows on screen from a partial sort first, see sortInStages
+    std::atomic<size_t> partialSortThreshold{ FileSystem::PARTIAL_SORT_THRESHOLD };
+    // rows the UI thread last showed
+    std::atomic<size_t> firstVisibleRow{ 0 };
+    std::atomic<size_t> numVisibleRows{ DEFAULT_VISIBLE_ROWS };
+    // the subscription with WatchRegistry::shared() is held here so it stays open across reloads
+    std::string watchedPath;
+    bool isWatching = false;
+
+    ~Worker();
+
+    void run();
+    void load(const Path& dir, bool stream, uint64_t generation);
+    void refresh(const Path& dir, uint64_t generation);
+    bool enumerate(const Path& dir, bool stream, uint64_t generation, FileSystem::SOARecord& out_Listing);
+    bool watch(const Path& dir, uint64_t& out_Generation);
+    void unwatch();
+    void sort(const std::vector<FileSystem::SortKey>& keys, uint64_t loadGen, uint64_t sortGen);
+    // sorts `back`, handing the visible rows over through `publish` first if the listing is big. False if it was
+    // cancelled, `back` keeps its previous order then
+    template<typename Publish>
+    bool sortInStages(const std::vector<FileSystem::SortKey>& keys, const Publish& publish);
+    // hands `back.indexes` over, `mutex` has to be held
+    void publishOrder(uint64_t loadGen, uint64_t sortGen);
+};
+
+// puts known recursive totals into the size column of directories, and asks for the rest when `requestMissing`
+inline static bool FillFolderSizes(FileSystem::SOARecord& records, const Path& directory, FolderSizeService& service, bool requestMissing) {
+    bool changed = false;
+    std::string path = directory.str();
+    if(!path.empty() && path.back() != Path::SEPARATOR) {
+        path.push_back(Path::SEPARATOR);
+    }
+    const size_t directoryLength = path.size();
+
+    for(size_t i = 0; i < records.nameOffsets.size(); i++) {
+        if(!(records.attributes[i] & FileSystem::FileAttributes::DIRECTORY)) continue;
+
+        path.resize(directoryLength);
+        path.append(records.getRecordName(i));
+
+        uint64_t size;
+        if(service.lookup(path, records.lastModifiedNumbers[i], size)) {
+            changed |= records.sizes[i] != size;
+            records.sizes[i] = size;
+        } else if(requestMissing) {
+            service.request(path, records.lastModifiedNumbers[i]);
+        }
+    }
+
+    return changed;
+}
+
+// directories go first while the primary column is ascending, last otherwise
+inline static bool AreDirectoriesFirst(const std::vector<FileSystem::SortKey>& keys) {
+    return keys.empty() || keys[0].direction == FileSystem::SortDirection::Ascending;
+}
+
+// one pool for every watcher's big sorts, they're rare enough that watchers don't need their own
+inline static WorkStealingPool& SharedSortPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+inline static bool SortRecords(FileSystem::SOARecord& records, const std::vector<FileSystem::SortKey>& keys, WorkStealingPool* sortPool, size_t parallelThreshold,
+                               const std::atomic<bool>* cancel) {
+    // the pool only starts for a listing that's actually big
+    WorkStealingPool* pool = records.size() < parallelThreshold ? nullptr : sortPool != nullptr ? sortPool : &SharedSortPool();
+    return records.sort(keys, AreDirectoriesFirst(keys), pool, parallelThreshold, cancel);
+}
+
+DirectoryWatcher::Worker::~Worker() {
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        alive = false;
+        // stops a load in flight at the next chunk
+        loadGeneration++;
+        cancelSort = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void DirectoryWatcher::Worker::run() {
+    while(true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !alive || loadRequested || refreshRequested || sortRequested; });
+
+        if(!alive) break;
+
+        if(loadRequested) {
+            loadRequested = false;
+            // the new listing includes whatever the refresh was about
+            refreshRequested = false;
+            const Path dir = directory;
+            const bool stream = streamEntries;
+            const uint64_t generation = loadGeneration;
+            lock.unlock();
+
+            load(dir, stream, generation);
+        } else if(refreshRequested) {
+            refreshRequested = false;
+            const Path dir = directory;
+            const uint64_t generation = loadGeneration;
+            lock.unlock();
+
+            refresh(dir, generation);
+        } else {
+            sortRequested = false;
+            cancelSort = false;
+            const std::vector<FileSystem::SortKey> keys = sortKeys;
+            const uint64_t loadGen = loadGeneration;
+            const uint64_t sortGen = sortGeneration;
+            lock.unlock();
+
+            sort(keys, loadGen, sortGen);
+        }
+    }
+
+    enumerator.close();
+    unwatch();
+}
+
+bool DirectoryWatcher::Worker::watch(const Path& dir, uint64_t& out_Generation) {
+    WatchRegistry& registry = WatchRegistry::shared();
+
+    if(isWatching && watchedPath == dir.str()) {
+        out_Generation = registry.poll(watchedPath);
+        return true;
+    }
+
+    unwatch();
+    isWatching = registry.subscribe(dir.str(), out_Generation);
+    if(isWatching) {
+        watchedPath = dir.str();
+    }
+    return isWatching;
+}
+
+void DirectoryWatcher::Worker::unwatch() {
+    if(!isWatching) return;
+
+    WatchRegistry::shared().unsubscribe(watchedPath);
+    watchedPath.clear();
+    isWatching = false;
+}
+
+bool DirectoryWatcher::Worker::enumerate(const Path& dir, bool stream, uint64_t generation, FileSystem::SOARecord& out_Listing) {
+    if(!enumerator.open(dir)) return false;
+
+    while(!enumerator.isDone()) {
+        const size_t firstRecord = out_Listing.nameOffsets.size();
+        const size_t numAdded = enumerator.next(out_Listing, ENUMERATION_CHUNK_SIZE);
+
+        if(generation != loadGeneration.load()) {
+            enumerator.close();
+            return false;
+        }
+
+        // copy the chunk out so the first entries show up while the rest is still being read
+        if(stream && numAdded > 0) {
+            std::scoped_lock<std::mutex> lock(mutex);
+            if(streamedGeneration != generation) {
+                streamed.clear();
+                streamedGeneration = generation;
+            }
+            streamed.append(out_Listing, firstRecord, numAdded);
+        }
+    }
+
+    return true;
+}
+
+void DirectoryWatcher::Worker::load(const Path& dir, bool stream, uint64_t generation) {
+    auto xCancelled = [&]() { return generation != loadGeneration.load(); };
+
+    auto xFail = [&]() {
+        // the next load subscribes again, in case the directory comes back
+        unwatch();
+        backWatchGeneration = 0;
+
+        std::scoped_lock<std::mutex> lock(mutex);
+        if(xCancelled()) return;
+
+        result = WorkerResult::FAILED;
+        resultLoadGeneration = generation;
+    };
+
+    DirectoryCache& cache = DirectoryCache::shared();
+    const std::string& cacheKey = dir.str();
+
+    // a cached listing is good as long as the directory's watch didn't fire, which takes no system call to tell.
+    // Directories that can't be watched fall back to their modification time
+    uint64_t changeStamp = 0;
+    const bool isWatched = watch(dir, changeStamp);
+    if(!isWatched && !FileSystem::getLastModifiedNumber(dir, changeStamp)) {
+        xFail();
+        return;
+    }
+
+    bool shouldLoad = false;
+    DirectoryCache::Snapshot snapshot = cache.acquire(cacheKey, changeStamp, xCancelled, shouldLoad);
+
+    if(snapshot == nullptr) {
+        // cancelled while another watcher was loading it
+        if(!shouldLoad) return;
+
+        FileSystem::SOARecord listing;
+        if(!enumerate(dir, stream, generation, listing)) {
+            cache.abandon(cacheKey);
+            if(!xCancelled()) xFail();
+            return;
+        }
+
+        // every watcher sharing the snapshot sorts by name from these
+        listing.buildSortKeys();
+        snapshot = std::make_shared<const FileSystem::SOARecord>(std::move(listing));
+        cache.insert(cacheKey, changeStamp, snapshot);
+    }
+
+    if(xCancelled()) return;
+
+    // the snapshot is shared with other watchers, sorting and folder sizes happen on our own copy
+    back = *snapshot;
+    backWatchGeneration = isWatched ? changeStamp : 0;
+
+    if(folderSizes != nullptr) {
+        FillFolderSizes(back, dir, *folderSizes, true);
+    }
+
+    std::vector<FileSystem::SortKey> keys;
+    uint64_t sortGen = 0;
+
+    // the first result is the listing, whatever follows only changes its order
+    bool isPublished = false;
+    auto xPublish = [&]() {
+        std::scoped_lock<std::mutex> lock(mutex);
+        if(xCancelled()) return;
+
+        if(isPublished) {
+            publishOrder(generation, sortGen);
+            return;
+        }
+
+        // `back` stays with the worker for later re-sorts, the UI thread gets a copy. `ready` holds the previous
+        // front buffer after a swap so the copy reuses its capacity
+        ready = back;
+        deltas.clear();
+        result = WorkerResult::LISTING;
+        resultLoadGeneration = generation;
+        resultSortGeneration = sortGen;
+        resultWatchGeneration = isWatched ? changeStamp : 0;
+        isPublished = true;
+    };
+
+    // sort with whatever the user picked while we were enumerating, that satisfies any pending sort request too.
+    // Picking something else while this sorts stops it, it starts over with the new keys
+    while(true) {
+        {
+            std::scoped_lock<std::mutex> lock(mutex);
+            keys = sortKeys;
+            sortGen = sortGeneration;
+            sortRequested = false;
+            cancelSort = false;
+        }
+
+        if(sortInStages(keys, xPublish)) break;
+        if(xCancelled()) return;
+    }
+    backSortKeys = keys;
+
+    xPublish();
+}
+
+void DirectoryWatcher::Worker::sort(const std::vector<FileSystem::SortKey>& keys, uint64_t loadGen, uint64_t sortGen) {
+    if(folderSizes != nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        const Path dir = directory;
+        lock.unlock();
+
+        FillFolderSizes(back, dir, *folderSizes, false);
+    }
+
+    auto xPublish = [&]() {
+        std::scoped_lock<std::mutex> lock(mutex);
+        publishOrder(loadGen, sortGen);
+    };
 
+    bool isPartialPublished = false;
+    auto xPublishPartial = [&]() {
+        xPublish();
+        isPartialPublished = true;
+    };
+
+    // a newer request is waiting, the UI thread keeps showing the previous order until that one's done
+    if(!sortInStages(keys, xPublishPartial)) {
+        // the UI thread may have the partial order of `keys` by now, changes patched in by `backSortKeys` would
+        // land on the wrong rows of it. It goes back to the order `back` is in until the newer sort is done
+        if(isPartialPublished) {
+            std::scoped_lock<std::mutex> lock(mutex);
+            publishOrder(loadGen, sortGeneration);
+        }
+        return;
+    }
+    backSortKeys = keys;
+
+    xPublish();
+}
+
+// A full sort of a million names takes a few hundred milliseconds, selecting the rows on screen (plus a screenful
+// either side) takes a linear pass. Those go out first, then the full order replaces them. Ties are broken the way
+// the stable sort breaks them, so the rows already on screen don't move when it does
+template<typename Publish>
+bool DirectoryWatcher::Worker::sortInStages(const std::vector<FileSystem::SortKey>& keys, const Publish& publish) {
+    if(back.size() >= partialSortThreshold) {
+        const size_t numRows = numVisibleRows;
+        const size_t first = firstVisibleRow;
+        const size_t margin = std::min(first, numRows);
+
+        // the full sort has to start from the same order for its ties to agree
+        std::vector<size_t> unsorted = back.indexes;
+        if(!back.partialSort(keys, AreDirectoriesFirst(keys), first - margin, numRows + margin + numRows, &cancelSort)) return false;
+        publish();
+        back.indexes.swap(unsorted);
+    }
+
+    return SortRecords(back, keys, sortPool, parallelSortThreshold, &cancelSort);
+}
+
+void DirectoryWatcher::Worker::publishOrder(uint64_t loadGen, uint64_t sortGen) {
+    if(loadGen != loadGeneration || sortGen != sortGeneration) return;
+
+    // the columns didn't change, only the order has to be handed over. If the listing itself
+    // hasn't been picked up yet it's updated in place and goes out as one result
+    if(result == WorkerResult::FAILED) return;
+
+    ready.indexes = back.indexes;
+    if(result != WorkerResult::LISTING) {
+        result = WorkerResult::ORDER;
+    }
+    resultLoadGeneration = loadGen;
+    resultSortGeneration = sortGen;
+}
+
+// Brings `back` up to date with the entries the watch reported instead of enumerating the whole directory, a single
+// changed file costs a lookup and a binary search on each side
+void DirectoryWatcher::Worker::refresh(const Path& dir, uint64_t generation) {
+    std::vector<std::string> names;
+    uint64_t watchGeneration = 0;
+    const bool isKnown = backWatchGeneration != 0 && isWatching && watchedPath == dir.str()
+        && WatchRegistry::shared().changesSince(watchedPath, backWatchGeneration, names, watchGeneration);
+
+    // an entry changing repeatedly only needs one look
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    if(!isKnown || names.size() > MAX_REFRESH_CHANGES) {
+        load(dir, false, generation);
+        return;
+    }
+
+    std::vector<FileSystem::EntryChange> changes(names.size());
+    for(size_t i = 0; i < names.size(); i++) {
+        FileSystem::EntryChange& change = changes[i];
+        change.name = std::move(names[i]);
+        change.exists = FileSystem::getEntryInfo(dir, change.name, change);
+    }
+
+    if(generation != loadGeneration.load()) return;
+
+    back.applyChanges(changes, backSortKeys, AreDirectoriesFirst(backSortKeys));
+    backWatchGeneration = watchGeneration;
+
+    if(folderSizes != nullptr) {
+        for(const FileSystem::EntryChange& change : changes) {
+            if(!change.exists || !(change.attributes & FileSystem::FileAttributes::DIRECTORY)) continue;
+
+            Path path = dir;
+            path.appendName(change.name);
+            folderSizes->request(path.str(), change.lastModifiedNumber);
+        }
+    }
+
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != loadGeneration || result == WorkerResult::FAILED) return;
+
+    // the UI thread hasn't taken the listing yet, it gets the patched one instead
+    if(result == WorkerResult::LISTING) {
+        ready = back;
+        resultWatchGeneration = watchGeneration;
+        return;
+    }
+
+    // a pending order refers to the records before the change
+    if(result == WorkerResult::ORDER) {
+        ready.indexes = back.indexes;
+    }
+
+    deltas.push_back({ std::move(changes), backSortKeys });
+    deltasLoadGeneration = generation;
+}
+
+DirectoryWatcher::DirectoryWatcher()
+    : mWorker(std::make_unique<Worker>()) {
+    mWorker->thread = std::thread(&Worker::run, mWorker.get());
+}
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+DirectoryWatcher::DirectoryWatcher(DirectoryWatcher&&) = default;
+DirectoryWatcher& DirectoryWatcher::operator=(DirectoryWatcher&&) = default;
+
+bool DirectoryWatcher::update() {
     bool wasUpdated = false;
 
-    DWORD waitStatus;
-    waitStatus = WaitForSingleObject(mDirChangeHandle, 0);
+    // check if any changes occurred, the current entries stay up until the new listing is ready. Whichever widget
+    // on this directory polls first picks the notification up, the others see the bumped generation
+    if(mWatchGeneration != 0) {
+        const uint64_t generation = WatchRegistry::shared().poll(mDirectory.str());
+        if(generation != 0 && generation != mWatchGeneration) {
+            mWatchGeneration = generation;
+
+            // the totals of this directory and everything above it include whatever changed
+            if(mFolderSizeService != nullptr) {
+                mFolderSizeService->invalidate(mDirectory.str());
+            }
+            requestRefresh();
+        }
+    }
+
+    updateFolderSizes();
+
+    Worker& worker = *mWorker;
+    std::scoped_lock<std::mutex> lock(worker.mutex);
+
+    // patches come before any result, a pending order already includes them
+    if(!worker.deltas.empty()) {
+        if(worker.deltasLoadGeneration == mLoadGeneration && mStatus == DirectoryStatus::READY) {
+            for(const Worker::Delta& delta : worker.deltas) {
+                mRecords.applyChanges(delta.changes, delta.sortKeys, AreDirectoriesFirst(delta.sortKeys));
+            }
+            wasUpdated = true;
+            mListingVersion++;
+        }
+        worker.deltas.clear();
+    }
 
-    // check if any changes occurred
-    switch(waitStatus) {
-        case WAIT_OBJECT_0:
+    if(mStatus == DirectoryStatus::LOADING && worker.streamedGeneration == mLoadGeneration) {
+        if(worker.streamed.size() > 0) {
+            mRecords.append(worker.streamed, 0, worker.streamed.size());
+            worker.streamed.clear();
+            mListingVersion++;
+        }
+    }
+
+    if(worker.result == WorkerResult::NONE || worker.resultLoadGeneration != mLoadGeneration) {
+        return wasUpdated;
+    }
+
+    switch(worker.result) {
+        case WorkerResult::LISTING:
             {
-                mUpdateDirectory = true;
-                mUpdateSort = true;
-                FindNextChangeNotification(mDirChangeHandle);
+                std::swap(mRecords, worker.ready);
+                mStatus = DirectoryStatus::READY;
+                wasUpdated = true;
+                mListingVersion++;
+                // totals that finished after the worker filled them in get picked up next frame
+                mSeenFolderSizeScans = 0;
+                mWatchGeneration = worker.resultWatchGeneration;
             } break;
-        default:
+        case WorkerResult::ORDER:
             {
+                if(worker.resultSortGeneration == mSortGeneration) {
+                    mRecords.indexes.swap(worker.ready.indexes);
+                    mOrderVersion++;
+                }
             } break;
+        case WorkerResult::FAILED:
+            {
+                mRecords.clear();
+                mStatus = DirectoryStatus::NOT_FOUND;
+                mWatchGeneration = 0;
+                wasUpdated = true;
+                mListingVersion++;
+            } break;
+        default:
+            break;
     }
 
-    if(mUpdateDirectory) {
-        wasUpdated = true;
-        mUpdateDirectory = false;
-        mRecords.clear();
-        errors = FileSystem::enumerateDirectory(mDirectory, mRecords);
+    worker.result = WorkerResult::NONE;
 
-        if(mDirChangeHandle != INVALID_HANDLE_VALUE) {
-            FindCloseChangeNotification(mDirChangeHandle);
-        }
+    return wasUpdated;
+}
 
-        mDirChangeHandle = FindFirstChangeNotificationW(mDirectory.wstr().data(), FALSE, 
-                FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
-                );
+void DirectoryWatcher::requestLoad(bool streamEntries) {
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->directory = mDirectory;
+        mWorker->streamEntries = streamEntries;
+        mWorker->loadRequested = true;
+        mWorker->cancelSort = true;
+        mLoadGeneration = ++mWorker->loadGeneration;
     }
+    mWorker->wake.notify_one();
+}
 
-    if(mUpdateSort) {
-        mUpdateSort = false;
+void DirectoryWatcher::requestRefresh() {
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->refreshRequested = true;
+    }
+    mWorker->wake.notify_one();
+}
 
-        if(mSortFlags & DIRECTORY_SORT_NAME) {
-            mRecords.sortByName(mSortDirection);
-        } 
+void DirectoryWatcher::changeDirectory(const Path& newPath) {
+    mDirectory = newPath;
+    mRecords.clear();
+    mStatus = DirectoryStatus::LOADING;
+    mListingVersion++;
 
-        if(mSortFlags & DIRECTORY_SORT_DATE) {
-            mRecords.sortByLastModified(mSortDirection);
-        } 
+    // notifications for the old directory are of no use anymore, the worker moves the subscription over
+    mWatchGeneration = 0;
+    // a new directory starts at the top
+    mWorker->firstVisibleRow = 0;
 
-        if(mSortFlags & DIRECTORY_SORT_FILE_SIZE) {
-            mRecords.sortBySize(mSortDirection);
-        } 
+    requestLoad(true);
+}
+
+void DirectoryWatcher::setSort(const std::vector<FileSystem::SortKey>& keys) {
+    mSortKeys = keys;
+    requestSort(true);
+}
 
-        mRecords.sortByType(mSortDirection);
+void DirectoryWatcher::setSort(FileSystem::SortColumn column, FileSystem::SortDirection direction) {
+    setSort(std::vector<FileSystem::SortKey>{ { column, direction } });
+}
+
+void DirectoryWatcher::requestSort(bool cancelRunning) {
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->sortKeys = mSortKeys;
+        mWorker->sortRequested = true;
+        if(cancelRunning) {
+            mWorker->cancelSort = true;
+        }
+        mSortGeneration = ++mWorker->sortGeneration;
     }
+    mWorker->wake.notify_one();
+}
 
-    return wasUpdated;
+void DirectoryWatcher::setParallelSortThreshold(size_t numEntries) {
+    mWorker->parallelSortThreshold = numEntries;
 }
 
-void DirectoryWatcher::changeDirectory(const Path& newPath) {
-    mUpdateDirectory = true;
-    mUpdateSort = true;
-    mDirectory = newPath;
+void DirectoryWatcher::setPartialSortThreshold(size_t numEntries) {
+    mWorker->partialSortThreshold = numEntries;
 }
 
-void DirectoryWatcher::setSort(DirectorySortFlags sortFlags, FileSystem::SortDirection direction) {
-    mUpdateSort = true;
-    mSortFlags = sortFlags;
-    mSortDirection = direction;
+void DirectoryWatcher::setVisibleRows(size_t firstRow, size_t numRows) {
+    mWorker->firstVisibleRow = firstRow;
+    mWorker->numVisibleRows = std::max<size_t>(numRows, 1);
 }
 
+void DirectoryWatcher::setFolderSizeService(FolderSizeService* service) {
+    mFolderSizeService = service;
+
+    std::scoped_lock<std::mutex> lock(mWorker->mutex);
+    mWorker->folderSizes = service;
+}
+
+void DirectoryWatcher::setSortPool(WorkStealingPool* pool) {
+    mWorker->sortPool = pool;
+}
+
+// fills in folder totals that finished since the last look, and re-sorts if they decide the order
+void DirectoryWatcher::updateFolderSizes() {
+    if(mFolderSizeService == nullptr || mStatus != DirectoryStatus::READY) return;
+
+    const uint64_t numScans = mFolderSizeService->numCompletedScans();
+    if(numScans == mSeenFolderSizeScans) return;
+    mSeenFolderSizeScans = numScans;
+
+    const bool changed = FillFolderSizes(mRecords, mDirectory, *mFolderSizeService, false);
+    if(!changed) return;
+
+    for(const FileSystem::SortKey& key : mSortKeys) {
+        if(key.column == FileSystem::SortColumn::Size) {
+            // totals can trickle in every frame, cancelling for each of them could keep a big sort from ever finishing
+            requestSort(false);
+            break;
+        }
+    }
+}
@@ -1,31 +1,91 @@
 #pragma once
-#include <unordered_map>
+#include <memory>
+#include <vector>
 #include "Path.h"
 #include "SortDirection.h"
 #include "FileSystem.h"
 
-enum DirectorySortFlags {
-    DIRECTORY_SORT_NONE      = 0,
-    DIRECTORY_SORT_NAME      = 1 << 1,
-    DIRECTORY_SORT_DATE      = 1 << 2,
-    DIRECTORY_SORT_FILE_SIZE = 1 << 3,
+class FolderSizeService;
+class WorkStealingPool;
+
+static constexpr FileSystem::SortKey DEFAULT_SORT_KEY = { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending };
+
+enum class DirectoryStatus {
+    LOADING,
+    READY,
+    NOT_FOUND,
 };
 
+// Keeps mRecords in sync with a directory. Enumeration and sorting run on a worker thread into a back buffer,
+// update() swaps finished listings into mRecords at the start of a frame so the UI thread never waits on the file system.
+// Changes reported by the directory's watch are looked up entry by entry and patched into both buffers.
+// Big listings hand over the rows on screen from a partial sort before the full order is done
 class DirectoryWatcher {
-    using DirectoryPath = std::string;
-
 public:
-    void setSort(DirectorySortFlags flags, FileSystem::SortDirection);
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(DirectoryWatcher&&);
+    DirectoryWatcher& operator=(DirectoryWatcher&&);
+
+    // sorts by every key in order, directories are grouped first or last by the direction of the first one
+    void setSort(const std::vector<FileSystem::SortKey>& keys);
+    void setSort(FileSystem::SortColumn column, FileSystem::SortDirection direction);
     void changeDirectory(const Path& newPath);
+
+    // listings with at least this many entries are sorted on several threads
+    void setParallelSortThreshold(size_t numEntries);
+    // listings with at least this many entries show their visible rows before the rest of the order is known
+    void setPartialSortThreshold(size_t numEntries);
+    // rows the view shows, sorted ahead of the rest of a big listing. Call every frame, it's two atomic stores
+    void setVisibleRows(size_t firstRow, size_t numRows);
+
+    // directories get their recursive size from `service` as it becomes known, call before the first changeDirectory
+    void setFolderSizeService(FolderSizeService* service);
+    // big sorts started after the call run on `pool` instead of the one all watchers share, null goes back to that one
+    void setSortPool(WorkStealingPool* pool);
+
+    // picks up whatever the worker finished since the last call, returns true when a new listing was swapped in
+    // or entries were added, removed or moved around by a change in the directory
     bool update();
 
+    // true while the listing is still streaming into mRecords, entries are unsorted until it finishes
+    inline bool isLoading() const { return mStatus == DirectoryStatus::LOADING; }
+    inline DirectoryStatus status() const { return mStatus; }
+
+    // bumped whenever mRecords gets other entries (a new listing, streamed or patched ones) / only a new order,
+    // for anything derived from the records to tell whether it's still up to date
+    inline uint64_t listingVersion() const { return mListingVersion; }
+    inline uint64_t orderVersion() const { return mOrderVersion; }
+
     Path mDirectory;
 
     FileSystem::SOARecord mRecords;
-    FileSystem::SortDirection mSortDirection;
-    int mSortFlags = DIRECTORY_SORT_NAME;
-    bool mUpdateDirectory = true;
-    bool mUpdateSort = true;
-    void* mDirChangeHandle = nullptr;
-    bool errors = false; // FIXME: replace with enum
+
+private:
+    struct Worker;
+
+    void requestLoad(bool streamEntries);
+    // patches the listing with the entries the watch reported, falls back to a load when it can't
+    void requestRefresh();
+    // `cancelRunning` stops a sort in flight that the new one makes pointless
+    void requestSort(bool cancelRunning);
+    void updateFolderSizes();
+
+    std::unique_ptr<Worker> mWorker;
+
+    DirectoryStatus mStatus = DirectoryStatus::LOADING;
+    // results tagged with older generations belong to directories/sorts the user already left
+    uint64_t mLoadGeneration = 0;
+    uint64_t mSortGeneration = 0;
+    // last generation of the directory's WatchRegistry watch we reloaded for, 0 while not watching
+    uint64_t mWatchGeneration = 0;
+
+    uint64_t mListingVersion = 1;
+    uint64_t mOrderVersion = 1;
+
+    std::vector<FileSystem::SortKey> mSortKeys = { DEFAULT_SORT_KEY };
+
+    FolderSizeService* mFolderSizeService = nullptr;
+    uint64_t mSeenFolderSizeScans = 0;
 };
@@ -0,0 +1,753 @@
+#include "FileFinder.h"
+#include "SubstringSearch.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <stdio.h>
+
+// the Windows enumeration gets sizes and dates along with the names, elsewhere they take a stat per entry and are
+// only looked up for the entries whose name matched
+#ifdef _WIN32
+static constexpr int FIND_ENUMERATE_FIELDS = FileSystem::ENUMERATE_ALL;
+#else
+static constexpr int FIND_ENUMERATE_FIELDS = FileSystem::ENUMERATE_NAME_AND_TYPE;
+#endif
+
+static constexpr uint64_t FILE_TIME_TICKS_PER_SECOND = 10000000ULL;
+// listed paths looked up per task
+static constexpr size_t LISTED_CHUNK_SIZE = 256;
+
+inline static char FoldAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+inline static bool HasUpperCase(std::string_view text) {
+    for(char c : text) {
+        if(c >= 'A' && c <= 'Z') return true;
+    }
+    return false;
+}
+
+// "10", "10k", "10MB" in bytes
+inline static bool ParseSize(std::string_view text, uint64_t& out_Size) {
+    size_t pos = 0;
+    uint64_t value = 0;
+    while(pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+        const uint64_t digit = text[pos] - '0';
+        if(value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+        pos++;
+    }
+    if(pos == 0) return false;
+
+    int shift = 0;
+    if(pos < text.size()) {
+        switch(FoldAscii(text[pos])) {
+            case 'k': shift = 10; break;
+            case 'm': shift = 20; break;
+            case 'g': shift = 30; break;
+            case 't': shift = 40; break;
+            case 'b': break;
+            default: return false;
+        }
+        pos++;
+        if(shift > 0 && pos < text.size() && FoldAscii(text[pos]) == 'b') pos++;
+    }
+    if(pos != text.size()) return false;
+    if(shift > 0 && value > (UINT64_MAX >> shift)) return false;
+
+    out_Size = value << shift;
+    return true;
+}
+
+// "30m", "7d", "7" in file time ticks
+inline static bool ParseAge(std::string_view text, uint64_t& out_Age) {
+    size_t pos = 0;
+    uint64_t value = 0;
+    while(pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+        const uint64_t digit = text[pos] - '0';
+        if(value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+        pos++;
+    }
+    if(pos == 0) return false;
+
+    uint64_t seconds = 24 * 60 * 60;
+    if(pos < text.size()) {
+        switch(text[pos]) {
+            case 's': seconds = 1; break;
+            case 'm': seconds = 60; break;
+            case 'h': seconds = 60 * 60; break;
+            case 'd': seconds = 24 * 60 * 60; break;
+            case 'w': seconds = 7 * 24 * 60 * 60; break;
+            default: return false;
+        }
+        pos++;
+    }
+    if(pos != text.size()) return false;
+
+    const uint64_t ticks = seconds * FILE_TIME_TICKS_PER_SECOND;
+    if(value > UINT64_MAX / ticks) return false;
+
+    out_Age = value * ticks;
+    return true;
+}
+
+inline static void SplitNames(std::string_view text, std::vector<std::string>& out_Names) {
+    size_t start = 0;
+    while(start <= text.size()) {
+        size_t end = text.find(',', start);
+        if(end == std::string_view::npos) end = text.size();
+
+        if(end > start) out_Names.emplace_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+bool ParseFindQuery(const std::vector<std::string>& args, uint64_t currentFileTime, FindQuery& out_Query) {
+    if(args.empty()) return false;
+
+    FindQuery query;
+    bool hasPattern = false;
+
+    for(const std::string& arg : args) {
+        if(!query.text.empty()) query.text.push_back(' ');
+        query.text.append(arg);
+
+        const std::string_view token(arg);
+        if(token.substr(0, 5) == "size>" || token.substr(0, 5) == "size<") {
+            uint64_t size;
+            if(!ParseSize(token.substr(5), size)) return false;
+
+            if(token[4] == '>') {
+                if(size == UINT64_MAX) return false;
+                query.minSize = std::max(query.minSize, size + 1);
+            } else {
+                if(size == 0) return false;
+                query.maxSize = std::min(query.maxSize, size - 1);
+            }
+        } else if(token.substr(0, 6) == "mtime<" || token.substr(0, 6) == "mtime>") {
+            uint64_t age;
+            if(!ParseAge(token.substr(6), age)) return false;
+
+            const uint64_t since = currentFileTime > age ? currentFileTime - age : 0;
+            if(token[5] == '<') {
+                // newer than `since`
+                query.minLastModified = std::max(query.minLastModified, since);
+            } else {
+                query.maxLastModified = std::min(query.maxLastModified, since);
+            }
+        } else if(token.substr(0, 6) == "prune=") {
+            SplitNames(token.substr(6), query.pruneNames);
+        } else if(token == "noprune") {
+            query.useDefaultPrune = false;
+        } else {
+            if(hasPattern) return false;
+            hasPattern = true;
+
+            if(token.substr(0, 3) == "re:") {
+                query.kind = FindPatternKind::Regex;
+                query.pattern = token.substr(3);
+                query.isCaseSensitive = true;
+            } else {
+                query.kind = token.find_first_of("*?[") != std::string_view::npos ? FindPatternKind::Glob : FindPatternKind::Substring;
+                query.pattern = token;
+                query.isCaseSensitive = HasUpperCase(token);
+            }
+        }
+    }
+
+    if(query.minSize > query.maxSize || query.minLastModified > query.maxLastModified) return false;
+    if(!FindMatcher(query).isValid()) return false;
+
+    out_Query = std::move(query);
+    return true;
+}
+
+// Matches `c` against the [...] class starting at glob[pos]. Sets `out_End` past the class, a [ that isn't closed is
+// a plain one and only matches itself
+inline static bool MatchGlobClass(std::string_view glob, size_t pos, char c, bool ignoreCase, size_t& out_End) {
+    size_t i = pos + 1;
+    bool negate = false;
+    if(i < glob.size() && (glob[i] == '!' || glob[i] == '^')) {
+        negate = true;
+        i++;
+    }
+
+    const char folded = ignoreCase ? FoldAscii(c) : c;
+    bool matched = false;
+    // a ] right after the opening bracket is part of the set
+    bool isFirst = true;
+    while(i < glob.size() && (glob[i] != ']' || isFirst)) {
+        isFirst = false;
+
+        char low = glob[i];
+        char high = low;
+        if(i + 2 < glob.size() && glob[i + 1] == '-' && glob[i + 2] != ']') {
+            high = glob[i + 2];
+            i += 3;
+        } else {
+            i++;
+        }
+
+        if(c >= low && c <= high) {
+            matched = true;
+        } else if(ignoreCase) {
+            // [a-z] takes 'Q' and [A-Z] takes 'q'
+            const char upper = (folded >= 'a' && folded <= 'z') ? static_cast<char>(folded - 0x20) : folded;
+            matched |= (folded >= low && folded <= high) || (upper >= low && upper <= high);
+        }
+    }
+
+    if(i >= glob.size()) {
+        out_End = pos + 1;
+        return c == '[';
+    }
+
+    out_End = i + 1;
+    return matched != negate;
+}
+
+bool GlobMatch(std::string_view name, std::string_view glob, bool ignoreCase) {
+    size_t n = 0;
+    size_t g = 0;
+    // where to pick up after the last * when what followed it stops matching, that * takes one more character then
+    size_t starGlob = std::string_view::npos;
+    size_t starName = 0;
+
+    while(n < name.size()) {
+        if(g < glob.size()) {
+            const char c = glob[g];
+            if(c == '*') {
+                g++;
+                starGlob = g;
+                starName = n;
+                continue;
+            }
+
+            bool matched = false;
+            size_t next = g + 1;
+            if(c == '?') {
+                matched = true;
+            } else if(c == '[') {
+                matched = MatchGlobClass(glob, g, name[n], ignoreCase, next);
+            } else {
+                matched = ignoreCase ? FoldAscii(c) == FoldAscii(name[n]) : c == name[n];
+            }
+
+            if(matched) {
+                n++;
+                g = next;
+                continue;
+            }
+        }
+
+        if(starGlob == std::string_view::npos) return false;
+        g = starGlob;
+        n = ++starName;
+    }
+
+    while(g < glob.size() && glob[g] == '*') {
+        g++;
+    }
+    return g == glob.size();
+}
+
+// the longest run of characters a glob matches only by themselves
+inline static std::string LongestGlobLiteral(std::string_view glob) {
+    std::string_view longest;
+    size_t runStart = 0;
+
+    size_t i = 0;
+    while(i < glob.size()) {
+        const char c = glob[i];
+        if(c != '*' && c != '?' && c != '[') {
+            i++;
+            continue;
+        }
+
+        if(i - runStart > longest.size()) longest = glob.substr(runStart, i - runStart);
+
+        size_t next = i + 1;
+        if(c == '[') {
+            MatchGlobClass(glob, i, '\0', false, next);
+        }
+        i = next;
+        runStart = i;
+    }
+    if(glob.size() - runStart > longest.size()) longest = glob.substr(runStart);
+
+    return std::string(longest);
+}
+
+FindMatcher::FindMatcher(const FindQuery& query)
+    : mQuery(query) {
+    if(mQuery.kind == FindPatternKind::Regex) {
+        try {
+            mRegex = std::regex(mQuery.pattern, std::regex::ECMAScript | std::regex::optimize);
+        } catch(const std::regex_error& error) {
+            printf("[FIND] invalid regex '%s': %s\n", mQuery.pattern.c_str(), error.what());
+            mIsValid = false;
+        }
+    } else if(mQuery.kind == FindPatternKind::Glob) {
+        mGlobLiteral = LongestGlobLiteral(mQuery.pattern);
+    }
+}
+
+bool FindMatcher::matchesName(std::string_view name) const {
+    const SubstringCase matchCase = mQuery.isCaseSensitive ? SubstringCase::Sensitive : SubstringCase::AsciiInsensitive;
+
+    switch(mQuery.kind) {
+        case FindPatternKind::Substring:
+            return ContainsSubstring(name, mQuery.pattern, matchCase);
+        case FindPatternKind::Glob:
+            return ContainsSubstring(name, mGlobLiteral, matchCase) && GlobMatch(name, mQuery.pattern, !mQuery.isCaseSensitive);
+        case FindPatternKind::Regex:
+            return mIsValid && std::regex_search(name.begin(), name.end(), mRegex);
+    }
+    return false;
+}
+
+void FindMatcher::matchNames(const FileSystem::SOARecord& entries, BitSet& out_Matches) const {
+    const size_t numRecords = entries.nameOffsets.size();
+    out_Matches.reset(numRecords);
+    if(numRecords == 0 || !mIsValid) return;
+
+    const SubstringCase matchCase = mQuery.isCaseSensitive ? SubstringCase::Sensitive : SubstringCase::AsciiInsensitive;
+    const std::string_view arena(entries.nameArena.data(), entries.nameArena.size());
+
+    switch(mQuery.kind) {
+        case FindPatternKind::Substring:
+            {
+                FindInNames(arena, entries.nameOffsets, 0, numRecords, mQuery.pattern, matchCase, out_Matches);
+            } break;
+        case FindPatternKind::Glob:
+            {
+                FindInNames(arena, entries.nameOffsets, 0, numRecords, mGlobLiteral, matchCase, out_Matches);
+                for(size_t i = out_Matches.findNext(0); i != BitSet::NPOS; i = out_Matches.findNext(i + 1)) {
+                    if(!GlobMatch(entries.getRecordName(i), mQuery.pattern, !mQuery.isCaseSensitive)) {
+                        out_Matches.unset(i);
+                    }
+                }
+            } break;
+        case FindPatternKind::Regex:
+            {
+                for(size_t i = 0; i < numRecords; i++) {
+                    const std::string_view name = entries.getRecordName(i);
+                    if(std::regex_search(name.begin(), name.end(), mRegex)) {
+                        out_Matches.set(i);
+                    }
+                }
+            } break;
+    }
+}
+
+std::string_view FindMatcher::literal() const {
+    switch(mQuery.kind) {
+        case FindPatternKind::Substring:
+            return mQuery.pattern;
+        case FindPatternKind::Glob:
+            return mGlobLiteral;
+        default:
+            return std::string_view();
+    }
+}
+
+bool FindMatcher::matchesEntry(int attributes, uint64_t size, uint64_t lastModifiedNumber) const {
+    if(mQuery.hasSizeBound()) {
+        if(attributes & FileSystem::FileAttributes::DIRECTORY) return false;
+        if(size < mQuery.minSize || size > mQuery.maxSize) return false;
+    }
+    if(mQuery.hasDateBound()) {
+        if(lastModifiedNumber < mQuery.minLastModified || lastModifiedNumber > mQuery.maxLastModified) return false;
+    }
+    return true;
+}
+
+// everything below `mutex` is shared between the UI thread and the worker and guarded by it
+struct FileFinder::Worker {
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool alive = true;
+
+    // latest request from the UI thread
+    Path root;
+    std::shared_ptr<const FindMatcher> matcher;
+    std::vector<std::string> pruneNames;
+    // looked up instead of walking when `isListed`
+    std::vector<std::string> listedPaths;
+    bool isListed = false;
+    bool findRequested = false;
+    // bumped by every request, results of older ones are thrown away
+    std::atomic<uint64_t> generation{ 0 };
+    // stops the walk in flight, cleared when the worker takes the next request
+    std::atomic<bool> cancel{ false };
+
+    // found since the last update(), always by the latest request
+    FileSystem::SOARecord results;
+    std::vector<std::string> directories;
+    std::vector<uint32_t> directoryOfResult;
+    size_t numDirectoriesSearched = 0;
+    size_t numResults = 0;
+    bool isDone = false;
+    bool wasStopped = false;
+
+    ~Worker();
+
+    void run();
+    void find(const Path& findRoot, const FindMatcher& findMatcher, const std::vector<std::string>& findPruneNames, uint64_t findGeneration);
+    void findListed(const std::vector<std::string>& findPaths, const FindMatcher& findMatcher, uint64_t findGeneration);
+    // hands the matches of one directory over, false once the find was replaced
+    bool flush(std::string_view directory, const FileSystem::SOARecord& found, uint64_t findGeneration);
+};
+
+// finds of all widgets share one pool, it's rare for two to run at once
+inline static WorkStealingPool& SharedFindPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+FileFinder::Worker::~Worker() {
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        alive = false;
+        generation++;
+    }
+    cancel = true;
+    wake.notify_all();
+    thread.join();
+}
+
+void FileFinder::Worker::run() {
+    while(true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !alive || findRequested; });
+
+        if(!alive) break;
+
+        findRequested = false;
+        cancel = false;
+        const Path findRoot = root;
+        const std::shared_ptr<const FindMatcher> findMatcher = std::move(matcher);
+        const std::vector<std::string> findPruneNames = pruneNames;
+        const std::vector<std::string> findPaths = std::move(listedPaths);
+        const bool findIsListed = isListed;
+        const uint64_t findGeneration = generation;
+        lock.unlock();
+
+        if(findIsListed) {
+            findListed(findPaths, *findMatcher, findGeneration);
+        } else {
+            find(findRoot, *findMatcher, findPruneNames, findGeneration);
+        }
+    }
+}
+
+void FileFinder::Worker::find(const Path& findRoot, const FindMatcher& findMatcher, const std::vector<std::string>& findPruneNames, uint64_t findGeneration) {
+    WorkStealingPool& pool = SharedFindPool();
+
+    // indexed by worker, matches of one directory are collected before they're handed over
+    struct Scratch {
+        BitSet                  nameMatches;
+        FileSystem::SOARecord   found;
+    };
+    std::vector<Scratch> scratch(pool.numThreads());
+
+    FileSystem::TraverseOptions options;
+    options.fields = FIND_ENUMERATE_FIELDS;
+    options.cancel = &cancel;
+    options.descend = [&](const FileSystem::TraverseBatch& batch, size_t recordIdx) {
+        const std::string_view name = batch.entries.getRecordName(recordIdx);
+        for(const std::string& pruneName : findPruneNames) {
+            if(name == pruneName) return false;
+        }
+        return true;
+    };
+
+    FileSystem::traverseDirectory(pool, findRoot, options, [&](const FileSystem::TraverseBatch& batch) {
+        if(generation.load() != findGeneration) return;
+
+        const FileSystem::SOARecord& entries = batch.entries;
+        Scratch& local = scratch[batch.workerIdx];
+        local.found.clear();
+
+        findMatcher.matchNames(entries, local.nameMatches);
+
+        // the directory's Path is only built once a name in it matched
+        std::optional<Path> directory;
+        for(size_t i = local.nameMatches.findNext(0); i != BitSet::NPOS; i = local.nameMatches.findNext(i + 1)) {
+            const std::string_view name = entries.getRecordName(i);
+            int attributes = entries.attributes[i];
+            uint64_t lastModifiedNumber = entries.lastModifiedNumbers[i];
+            uint64_t size = entries.sizes[i];
+
+            if(FIND_ENUMERATE_FIELDS != FileSystem::ENUMERATE_ALL) {
+                if(!directory) directory.emplace(std::string(batch.directory));
+
+                // gone since the directory was read
+                FileSystem::EntryChange entry;
+                if(!FileSystem::getEntryInfo(*directory, name, entry)) continue;
+
+                attributes = entry.attributes;
+                lastModifiedNumber = entry.lastModifiedNumber;
+                size = entry.size;
+            }
+
+            if(!findMatcher.matchesEntry(attributes, size, lastModifiedNumber)) continue;
+
+            local.found.add(name, attributes, lastModifiedNumber, size);
+        }
+
+        flush(batch.directory, local.found, findGeneration);
+    });
+
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != findGeneration) return;
+
+    isDone = true;
+    wasStopped = cancel.load();
+}
+
+void FileFinder::Worker::findListed(const std::vector<std::string>& findPaths, const FindMatcher& findMatcher, uint64_t findGeneration) {
+    WorkStealingPool& pool = SharedFindPool();
+
+    // indexed by worker
+    std::vector<FileSystem::SOARecord> found(pool.numThreads());
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t chunkStart = 0; chunkStart < findPaths.size(); chunkStart += LISTED_CHUNK_SIZE) {
+        pool.submit(group, [&, chunkStart](size_t workerIdx) {
+            if(cancel.load() || generation.load() != findGeneration) return;
+
+            FileSystem::SOARecord& local = found[workerIdx];
+            local.clear();
+
+            // index results come in level order, the entries of a directory mostly next to each other
+            std::string_view directory;
+            std::optional<Path> directoryPath;
+            const size_t chunkEnd = std::min(chunkStart + LISTED_CHUNK_SIZE, findPaths.size());
+            for(size_t i = chunkStart; i < chunkEnd && !cancel.load(); i++) {
+                const std::string_view path = findPaths[i];
+                const size_t separator = path.rfind(Path::SEPARATOR);
+                if(separator == std::string_view::npos) continue;
+
+                // a root like "/" or "C:\" keeps its separator
+                const std::string_view entryDirectory = path.substr(0, path.find(Path::SEPARATOR) == separator ? separator + 1 : separator);
+                if(entryDirectory != directory) {
+                    if(local.size() > 0 && !flush(directory, local, findGeneration)) return;
+                    local.clear();
+                    directory = entryDirectory;
+                    directoryPath.emplace(std::string(directory));
+                }
+
+                // gone since it was indexed
+                const std::string_view name = path.substr(separator + 1);
+                FileSystem::EntryChange entry;
+                if(!FileSystem::getEntryInfo(*directoryPath, name, entry)) continue;
+                if(!findMatcher.matchesEntry(entry.attributes, entry.size, entry.lastModifiedNumber)) continue;
+
+                local.add(name, entry.attributes, entry.lastModifiedNumber, entry.size);
+            }
+            if(local.size() > 0) flush(directory, local, findGeneration);
+        });
+    }
+    pool.wait(group);
+
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != findGeneration) return;
+
+    isDone = true;
+    wasStopped = cancel.load();
+}
+
+bool FileFinder::Worker::flush(std::string_view directory, const FileSystem::SOARecord& found, uint64_t findGeneration) {
+    std::scoped_lock<std::mutex> lock(mutex);
+    if(generation != findGeneration) return false;
+
+    numDirectoriesSearched++;
+
+    size_t numFound = std::min(found.size(), MAX_RESULTS - std::min(numResults, MAX_RESULTS));
+    if(numFound == 0) return true;
+
+    const uint32_t directoryIdx = static_cast<uint32_t>(directories.size());
+    directories.emplace_back(directory);
+    results.append(found, 0, numFound);
+    directoryOfResult.insert(directoryOfResult.end(), numFound, directoryIdx);
+
+    numResults += numFound;
+    if(numResults >= MAX_RESULTS) {
+        cancel = true;
+    }
+    return true;
+}
+
+FileFinder::FileFinder()
+    : mWorker(std::make_unique<Worker>()),
+    mPruneNames(DefaultPruneNames()) {
+    mWorker->thread = std::thread(&Worker::run, mWorker.get());
+}
+
+FileFinder::~FileFinder() = default;
+
+FileFinder::FileFinder(FileFinder&&) = default;
+FileFinder& FileFinder::operator=(FileFinder&&) = default;
+
+const std::vector<std::string>& FileFinder::DefaultPruneNames() {
+    static const std::vector<std::string> names = { ".git", ".hg", ".svn", "node_modules" };
+    return names;
+}
+
+void FileFinder::setPruneNames(const std::vector<std::string>& names) {
+    mPruneNames = names;
+}
+
+bool FileFinder::start(const Path& root, const FindQuery& query) {
+    return startFind(root, query, std::vector<std::string>(), false);
+}
+
+bool FileFinder::startListed(const Path& root, const FindQuery& query, std::vector<std::string> paths) {
+    return startFind(root, query, std::move(paths), true);
+}
+
+bool FileFinder::startFind(const Path& root, const FindQuery& query, std::vector<std::string> paths, bool isListed) {
+    auto matcher = std::make_shared<const FindMatcher>(query);
+    if(root.isEmpty() || !matcher->isValid()) return false;
+
+    std::vector<std::string> pruneNames = query.pruneNames;
+    if(query.useDefaultPrune) {
+        pruneNames.insert(pruneNames.end(), mPruneNames.begin(), mPruneNames.end());
+    }
+
+    mRoot = root;
+    mQuery = query;
+    mResults.clear();
+    mDirectories.clear();
+    mDirectoryOfResult.clear();
+    mNumDirectoriesSearched = 0;
+    mNumListedPaths = paths.size();
+    mIsListed = isListed;
+    mIsActive = true;
+    mIsSearching = true;
+    mWasStopped = false;
+    mStartTime = std::chrono::steady_clock::now();
+
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mGeneration = ++mWorker->generation;
+        mWorker->cancel = true;
+
+        mWorker->root = root;
+        mWorker->matcher = std::move(matcher);
+        mWorker->pruneNames = std::move(pruneNames);
+        mWorker->listedPaths = std::move(paths);
+        mWorker->isListed = isListed;
+        mWorker->findRequested = true;
+
+        mWorker->results.clear();
+        mWorker->directories.clear();
+        mWorker->directoryOfResult.clear();
+        mWorker->numDirectoriesSearched = 0;
+        mWorker->numResults = 0;
+        mWorker->isDone = false;
+        mWorker->wasStopped = false;
+    }
+    mWorker->wake.notify_one();
+
+    return true;
+}
+
+void FileFinder::cancel() {
+    if(!mIsSearching) return;
+
+    // a request the worker didn't take yet is dropped, the worker clears the flag when it takes one
+    std::scoped_lock<std::mutex> lock(mWorker->mutex);
+    if(mWorker->findRequested) {
+        mWorker->findRequested = false;
+        mWorker->isDone = true;
+        mWorker->wasStopped = true;
+    } else {
+        mWorker->cancel = true;
+    }
+}
+
+void FileFinder::clear() {
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->generation++;
+        mWorker->cancel = true;
+        mWorker->findRequested = false;
+        mWorker->listedPaths.clear();
+        mWorker->results.clear();
+        mWorker->directories.clear();
+        mWorker->directoryOfResult.clear();
+    }
+
+    mQuery = FindQuery();
+    mResults.clear();
+    mDirectories.clear();
+    mDirectoryOfResult.clear();
+    mNumDirectoriesSearched = 0;
+    mNumListedPaths = 0;
+    mIsListed = false;
+    mIsActive = false;
+    mIsSearching = false;
+    mWasStopped = false;
+}
+
+bool FileFinder::update() {
+    if(!mIsSearching) return false;
+
+    std::scoped_lock<std::mutex> lock(mWorker->mutex);
+    Worker& worker = *mWorker;
+
+    bool changed = false;
+    mNumDirectoriesSearched = worker.numDirectoriesSearched;
+
+    if(worker.results.size() > 0) {
+        const uint32_t directoryBase = static_cast<uint32_t>(mDirectories.size());
+        for(std::string& directory : worker.directories) {
+            mDirectories.push_back(std::move(directory));
+        }
+        for(uint32_t directoryIdx : worker.directoryOfResult) {
+            mDirectoryOfResult.push_back(directoryBase + directoryIdx);
+        }
+
+        if(mResults.size() == 0) {
+            std::swap(mResults, worker.results);
+        } else {
+            mResults.append(worker.results, 0, worker.results.size());
+        }
+
+        worker.results.clear();
+        worker.directories.clear();
+        worker.directoryOfResult.clear();
+        changed = true;
+    }
+
+    if(worker.isDone) {
+        mIsSearching = false;
+        mWasStopped = worker.wasStopped;
+        mEndTime = std::chrono::steady_clock::now();
+        changed = true;
+    }
+
+    return changed;
+}
+
+Path FileFinder::resultPath(size_t i) const {
+    Path path(resultDirectory(i));
+    path.appendName(mResults.getName(i));
+    return path;
+}
+
+double FileFinder::elapsedSeconds() const {
+    const auto end = mIsSearching ? std::chrono::steady_clock::now() : mEndTime;
+    return std::chrono::duration<double>(end - mStartTime).count();
+}
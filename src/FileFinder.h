@@ -0,0 +1,172 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BitSet.h"
+#include "FileSystem.h"
+#include "Path.h"
+
+enum class FindPatternKind {
+    // anywhere in the name
+    Substring,
+    // the whole name: * any run of characters, ? one character, [abc] [a-z] [!abc] one out of a set
+    Glob,
+    // std::regex ECMAScript, anywhere in the name
+    Regex,
+};
+
+// What the `find` command looks for. Names are matched on their own, without the directory they're in
+struct FindQuery {
+    FindPatternKind kind = FindPatternKind::Substring;
+    // an empty pattern matches every name
+    std::string pattern;
+    // smart case for substrings and globs like FuzzyPattern, regexes are taken as written
+    bool isCaseSensitive = false;
+
+    // inclusive bounds. Only files have a size, any size bound leaves directories out
+    uint64_t minSize = 0;
+    uint64_t maxSize = UINT64_MAX;
+    // in the unit of SOARecord::lastModifiedNumbers
+    uint64_t minLastModified = 0;
+    uint64_t maxLastModified = UINT64_MAX;
+
+    // directory names that aren't walked into on top of the finder's own, or instead of them without the defaults
+    std::vector<std::string> pruneNames;
+    bool useDefaultPrune = true;
+
+    // the arguments as typed, to show what the results are for
+    std::string text;
+
+    inline bool hasSizeBound() const { return minSize > 0 || maxSize < UINT64_MAX; }
+    inline bool hasDateBound() const { return minLastModified > 0 || maxLastModified < UINT64_MAX; }
+};
+
+// Parses `find` arguments: a pattern and any of
+//   size>10M size<1k       sizes in bytes or with a k / M / G / T suffix, powers of 1024
+//   mtime<7d mtime>2h      modified less / more than that long ago, s / m / h / d / w, days without a suffix
+//   prune=build,out        more directory names not to walk into
+//   noprune                walk into the directories the finder prunes by default too
+// The pattern is a regex after "re:", a glob if it has * ? or [ in it, and a substring otherwise. Ages count back
+// from `currentFileTime`. Returns false for no arguments, ones it doesn't understand, a second pattern or a bad regex
+bool ParseFindQuery(const std::vector<std::string>& args, uint64_t currentFileTime, FindQuery& out_Query);
+
+// whether `glob` matches all of `name`, see FindPatternKind::Glob. A [ without a closing ] is a plain [
+bool GlobMatch(std::string_view name, std::string_view glob, bool ignoreCase);
+
+// A FindQuery ready to test entries against from several threads at once
+class FindMatcher {
+public:
+    explicit FindMatcher(const FindQuery& query);
+
+    // false if the query is a regex that doesn't compile, nothing matches then
+    inline bool isValid() const { return mIsValid; }
+
+    bool matchesName(std::string_view name) const;
+    // matchesName() for every record of `entries`, bit `i` for record `i`. Substrings and the plain part of a glob
+    // are looked for in the name arena in one pass, the rest of a glob only on names that have it
+    void matchNames(const FileSystem::SOARecord& entries, BitSet& out_Matches) const;
+    bool matchesEntry(int attributes, uint64_t size, uint64_t lastModifiedNumber) const;
+
+    // characters every matching name contains in a row, for narrowing names down before matchesName(). Empty for
+    // regexes and patterns that don't have any
+    std::string_view literal() const;
+    // whether matchesName() tells no more than finding literal() in the name
+    inline bool isLiteral() const { return mQuery.kind == FindPatternKind::Substring; }
+    inline bool isCaseSensitive() const { return mQuery.isCaseSensitive; }
+
+private:
+    FindQuery mQuery;
+    std::regex mRegex;
+    // a run of plain characters every match of a glob contains, checked before the glob itself
+    std::string mGlobLiteral;
+    bool mIsValid = true;
+};
+
+// Runs `find` below a directory. The tree is walked on a shared pool with a task per directory and matches are
+// handed to update() directory by directory, so the first ones show while the rest of the tree is still being
+// walked. Pruned directories show up in the results when they match but aren't walked into. A new find cancels
+// the one in flight, results of a cancelled find stay
+class FileFinder {
+public:
+    // a find stops once it has this many results
+    static constexpr size_t MAX_RESULTS = 1000000;
+
+    FileFinder();
+    ~FileFinder();
+
+    FileFinder(FileFinder&&);
+    FileFinder& operator=(FileFinder&&);
+
+    static const std::vector<std::string>& DefaultPruneNames();
+    // directory names no find walks into unless its query says noprune, DefaultPruneNames() to begin with
+    void setPruneNames(const std::vector<std::string>& names);
+    inline const std::vector<std::string>& pruneNames() const { return mPruneNames; }
+
+    // drops the results so far and starts looking for `query` below `root`, false if the query can't match
+    bool start(const Path& root, const FindQuery& query);
+    // The same for exactly `paths`, full paths below `root` whose names a FileIndex matched with the query, instead
+    // of walking for them. They're looked up in chunks spread over the pool for their sizes and dates, and to
+    // leave out the ones that went away since they were indexed
+    bool startListed(const Path& root, const FindQuery& query, std::vector<std::string> paths);
+    // stops the walk, the results found so far stay
+    void cancel();
+    // cancels and drops the results
+    void clear();
+
+    // picks up the matches found since the last call, returns true if there were any or the find finished
+    bool update();
+
+    // true from start() until clear()
+    inline bool isActive() const { return mIsActive; }
+    inline bool isSearching() const { return mIsSearching; }
+    // true if the walk stopped early, cancelled or at MAX_RESULTS
+    inline bool wasStopped() const { return mWasStopped; }
+
+    inline const Path& root() const { return mRoot; }
+    // true if the find was handed its paths by startListed()
+    inline bool isListed() const { return mIsListed; }
+    inline size_t numListedPaths() const { return mNumListedPaths; }
+    inline const FindQuery& query() const { return mQuery; }
+
+    inline size_t numResults() const { return mResults.size(); }
+    // in the order they were found, entries of one directory together
+    inline const FileSystem::SOARecord& results() const { return mResults; }
+    // full path of the directory result `i` is in
+    inline const std::string& resultDirectory(size_t i) const { return mDirectories[mDirectoryOfResult[i]]; }
+    Path resultPath(size_t i) const;
+
+    inline size_t numDirectoriesSearched() const { return mNumDirectoriesSearched; }
+    // since start(), up to when the walk ended once it did
+    double elapsedSeconds() const;
+
+private:
+    struct Worker;
+
+    bool startFind(const Path& root, const FindQuery& query, std::vector<std::string> paths, bool isListed);
+
+    std::unique_ptr<Worker> mWorker;
+
+    Path mRoot;
+    FindQuery mQuery;
+    std::vector<std::string> mPruneNames;
+
+    FileSystem::SOARecord mResults;
+    std::vector<std::string> mDirectories;
+    std::vector<uint32_t> mDirectoryOfResult;
+    size_t mNumDirectoriesSearched = 0;
+
+    // results tagged with older generations belong to finds that were replaced
+    uint64_t mGeneration = 0;
+    size_t mNumListedPaths = 0;
+    bool mIsListed = false;
+    bool mIsActive = false;
+    bool mIsSearching = false;
+    bool mWasStopped = false;
+
+    std::chrono::steady_clock::time_point mStartTime;
+    std::chrono::steady_clock::time_point mEndTime;
+};
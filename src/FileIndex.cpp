@@ -0,0 +1,825 @@
+#include "FileIndex.h"
+#include "DirectoryTree.h"
+#include "Path.h"
+#include "WatchRegistry.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// Everything is stored in native byte order and every table starts 8 byte aligned, so the mapped file can be
+// read in place. Name lengths aren't stored: names are NUL terminated and the next offset says where one ends
+struct FileIndex::Header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    numNodes;
+    uint64_t    imageSize;
+    uint64_t    arenaSize;
+
+    // byte offsets of the tables from the start of the image
+    uint64_t    parents;
+    uint64_t    firstChildren;
+    uint64_t    numChildren;
+    uint64_t    nameOffsets;
+    // every node but the root, which is the full path and not a name
+    uint64_t    sortedByName;
+    uint64_t    attributes;
+    uint64_t    arena;
+};
+
+// the tables of an image before they're written, nodes in level order with contiguous children
+struct FileIndex::Nodes {
+    std::vector<char>       arena;
+    std::vector<uint32_t>   nameOffsets;
+    std::vector<uint32_t>   parents;
+    std::vector<uint32_t>   firstChildren;
+    std::vector<uint32_t>   numChildren;
+    std::vector<uint8_t>    attributes;
+
+    inline size_t size() const { return parents.size(); }
+
+    void add(std::string_view name, uint32_t parent, int attribute) {
+        nameOffsets.push_back(static_cast<uint32_t>(arena.size()));
+        arena.insert(arena.end(), name.begin(), name.end());
+        arena.push_back('\0');
+        parents.push_back(parent);
+        firstChildren.push_back(0);
+        numChildren.push_back(0);
+        attributes.push_back(static_cast<uint8_t>(attribute));
+    }
+};
+
+static constexpr char INDEX_MAGIC[8] = { 'F', 'B', 'I', 'N', 'D', 'E', 'X', '\0' };
+// names scanned per task, a multiple of 64 so neighbouring chunks never share a word of the match bits
+static constexpr size_t SCAN_CHUNK_SIZE = 64 * 1024;
+// the name table is sorted on the pool in this many chunks per thread once it has more names than this
+static constexpr size_t PARALLEL_SORT_CHUNKS_PER_THREAD = 4;
+static constexpr size_t PARALLEL_SORT_MIN_SIZE = 64 * 1024;
+
+inline static unsigned char FoldAscii(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+inline static size_t AlignUp(size_t offset) {
+    return (offset + 7) & ~size_t(7);
+}
+
+// the first 8 folded bytes of a NUL terminated name, big endian so the keys compare like the names do
+inline static uint64_t FoldedKey(const char* name) {
+    uint64_t key = 0;
+    int i = 0;
+    for(; i < 8 && name[i] != '\0'; i++) {
+        key = (key << 8) | FoldAscii(static_cast<unsigned char>(name[i]));
+    }
+    return key << (8 * (8 - i));
+}
+
+// strcmp of two NUL terminated names with A-Z folded
+inline static int CompareFolded(const char* lhs, const char* rhs) {
+    for(;; lhs++, rhs++) {
+        const unsigned char l = FoldAscii(static_cast<unsigned char>(*lhs));
+        const unsigned char r = FoldAscii(static_cast<unsigned char>(*rhs));
+        if(l != r) return l < r ? -1 : 1;
+        if(l == '\0') return 0;
+    }
+}
+
+// compares the start of a NUL terminated name with an already folded prefix. 0 if the name starts with it, a name
+// that ends early compares less
+inline static int CompareFoldedPrefix(const char* name, std::string_view foldedPrefix) {
+    for(size_t i = 0; i < foldedPrefix.size(); i++) {
+        const unsigned char l = FoldAscii(static_cast<unsigned char>(name[i]));
+        const unsigned char r = static_cast<unsigned char>(foldedPrefix[i]);
+        if(l != r) return l < r ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sorts `ids` by folded name, ties by id so the order doesn't depend on the sort. Names are compared on a packed key
+// of their first 8 bytes before the whole name is looked at. With a pool the ids are sorted in chunks that are merged
+// pairwise after, each pass of merges spread over the pool too
+inline static void SortByFoldedName(std::vector<uint32_t>& ids, const char* arena, const std::vector<uint32_t>& nameOffsets, WorkStealingPool* pool) {
+    std::vector<uint64_t> keys(nameOffsets.size());
+    for(size_t i = 0; i < nameOffsets.size(); i++) {
+        keys[i] = FoldedKey(arena + nameOffsets[i]);
+    }
+
+    const auto xLess = [&](uint32_t lhs, uint32_t rhs) {
+        if(keys[lhs] != keys[rhs]) return keys[lhs] < keys[rhs];
+        const int order = CompareFolded(arena + nameOffsets[lhs], arena + nameOffsets[rhs]);
+        return order != 0 ? order < 0 : lhs < rhs;
+    };
+
+    if(pool == nullptr || pool->numThreads() < 2 || ids.size() < PARALLEL_SORT_MIN_SIZE) {
+        std::sort(ids.begin(), ids.end(), xLess);
+        return;
+    }
+
+    const size_t numChunks = pool->numThreads() * PARALLEL_SORT_CHUNKS_PER_THREAD;
+    std::vector<size_t> bounds;
+    for(size_t chunk = 0; chunk <= numChunks; chunk++) {
+        bounds.push_back(ids.size() * chunk / numChunks);
+    }
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t chunk = 0; chunk < numChunks; chunk++) {
+        pool->submit(group, [&, chunk](size_t) {
+            std::sort(ids.begin() + bounds[chunk], ids.begin() + bounds[chunk + 1], xLess);
+        });
+    }
+    pool->wait(group);
+
+    // sorted runs of `width` chunks are merged into runs of twice that
+    for(size_t width = 1; width < numChunks; width *= 2) {
+        for(size_t chunk = 0; chunk + width < numChunks; chunk += 2 * width) {
+            pool->submit(group, [&, chunk, width](size_t) {
+                const size_t end = std::min(chunk + 2 * width, numChunks);
+                std::inplace_merge(ids.begin() + bounds[chunk], ids.begin() + bounds[chunk + width], ids.begin() + bounds[end], xLess);
+            });
+        }
+        pool->wait(group);
+    }
+}
+
+FileIndex::FileIndex() = default;
+FileIndex::~FileIndex() = default;
+FileIndex::FileIndex(FileIndex&&) = default;
+FileIndex& FileIndex::operator=(FileIndex&&) = default;
+
+bool FileIndex::build(WorkStealingPool& pool, const Path& root) {
+    FileSystem::DirectoryTree tree;
+    if(!tree.build(pool, root)) {
+        printf("Failed to walk %s for the file index\n", root.str().c_str());
+        return false;
+    }
+
+    build(tree, &pool);
+    return true;
+}
+
+void FileIndex::build(const FileSystem::DirectoryTree& tree, WorkStealingPool* pool) {
+    if(tree.isEmpty()) {
+        clear();
+        return;
+    }
+
+    Nodes nodes;
+    for(uint32_t node = 0; node < tree.size(); node++) {
+        nodes.add(tree.getName(node), tree.getParent(node), tree.getAttributes(node));
+
+        const FileSystem::DirectoryTree::NodeRange children = tree.getChildren(node);
+        nodes.firstChildren[node] = children.begin;
+        nodes.numChildren[node] = children.end - children.begin;
+    }
+
+    std::vector<char> image;
+    writeImage(nodes, pool, image);
+
+    mFile.close();
+    mBuffer = std::move(image);
+    setImage(mBuffer.data(), mBuffer.size());
+    resetChanges();
+}
+
+bool FileIndex::load(const Path& path) {
+    FileSystem::MappedFile file;
+    if(!file.open(path)) return false;
+
+    if(!setImage(file.data(), file.size())) {
+        printf("%s isn't a file index of version %u\n", path.str().c_str(), FORMAT_VERSION);
+        return false;
+    }
+
+    // the tables point into the mapping, which stays where it is when the file is moved
+    mFile = std::move(file);
+    mBuffer = std::vector<char>();
+    resetChanges();
+    return true;
+}
+
+bool FileIndex::save(const Path& path, WorkStealingPool* pool) {
+    if(isEmpty()) return false;
+
+    // live nodes again in level order, a directory's added children after the ones from the image
+    Nodes nodes;
+    std::vector<uint32_t> order = { ROOT };
+    std::vector<uint32_t> newIds(numNodes(), NO_NODE);
+    std::vector<uint32_t> children;
+
+    nodes.add(getName(ROOT), NO_NODE, getAttributes(ROOT));
+    newIds[ROOT] = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        const uint32_t node = order[i];
+
+        children.clear();
+        collectChildren(node, children);
+
+        nodes.firstChildren[i] = static_cast<uint32_t>(order.size());
+        nodes.numChildren[i] = static_cast<uint32_t>(children.size());
+        for(uint32_t child : children) {
+            newIds[child] = static_cast<uint32_t>(order.size());
+            order.push_back(child);
+            nodes.add(getName(child), newIds[node], getAttributes(child));
+        }
+    }
+
+    std::vector<char> image;
+    writeImage(nodes, pool, image);
+
+    // windows won't replace a file that's still mapped, the new image is used from memory until it's mapped again
+    mFile.close();
+    mBuffer = std::move(image);
+    setImage(mBuffer.data(), mBuffer.size());
+    resetChanges();
+
+    if(!FileSystem::writeFileAtomically(path, mBuffer.data(), mBuffer.size())) {
+        printf("Failed to write the file index %s\n", path.str().c_str());
+        return false;
+    }
+
+    // mapped, the pages are shared with the page cache instead of being a private copy
+    FileSystem::MappedFile file;
+    if(file.open(path) && setImage(file.data(), file.size())) {
+        mFile = std::move(file);
+        mBuffer = std::vector<char>();
+    }
+    return true;
+}
+
+void FileIndex::clear() {
+    mFile.close();
+    mBuffer = std::vector<char>();
+    mImageSize = 0;
+
+    mNumImageNodes = 0;
+    mParents = nullptr;
+    mFirstChildren = nullptr;
+    mNumChildren = nullptr;
+    mNameOffsets = nullptr;
+    mSortedByName = nullptr;
+    mAttributes = nullptr;
+    mArena = std::string_view();
+
+    resetChanges();
+}
+
+bool FileIndex::setImage(const char* image, size_t size) {
+    if(image == nullptr || size < sizeof(Header)) return false;
+
+    Header header;
+    memcpy(&header, image, sizeof(Header));
+
+    if(memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) return false;
+    if(header.version != FORMAT_VERSION || header.imageSize != size) return false;
+    if(header.numNodes == 0 || header.arenaSize == 0) return false;
+
+    const uint64_t numNodes = header.numNodes;
+    const auto xFits = [&](uint64_t offset, uint64_t bytes) {
+        return offset % 8 == 0 && offset >= sizeof(Header) && offset <= size && bytes <= size - offset;
+    };
+    if(!xFits(header.parents, numNodes * 4) || !xFits(header.firstChildren, numNodes * 4) || !xFits(header.numChildren, numNodes * 4) ||
+       !xFits(header.nameOffsets, numNodes * 4) || !xFits(header.sortedByName, (numNodes - 1) * 4) ||
+       !xFits(header.attributes, numNodes) || !xFits(header.arena, header.arenaSize)) {
+        return false;
+    }
+    // the scans and the name lookups rely on the last name being terminated too
+    if(image[header.arena + header.arenaSize - 1] != '\0') return false;
+
+    mImageSize = size;
+    mNumImageNodes = header.numNodes;
+    mParents = reinterpret_cast<const uint32_t*>(image + header.parents);
+    mFirstChildren = reinterpret_cast<const uint32_t*>(image + header.firstChildren);
+    mNumChildren = reinterpret_cast<const uint32_t*>(image + header.numChildren);
+    mNameOffsets = reinterpret_cast<const uint32_t*>(image + header.nameOffsets);
+    mSortedByName = reinterpret_cast<const uint32_t*>(image + header.sortedByName);
+    mAttributes = reinterpret_cast<const uint8_t*>(image + header.attributes);
+    mArena = std::string_view(image + header.arena, header.arenaSize);
+    return true;
+}
+
+void FileIndex::resetChanges() {
+    mRemovedImageNodes.reset(mNumImageNodes);
+    mAddedArena = std::vector<char>();
+    mAddedNameOffsets = std::vector<uint32_t>();
+    mAddedNameLengths = std::vector<uint32_t>();
+    mAddedParents = std::vector<uint32_t>();
+    mAddedAttributes = std::vector<uint8_t>();
+    mAddedRemoved = std::vector<bool>();
+    mAddedChildren.clear();
+
+    mNumEntries = mNumImageNodes;
+    mNumChanges = 0;
+}
+
+std::string_view FileIndex::getName(uint32_t node) const {
+    if(node < mNumImageNodes) {
+        const size_t begin = mNameOffsets[node];
+        const size_t end = node + 1 < mNumImageNodes ? mNameOffsets[node + 1] : mArena.size();
+        return mArena.substr(begin, end - begin - 1);
+    }
+
+    const uint32_t added = node - mNumImageNodes;
+    return std::string_view(&mAddedArena[mAddedNameOffsets[added]], mAddedNameLengths[added]);
+}
+
+uint32_t FileIndex::getParent(uint32_t node) const {
+    return node < mNumImageNodes ? mParents[node] : mAddedParents[node - mNumImageNodes];
+}
+
+int FileIndex::getAttributes(uint32_t node) const {
+    return node < mNumImageNodes ? mAttributes[node] : mAddedAttributes[node - mNumImageNodes];
+}
+
+bool FileIndex::isRemoved(uint32_t node) const {
+    return node < mNumImageNodes ? mRemovedImageNodes.test(node) : mAddedRemoved[node - mNumImageNodes];
+}
+
+void FileIndex::buildPath(uint32_t node, std::string& out) const {
+    // only the root path can end in a separator, e.g. "/" or "C:\"
+    const std::string_view rootName = getName(ROOT);
+    const bool rootHasSeparator = !rootName.empty() && rootName.back() == Path::SEPARATOR;
+
+    // walk up twice, once to measure and once to fill the string back to front
+    size_t length = 0;
+    for(uint32_t current = node; current != ROOT; current = getParent(current)) {
+        length += getName(current).size() + 1;
+    }
+    length += rootName.size();
+    if(node != ROOT && rootHasSeparator) length--;
+
+    out.resize(length);
+
+    size_t end = length;
+    for(uint32_t current = node; current != ROOT; current = getParent(current)) {
+        const std::string_view name = getName(current);
+        end -= name.size();
+        memcpy(&out[end], name.data(), name.size());
+
+        if(getParent(current) != ROOT || !rootHasSeparator) {
+            out[--end] = Path::SEPARATOR;
+        }
+    }
+    memcpy(&out[0], rootName.data(), rootName.size());
+}
+
+std::string FileIndex::getPath(uint32_t node) const {
+    std::string result;
+    buildPath(node, result);
+    return result;
+}
+
+uint32_t FileIndex::findPath(std::string_view path) const {
+    if(isEmpty()) return NO_NODE;
+
+    const std::string_view rootName = rootPath();
+    if(path.size() < rootName.size() || path.substr(0, rootName.size()) != rootName) return NO_NODE;
+
+    std::string_view rest = path.substr(rootName.size());
+    if(!rest.empty() && (rootName.empty() || rootName.back() != Path::SEPARATOR)) {
+        // "/a/bc" isn't below "/a/b"
+        if(rest.front() != Path::SEPARATOR) return NO_NODE;
+    }
+
+    uint32_t node = ROOT;
+    while(!rest.empty() && node != NO_NODE) {
+        if(rest.front() == Path::SEPARATOR) {
+            rest.remove_prefix(1);
+            continue;
+        }
+
+        const size_t separator = rest.find(Path::SEPARATOR);
+        node = findChild(node, rest.substr(0, separator));
+        rest = separator == std::string_view::npos ? std::string_view() : rest.substr(separator);
+    }
+    return node;
+}
+
+uint32_t FileIndex::findChild(uint32_t parent, std::string_view name) const {
+    if(parent < mNumImageNodes) {
+        const uint32_t begin = mFirstChildren[parent];
+        for(uint32_t child = begin; child < begin + mNumChildren[parent]; child++) {
+            if(!mRemovedImageNodes.test(child) && getName(child) == name) return child;
+        }
+    }
+
+    const auto range = mAddedChildren.equal_range(parent);
+    for(auto it = range.first; it != range.second; ++it) {
+        if(!isRemoved(it->second) && getName(it->second) == name) return it->second;
+    }
+    return NO_NODE;
+}
+
+void FileIndex::collectChildren(uint32_t node, std::vector<uint32_t>& out_Children) const {
+    if(node < mNumImageNodes) {
+        const uint32_t begin = mFirstChildren[node];
+        for(uint32_t child = begin; child < begin + mNumChildren[node]; child++) {
+            if(!mRemovedImageNodes.test(child)) out_Children.push_back(child);
+        }
+    }
+
+    // the multimap hands them out in no particular order, ids are the order they were added in
+    const size_t firstAdded = out_Children.size();
+    const auto range = mAddedChildren.equal_range(node);
+    for(auto it = range.first; it != range.second; ++it) {
+        if(!isRemoved(it->second)) out_Children.push_back(it->second);
+    }
+    std::sort(out_Children.begin() + firstAdded, out_Children.end());
+}
+
+void FileIndex::findSubstring(std::string_view needle, SubstringCase matchCase, std::vector<uint32_t>& out_Nodes,
+                              size_t maxResults, WorkStealingPool* pool) const {
+    if(isEmpty() || maxResults == 0) return;
+
+    // the root's name is the whole path, it's not a match candidate
+    BitSet matches;
+    matches.reset(mNumImageNodes);
+    if(pool != nullptr && pool->numThreads() > 1 && mNumImageNodes > SCAN_CHUNK_SIZE) {
+        WorkStealingPool::TaskGroup group;
+        for(size_t chunkStart = 0; chunkStart < mNumImageNodes; chunkStart += SCAN_CHUNK_SIZE) {
+            pool->submit(group, [&, chunkStart](size_t) {
+                const size_t begin = std::max<size_t>(chunkStart, ROOT + 1);
+                const size_t end = std::min<size_t>(chunkStart + SCAN_CHUNK_SIZE, mNumImageNodes);
+                FindInNames(mArena, mNameOffsets, mNumImageNodes, begin, end, needle, matchCase, matches);
+            });
+        }
+        pool->wait(group);
+    } else {
+        FindInNames(mArena, mNameOffsets, mNumImageNodes, ROOT + 1, mNumImageNodes, needle, matchCase, matches);
+    }
+
+    // both have one bit per image node
+    std::vector<uint64_t>& matchWords = matches.words();
+    const std::vector<uint64_t>& removedWords = mRemovedImageNodes.words();
+    for(size_t word = 0; word < matchWords.size(); word++) {
+        matchWords[word] &= ~removedWords[word];
+    }
+
+    for(size_t node = matches.findNext(0); node != BitSet::NPOS; node = matches.findNext(node + 1)) {
+        out_Nodes.push_back(static_cast<uint32_t>(node));
+        if(--maxResults == 0) return;
+    }
+
+    for(uint32_t node = mNumImageNodes; node < numNodes(); node++) {
+        if(!isRemoved(node) && ContainsSubstring(getName(node), needle, matchCase)) {
+            out_Nodes.push_back(node);
+            if(--maxResults == 0) return;
+        }
+    }
+}
+
+void FileIndex::findPrefix(std::string_view prefix, SubstringCase matchCase, std::vector<uint32_t>& out_Nodes, size_t maxResults) const {
+    // a NUL can't be in a name and the compare below would read past one
+    if(isEmpty() || maxResults == 0 || prefix.find('\0') != std::string_view::npos) return;
+
+    std::string folded(prefix);
+    for(char& c : folded) {
+        c = static_cast<char>(FoldAscii(static_cast<unsigned char>(c)));
+    }
+
+    const auto xCompare = [&](uint32_t node) {
+        return CompareFoldedPrefix(mArena.data() + mNameOffsets[node], folded);
+    };
+
+    // the folded order puts every name with the prefix in one run
+    const uint32_t* sortedEnd = mSortedByName + (mNumImageNodes - 1);
+    const uint32_t* begin = std::partition_point(mSortedByName, sortedEnd, [&](uint32_t node) { return xCompare(node) < 0; });
+    const uint32_t* end = std::partition_point(begin, sortedEnd, [&](uint32_t node) { return xCompare(node) == 0; });
+
+    for(const uint32_t* it = begin; it != end; ++it) {
+        if(mRemovedImageNodes.test(*it)) continue;
+        if(matchCase == SubstringCase::Sensitive && getName(*it).substr(0, prefix.size()) != prefix) continue;
+
+        out_Nodes.push_back(*it);
+        if(--maxResults == 0) return;
+    }
+
+    for(uint32_t node = mNumImageNodes; node < numNodes(); node++) {
+        if(isRemoved(node)) continue;
+
+        const std::string_view name = getName(node);
+        if(name.size() < prefix.size()) continue;
+
+        const bool matches = matchCase == SubstringCase::Sensitive
+            ? name.substr(0, prefix.size()) == prefix
+            : CompareFoldedPrefix(name.data(), folded) == 0;
+        if(matches) {
+            out_Nodes.push_back(node);
+            if(--maxResults == 0) return;
+        }
+    }
+}
+
+uint32_t FileIndex::addNode(uint32_t parent, std::string_view name, int attributes) {
+    const uint32_t node = numNodes();
+
+    mAddedNameOffsets.push_back(static_cast<uint32_t>(mAddedArena.size()));
+    mAddedNameLengths.push_back(static_cast<uint32_t>(name.size()));
+    mAddedArena.insert(mAddedArena.end(), name.begin(), name.end());
+    // NUL terminated like the image's names, the prefix compare reads up to it
+    mAddedArena.push_back('\0');
+    mAddedParents.push_back(parent);
+    mAddedAttributes.push_back(static_cast<uint8_t>(attributes));
+    mAddedRemoved.push_back(false);
+    mAddedChildren.emplace(parent, node);
+
+    mNumEntries++;
+    mNumChanges++;
+    return node;
+}
+
+void FileIndex::addTree(const FileSystem::DirectoryTree& tree, uint32_t treeNode, uint32_t parent) {
+    // level order like the tree's, a node's parent always has its id already. Pairs of a tree node and its id
+    std::vector<std::pair<uint32_t, uint32_t>> queue = { { treeNode, parent } };
+    for(size_t i = 0; i < queue.size(); i++) {
+        const auto [current, id] = queue[i];
+
+        const FileSystem::DirectoryTree::NodeRange children = tree.getChildren(current);
+        for(uint32_t child = children.begin; child < children.end; child++) {
+            queue.push_back({ child, addNode(id, tree.getName(child), tree.getAttributes(child)) });
+        }
+    }
+}
+
+void FileIndex::removeSubtree(uint32_t node) {
+    std::vector<uint32_t> stack = { node };
+    while(!stack.empty()) {
+        const uint32_t current = stack.back();
+        stack.pop_back();
+
+        // children that were removed before are skipped by collectChildren, so every node is counted once
+        collectChildren(current, stack);
+
+        if(current < mNumImageNodes) {
+            mRemovedImageNodes.set(current);
+        } else {
+            mAddedRemoved[current - mNumImageNodes] = true;
+        }
+        mNumEntries--;
+        mNumChanges++;
+    }
+}
+
+bool FileIndex::applyChanges(WorkStealingPool& pool, std::string_view directory, const std::vector<std::string>& names) {
+    const uint32_t directoryNode = findPath(directory);
+    if(directoryNode == NO_NODE || !isDirectory(directoryNode)) return false;
+
+    const Path directoryPath{std::string(directory)};
+
+    // watches report a name once per change, it only has to be looked at once
+    std::vector<std::string> uniqueNames = names;
+    std::sort(uniqueNames.begin(), uniqueNames.end());
+    uniqueNames.erase(std::unique(uniqueNames.begin(), uniqueNames.end()), uniqueNames.end());
+
+    for(const std::string& name : uniqueNames) {
+        FileSystem::EntryChange entry;
+        const bool exists = FileSystem::getEntryInfo(directoryPath, name, entry);
+
+        // entries that look the same stay as they are, what's below a directory is up to the watches there
+        const uint32_t existing = findChild(directoryNode, name);
+        if(existing != NO_NODE) {
+            if(exists && getAttributes(existing) == entry.attributes) continue;
+            removeSubtree(existing);
+        }
+        if(!exists) continue;
+
+        const uint32_t node = addNode(directoryNode, name, entry.attributes);
+
+        // a directory that showed up may have come with everything in it, a move for one
+        const int attributes = entry.attributes;
+        if((attributes & FileSystem::FileAttributes::DIRECTORY) && !(attributes & FileSystem::FileAttributes::SYMLINK)) {
+            Path childPath = directoryPath;
+            childPath.appendName(name);
+
+            FileSystem::DirectoryTree tree;
+            if(tree.build(pool, childPath)) addTree(tree, FileSystem::DirectoryTree::ROOT, node);
+        }
+    }
+    return true;
+}
+
+bool FileIndex::rescan(WorkStealingPool& pool, std::string_view directory) {
+    const uint32_t directoryNode = findPath(directory);
+    if(directoryNode == NO_NODE || !isDirectory(directoryNode)) return false;
+
+    std::vector<uint32_t> children;
+    collectChildren(directoryNode, children);
+    for(uint32_t child : children) {
+        removeSubtree(child);
+    }
+
+    FileSystem::DirectoryTree tree;
+    if(tree.build(pool, Path(std::string(directory)))) {
+        addTree(tree, FileSystem::DirectoryTree::ROOT, directoryNode);
+    } else if(directoryNode != ROOT) {
+        // it went away itself
+        removeSubtree(directoryNode);
+    }
+    return true;
+}
+
+size_t FileIndex::applyTree(std::string_view directory, const FileSystem::DirectoryTree& tree) {
+    const uint32_t directoryNode = findPath(directory);
+    if(directoryNode == NO_NODE || !isDirectory(directoryNode)) return 0;
+
+    const size_t numChangesBefore = mNumChanges;
+    if(tree.isEmpty()) {
+        // it went away itself
+        if(directoryNode != ROOT) {
+            removeSubtree(directoryNode);
+        } else {
+            std::vector<uint32_t> children;
+            collectChildren(ROOT, children);
+            for(uint32_t child : children) {
+                removeSubtree(child);
+            }
+        }
+        return mNumChanges - numChangesBefore;
+    }
+
+    // pairs of the same directory in the index and in the tree
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { directoryNode, FileSystem::DirectoryTree::ROOT } };
+    std::vector<uint32_t> children;
+    std::vector<uint32_t> kept;
+    std::unordered_map<std::string_view, uint32_t> byName;
+    while(!stack.empty()) {
+        const auto [node, treeNode] = stack.back();
+        stack.pop_back();
+
+        children.clear();
+        collectChildren(node, children);
+        byName.clear();
+        for(uint32_t child : children) {
+            byName.emplace(getName(child), child);
+        }
+
+        // matched up before anything is added, names of added nodes move when their arena grows
+        const FileSystem::DirectoryTree::NodeRange treeChildren = tree.getChildren(treeNode);
+        kept.assign(treeChildren.end - treeChildren.begin, NO_NODE);
+        for(uint32_t treeChild = treeChildren.begin; treeChild < treeChildren.end; treeChild++) {
+            const auto it = byName.find(tree.getName(treeChild));
+            if(it == byName.end() || getAttributes(it->second) != tree.getAttributes(treeChild)) continue;
+
+            kept[treeChild - treeChildren.begin] = it->second;
+            byName.erase(it);
+        }
+
+        // what's left went away or turned into something else
+        for(const auto& [name, child] : byName) {
+            removeSubtree(child);
+        }
+        byName.clear();
+
+        for(uint32_t treeChild = treeChildren.begin; treeChild < treeChildren.end; treeChild++) {
+            const uint32_t child = kept[treeChild - treeChildren.begin];
+            if(child == NO_NODE) {
+                addTree(tree, treeChild, addNode(node, tree.getName(treeChild), tree.getAttributes(treeChild)));
+            } else if(tree.isDirectory(treeChild)) {
+                stack.push_back({ child, treeChild });
+            }
+        }
+    }
+    return mNumChanges - numChangesBefore;
+}
+
+bool FileIndex::watch(WatchRegistry& registry, const std::string& directory) {
+    uint64_t generation = 0;
+    if(!registry.subscribe(directory, generation)) return false;
+
+    // one subscription per directory, a second one would never be given back
+    if(!mWatches.emplace(directory, generation).second) {
+        registry.unsubscribe(directory);
+    }
+    return true;
+}
+
+size_t FileIndex::watchTree(WatchRegistry& registry, size_t maxWatches) {
+    if(isEmpty()) return mWatches.size();
+
+    std::vector<uint32_t> queue = { ROOT };
+    std::vector<uint32_t> children;
+    std::string path;
+    for(size_t i = 0; i < queue.size() && mWatches.size() < maxWatches; i++) {
+        const uint32_t node = queue[i];
+        buildPath(node, path);
+        if(!watch(registry, path)) continue;
+
+        children.clear();
+        collectChildren(node, children);
+        for(uint32_t child : children) {
+            const int attributes = getAttributes(child);
+            if((attributes & FileSystem::FileAttributes::DIRECTORY) && !(attributes & FileSystem::FileAttributes::SYMLINK)) {
+                queue.push_back(child);
+            }
+        }
+    }
+    return mWatches.size();
+}
+
+std::vector<std::string> FileIndex::unwatchedDirectories() const {
+    std::vector<std::string> unwatched;
+    if(isEmpty()) return unwatched;
+
+    // down through the watched directories only, everything else hangs off the first unwatched one on its way up
+    std::vector<uint32_t> stack = { ROOT };
+    std::vector<uint32_t> children;
+    std::string path;
+    while(!stack.empty()) {
+        const uint32_t node = stack.back();
+        stack.pop_back();
+
+        buildPath(node, path);
+        if(mWatches.count(path) == 0) {
+            unwatched.push_back(path);
+            continue;
+        }
+
+        children.clear();
+        collectChildren(node, children);
+        for(uint32_t child : children) {
+            const int attributes = getAttributes(child);
+            if((attributes & FileSystem::FileAttributes::DIRECTORY) && !(attributes & FileSystem::FileAttributes::SYMLINK)) {
+                stack.push_back(child);
+            }
+        }
+    }
+    return unwatched;
+}
+
+void FileIndex::unwatchAll(WatchRegistry& registry) {
+    for(const auto& [directory, generation] : mWatches) {
+        registry.unsubscribe(directory);
+    }
+    mWatches.clear();
+}
+
+size_t FileIndex::pollWatches(WatchRegistry& registry, WorkStealingPool& pool) {
+    size_t numChanged = 0;
+    std::vector<std::string> names;
+    for(auto& [directory, generation] : mWatches) {
+        const uint64_t current = registry.poll(directory);
+        if(current == 0 || current == generation) continue;
+
+        names.clear();
+        uint64_t upTo = current;
+        if(registry.changesSince(directory, generation, names, upTo) && applyChanges(pool, directory, names)) {
+            generation = upTo;
+        } else {
+            rescan(pool, directory);
+            generation = current;
+        }
+        numChanged++;
+    }
+    return numChanged;
+}
+
+size_t FileIndex::changesMemoryUsage() const {
+    return mRemovedImageNodes.words().capacity() * sizeof(uint64_t)
+        + mAddedArena.capacity()
+        + (mAddedNameOffsets.capacity() + mAddedNameLengths.capacity() + mAddedParents.capacity()) * sizeof(uint32_t)
+        + mAddedAttributes.capacity()
+        + mAddedRemoved.capacity() / 8
+        + mAddedChildren.size() * (sizeof(std::pair<uint32_t, uint32_t>) + 2 * sizeof(void*))
+        + mAddedChildren.bucket_count() * sizeof(void*);
+}
+
+void FileIndex::writeImage(const Nodes& nodes, WorkStealingPool* pool, std::vector<char>& out_Image) {
+    const uint32_t numNodes = static_cast<uint32_t>(nodes.size());
+
+    std::vector<uint32_t> sortedByName;
+    sortedByName.reserve(numNodes - 1);
+    for(uint32_t node = ROOT + 1; node < numNodes; node++) {
+        sortedByName.push_back(node);
+    }
+    SortByFoldedName(sortedByName, nodes.arena.data(), nodes.nameOffsets, pool);
+
+    Header header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.numNodes = numNodes;
+    header.arenaSize = nodes.arena.size();
+
+    size_t offset = AlignUp(sizeof(Header));
+    const auto xPlace = [&](uint64_t& out_Offset, size_t bytes) {
+        out_Offset = offset;
+        offset = AlignUp(offset + bytes);
+    };
+    xPlace(header.parents, numNodes * sizeof(uint32_t));
+    xPlace(header.firstChildren, numNodes * sizeof(uint32_t));
+    xPlace(header.numChildren, numNodes * sizeof(uint32_t));
+    xPlace(header.nameOffsets, numNodes * sizeof(uint32_t));
+    xPlace(header.sortedByName, sortedByName.size() * sizeof(uint32_t));
+    xPlace(header.attributes, numNodes);
+    xPlace(header.arena, nodes.arena.size());
+    header.imageSize = offset;
+
+    out_Image.assign(offset, '\0');
+    memcpy(out_Image.data(), &header, sizeof(header));
+    memcpy(&out_Image[header.parents], nodes.parents.data(), numNodes * sizeof(uint32_t));
+    memcpy(&out_Image[header.firstChildren], nodes.firstChildren.data(), numNodes * sizeof(uint32_t));
+    memcpy(&out_Image[header.numChildren], nodes.numChildren.data(), numNodes * sizeof(uint32_t));
+    memcpy(&out_Image[header.nameOffsets], nodes.nameOffsets.data(), numNodes * sizeof(uint32_t));
+    memcpy(&out_Image[header.sortedByName], sortedByName.data(), sortedByName.size() * sizeof(uint32_t));
+    memcpy(&out_Image[header.attributes], nodes.attributes.data(), numNodes);
+    memcpy(&out_Image[header.arena], nodes.arena.data(), nodes.arena.size());
+}
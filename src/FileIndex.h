@@ -0,0 +1,165 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "BitSet.h"
+#include "FileSystem.h"
+#include "SubstringSearch.h"
+
+class Path;
+class WatchRegistry;
+class WorkStealingPool;
+
+namespace FileSystem {
+    class DirectoryTree;
+}
+
+// The name of every entry below a root, kept in a file that's mapped back in so a big tree is searchable right
+// after startup without walking it again. The file is one image of flat tables like DirectoryTree's:
+//   - parent links and contiguous child ranges in level order, full paths are put together on demand
+//   - every name NUL terminated in one arena in node order, which FindInNames scans for substrings
+//   - the nodes sorted by ASCII folded name, which prefix queries binary search
+// An index that was built in memory uses the same image from a buffer instead of a mapping.
+// Changes after that are kept next to the image: removed nodes are flagged, added ones live in small tables of
+// their own with ids following the image's. save() merges them into a new image.
+// Queries are const and may run concurrently with each other, but not with anything that changes the index
+class FileIndex {
+public:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+    static constexpr uint32_t ROOT = 0;
+    // bumped whenever the layout of the file changes, older files are rebuilt instead of read
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    FileIndex();
+    ~FileIndex();
+
+    FileIndex(const FileIndex&) = delete;
+    FileIndex& operator=(const FileIndex&) = delete;
+    FileIndex(FileIndex&&);
+    FileIndex& operator=(FileIndex&&);
+
+    // walks `root` on `pool` and replaces the index with what's there now
+    bool build(WorkStealingPool& pool, const Path& root);
+    // the same from a tree that was already walked. The sort of the name table is spread over `pool` if it's given
+    void build(const FileSystem::DirectoryTree& tree, WorkStealingPool* pool = nullptr);
+
+    // maps an index saved before, false if there's no such file or it isn't an index of this version
+    bool load(const Path& path);
+    // writes the index with the changes since it was built or loaded merged in and maps the new file
+    bool save(const Path& path, WorkStealingPool* pool = nullptr);
+    void clear();
+
+    inline bool isEmpty() const { return numNodes() == 0; }
+    // ids go up to numNodes() and stay valid until the next build, load or save. Some may be removed ones
+    inline uint32_t numNodes() const { return mNumImageNodes + static_cast<uint32_t>(mAddedParents.size()); }
+    // nodes that aren't removed, the root included
+    inline size_t numEntries() const { return mNumEntries; }
+    // nodes added or removed since the last build, load or save
+    inline size_t numChanges() const { return mNumChanges; }
+    // true while the image is a mapped file rather than a buffer
+    inline bool isMapped() const { return mFile.isOpen(); }
+
+    std::string_view getName(uint32_t node) const;
+    uint32_t getParent(uint32_t node) const;
+    int getAttributes(uint32_t node) const;
+    inline bool isDirectory(uint32_t node) const { return getAttributes(node) & FileSystem::FileAttributes::DIRECTORY; }
+    bool isRemoved(uint32_t node) const;
+
+    // the root's name is the full path the index was built from
+    inline std::string_view rootPath() const { return isEmpty() ? std::string_view() : getName(ROOT); }
+
+    // writes the full path of `node` into `out`, reusing its capacity
+    void buildPath(uint32_t node, std::string& out) const;
+    std::string getPath(uint32_t node) const;
+
+    // the node of a full path below or at the root, NO_NODE if it isn't in the index
+    uint32_t findPath(std::string_view path) const;
+    // the child of `parent` called `name`, NO_NODE if there isn't one
+    uint32_t findChild(uint32_t parent, std::string_view name) const;
+
+    // Nodes whose name contains `needle`, in level order with the added ones after the image's. The image's names
+    // are scanned in chunks spread over `pool` if it's given. Stops at `maxResults`
+    void findSubstring(std::string_view needle, SubstringCase matchCase, std::vector<uint32_t>& out_Nodes,
+                       size_t maxResults = SIZE_MAX, WorkStealingPool* pool = nullptr) const;
+    // nodes whose name starts with `prefix`, the image's ones in folded name order. Stops at `maxResults`
+    void findPrefix(std::string_view prefix, SubstringCase matchCase, std::vector<uint32_t>& out_Nodes, size_t maxResults = SIZE_MAX) const;
+
+    // Brings entries `names` of `directory` up to date with the disk, the way a directory watch reports changes:
+    // entries that went away are removed with everything below them, new ones are added and new directories
+    // walked on `pool`. False if `directory` isn't an indexed directory
+    bool applyChanges(WorkStealingPool& pool, std::string_view directory, const std::vector<std::string>& names);
+    // walks `directory` again and replaces everything below it, for changes nobody knows the names of
+    bool rescan(WorkStealingPool& pool, std::string_view directory);
+    // Brings `directory` and everything below it in line with `tree`, a walk of it taken by the caller. Unlike
+    // rescan() entries that look the same are kept, so only what differs counts as a change. An empty tree means
+    // the directory went away. Returns how many nodes changed
+    size_t applyTree(std::string_view directory, const FileSystem::DirectoryTree& tree);
+
+    // Follows `directory` through `registry`, pollWatches() patches in what changed there. Watches are per
+    // directory and the OS limits how many there can be, so watch the directories that matter
+    bool watch(WatchRegistry& registry, const std::string& directory);
+    // watches indexed directories shallowest first until `maxWatches` are watched, returns how many are
+    size_t watchTree(WatchRegistry& registry, size_t maxWatches);
+    void unwatchAll(WatchRegistry& registry);
+    inline size_t numWatches() const { return mWatches.size(); }
+    // The unwatched directories right below watched ones, or the root if it isn't watched. Nothing reports what
+    // changes in them or below them: they're what watchTree() ran out of watches for and directories that showed up
+    // after it, walk them again every so often and applyTree() the result
+    std::vector<std::string> unwatchedDirectories() const;
+    // applies whatever the watched directories reported since the last call, returns how many changed
+    size_t pollWatches(WatchRegistry& registry, WorkStealingPool& pool);
+
+    // bytes of the image, mapped or not, and of the changes next to it
+    inline size_t imageSize() const { return mImageSize; }
+    size_t changesMemoryUsage() const;
+
+private:
+    struct Header;
+    struct Nodes;
+
+    // lays the tables of `nodes` out in one image the way Header describes it
+    static void writeImage(const Nodes& nodes, WorkStealingPool* pool, std::vector<char>& out_Image);
+    // points the tables at `image` once its header checks out, false and nothing changed if it doesn't
+    bool setImage(const char* image, size_t size);
+    void resetChanges();
+
+    // appends what's below `treeNode` of `tree` below `parent`, `treeNode` itself becomes `parent`
+    void addTree(const FileSystem::DirectoryTree& tree, uint32_t treeNode, uint32_t parent);
+    uint32_t addNode(uint32_t parent, std::string_view name, int attributes);
+    void removeSubtree(uint32_t node);
+
+    // pushes the children of `node` that aren't removed
+    void collectChildren(uint32_t node, std::vector<uint32_t>& out_Children) const;
+
+    FileSystem::MappedFile mFile;
+    std::vector<char> mBuffer;
+    size_t mImageSize = 0;
+
+    // tables of the image
+    uint32_t mNumImageNodes = 0;
+    const uint32_t* mParents = nullptr;
+    const uint32_t* mFirstChildren = nullptr;
+    const uint32_t* mNumChildren = nullptr;
+    const uint32_t* mNameOffsets = nullptr;
+    const uint32_t* mSortedByName = nullptr;
+    const uint8_t* mAttributes = nullptr;
+    std::string_view mArena;
+
+    // changes since, added nodes have ids from mNumImageNodes on
+    BitSet mRemovedImageNodes;
+    std::vector<char> mAddedArena;
+    std::vector<uint32_t> mAddedNameOffsets;
+    std::vector<uint32_t> mAddedNameLengths;
+    std::vector<uint32_t> mAddedParents;
+    std::vector<uint8_t> mAddedAttributes;
+    std::vector<bool> mAddedRemoved;
+    std::unordered_multimap<uint32_t, uint32_t> mAddedChildren;
+
+    size_t mNumEntries = 0;
+    size_t mNumChanges = 0;
+
+    // watched directory -> generation its changes were applied up to
+    std::unordered_map<std::string, uint64_t> mWatches;
+};
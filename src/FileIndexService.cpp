@@ -0,0 +1,275 @@
+#include "FileIndexService.h"
+#include "DirectoryTree.h"
+#include "FileFinder.h"
+#include "WatchRegistry.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+FileIndexService::FileIndexService(const Path& directory, size_t numThreads)
+    : mDirectory(directory),
+    mPool(numThreads) {
+    mThread = std::thread(&FileIndexService::run, this);
+}
+
+FileIndexService::~FileIndexService() {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        mAlive = false;
+    }
+    mCancel = true;
+    mWakeCondition.notify_all();
+    mThread.join();
+}
+
+void FileIndexService::request(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        if(root == mBusyRoot) return;
+        for(const Request& queued : mQueue) {
+            if(queued.root == root && !queued.isDrop) return;
+        }
+        mQueue.push_back({ root, false });
+    }
+    mWakeCondition.notify_one();
+}
+
+void FileIndexService::drop(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(), [&](const Request& queued) { return queued.root == root; }), mQueue.end());
+        mQueue.push_back({ root, true });
+
+        // the build in flight only notices between directories
+        if(root == mBusyRoot) mCancel = true;
+    }
+    mWakeCondition.notify_one();
+}
+
+void FileIndexService::setMaxWatchesPerIndex(size_t maxWatches) {
+    mMaxWatchesPerIndex = maxWatches;
+}
+
+void FileIndexService::setUnwatchedRefreshInterval(std::chrono::milliseconds interval) {
+    mUnwatchedRefreshInterval = interval;
+}
+
+std::vector<std::string> FileIndexService::readyRoots() const {
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+
+    std::vector<std::string> roots;
+    for(const auto& [root, index] : mIndexes) {
+        roots.push_back(root);
+    }
+    std::sort(roots.begin(), roots.end());
+    return roots;
+}
+
+std::string FileIndexService::busyRoot() const {
+    std::scoped_lock<std::mutex> lock(mQueueMutex);
+    return mBusyRoot;
+}
+
+bool FileIndexService::findMatches(const Path& directory, const FindQuery& query, const std::vector<std::string>& defaultPruneNames,
+                                   std::vector<std::string>& out_Paths) const {
+    const FindMatcher matcher(query);
+    if(!matcher.isValid()) return false;
+
+    std::vector<std::string> pruneNames = query.pruneNames;
+    if(query.useDefaultPrune) {
+        pruneNames.insert(pruneNames.end(), defaultPruneNames.begin(), defaultPruneNames.end());
+    }
+
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+
+    // the innermost root has the fewest names to go through
+    const FileIndex* index = nullptr;
+    uint32_t directoryNode = FileIndex::NO_NODE;
+    for(const auto& [root, candidate] : mIndexes) {
+        const uint32_t node = candidate.findPath(directory.str());
+        if(node != FileIndex::NO_NODE && candidate.isDirectory(node) && (index == nullptr || root.size() > index->rootPath().size())) {
+            index = &candidate;
+            directoryNode = node;
+        }
+    }
+    if(index == nullptr) return false;
+
+    std::vector<uint32_t> nodes;
+    const std::string_view literal = matcher.literal();
+    if(literal.empty()) {
+        for(uint32_t node = FileIndex::ROOT + 1; node < index->numNodes(); node++) {
+            if(!index->isRemoved(node)) nodes.push_back(node);
+        }
+    } else {
+        index->findSubstring(literal, matcher.isCaseSensitive() ? SubstringCase::Sensitive : SubstringCase::AsciiInsensitive, nodes);
+    }
+
+    std::string path;
+    for(uint32_t node : nodes) {
+        if(!matcher.isLiteral() && !matcher.matchesName(index->getName(node))) continue;
+
+        // below the directory searched, and not below a directory under it the walk wouldn't go into. A pruned
+        // directory itself is still a result
+        bool isInScope = false;
+        bool isPruned = false;
+        for(uint32_t parent = index->getParent(node); parent != FileIndex::NO_NODE && !isInScope; parent = index->getParent(parent)) {
+            isInScope = parent == directoryNode;
+            if(!isInScope && !isPruned) {
+                isPruned = std::find(pruneNames.begin(), pruneNames.end(), index->getName(parent)) != pruneNames.end();
+            }
+        }
+        if(!isInScope || isPruned) continue;
+
+        index->buildPath(node, path);
+        out_Paths.push_back(path);
+        if(out_Paths.size() >= FileFinder::MAX_RESULTS) break;
+    }
+    return true;
+}
+
+Path FileIndexService::indexPath(const std::string& root) const {
+    // FNV-1a of the root, the same root always gets the same file
+    uint64_t hash = 14695981039346656037ull;
+    for(char c : root) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.fidx", static_cast<unsigned long long>(hash));
+
+    Path path = mDirectory;
+    path.appendName(name);
+    return path;
+}
+
+void FileIndexService::run() {
+    auto lastRefresh = std::chrono::steady_clock::now();
+
+    while(true) {
+        Request request;
+        bool hasRequest = false;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mWakeCondition.wait_for(lock, POLL_INTERVAL, [this]() { return !mAlive || !mQueue.empty(); });
+
+            if(!mAlive) break;
+
+            if(!mQueue.empty()) {
+                request = std::move(mQueue.front());
+                mQueue.pop_front();
+                hasRequest = true;
+
+                // a drop of the root before this one is done with it
+                mCancel = false;
+                mBusyRoot = request.isDrop ? std::string() : request.root;
+            }
+        }
+
+        if(hasRequest) {
+            if(request.isDrop) {
+                dropIndex(request.root);
+            } else {
+                loadIndex(request.root);
+            }
+
+            std::scoped_lock<std::mutex> lock(mQueueMutex);
+            mBusyRoot.clear();
+        }
+
+        pollIndexes();
+
+        if(std::chrono::steady_clock::now() - lastRefresh >= mUnwatchedRefreshInterval.load()) {
+            refreshUnwatched();
+            lastRefresh = std::chrono::steady_clock::now();
+        }
+    }
+
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    for(auto& [root, index] : mIndexes) {
+        index.unwatchAll(WatchRegistry::shared());
+        if(index.numChanges() > 0) index.save(indexPath(root), &mPool);
+    }
+}
+
+void FileIndexService::loadIndex(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mIndexMutex);
+        if(mIndexes.count(root) > 0) return;
+    }
+
+    FileSystem::TraverseOptions options;
+    options.cancel = &mCancel;
+
+    const Path path = indexPath(root);
+    FileIndex index;
+    if(!index.load(path) || index.rootPath() != root) {
+        FileSystem::DirectoryTree tree;
+        if(!tree.build(mPool, Path(root), options) || mCancel) return;
+        index.build(tree, &mPool);
+    }
+
+    // watched first, so nothing that changes during the walk slips through. Only the differences count as changes
+    index.watchTree(WatchRegistry::shared(), mMaxWatchesPerIndex);
+    FileSystem::DirectoryTree tree;
+    tree.build(mPool, Path(root), options);
+    if(mCancel) {
+        index.unwatchAll(WatchRegistry::shared());
+        return;
+    }
+    index.applyTree(root, tree);
+    if(index.numChanges() > 0 || !index.isMapped()) index.save(path, &mPool);
+
+    printf("File index of %s: %zu entries, %zu watched directories, %zu kB\n", root.c_str(), index.numEntries(), index.numWatches(), index.imageSize() / 1024);
+
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    mIndexes.emplace(root, std::move(index));
+}
+
+void FileIndexService::dropIndex(const std::string& root) {
+    {
+        std::scoped_lock<std::mutex> lock(mIndexMutex);
+        auto it = mIndexes.find(root);
+        if(it != mIndexes.end()) {
+            it->second.unwatchAll(WatchRegistry::shared());
+            mIndexes.erase(it);
+        }
+    }
+
+    // unmapped by now, windows won't delete a mapped file
+    FileSystem::removeFile(indexPath(root));
+}
+
+void FileIndexService::pollIndexes() {
+    std::scoped_lock<std::mutex> lock(mIndexMutex);
+    for(auto& [root, index] : mIndexes) {
+        index.pollWatches(WatchRegistry::shared(), mPool);
+        if(index.numChanges() >= SAVE_AFTER_CHANGES) index.save(indexPath(root), &mPool);
+    }
+}
+
+void FileIndexService::refreshUnwatched() {
+    // walked without the lock, finds only wait for the differences to be patched in
+    std::vector<std::pair<std::string, std::vector<std::string>>> unwatched;
+    {
+        std::scoped_lock<std::mutex> lock(mIndexMutex);
+        for(const auto& [root, index] : mIndexes) {
+            unwatched.emplace_back(root, index.unwatchedDirectories());
+        }
+    }
+
+    FileSystem::TraverseOptions options;
+    options.cancel = &mCancel;
+
+    for(const auto& [root, directories] : unwatched) {
+        for(const std::string& directory : directories) {
+            FileSystem::DirectoryTree tree;
+            tree.build(mPool, Path(directory), options);
+            // a walk that was stopped halfway would take what it didn't get to for removed
+            if(mCancel) return;
+
+            std::scoped_lock<std::mutex> lock(mIndexMutex);
+            auto it = mIndexes.find(root);
+            if(it != mIndexes.end()) it->second.applyTree(directory, tree);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "FileIndex.h"
+#include "Path.h"
+#include "WorkStealingPool.h"
+
+struct FindQuery;
+
+// Keeps a FileIndex of every root it's asked to, so a find below one of them looks names up instead of walking.
+// An index saved before is loaded from its file, otherwise it's built. Either way its directories are watched and
+// it's compared with the disk once for what changed while nobody was looking, after that the watches keep it
+// current. Watches run out on big trees: the subtrees past them are walked again every so often and the
+// differences patched in. Changes are saved every so often and on shutdown.
+// One instance is shared by all browser widgets
+class FileIndexService {
+public:
+    // how often the watched directories of the indexes are looked at
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{ 500 };
+    // how often the subtrees no watch covers are walked again
+    static constexpr std::chrono::milliseconds UNWATCHED_REFRESH_INTERVAL{ 60 * 1000 };
+    // watches per index, the OS limits how many there can be
+    static constexpr size_t MAX_WATCHES_PER_INDEX = 4096;
+    // an index is saved again once it has this many changes next to its image
+    static constexpr size_t SAVE_AFTER_CHANGES = 1000;
+
+    // index files go to `directory`. 0 threads means one per hardware thread
+    explicit FileIndexService(const Path& directory, size_t numThreads = 0);
+    ~FileIndexService();
+
+    FileIndexService(const FileIndexService&) = delete;
+    FileIndexService& operator=(const FileIndexService&) = delete;
+
+    // queues loading or building the index of `root`, nothing happens if it has one already
+    void request(const std::string& root);
+    // forgets the index of `root` and deletes its file, stopping its build if it's the one running
+    void drop(const std::string& root);
+
+    // watches given to indexes loaded after the call
+    void setMaxWatchesPerIndex(size_t maxWatches);
+    void setUnwatchedRefreshInterval(std::chrono::milliseconds interval);
+
+    // roots whose index is ready to be queried
+    std::vector<std::string> readyRoots() const;
+    // the root being loaded or built right now, empty if there's none
+    std::string busyRoot() const;
+
+    // Full paths of the entries below `directory` whose names match `query`, from the index of a root `directory`
+    // is in, up to FileFinder::MAX_RESULTS. Directories the query prunes aren't looked into, `defaultPruneNames`
+    // count too unless it says noprune. False if there's no ready index there, find has to walk then.
+    // Sizes and dates aren't in the index, the caller checks those
+    bool findMatches(const Path& directory, const FindQuery& query, const std::vector<std::string>& defaultPruneNames,
+                     std::vector<std::string>& out_Paths) const;
+
+    // the file the index of `root` is kept in
+    Path indexPath(const std::string& root) const;
+
+private:
+    struct Request {
+        std::string root;
+        bool        isDrop = false;
+    };
+
+    void run();
+    void loadIndex(const std::string& root);
+    void dropIndex(const std::string& root);
+    // applies what the watches reported and saves indexes that piled up changes
+    void pollIndexes();
+    // walks the subtrees of every index no watch covers and patches in the differences
+    void refreshUnwatched();
+
+    Path mDirectory;
+    WorkStealingPool mPool;
+
+    mutable std::mutex                          mIndexMutex;
+    std::unordered_map<std::string, FileIndex>  mIndexes;
+
+    mutable std::mutex      mQueueMutex;
+    std::condition_variable mWakeCondition;
+    std::deque<Request>     mQueue;
+    std::string             mBusyRoot;
+    bool                    mAlive = true;
+
+    // stops the build or walk in flight when its index is dropped or shutting down
+    std::atomic<bool>   mCancel{ false };
+
+    std::atomic<size_t>                     mMaxWatchesPerIndex{ MAX_WATCHES_PER_INDEX };
+    std::atomic<std::chrono::milliseconds>  mUnwatchedRefreshInterval{ UNWATCHED_REFRESH_INTERVAL };
+
+    std::thread mThread;
+};
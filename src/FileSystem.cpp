@@ -1,4 +1,6 @@
 #include "FileSystem.h"
+
+#ifdef _WIN32
 #include "FileOpsProgressSink.h"
 #include <fileapi.h>
 
@@ -7,32 +9,173 @@
 #endif
 #include <windows.h>
 
-#include "StringUtils.h"
 #include <Shellapi.h>
 
 #include <ocidl.h>
 
-#include <algorithm>
-
 #include <shlobj.h>
 #include <shlwapi.h>
+#endif
+
+#include "StringUtils.h"
+
+#include <algorithm>
 #include <assert.h>
+#include <string.h>
+#include <mutex>
+#include <set>
 
 #include "Path.h"
 #include "NaturalComparator.h"
+#include "WorkStealingPool.h"
 
 namespace FileSystem {
 
-void SOARecord::sortByName(SortDirection direction) {
-    if(direction == SortDirection::Ascending) {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return NaturalComparator(names[rhs], names[lhs]); 
-        });
-    } else {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return NaturalComparator(names[lhs], names[rhs]); 
-        });
+void SOARecord::add(std::string_view name, int attribute, uint64_t lastModifiedNumber, uint64_t size) {
+    const size_t offset = nameArena.size();
+
+    nameArena.resize(offset + name.size() + 1);
+    memcpy(&nameArena[offset], name.data(), name.size());
+    nameArena[offset + name.size()] = '\0';
+
+    indexes.push_back(nameOffsets.size());
+    nameOffsets.push_back(static_cast<uint32_t>(offset));
+    nameLengths.push_back(static_cast<uint32_t>(name.size()));
+    attributes.push_back(attribute);
+    lastModifiedNumbers.push_back(lastModifiedNumber);
+    sizes.push_back(size);
+}
+
+void SOARecord::append(const SOARecord& other, size_t firstRecord, size_t count) {
+    for(size_t i = firstRecord; i < firstRecord + count; i++) {
+        add(other.getRecordName(i), other.attributes[i], other.lastModifiedNumbers[i], other.sizes[i]);
+    }
+}
+
+size_t SOARecord::memoryUsage() const {
+    return indexes.capacity()               * sizeof(size_t)
+        + nameArena.capacity()              * sizeof(char)
+        + nameOffsets.capacity()            * sizeof(uint32_t)
+        + nameLengths.capacity()            * sizeof(uint32_t)
+        + attributes.capacity()             * sizeof(int)
+        + lastModifiedNumbers.capacity()    * sizeof(uint64_t)
+        + sizes.capacity()                  * sizeof(uint64_t)
+        + sortKeyArena.capacity()           * sizeof(char)
+        + sortKeyOffsets.capacity()         * sizeof(uint32_t)
+        // roughly a node and a bucket per entry
+        + nameIndex.recordsByHash.size()    * (sizeof(uint64_t) + sizeof(uint32_t) + 3 * sizeof(void*));
+}
+
+// listings sort "Readme" next to "readme", in any script
+static constexpr CaseFolding NAME_SORT_FOLDING = CaseFolding::Unicode;
+
+void SOARecord::buildSortKeys() {
+    const size_t numRecords = nameOffsets.size();
+    if(sortKeyOffsets.size() >= numRecords) return;
+
+    sortKeyOffsets.reserve(numRecords);
+    for(size_t i = sortKeyOffsets.size(); i < numRecords; i++) {
+        sortKeyOffsets.push_back(static_cast<uint32_t>(sortKeyArena.size()));
+        AppendNaturalSortKey(getRecordName(i), sortKeyArena, NAME_SORT_FOLDING);
+    }
+}
+
+// buckets smaller than this are finished with a comparison sort, counting 256 bins doesn't pay off for them
+static constexpr size_t NAME_RADIX_SORT_THRESHOLD = 64;
+
+// Stable MSD radix sort of `indexes` in [begin, end) by the byte keys `keyOf(recordIdx)` returns, one byte per level. Keys must be
+// prefix free, then all keys in a bucket are equal once the first of them ends. `flip` is XORed into every byte,
+// 0xFF sorts descending. Its scratch space covers the range only, chunks sorted side by side don't each pay for the
+// whole listing. Returns false if `cancel` was set before every bucket was done
+template<typename KeyOf>
+inline static bool RadixSortByBytes(std::vector<size_t>& indexes, size_t begin, size_t end, const KeyOf& keyOf, uint8_t flip, const std::atomic<bool>* cancel = nullptr) {
+    struct Bucket {
+        size_t begin;
+        size_t end;
+        size_t depth;
+    };
+
+    auto xByte = [&](size_t recordIdx, size_t depth) {
+        return static_cast<uint8_t>(keyOf(recordIdx)[depth]) ^ flip;
+    };
+
+    std::vector<size_t> scratch(end - begin);
+    std::vector<Bucket> stack;
+    stack.push_back({ begin, end, 0 });
+
+    while(!stack.empty()) {
+        if(cancel != nullptr && cancel->load(std::memory_order_relaxed)) return false;
+
+        const Bucket bucket = stack.back();
+        stack.pop_back();
+
+        const size_t count = bucket.end - bucket.begin;
+        if(count < 2) continue;
+
+        if(count < NAME_RADIX_SORT_THRESHOLD) {
+            std::stable_sort(indexes.begin() + bucket.begin, indexes.begin() + bucket.end, [&](size_t lhs, size_t rhs) {
+                const std::string_view lhsKey = keyOf(lhs).substr(bucket.depth);
+                const std::string_view rhsKey = keyOf(rhs).substr(bucket.depth);
+                return flip ? rhsKey < lhsKey : lhsKey < rhsKey;
+            });
+            continue;
+        }
+
+        size_t counts[256] = {};
+        for(size_t i = bucket.begin; i < bucket.end; i++) {
+            counts[xByte(indexes[i], bucket.depth)]++;
+        }
+
+        // a shared byte (the tags and the common "file_" of "file_1".."file_N") needs no moving. Skip every byte
+        // the bucket has in common in one go rather than a pass per byte
+        if(counts[xByte(indexes[bucket.begin], bucket.depth)] == count) {
+            const std::string_view firstKey = keyOf(indexes[bucket.begin]);
+            size_t common = firstKey.size();
+            for(size_t i = bucket.begin + 1; i < bucket.end && common > bucket.depth + 1; i++) {
+                const std::string_view key = keyOf(indexes[i]);
+                const size_t limit = std::min(common, key.size());
+                size_t j = bucket.depth + 1;
+                while(j < limit && key[j] == firstKey[j]) {
+                    j++;
+                }
+                common = j;
+            }
+
+            // a key that ends inside the common prefix means they're all equal
+            if(firstKey.size() > common) {
+                stack.push_back({ bucket.begin, bucket.end, common });
+            }
+            continue;
+        }
+
+        size_t starts[256];
+        size_t start = bucket.begin;
+        for(size_t b = 0; b < 256; b++) {
+            starts[b] = start;
+            start += counts[b];
+        }
+
+        for(size_t i = bucket.begin; i < bucket.end; i++) {
+            scratch[starts[xByte(indexes[i], bucket.depth)]++ - begin] = indexes[i];
+        }
+        std::copy(scratch.begin() + (bucket.begin - begin), scratch.begin() + (bucket.end - begin), indexes.begin() + bucket.begin);
+
+        for(size_t b = 0; b < 256; b++) {
+            if(counts[b] < 2) continue;
+
+            const size_t childBegin = starts[b] - counts[b];
+            if(keyOf(indexes[childBegin]).size() > bucket.depth + 1) {
+                stack.push_back({ childBegin, starts[b], bucket.depth + 1 });
+            }
+        }
     }
+
+    return true;
+}
+
+void SOARecord::sortByName(SortDirection direction) {
+    buildSortKeys();
+    RadixSortByBytes(indexes, 0, indexes.size(), [this](size_t recordIdx) { return getSortKey(recordIdx); }, direction == SortDirection::Ascending ? 0x00 : 0xFF);
 }
 
 void SOARecord::sortByType(SortDirection direction) {
@@ -48,28 +191,604 @@ void SOARecord::sortByType(SortDirection direction) {
 }
 
 
-void SOARecord::sortByLastModified(SortDirection direction) {
-    if(direction == SortDirection::Ascending) {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return lastModifiedNumbers[lhs] > lastModifiedNumbers[rhs];
-        });
-    } else {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return lastModifiedNumbers[lhs] < lastModifiedNumbers[rhs];
-        });
+// below this many entries a plain stable_sort beats building the histograms
+static constexpr size_t VALUE_RADIX_SORT_THRESHOLD = 256;
+// 11 bit digits keep a histogram in L1 and need 6 passes at most
+static constexpr int VALUE_RADIX_BITS = 11;
+static constexpr size_t VALUE_RADIX_BUCKETS = size_t(1) << VALUE_RADIX_BITS;
+
+// Stable LSD radix sort of `indexes` in [begin, end) by `keyOf(recordIdx)`, smallest first. Sorts (key, index) pairs
+// so every pass streams through memory instead of chasing `indexes`. Keys are rebased on the smallest one so only the
+// bits that actually differ get passes, sizes rarely need more than three, file times four or five.
+// Returns false, with [begin, end) as it was, if `cancel` was set before the last pass
+template<typename KeyOf>
+inline static bool RadixSortByValue(std::vector<size_t>& indexes, size_t begin, size_t end, const KeyOf& keyOf, const std::atomic<bool>* cancel = nullptr) {
+    const size_t count = end - begin;
+
+    if(count < VALUE_RADIX_SORT_THRESHOLD) {
+        std::stable_sort(indexes.begin() + begin, indexes.begin() + end, [&](size_t lhs, size_t rhs) { return keyOf(lhs) < keyOf(rhs); });
+        return true;
+    }
+
+    struct KeyedIndex {
+        uint64_t key;
+        size_t   index;
+    };
+
+    std::vector<KeyedIndex> keyed(count);
+    uint64_t minKey = UINT64_MAX;
+    uint64_t maxKey = 0;
+    for(size_t i = 0; i < count; i++) {
+        const uint64_t key = keyOf(indexes[begin + i]);
+        keyed[i] = { key, indexes[begin + i] };
+        minKey = std::min(minKey, key);
+        maxKey = std::max(maxKey, key);
+    }
+
+    const uint64_t range = maxKey - minKey;
+    if(range == 0) return true;
+
+    int numBits = 0;
+    while(numBits < 64 && (range >> numBits) != 0) {
+        numBits++;
+    }
+    const int numPasses = (numBits + VALUE_RADIX_BITS - 1) / VALUE_RADIX_BITS;
+
+    std::vector<size_t> histograms(numPasses * VALUE_RADIX_BUCKETS, 0);
+    for(size_t i = 0; i < count; i++) {
+        const uint64_t key = keyed[i].key - minKey;
+        keyed[i].key = key;
+        for(int pass = 0; pass < numPasses; pass++) {
+            histograms[pass * VALUE_RADIX_BUCKETS + ((key >> (pass * VALUE_RADIX_BITS)) & (VALUE_RADIX_BUCKETS - 1))]++;
+        }
+    }
+
+    std::vector<KeyedIndex> scratch(count);
+    for(int pass = 0; pass < numPasses; pass++) {
+        // passes work on the copy, `indexes` isn't touched until the end
+        if(cancel != nullptr && cancel->load(std::memory_order_relaxed)) return false;
+
+        const int shift = pass * VALUE_RADIX_BITS;
+        size_t* offsets = &histograms[pass * VALUE_RADIX_BUCKETS];
+
+        // every key has the same digit here, nothing would move
+        if(offsets[(keyed[0].key >> shift) & (VALUE_RADIX_BUCKETS - 1)] == count) continue;
+
+        size_t offset = 0;
+        for(size_t b = 0; b < VALUE_RADIX_BUCKETS; b++) {
+            const size_t bucketSize = offsets[b];
+            offsets[b] = offset;
+            offset += bucketSize;
+        }
+
+        for(size_t i = 0; i < count; i++) {
+            scratch[offsets[(keyed[i].key >> shift) & (VALUE_RADIX_BUCKETS - 1)]++] = keyed[i];
+        }
+        keyed.swap(scratch);
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        indexes[begin + i] = keyed[i].index;
     }
+    return true;
+}
+
+// ascending sizes and dates put the largest first, flipping the bits turns that into a smallest first sort
+inline static uint64_t ValueFlip(SortDirection direction) {
+    return direction == SortDirection::Ascending ? ~0ULL : 0ULL;
+}
+
+void SOARecord::sortByLastModified(SortDirection direction) {
+    const uint64_t flip = ValueFlip(direction);
+    RadixSortByValue(indexes, 0, indexes.size(), [&](size_t recordIdx) { return lastModifiedNumbers[recordIdx] ^ flip; });
 }
 
 void SOARecord::sortBySize(SortDirection direction) {
-    if(direction == SortDirection::Ascending) {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return sizes[lhs] > sizes[rhs];
-        });
+    const uint64_t flip = ValueFlip(direction);
+    RadixSortByValue(indexes, 0, indexes.size(), [&](size_t recordIdx) { return sizes[recordIdx] ^ flip; });
+}
+
+// negative if sort() puts record `lhs` before `rhs`, positive if after and 0 for records equal in every key
+inline static int CompareRecords(const SOARecord& records, size_t lhs, size_t rhs, const std::vector<SortKey>& keys, bool directoriesFirst) {
+    const bool lhsFirstGroup = ((records.attributes[lhs] & FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+    const bool rhsFirstGroup = ((records.attributes[rhs] & FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+    if(lhsFirstGroup != rhsFirstGroup) return lhsFirstGroup ? -1 : 1;
+
+    for(const SortKey& key : keys) {
+        if(key.column == SortColumn::Name) {
+            // sort keys are prefix free, so flipping every byte for descending is the same as swapping the sides
+            const int order = records.getSortKey(lhs).compare(records.getSortKey(rhs));
+            if(order != 0) return key.direction == SortDirection::Ascending ? order : -order;
+        } else {
+            const std::vector<uint64_t>& values = key.column == SortColumn::Size ? records.sizes : records.lastModifiedNumbers;
+            const uint64_t flip = ValueFlip(key.direction);
+            if(values[lhs] != values[rhs]) return (values[lhs] ^ flip) < (values[rhs] ^ flip) ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+// true if sort() puts record `lhs` before `rhs`, false for records equal in every key
+inline static bool RecordPrecedes(const SOARecord& records, size_t lhs, size_t rhs, const std::vector<SortKey>& keys, bool directoriesFirst) {
+    return CompareRecords(records, lhs, rhs, keys, directoriesFirst) < 0;
+}
+
+// Stable sort of `indexes` spread over `pool`. Every thread sorts a contiguous chunk with `sortRange(begin, end)`,
+// then neighbouring runs are merged by `precedes` until one is left. Each merge is split at co-ranks into as many
+// independent pieces as there are threads, so the last merges keep the pool as busy as the first.
+// Ties always go to the earlier run, which keeps the result identical to sorting the whole range at once.
+// Returns false if `cancel` was set before the last merge, `indexes` is some permutation of what it was then
+template<typename SortRange, typename Precedes>
+inline static bool ParallelSort(std::vector<size_t>& indexes, WorkStealingPool& pool, const SortRange& sortRange, const Precedes& precedes, const std::atomic<bool>* cancel) {
+    auto xCancelled = [cancel]() { return cancel != nullptr && cancel->load(std::memory_order_relaxed); };
+
+    const size_t count = indexes.size();
+    const size_t numThreads = pool.numThreads();
+
+    std::vector<size_t> runStarts;
+    for(size_t chunk = 0; chunk < numThreads; chunk++) {
+        runStarts.push_back(count * chunk / numThreads);
+    }
+    runStarts.push_back(count);
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t run = 0; run + 1 < runStarts.size(); run++) {
+        pool.submit(group, [&, run](size_t) { sortRange(runStarts[run], runStarts[run + 1]); });
+    }
+    pool.wait(group);
+    if(xCancelled()) return false;
+
+    // where the first `k` merged entries split between runs `a` and `b`: the smallest `i` such that taking `i` from
+    // `a` and `k - i` from `b` never puts an entry of `b` before one of `a` it ties with
+    auto xCoRank = [&](const size_t* a, size_t aSize, const size_t* b, size_t bSize, size_t k) {
+        size_t low = k > bSize ? k - bSize : 0;
+        size_t high = std::min(k, aSize);
+        while(low < high) {
+            const size_t i = low + (high - low) / 2;
+            const size_t j = k - i;
+            if(j > 0 && i < aSize && !precedes(b[j - 1], a[i])) {
+                low = i + 1;
+            } else {
+                high = i;
+            }
+        }
+        return low;
+    };
+
+    std::vector<size_t> merged(count);
+    while(runStarts.size() > 2) {
+        if(xCancelled()) return false;
+
+        const size_t numPairs = (runStarts.size() - 1) / 2;
+        const size_t piecesPerPair = std::max<size_t>(1, numThreads / numPairs);
+
+        std::vector<size_t> mergedStarts;
+        for(size_t run = 0; run + 1 < runStarts.size(); run += 2) {
+            const size_t begin = runStarts[run];
+            mergedStarts.push_back(begin);
+
+            // odd one out, carried over to the next round as it is
+            if(run + 2 >= runStarts.size()) {
+                std::copy(indexes.begin() + begin, indexes.begin() + runStarts[run + 1], merged.begin() + begin);
+                continue;
+            }
+
+            const size_t* a = &indexes[begin];
+            const size_t aSize = runStarts[run + 1] - begin;
+            const size_t* b = &indexes[runStarts[run + 1]];
+            const size_t bSize = runStarts[run + 2] - runStarts[run + 1];
+            const size_t total = aSize + bSize;
+
+            for(size_t piece = 0; piece < piecesPerPair; piece++) {
+                pool.submit(group, [&, a, aSize, b, bSize, begin, total, piece](size_t) {
+                    const size_t first = total * piece / piecesPerPair;
+                    const size_t last = total * (piece + 1) / piecesPerPair;
+                    const size_t aFirst = xCoRank(a, aSize, b, bSize, first);
+                    const size_t aLast = xCoRank(a, aSize, b, bSize, last);
+
+                    std::merge(a + aFirst, a + aLast, b + (first - aFirst), b + (last - aLast), merged.begin() + begin + first, precedes);
+                });
+            }
+        }
+        mergedStarts.push_back(count);
+        pool.wait(group);
+
+        indexes.swap(merged);
+        runStarts.swap(mergedStarts);
+    }
+
+    return true;
+}
+
+// top bit of a packed numeric key, sizes and file times never get that large
+static constexpr uint64_t PACKED_GROUP_BIT = 1ULL << 63;
+
+bool SOARecord::sort(const std::vector<SortKey>& keys, bool directoriesFirst, WorkStealingPool* pool, size_t parallelThreshold, const std::atomic<bool>* cancel) {
+    auto xGroup = [&](size_t recordIdx) -> uint8_t {
+        const bool isDirectory = attributes[recordIdx] & FileAttributes::DIRECTORY;
+        return isDirectory == directoriesFirst ? 0 : 1;
+    };
+
+    auto xValues = [&](SortColumn column) -> const std::vector<uint64_t>& {
+        return column == SortColumn::Size ? sizes : lastModifiedNumbers;
+    };
+
+    // a cancelled sort leaves `indexes` half done, this is what it goes back to
+    std::vector<size_t> original;
+    if(cancel != nullptr) {
+        original = indexes;
+    }
+
+    // every path below sorts a range of `indexes` the same way, big listings have their chunks sorted in parallel
+    // and merged by comparing the keys the path sorted by
+    auto xSort = [&](const auto& sortRange, const auto& precedes) {
+        bool isDone;
+        if(pool == nullptr || pool->numThreads() < 2 || indexes.size() < parallelThreshold) {
+            isDone = sortRange(0, indexes.size());
+        } else {
+            isDone = ParallelSort(indexes, *pool, sortRange, precedes, cancel);
+        }
+
+        if(!isDone) {
+            indexes.swap(original);
+        }
+        return isDone;
+    };
+
+    // the group plus a single size or date fits one 64 bit key
+    if(keys.empty() || (keys.size() == 1 && keys[0].column != SortColumn::Name)) {
+        const std::vector<uint64_t>* values = keys.empty() ? nullptr : &xValues(keys[0].column);
+        const uint64_t flip = keys.empty() ? 0 : ValueFlip(keys[0].direction) & ~PACKED_GROUP_BIT;
+
+        auto xKey = [&](size_t recordIdx) {
+            const uint64_t value = values != nullptr ? ((*values)[recordIdx] & ~PACKED_GROUP_BIT) ^ flip : 0;
+            return (static_cast<uint64_t>(xGroup(recordIdx)) << 63) | value;
+        };
+
+        return xSort([&](size_t begin, size_t end) { return RadixSortByValue(indexes, begin, end, xKey, cancel); },
+                     [&](size_t lhs, size_t rhs) { return xKey(lhs) < xKey(rhs); });
+    }
+
+    // the group is the first digit, splitting on it up front is the radix sort's first level without copying
+    // the name keys into packed ones
+    if(keys.size() == 1) {
+        buildSortKeys();
+
+        const uint8_t flip = keys[0].direction == SortDirection::Ascending ? 0x00 : 0xFF;
+        auto xNameKey = [this](size_t recordIdx) { return getSortKey(recordIdx); };
+
+        return xSort([&](size_t begin, size_t end) {
+            auto firstOfSecondGroup = std::stable_partition(indexes.begin() + begin, indexes.begin() + end, [&](size_t recordIdx) { return xGroup(recordIdx) == 0; });
+            const size_t middle = firstOfSecondGroup - indexes.begin();
+
+            return RadixSortByBytes(indexes, begin, middle, xNameKey, flip, cancel)
+                && RadixSortByBytes(indexes, middle, end, xNameKey, flip, cancel);
+        }, [&](size_t lhs, size_t rhs) { return RecordPrecedes(*this, lhs, rhs, keys, directoriesFirst); });
+    }
+
+    // otherwise every record gets one byte key: the group, then each column in turn. Names are prefix free and
+    // numbers fixed size, so comparing the concatenation compares column by column
+    for(const SortKey& key : keys) {
+        if(key.column == SortColumn::Name) {
+            buildSortKeys();
+            break;
+        }
+    }
+
+    const size_t numRecords = nameOffsets.size();
+    std::vector<uint32_t> packedOffsets(numRecords + 1);
+
+    size_t packedSize = 0;
+    for(size_t i = 0; i < numRecords; i++) {
+        packedOffsets[i] = static_cast<uint32_t>(packedSize);
+        packedSize++;
+        for(const SortKey& key : keys) {
+            packedSize += key.column == SortColumn::Name ? getSortKey(i).size() : sizeof(uint64_t);
+        }
+    }
+    packedOffsets[numRecords] = static_cast<uint32_t>(packedSize);
+
+    std::vector<char> packed(packedSize);
+    for(size_t i = 0; i < numRecords; i++) {
+        char* out = &packed[packedOffsets[i]];
+        *out++ = static_cast<char>(xGroup(i));
+
+        for(const SortKey& key : keys) {
+            if(key.column == SortColumn::Name) {
+                const std::string_view nameKey = getSortKey(i);
+                memcpy(out, nameKey.data(), nameKey.size());
+                if(key.direction == SortDirection::Descending) {
+                    for(size_t c = 0; c < nameKey.size(); c++) {
+                        out[c] = ~out[c];
+                    }
+                }
+                out += nameKey.size();
+            } else {
+                const uint64_t value = xValues(key.column)[i] ^ ValueFlip(key.direction);
+                for(int shift = 56; shift >= 0; shift -= 8) {
+                    *out++ = static_cast<char>((value >> shift) & 0xFF);
+                }
+            }
+        }
+    }
+
+    auto xPackedKey = [&](size_t recordIdx) {
+        return std::string_view(&packed[packedOffsets[recordIdx]], packedOffsets[recordIdx + 1] - packedOffsets[recordIdx]);
+    };
+
+    if(cancel != nullptr && cancel->load()) return false;
+
+    return xSort([&](size_t begin, size_t end) { return RadixSortByBytes(indexes, begin, end, xPackedKey, 0x00, cancel); },
+                 [&](size_t lhs, size_t rhs) { return xPackedKey(lhs) < xPackedKey(rhs); });
+}
+
+bool SOARecord::partialSort(const std::vector<SortKey>& keys, bool directoriesFirst, size_t firstRow, size_t numRows, const std::atomic<bool>* cancel) {
+    const size_t count = indexes.size();
+    if(count == 0 || numRows == 0) return true;
+
+    // a window past the end (the listing got shorter) becomes the last rows
+    numRows = std::min(numRows, count);
+    firstRow = std::min(firstRow, count - numRows);
+    const size_t lastRow = firstRow + numRows;
+
+    for(const SortKey& key : keys) {
+        if(key.column == SortColumn::Name) {
+            buildSortKeys();
+            break;
+        }
+    }
+
+    // Selecting compares every record a few times, so it works on the group and the first 23 bytes of the primary
+    // key side by side instead of chasing each record's columns. Only records tied on those compare in full.
+    // sort() is stable, records tied in every key keep their current order, so ties are broken by position to
+    // agree with it row for row
+    struct Candidate {
+        uint64_t    words[3];
+        uint32_t    recordIdx;
+        uint32_t    position;
+    };
+
+    // walking the columns in record order instead of through `indexes` saves a cache miss per column per record,
+    // the position a record has in `indexes` is scattered into place beforehand
+    const size_t numRecords = nameOffsets.size();
+    std::vector<uint32_t> positions(numRecords, UINT32_MAX);
+    for(size_t i = 0; i < count; i++) {
+        positions[indexes[i]] = static_cast<uint32_t>(i);
+    }
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(count);
+    for(size_t recordIdx = 0; recordIdx < numRecords; recordIdx++) {
+        // removed records wait for compact() outside of `indexes`
+        if(positions[recordIdx] == UINT32_MAX) continue;
+
+        const bool isDirectory = attributes[recordIdx] & FileAttributes::DIRECTORY;
+
+        Candidate& candidate = candidates.emplace_back();
+        candidate.words[0] = static_cast<uint64_t>(isDirectory == directoriesFirst ? 0 : 1) << 56;
+        candidate.words[1] = 0;
+        candidate.words[2] = 0;
+        candidate.recordIdx = static_cast<uint32_t>(recordIdx);
+        candidate.position = positions[recordIdx];
+
+        if(keys.empty()) continue;
+
+        if(keys[0].column == SortColumn::Name) {
+            // missing bytes are zero, keys are prefix free so two of them never tie on the padding alone
+            const std::string_view nameKey = getSortKey(recordIdx);
+            const uint8_t flip = keys[0].direction == SortDirection::Ascending ? 0x00 : 0xFF;
+            for(size_t c = 0; c < 23 && c < nameKey.size(); c++) {
+                // the group takes the top byte of the first word
+                const size_t slot = c + 1;
+                const uint64_t byte = static_cast<uint8_t>(nameKey[c]) ^ flip;
+                candidate.words[slot / 8] |= byte << (56 - 8 * (slot % 8));
+            }
+        } else {
+            const std::vector<uint64_t>& values = keys[0].column == SortColumn::Size ? sizes : lastModifiedNumbers;
+            candidate.words[1] = values[recordIdx] ^ ValueFlip(keys[0].direction);
+        }
+    }
+
+    // a single size or date fits the words whole, ties on them are ties in every key
+    const bool isKeyComplete = keys.empty() || (keys.size() == 1 && keys[0].column != SortColumn::Name);
+
+    auto xPrecedes = [&](const Candidate& lhs, const Candidate& rhs) {
+        for(int w = 0; w < 3; w++) {
+            if(lhs.words[w] != rhs.words[w]) return lhs.words[w] < rhs.words[w];
+        }
+
+        if(!isKeyComplete) {
+            const int order = CompareRecords(*this, lhs.recordIdx, rhs.recordIdx, keys, directoriesFirst);
+            if(order != 0) return order < 0;
+        }
+        return lhs.position < rhs.position;
+    };
+
+    auto xCancelled = [cancel]() { return cancel != nullptr && cancel->load(std::memory_order_relaxed); };
+    if(xCancelled()) return false;
+
+    // everything before the window ends up in front of it, then the window's rows are split off the rest and sorted
+    if(firstRow > 0) {
+        std::nth_element(candidates.begin(), candidates.begin() + firstRow, candidates.end(), xPrecedes);
+    }
+    if(lastRow < count) {
+        if(xCancelled()) return false;
+        std::nth_element(candidates.begin() + firstRow, candidates.begin() + lastRow, candidates.end(), xPrecedes);
+    }
+    std::sort(candidates.begin() + firstRow, candidates.begin() + lastRow, xPrecedes);
+
+    for(size_t i = 0; i < count; i++) {
+        indexes[i] = candidates[i].recordIdx;
+    }
+    return true;
+}
+
+inline static uint64_t HashName(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+}
+
+size_t SOARecord::findRecord(std::string_view name) {
+    if(!nameIndex.isBuilt) {
+        nameIndex.recordsByHash.reserve(nameOffsets.size() - numRemoved);
+        for(size_t i = 0; i < nameOffsets.size(); i++) {
+            if(attributes[i] & FileAttributes::REMOVED) continue;
+            nameIndex.recordsByHash.emplace(HashName(getRecordName(i)), static_cast<uint32_t>(i));
+        }
+        nameIndex.isBuilt = true;
+    }
+
+    auto range = nameIndex.recordsByHash.equal_range(HashName(name));
+    for(auto it = range.first; it != range.second; ++it) {
+        if(getRecordName(it->second) == name) return it->second;
+    }
+    return SIZE_MAX;
+}
+
+size_t SOARecord::applyChanges(const std::vector<EntryChange>& changes, const std::vector<SortKey>& keys, bool directoriesFirst) {
+    bool hasNameKey = false;
+    for(const SortKey& key : keys) {
+        hasNameKey |= key.column == SortColumn::Name;
+    }
+    if(hasNameKey) {
+        buildSortKeys();
+    }
+
+    auto xPrecedes = [&](size_t lhs, size_t rhs) { return RecordPrecedes(*this, lhs, rhs, keys, directoriesFirst); };
+
+    auto xRemoveFromOrder = [&](size_t recordIdx) {
+        auto range = std::equal_range(indexes.begin(), indexes.end(), recordIdx, xPrecedes);
+        auto it = std::find(range.first, range.second, recordIdx);
+        // folder sizes filled in after the last sort can leave the order slightly off, don't rely on it
+        if(it == range.second) {
+            it = std::find(indexes.begin(), indexes.end(), recordIdx);
+        }
+        if(it != indexes.end()) {
+            indexes.erase(it);
+        }
+    };
+
+    // after any records it ties with, a full stable sort puts records that were added later there too
+    auto xInsertIntoOrder = [&](size_t recordIdx) {
+        indexes.insert(std::upper_bound(indexes.begin(), indexes.end(), recordIdx, xPrecedes), recordIdx);
+    };
+
+    size_t numChanged = 0;
+    for(const EntryChange& change : changes) {
+        const size_t recordIdx = findRecord(change.name);
+
+        if(recordIdx == SIZE_MAX) {
+            if(!change.exists) continue;
+
+            const size_t newIdx = nameOffsets.size();
+            add(change.name, change.attributes, change.lastModifiedNumber, change.size);
+            indexes.pop_back();
+            nameIndex.recordsByHash.emplace(HashName(change.name), static_cast<uint32_t>(newIdx));
+
+            // only records that already had a key get one, sortByName catches up on the others in one go
+            if(sortKeyOffsets.size() == newIdx) {
+                buildSortKeys();
+            }
+
+            xInsertIntoOrder(newIdx);
+        } else if(!change.exists) {
+            xRemoveFromOrder(recordIdx);
+
+            auto range = nameIndex.recordsByHash.equal_range(HashName(change.name));
+            for(auto it = range.first; it != range.second; ++it) {
+                if(it->second == recordIdx) {
+                    nameIndex.recordsByHash.erase(it);
+                    break;
+                }
+            }
+
+            attributes[recordIdx] = FileAttributes::REMOVED;
+            numRemoved++;
+        } else {
+            if(attributes[recordIdx] == change.attributes && lastModifiedNumbers[recordIdx] == change.lastModifiedNumber
+                    && sizes[recordIdx] == change.size) continue;
+
+            xRemoveFromOrder(recordIdx);
+            attributes[recordIdx] = change.attributes;
+            lastModifiedNumbers[recordIdx] = change.lastModifiedNumber;
+            sizes[recordIdx] = change.size;
+            xInsertIntoOrder(recordIdx);
+        }
+
+        numChanged++;
+    }
+
+    // tombstones cost a slot in every column and a pass in every full sort, don't let them pile up
+    if(numRemoved * 4 > nameOffsets.size()) {
+        compact();
+    }
+
+    return numChanged;
+}
+
+void SOARecord::compact() {
+    if(numRemoved == 0) return;
+
+    const size_t numRecords = nameOffsets.size();
+    // keys only survive if every record has one, otherwise buildSortKeys starts over
+    const bool keepSortKeys = sortKeyOffsets.size() == numRecords;
+
+    std::vector<size_t> newIdxOf(numRecords);
+    size_t numKept = 0;
+    size_t nameEnd = 0;
+    size_t sortKeyEnd = 0;
+
+    // everything moves towards the front, so each record can be copied over the ones dropped before it
+    for(size_t i = 0; i < numRecords; i++) {
+        if(attributes[i] & FileAttributes::REMOVED) continue;
+
+        const uint32_t nameLength = nameLengths[i];
+        memmove(&nameArena[nameEnd], &nameArena[nameOffsets[i]], nameLength + 1);
+        nameOffsets[numKept] = static_cast<uint32_t>(nameEnd);
+        nameLengths[numKept] = nameLength;
+        nameEnd += nameLength + 1;
+
+        if(keepSortKeys) {
+            const std::string_view sortKey = getSortKey(i);
+            memmove(&sortKeyArena[sortKeyEnd], sortKey.data(), sortKey.size());
+            sortKeyOffsets[numKept] = static_cast<uint32_t>(sortKeyEnd);
+            sortKeyEnd += sortKey.size();
+        }
+
+        attributes[numKept] = attributes[i];
+        lastModifiedNumbers[numKept] = lastModifiedNumbers[i];
+        sizes[numKept] = sizes[i];
+
+        newIdxOf[i] = numKept;
+        numKept++;
+    }
+
+    nameArena.resize(nameEnd);
+    nameOffsets.resize(numKept);
+    nameLengths.resize(numKept);
+    attributes.resize(numKept);
+    lastModifiedNumbers.resize(numKept);
+    sizes.resize(numKept);
+
+    if(keepSortKeys) {
+        sortKeyArena.resize(sortKeyEnd);
+        sortKeyOffsets.resize(numKept);
     } else {
-        std::stable_sort(indexes.begin(), indexes.end(), [&](const size_t& lhs, const size_t& rhs) { 
-                return sizes[lhs] < sizes[rhs];
-        });
+        sortKeyArena.clear();
+        sortKeyOffsets.clear();
+    }
+
+    for(size_t& recordIdx : indexes) {
+        recordIdx = newIdxOf[recordIdx];
     }
+
+    numRemoved = 0;
+    nameIndex.clear();
+}
+
+#ifdef _WIN32
+bool removeFile(const Path& path) {
+    return DeleteFileW(path.wstr().c_str()) != 0;
 }
 
 bool createDirectory(const Path& path) {
@@ -78,37 +797,158 @@ bool createDirectory(const Path& path) {
 
     return result != 0;
 }
+#endif
 
-bool traverseDirectory(const Path &path, std::vector<Path>& out_DirectoryItems) {
-    if(path.isEmpty()) return false;
-    if(!doesPathExist(path)) return false;
+bool enumerateDirectory(const Path& path, SOARecord& out_DirectoryItems, int fields) {
+    // one per thread so the backend buffers are reused between calls
+    thread_local static DirectoryEnumerator enumerator;
+
+    out_DirectoryItems.clear();
 
-    std::vector<Path> dirsToTraverse( { path } );
+    if(!enumerator.open(path, fields)) return false;
 
-    int baseDepth = path.getSegmentCount();
+    while(!enumerator.isDone()) {
+        enumerator.next(out_DirectoryItems, SIZE_MAX);
+    }
+
+    return true;
+}
+
+// entries read per enumerator call while walking, the whole directory is collected before it's handed out
+static constexpr size_t TRAVERSE_CHUNK_SIZE = 4096;
 
-    while(!dirsToTraverse.empty()) {
-        const Path currentPath = dirsToTraverse.back();
-        dirsToTraverse.pop_back();
+// shared by all tasks of one traverseDirectory call
+struct TraverseState {
+    const TraverseOptions&  options;
+    const TraverseCallback& callback;
+    WorkStealingPool&       pool;
+    WorkStealingPool::TaskGroup group;
 
-        SOARecord items;
-        enumerateDirectory(currentPath, items);
+    // indexed by worker, a task only ever touches the scratch of the thread it runs on
+    struct Scratch {
+        DirectoryEnumerator enumerator;
+        SOARecord           entries;
+        SOARecord           filtered;
+    };
+    std::vector<Scratch> scratch;
 
-        for(size_t i = 0; i < items.size(); i++) {
-            Path itemPath(currentPath);
-            itemPath.appendName(items.getName(i));
+    std::mutex                      visitedMutex;
+    std::set<DirectoryIdentity>     visited;
 
-            out_DirectoryItems.push_back(itemPath);
+    std::atomic<bool>       rootFailed{ false };
+    std::atomic<uint32_t>   nextDirectoryId{ 0 };
 
-            if(!items.isFile(i)) {
-                dirsToTraverse.push_back( itemPath );
+    TraverseState(WorkStealingPool& pool, const TraverseOptions& options, const TraverseCallback& callback)
+        : options(options), callback(callback), pool(pool), scratch(pool.numThreads()) {
+    }
+};
+
+struct TraverseTask {
+    std::shared_ptr<DirectoryHandle> parent;
+    // full path, the directory's own name is the tail starting at nameOffset
+    std::string path;
+    size_t      nameOffset;
+    int         depth;
+    uint32_t    parentId;
+    uint32_t    entryInParent;
+};
+
+static void TraverseOne(TraverseState& state, const TraverseTask& task, size_t workerIdx) {
+    const TraverseOptions& options = state.options;
+    if(options.cancel != nullptr && options.cancel->load()) return;
+
+    TraverseState::Scratch& scratch = state.scratch[workerIdx];
+    DirectoryEnumerator& enumerator = scratch.enumerator;
+
+    const std::string_view name = std::string_view(task.path).substr(task.nameOffset);
+    if(!enumerator.openAt(task.parent, name, task.path, options.fields)) {
+        if(task.depth == 0) state.rootFailed = true;
+        return;
+    }
+
+    bool canFollowSymlinks = false;
+    if(options.followSymlinks) {
+        DirectoryIdentity identity;
+        if(enumerator.getIdentity(identity)) {
+            canFollowSymlinks = true;
+
+            std::scoped_lock<std::mutex> lock(state.visitedMutex);
+            if(!state.visited.insert(identity).second) {
+                enumerator.close();
+                return;
             }
         }
     }
 
-    return true;
+    const bool descend = options.maxDepth < 0 || task.depth < options.maxDepth;
+    std::shared_ptr<DirectoryHandle> handle = descend ? enumerator.shareHandle() : nullptr;
+
+    scratch.entries.clear();
+    while(!enumerator.isDone()) {
+        enumerator.next(scratch.entries, TRAVERSE_CHUNK_SIZE);
+    }
+
+    SOARecord* entries = &scratch.entries;
+    if(options.filter) {
+        scratch.filtered.clear();
+        for(size_t i = 0; i < scratch.entries.nameOffsets.size(); i++) {
+            if(options.filter(scratch.entries.getRecordName(i), scratch.entries.attributes[i])) {
+                scratch.filtered.append(scratch.entries, i, 1);
+            }
+        }
+        entries = &scratch.filtered;
+    }
+
+    const uint32_t directoryId = state.nextDirectoryId++;
+    const TraverseBatch batch{ task.path, *entries, task.depth, workerIdx, directoryId, task.parentId, task.entryInParent };
+    state.callback(batch);
+
+    if(!descend) return;
+
+    const SOARecord& children = *entries;
+    const bool needsSeparator = !task.path.empty() && task.path.back() != Path::SEPARATOR;
+
+    for(size_t i = 0; i < children.nameOffsets.size(); i++) {
+        const int attribute = children.attributes[i];
+        if(!(attribute & FileAttributes::DIRECTORY)) continue;
+        if((attribute & FileAttributes::SYMLINK) && !canFollowSymlinks) continue;
+        if(options.descend && !options.descend(batch, i)) continue;
+
+        TraverseTask child;
+        child.parent = handle;
+        child.path.reserve(task.path.size() + 1 + children.nameLengths[i]);
+        child.path = task.path;
+        if(needsSeparator) child.path.push_back(Path::SEPARATOR);
+        child.nameOffset = child.path.size();
+        child.path.append(children.getRecordName(i));
+        child.depth = task.depth + 1;
+        child.parentId = directoryId;
+        child.entryInParent = static_cast<uint32_t>(i);
+
+        state.pool.submit(state.group, [&state, child = std::move(child)](size_t idx) { TraverseOne(state, child, idx); });
+    }
+}
+
+bool traverseDirectory(WorkStealingPool& pool, const Path& path, const TraverseOptions& options, const TraverseCallback& callback) {
+    if(path.isEmpty()) return false;
+
+    TraverseState state(pool, options, callback);
+
+    TraverseTask root;
+    root.path = path.str();
+    root.nameOffset = root.path.size();
+    root.depth = 0;
+    root.parentId = NO_TRAVERSE_PARENT;
+    root.entryInParent = 0;
+
+    pool.submit(state.group, [&state, root = std::move(root)](size_t idx) { TraverseOne(state, root, idx); });
+    pool.wait(state.group);
+
+    return !state.rootFailed;
 }
 
+#ifdef _WIN32
+
 void getDriveLetters(std::vector<char> &out_driveLetters) {
     DWORD driveBits = GetLogicalDrives();
 
@@ -184,81 +1024,282 @@ void openFile(const Path& path) {
     ShellExecuteW(0, 0, path.wstr().c_str(), 0, 0, SW_SHOW);
 }
 
-bool enumerateDirectory(const Path& path, SOARecord& out_DirectoryItems) {
-    if(path.isEmpty()) return false;
-    if(!doesPathExist(path)) return false;
-
-    out_DirectoryItems.clear();
+// nothing to keep, the Windows backend opens everything by full path
+struct DirectoryHandle {};
 
+struct DirectoryEnumerator::State {
+    HANDLE findHandle = INVALID_HANDLE_VALUE;
     WIN32_FIND_DATAW findFileData;
-    HANDLE hFind;
+    // findFileData holds an entry that hasn't been handed out yet
+    bool hasEntry = false;
+};
+
+DirectoryEnumerator::DirectoryEnumerator() 
+    : mState(std::make_unique<State>()) {
+}
 
-    const std::string& pathStr = path.str();
-    const std::string dir = pathStr + "/*";
-    const std::wstring wString = Util::Utf8ToWstring(dir);
+DirectoryEnumerator::~DirectoryEnumerator() {
+    close();
+}
+
+DirectoryEnumerator::DirectoryEnumerator(DirectoryEnumerator&&) = default;
+DirectoryEnumerator& DirectoryEnumerator::operator=(DirectoryEnumerator&&) = default;
+
+// FindFirstFileExW hands back every column along with the name, so `fields` doesn't save any work here
+bool DirectoryEnumerator::open(const Path& path, int fields) {
+    close();
 
-    hFind = FindFirstFileExW(wString.c_str(), FindExInfoBasic, &findFileData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if(path.isEmpty()) return false;
+    if(!doesPathExist(path)) return false;
 
-    if(hFind == INVALID_HANDLE_VALUE) {
-        printf("Can't find dir %s\n", dir.data());
+    if(!openAt(nullptr, {}, path.str(), fields)) {
+        printf("Can't find dir %s\n", path.str().data());
         return false;
     }
 
-    out_DirectoryItems.clear();
+    return true;
+}
+
+// FindFirstFileExW only takes full paths
+bool DirectoryEnumerator::openAt(const std::shared_ptr<DirectoryHandle>& parent, std::string_view name, const std::string& fullPath, int fields) {
+    close();
+
+    const std::wstring wString = Util::Utf8ToWstring(fullPath + "/*");
+
+    mState->findHandle = FindFirstFileExW(wString.c_str(), FindExInfoBasic, &mState->findFileData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if(mState->findHandle == INVALID_HANDLE_VALUE) return false;
 
-    size_t counter = 0;
+    mState->hasEntry = true;
+    return true;
+}
+
+std::shared_ptr<DirectoryHandle> DirectoryEnumerator::shareHandle() const {
+    return nullptr;
+}
+
+// FindFirstFileExW doesn't give us a handle to ask for the file index, so symlinked directories are never followed
+bool DirectoryEnumerator::getIdentity(DirectoryIdentity& out) const {
+    return false;
+}
 
-    do {
-        std::string filename = Util::WstringToUtf8(findFileData.cFileName);
-        if(filename == "." || filename == "..") continue;
+size_t DirectoryEnumerator::next(SOARecord& out_DirectoryItems, size_t maxEntries) {
+    size_t numAdded = 0;
+
+    // converted names go through this buffer straight into the record's arena, no per entry std::string
+    char filename[MAX_PATH * 4];
+
+    while(mState->hasEntry && numAdded < maxEntries) {
+        const WIN32_FIND_DATAW& findFileData = mState->findFileData;
+        const WCHAR* wFilename = findFileData.cFileName;
+
+        bool skip = wcscmp(wFilename, L".") == 0 || wcscmp(wFilename, L"..") == 0;
 
         // do not include system files
-        if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_SYSTEM) continue;
+        skip |= (findFileData.dwFileAttributes & FILE_ATTRIBUTE_SYSTEM) != 0;
 
-        FILETIME lastWriteTime{};
-        FileTimeToLocalFileTime(&findFileData.ftLastWriteTime, &lastWriteTime);
+        if(!skip) {
+            const FILETIME& lastWriteTime = findFileData.ftLastWriteTime;
+            uint64_t lastModifiedN = (static_cast<uint64_t>(lastWriteTime.dwHighDateTime) << 32) | static_cast<uint64_t>(lastWriteTime.dwLowDateTime);
 
-        SYSTEMTIME systemTime{};
-        FileTimeToSystemTime(&lastWriteTime, &systemTime);
+            int attribute = 0;
+            if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                attribute |= FileAttributes::DIRECTORY;
+            }
 
-        Timestamp lastModified;
-        
-        lastModified.year   = systemTime.wYear;
-        lastModified.month  = systemTime.wMonth;
-        lastModified.day    = systemTime.wDay;
+            if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN) {
+                attribute |= FileAttributes::HIDDEN;
+            }
+
+            if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+                attribute |= FileAttributes::SYMLINK;
+            }
 
-        lastModified.isPM = systemTime.wHour < 12 ? false : true;
+            uint64_t size = (static_cast<uint64_t>(findFileData.nFileSizeHigh) << 32) | static_cast<uint64_t>(findFileData.nFileSizeLow);
 
-        lastModified.hour = systemTime.wHour;
-        lastModified.hour %= 12;
-        if(lastModified.hour == 0) {
-            lastModified.hour = 12;
+            // returned length excludes the terminator since the source length is explicit
+            int filenameLength = WideCharToMultiByte(CP_UTF8, 0, wFilename, (int)wcslen(wFilename), filename, sizeof(filename), NULL, NULL);
+
+            out_DirectoryItems.add(std::string_view(filename, filenameLength), attribute, lastModifiedN, size);
+            numAdded++;
         }
 
-        lastModified.minute = systemTime.wMinute;
-        uint64_t lastModifiedN = (static_cast<uint64_t>(lastWriteTime.dwHighDateTime) << 32) | static_cast<uint64_t>(lastWriteTime.dwLowDateTime);
+        mState->hasEntry = FindNextFileW(mState->findHandle, &mState->findFileData);
+    }
+
+    if(!mState->hasEntry) close();
+
+    return numAdded;
+}
+
+bool DirectoryEnumerator::isDone() const {
+    return !mState->hasEntry;
+}
+
+void DirectoryEnumerator::close() {
+    // moved from
+    if(mState == nullptr) return;
+
+    if(mState->findHandle != INVALID_HANDLE_VALUE) {
+        FindClose(mState->findHandle);
+        mState->findHandle = INVALID_HANDLE_VALUE;
+    }
+    mState->hasEntry = false;
+}
+
+Timestamp fileTimeToLocalTimestamp(uint64_t fileTime) {
+    FILETIME utcTime{};
+    utcTime.dwLowDateTime   = static_cast<DWORD>(fileTime);
+    utcTime.dwHighDateTime  = static_cast<DWORD>(fileTime >> 32);
+
+    FILETIME localTime{};
+    FileTimeToLocalFileTime(&utcTime, &localTime);
+
+    SYSTEMTIME systemTime{};
+    FileTimeToSystemTime(&localTime, &systemTime);
+
+    return Timestamp::fromLocalTime(systemTime.wYear, systemTime.wMonth, systemTime.wDay, systemTime.wHour, systemTime.wMinute, systemTime.wSecond);
+}
+
+uint64_t getCurrentFileTime() {
+    FILETIME now{};
+    GetSystemTimeAsFileTime(&now);
+    return (static_cast<uint64_t>(now.dwHighDateTime) << 32) | static_cast<uint64_t>(now.dwLowDateTime);
+}
+
+struct MappedFile::State {
+    HANDLE      file = INVALID_HANDLE_VALUE;
+    HANDLE      mapping = nullptr;
+    const char* data = nullptr;
+    size_t      size = 0;
+};
+
+MappedFile::MappedFile()
+    : mState(std::make_unique<State>()) {
+}
+
+MappedFile::~MappedFile() {
+    if(mState) close();
+}
+
+MappedFile::MappedFile(MappedFile&&) = default;
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    if(this != &other) {
+        if(mState) close();
+        mState = std::move(other.mState);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const Path& path) {
+    close();
+
+    // FILE_SHARE_DELETE lets the file be replaced by a rename while it's mapped
+    HANDLE file = CreateFileW(path.wstr().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size{};
+    if(!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
 
-        int attribute = 0;
-        if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            attribute |= FileAttributes::DIRECTORY;
+    mState->file = file;
+    if(size.QuadPart > 0) {
+        // mapping an empty file fails, it just has no data
+        mState->mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mState->mapping == nullptr) {
+            close();
+            return false;
         }
 
-        if(findFileData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN) {
-            attribute |= FileAttributes::HIDDEN;
+        mState->data = static_cast<const char*>(MapViewOfFile(mState->mapping, FILE_MAP_READ, 0, 0, 0));
+        if(mState->data == nullptr) {
+            close();
+            return false;
         }
+    }
+    mState->size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if(mState->data != nullptr) UnmapViewOfFile(mState->data);
+    if(mState->mapping != nullptr) CloseHandle(mState->mapping);
+    if(mState->file != INVALID_HANDLE_VALUE) CloseHandle(mState->file);
+    *mState = State{};
+}
+
+bool MappedFile::isOpen() const {
+    return mState->file != INVALID_HANDLE_VALUE;
+}
+
+const char* MappedFile::data() const {
+    return mState->data;
+}
 
-        uint64_t size = (static_cast<uint64_t>(findFileData.nFileSizeHigh) << 32) | static_cast<uint64_t>(findFileData.nFileSizeLow);
+size_t MappedFile::size() const {
+    return mState->size;
+}
+
+bool readFile(const Path& path, std::vector<char>& out_Data, uint64_t maxSize, uint64_t& out_Size) {
+    out_Data.clear();
+    out_Size = 0;
+
+    HANDLE file = CreateFileW(path.wstr().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if(GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
 
-        out_DirectoryItems.indexes.push_back(counter++);
-        out_DirectoryItems.names.push_back(filename);
-        out_DirectoryItems.attributes.push_back(attribute);
-        out_DirectoryItems.lastModifiedDates.push_back(lastModified);
-        out_DirectoryItems.lastModifiedNumbers.push_back(lastModifiedN);
-        out_DirectoryItems.sizes.push_back(size);
-    } while(FindNextFileW(hFind, &findFileData));
+    out_Size = static_cast<uint64_t>(fileSize.QuadPart);
+    if(out_Size > maxSize) {
+        CloseHandle(file);
+        return true;
+    }
+
+    // a file that shrank since is cut short, one that grew is read up to the size it had
+    out_Data.resize(out_Size);
+    size_t numRead = 0;
+    while(numRead < out_Data.size()) {
+        const DWORD chunk = static_cast<DWORD>(std::min<size_t>(out_Data.size() - numRead, 1u << 30));
+        DWORD chunkRead = 0;
+        if(!ReadFile(file, out_Data.data() + numRead, chunk, &chunkRead, nullptr) || chunkRead == 0) break;
+        numRead += chunkRead;
+    }
+    out_Data.resize(numRead);
+    out_Size = numRead;
+
+    CloseHandle(file);
+    return true;
+}
 
-    FindClose(hFind);
+bool writeFileAtomically(const Path& path, const void* data, size_t size) {
+    const std::wstring targetPath = path.wstr();
+    const std::wstring tempPath = targetPath + L".tmp";
+
+    HANDLE file = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+
+    // WriteFile takes a DWORD, big files go in pieces
+    const char* bytes = static_cast<const char*>(data);
+    size_t written = 0;
+    while(written < size) {
+        const DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - written, 1u << 30));
+        DWORD numWritten = 0;
+        if(!WriteFile(file, bytes + written, chunk, &numWritten, nullptr) || numWritten == 0) break;
+        written += numWritten;
+    }
 
+    const bool success = CloseHandle(file) && written == size;
+    if(!success || !MoveFileExW(tempPath.c_str(), targetPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(tempPath.c_str());
+        return false;
+    }
     return true;
 }
 
@@ -279,6 +1320,42 @@ bool doesPathExist(const Path& path) {
     return result != INVALID_FILE_ATTRIBUTES;
 }
 
+bool getLastModifiedNumber(const Path& path, uint64_t& out_LastModifiedNumber) {
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if(!GetFileAttributesExW(path.wstr().data(), GetFileExInfoStandard, &data)) return false;
+
+    out_LastModifiedNumber = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | static_cast<uint64_t>(data.ftLastWriteTime.dwLowDateTime);
+    return true;
+}
+
+bool getEntryInfo(const Path& directory, std::string_view name, EntryChange& out_Entry) {
+    Path fullPath = directory;
+    fullPath.appendName(name);
+
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if(!GetFileAttributesExW(fullPath.wstr().data(), GetFileExInfoStandard, &data)) return false;
+
+    // the enumerator leaves system files out, they don't exist as far as listings are concerned
+    if(data.dwFileAttributes & FILE_ATTRIBUTE_SYSTEM) return false;
+
+    out_Entry.attributes = 0;
+    if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        out_Entry.attributes |= FileAttributes::DIRECTORY;
+    }
+
+    if(data.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN) {
+        out_Entry.attributes |= FileAttributes::HIDDEN;
+    }
+
+    if(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+        out_Entry.attributes |= FileAttributes::SYMLINK;
+    }
+
+    out_Entry.lastModifiedNumber = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | static_cast<uint64_t>(data.ftLastWriteTime.dwLowDateTime);
+    out_Entry.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | static_cast<uint64_t>(data.nFileSizeLow);
+    return true;
+}
+
 // NOTE: following operations shouldn't return false if the actual file operation failes... Error reporting is done through FileOpProgressSink
 
 FileOperation::FileOperation() {
@@ -478,4 +1555,6 @@ bool renameFileOrDirectory(const Path& itemPath, const std::wstring& newName, Fi
     return true;
 }
 
+#endif
+
 }
@@ -1,12 +1,21 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <unordered_map>
 #include "SortDirection.h"
 
+#ifdef _WIN32
 #include <guiddef.h>
+#endif
 
 class Path;
 class FileOpProgressSink;
+class WorkStealingPool;
 
 struct IFileOperation;
 
@@ -36,13 +45,49 @@ namespace FileSystem {
 
         uint16_t hour;
         uint16_t minute;
+        uint16_t second;
         bool isPM;
+
+        static inline Timestamp fromLocalTime(int year, int month, int day, int hour24, int minute, int second) {
+            Timestamp result;
+            result.year     = year;
+            result.month    = month;
+            result.day      = day;
+
+            result.isPM = hour24 < 12 ? false : true;
+
+            result.hour = hour24 % 12;
+            if(result.hour == 0) {
+                result.hour = 12;
+            }
+
+            result.minute = minute;
+            result.second = second;
+            return result;
+        }
+
+        inline int secondOfDay() const {
+            return ((hour % 12) + (isPM ? 12 : 0)) * 3600 + minute * 60 + second;
+        }
     };
 
     enum FileAttributes : int {
         NONE        = 0,
         DIRECTORY   = 1 << 0,
         HIDDEN      = 1 << 1,
+        // symlink or other reparse point, recursive walks don't follow these unless asked to
+        SYMLINK     = 1 << 2,
+        // left behind by SOARecord::applyChanges, the record isn't in `indexes` anymore and waits for compact()
+        REMOVED     = 1 << 3,
+    };
+
+    // columns requested from enumerateDirectory. 
+    // Backends that have to query metadata separately (POSIX) skip the work for columns that aren't requested
+    enum EnumerateFields : int {
+        ENUMERATE_NAME_AND_TYPE     = 0,
+        ENUMERATE_SIZE              = 1 << 0,
+        ENUMERATE_LAST_MODIFIED     = 1 << 1,
+        ENUMERATE_ALL               = ENUMERATE_SIZE | ENUMERATE_LAST_MODIFIED,
     };
 
     // https://learn.microsoft.com/en-us/windows/win32/shell/knownfolderid
@@ -60,43 +105,284 @@ namespace FileSystem {
         LocalAppData
     };
 
+#ifdef _WIN32
     GUID KnownFolderToGUID(KnownFolder);
+#endif
     
+    enum class SortColumn {
+        Name,
+        LastModified,
+        Size,
+    };
+
+    // one column of a multi column sort, earlier keys take precedence
+    struct SortKey {
+        SortColumn      column;
+        SortDirection   direction;
+    };
+
+    // below this many records splitting a sort across threads costs more than it saves
+    static constexpr size_t PARALLEL_SORT_THRESHOLD = 100000;
+    // from this many records on, a listing shows its visible rows from a partial sort before the full one is done
+    static constexpr size_t PARTIAL_SORT_THRESHOLD = 50000;
+
+    // an entry of a directory as it is now, built from the names a watch reported
+    struct EntryChange {
+        std::string name;
+        // false if the entry went away, the other fields are unused then
+        bool        exists = false;
+        int         attributes = 0;
+        uint64_t    lastModifiedNumber = 0;
+        uint64_t    size = 0;
+    };
+
+    // Finds records by name for SOARecord::applyChanges. Built on first use and dropped on copy, listings are
+    // copied around between threads far more often than they are patched
+    struct RecordNameIndex {
+        std::unordered_multimap<uint64_t, uint32_t> recordsByHash;
+        bool isBuilt = false;
+
+        RecordNameIndex() = default;
+        RecordNameIndex(const RecordNameIndex&) {}
+        RecordNameIndex& operator=(const RecordNameIndex&) { clear(); return *this; }
+        RecordNameIndex(RecordNameIndex&&) = default;
+        RecordNameIndex& operator=(RecordNameIndex&&) = default;
+
+        inline void clear() {
+            recordsByHash.clear();
+            isBuilt = false;
+        }
+    };
+
     struct SOARecord {
         std::vector<size_t>         indexes;
-        std::vector<std::string>    names;
+
+        // names are stored back to back (NUL terminated) in one arena, addressed by offset/length per entry.
+        // clear() keeps the capacity so re-enumerating a directory doesn't allocate
+        std::vector<char>           nameArena;
+        std::vector<uint32_t>       nameOffsets;
+        std::vector<uint32_t>       nameLengths;
+
         std::vector<int>            attributes;
-        std::vector<Timestamp>      lastModifiedDates;
+        // raw UTC file times (100ns ticks since 1601), converted to calendar time only for visible rows
         std::vector<uint64_t>       lastModifiedNumbers;
         std::vector<uint64_t>       sizes;
 
+        // natural order sort keys (see AppendNaturalSortKey) back to back, built by buildSortKeys
+        std::vector<char>           sortKeyArena;
+        std::vector<uint32_t>       sortKeyOffsets;
+
+        // records flagged REMOVED, they keep their slot in the columns until compact()
+        size_t                      numRemoved = 0;
+        RecordNameIndex             nameIndex;
+
         inline void clear() {
             indexes.clear();
-            names.clear();
+            nameArena.clear();
+            nameOffsets.clear();
+            nameLengths.clear();
             attributes.clear();
-            lastModifiedDates.clear();
             lastModifiedNumbers.clear();
             sizes.clear();
+            sortKeyArena.clear();
+            sortKeyOffsets.clear();
+            numRemoved = 0;
+            nameIndex.clear();
         }
 
-        inline size_t size() { return indexes.size(); }
+        inline size_t size() const { return indexes.size(); }
+
+        void add(std::string_view name, int attribute, uint64_t lastModifiedNumber, uint64_t size);
+
+        // appends `count` entries of `other` in enumeration order, starting at `firstRecord`
+        void append(const SOARecord& other, size_t firstRecord, size_t count);
+
+        // bytes held by the record including unused capacity
+        size_t memoryUsage() const;
 
-        inline const std::string&   getName(size_t i)               { return names[indexes[i]]; }
-        inline const bool           isFile(size_t i)                { return !(attributes[indexes[i]] & FileAttributes::DIRECTORY); }
-        inline const Timestamp&     getLastModifiedDate(size_t i)   { return lastModifiedDates[indexes[i]]; }
-        inline const uint64_t&      getLastModifiedNumber(size_t i) { return lastModifiedNumbers[indexes[i]]; }
-        inline const uint64_t       getSize(size_t i)               { return sizes[indexes[i]]; }
+        // encodes the names of records that don't have a sort key yet, so sortByName only compares bytes. Keys are
+        // case folded, names that differ only in case keep their relative order.
+        // Listings do it once after enumeration, sortByName catches up on whatever was added since
+        void buildSortKeys();
+
+        inline std::string_view getSortKey(size_t recordIdx) const {
+            const size_t end = recordIdx + 1 < sortKeyOffsets.size() ? sortKeyOffsets[recordIdx + 1] : sortKeyArena.size();
+            return std::string_view(&sortKeyArena[sortKeyOffsets[recordIdx]], end - sortKeyOffsets[recordIdx]);
+        }
+
+        // name of the entry at enumeration order `recordIdx`, i.e. not going through `indexes`
+        inline std::string_view     getRecordName(size_t recordIdx) const  { return std::string_view(&nameArena[nameOffsets[recordIdx]], nameLengths[recordIdx]); }
+
+        // the view is backed by the arena and NUL terminated, it stays valid until the record is cleared or grows
+        inline std::string_view     getName(size_t i) const                 { return getRecordName(indexes[i]); }
+        inline const bool           isFile(size_t i) const                  { return !(attributes[indexes[i]] & FileAttributes::DIRECTORY); }
+        inline const uint64_t&      getLastModifiedNumber(size_t i) const   { return lastModifiedNumbers[indexes[i]]; }
+        inline const uint64_t       getSize(size_t i) const                 { return sizes[indexes[i]]; }
 
         void sortByName(SortDirection);
         void sortByType(SortDirection);
         void sortByLastModified(SortDirection);
         void sortBySize(SortDirection);
+
+        // sorts by all `keys` at once with directories grouped before or after files, a single pass that's stable
+        // for records equal in every key. Same directions as the single column sorts.
+        // Listings of at least `parallelThreshold` records are sorted in chunks on `pool` and merged, same result.
+        // `cancel` is checked between passes, once it's set the sort stops, puts `indexes` back and returns false
+        bool sort(const std::vector<SortKey>& keys, bool directoriesFirst, WorkStealingPool* pool = nullptr, size_t parallelThreshold = PARALLEL_SORT_THRESHOLD,
+                  const std::atomic<bool>* cancel = nullptr);
+
+        // puts the `numRows` rows starting at `firstRow` where sort() would, ties included, and leaves the rest in no
+        // particular order. A selection instead of a sort, so the rows on screen are ready long before the whole
+        // listing is. False, with `indexes` untouched, if `cancel` got set first
+        bool partialSort(const std::vector<SortKey>& keys, bool directoriesFirst, size_t firstRow, size_t numRows, const std::atomic<bool>* cancel = nullptr);
+
+        // record with that name, or SIZE_MAX. Removed records aren't found
+        size_t findRecord(std::string_view name);
+
+        // Patches the listing instead of sorting it again. `indexes` has to be sorted by `keys` already, new and
+        // changed records are binary searched into place and removed ones are flagged and compacted once they
+        // pile up. Returns the number of records that actually changed
+        size_t applyChanges(const std::vector<EntryChange>& changes, const std::vector<SortKey>& keys, bool directoriesFirst);
+
+        // drops the REMOVED records, keeps the order of `indexes`
+        void compact();
     };
 
-    bool enumerateDirectory(const Path& path, SOARecord& out_DirectoryItems);
+    bool enumerateDirectory(const Path& path, SOARecord& out_DirectoryItems, int fields = ENUMERATE_ALL);
+
+    // An open directory its subdirectories can be opened relative to, so a deep walk doesn't resolve the
+    // full path again for every directory. Only the Linux backend keeps anything in it (an O_DIRECTORY fd)
+    struct DirectoryHandle;
+
+    // names a directory independently of the path it was reached through, used to stop symlink cycles
+    struct DirectoryIdentity {
+        uint64_t device;
+        uint64_t inode;
+
+        inline bool operator<(const DirectoryIdentity& rhs) const {
+            return device != rhs.device ? device < rhs.device : inode < rhs.inode;
+        }
+    };
+
+    // Pulls a directory listing in chunks so the consumer can show entries while a huge directory is still being read.
+    // Keep one around and re-open it, the backends reuse their buffers.
+    class DirectoryEnumerator {
+        public:
+            DirectoryEnumerator();
+            ~DirectoryEnumerator();
+
+            DirectoryEnumerator(const DirectoryEnumerator&) = delete;
+            DirectoryEnumerator& operator=(const DirectoryEnumerator&) = delete;
+            DirectoryEnumerator(DirectoryEnumerator&&);
+            DirectoryEnumerator& operator=(DirectoryEnumerator&&);
+
+            bool open(const Path& path, int fields = ENUMERATE_ALL);
+
+            // opens `name` inside `parent`. `fullPath` is used instead where relative opens aren't supported
+            // or `parent` is null
+            bool openAt(const std::shared_ptr<DirectoryHandle>& parent, std::string_view name, const std::string& fullPath, int fields = ENUMERATE_ALL);
+
+            // keeps the open directory alive past the end of the enumeration so children can be opened with openAt.
+            // Call it before the listing is exhausted. Null where relative opens aren't supported
+            std::shared_ptr<DirectoryHandle> shareHandle() const;
+
+            // false where the backend can't identify the open directory cheaply
+            bool getIdentity(DirectoryIdentity& out) const;
+
+            // appends up to maxEntries entries to out, returns the number added
+            size_t next(SOARecord& out, size_t maxEntries);
+
+            bool isDone() const;
+            void close();
+
+        private:
+            struct State;
+            std::unique_ptr<State> mState;
+    };
+    // A whole file mapped read only, for reading big files without copying them into memory first.
+    // Unmapped when closed, re-opened or destroyed
+    class MappedFile {
+        public:
+            MappedFile();
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            MappedFile(MappedFile&&);
+            MappedFile& operator=(MappedFile&&);
+
+            // false if the file can't be opened or mapped. An empty file opens with a null data()
+            bool open(const Path& path);
+            void close();
+
+            bool isOpen() const;
+            const char* data() const;
+            size_t size() const;
+
+        private:
+            struct State;
+            std::unique_ptr<State> mState;
+    };
+
+    // Reads all of `path` into `out_Data`, reusing its capacity, if it has at most `maxSize` bytes. A bigger file is
+    // left unread with `out_Data` empty and `out_Size` set, for mapping it instead. False if it can't be opened or
+    // isn't a regular file
+    bool readFile(const Path& path, std::vector<char>& out_Data, uint64_t maxSize, uint64_t& out_Size);
+
+    // writes `size` bytes to a temporary file next to `path` and renames it over `path`, so readers see the old
+    // contents or the new ones and never half of them. False if anything failed, `path` is left alone then
+    bool writeFileAtomically(const Path& path, const void* data, size_t size);
+
+    // deletes the file at `path` for good, false if it couldn't be deleted
+    bool removeFile(const Path& path);
+
     bool createDirectory(const Path& path);
 
-    bool traverseDirectory(const Path& path, std::vector<Path>& out_DirectoryItems);
+    // converts a UTC file time from SOARecord::lastModifiedNumbers to local calendar time
+    Timestamp fileTimeToLocalTimestamp(uint64_t fileTime);
+    // the current UTC time in the unit of SOARecord::lastModifiedNumbers
+    uint64_t getCurrentFileTime();
+
+    struct TraverseBatch;
+
+    struct TraverseOptions {
+        // levels below the root to descend into, the root's own entries are depth 0. Negative means no limit
+        int maxDepth = -1;
+        int fields = ENUMERATE_NAME_AND_TYPE;
+        // descend into symlinked directories. Every directory is then visited once by identity so link cycles end,
+        // backends that can't identify directories never follow links
+        bool followSymlinks = false;
+        // return false to drop an entry, dropped directories aren't descended into
+        std::function<bool(std::string_view name, int attributes)> filter;
+        // return false to keep directory entry `recordIdx` of `batch` in the results but not walk into it
+        std::function<bool(const TraverseBatch& batch, size_t recordIdx)> descend;
+        // checked before every directory, set it from any thread to stop the walk early
+        const std::atomic<bool>* cancel = nullptr;
+    };
+
+    struct TraverseBatch {
+        // full path of the directory `entries` are in
+        std::string_view    directory;
+        const SOARecord&    entries;
+        int                 depth;
+        // thread of the pool the callback runs on, for per thread output without locking
+        size_t              workerIdx;
+
+        // ids are handed out per walk, the root is 0. A directory is entry `entryInParent` (enumeration order) of its
+        // parent's batch, which always arrives first. Lets callers link batches without comparing paths
+        uint32_t            directoryId;
+        uint32_t            parentId;
+        uint32_t            entryInParent;
+    };
+
+    static constexpr uint32_t NO_TRAVERSE_PARENT = UINT32_MAX;
+
+    using TraverseCallback = std::function<void(const TraverseBatch&)>;
+
+    // Walks the tree below `path` on `pool`, one task per directory, and hands the entries of every directory to
+    // `callback`. The callback runs concurrently on the pool's threads, batches arrive in no particular order and
+    // the callback must not wait on the pool itself. Returns false if the root couldn't be opened
+    bool traverseDirectory(WorkStealingPool& pool, const Path& path, const TraverseOptions& options, const TraverseCallback& callback);
 
     void getDriveLetters(std::vector<char>& out_driveLetters);
     void getDriveNames(std::vector<std::string>& out_driveNames);
@@ -107,6 +393,11 @@ namespace FileSystem {
     Path getCurrentProcessPath();
 
     bool doesPathExist(const Path& path);
+    // modification time in the same unit as SOARecord::lastModifiedNumbers, false if the path doesn't exist
+    bool getLastModifiedNumber(const Path& path, uint64_t& out_LastModifiedNumber);
+    // fills in attributes, date and size of `name` in `directory` the way enumerateDirectory would, leaves the name
+    // alone. False if there's no such entry or the enumerator would skip it
+    bool getEntryInfo(const Path& directory, std::string_view name, EntryChange& out_Entry);
     bool deleteFileOrDirectory(const Path& itemPath, bool moveToRecycleBin, FileOpProgressSink* ps = nullptr);
     bool moveFileOrDirectory(const Path& itemPath, const Path& toDirectory, FileOpProgressSink* ps = nullptr);
     bool copyFileOrDirectory(const Path& itemPath, const Path& toDirectory, FileOpProgressSink* ps = nullptr);
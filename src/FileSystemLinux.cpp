@@ -0,0 +1,481 @@
+#ifdef __linux__
+
+#include "FileSystem.h"
+#include "Path.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+namespace FileSystem {
+
+// record layout returned by getdents64(2), glibc doesn't export it
+struct LinuxDirent64 {
+    uint64_t        d_ino;
+    int64_t         d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[];
+};
+
+// big enough that a typical directory is read in a handful of syscalls.
+// owned by the enumerator and reused every time it's re-opened
+static constexpr size_t DIRENT_BUFFER_SIZE = 1 << 20;
+
+// seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01
+static constexpr uint64_t FILETIME_UNIX_EPOCH_OFFSET = 11644473600ULL;
+
+// an entry whose metadata still has to be queried after the getdents64 batch is parsed
+struct PendingStat {
+    size_t      recordIdx;
+    const char* name;
+    bool        needsType;
+};
+
+// keep lastModifiedNumbers in the same unit as the Windows backend (100ns ticks since 1601)
+inline static uint64_t UnixTimeToFileTime(int64_t seconds, uint32_t nanoseconds) {
+    return (static_cast<uint64_t>(seconds) + FILETIME_UNIX_EPOCH_OFFSET) * 10000000ULL + nanoseconds / 100;
+}
+
+struct StatResult {
+    bool        isDirectory;
+    uint64_t    size;
+    int64_t     mtimeSeconds;
+    uint32_t    mtimeNanoseconds;
+};
+
+// statx only for the fields we were asked for. Falls back to fstatat on kernels without statx
+inline static bool StatAt(int dirFd, const char* name, unsigned int mask, StatResult& out) {
+    static std::atomic<bool> hasStatx{ true };
+
+#ifdef STATX_BASIC_STATS
+    if(hasStatx) {
+        struct statx stx{};
+        if(statx(dirFd, name, AT_STATX_DONT_SYNC, mask, &stx) == 0) {
+            out.isDirectory         = S_ISDIR(stx.stx_mode);
+            out.size                = stx.stx_size;
+            out.mtimeSeconds        = stx.stx_mtime.tv_sec;
+            out.mtimeNanoseconds    = stx.stx_mtime.tv_nsec;
+            return true;
+        }
+
+        if(errno != ENOSYS) return false;
+        hasStatx = false;
+    }
+#endif
+
+    struct stat st{};
+    if(fstatat(dirFd, name, &st, 0) != 0) return false;
+
+    out.isDirectory         = S_ISDIR(st.st_mode);
+    out.size                = st.st_size;
+    out.mtimeSeconds        = st.st_mtim.tv_sec;
+    out.mtimeNanoseconds    = st.st_mtim.tv_nsec;
+    return true;
+}
+
+struct DirectoryHandle {
+    int fd = -1;
+
+    explicit DirectoryHandle(int fd) : fd(fd) {}
+    ~DirectoryHandle() { ::close(fd); }
+};
+
+struct DirectoryEnumerator::State {
+    // owns the fd, shareHandle() hands out references so children can be opened with openat after we're done
+    std::shared_ptr<DirectoryHandle> dir;
+    int dirFd = -1;
+    int fields = ENUMERATE_ALL;
+
+    std::vector<char> buffer;
+    // unread part of the last getdents64 batch
+    long bufferOffset = 0;
+    long bufferSize = 0;
+
+    std::vector<PendingStat> pendingStats;
+};
+
+DirectoryEnumerator::DirectoryEnumerator() 
+    : mState(std::make_unique<State>()) {
+}
+
+DirectoryEnumerator::~DirectoryEnumerator() {
+    close();
+}
+
+DirectoryEnumerator::DirectoryEnumerator(DirectoryEnumerator&&) = default;
+DirectoryEnumerator& DirectoryEnumerator::operator=(DirectoryEnumerator&&) = default;
+
+bool DirectoryEnumerator::open(const Path& path, int fields) {
+    if(path.isEmpty()) {
+        close();
+        return false;
+    }
+
+    if(!openAt(nullptr, {}, path.str(), fields)) {
+        printf("Can't find dir %s\n", path.str().data());
+        return false;
+    }
+
+    return true;
+}
+
+bool DirectoryEnumerator::openAt(const std::shared_ptr<DirectoryHandle>& parent, std::string_view name, const std::string& fullPath, int fields) {
+    close();
+
+    int fd = -1;
+    if(parent != nullptr && !name.empty() && name.size() <= NAME_MAX) {
+        char nameBuffer[NAME_MAX + 1];
+        memcpy(nameBuffer, name.data(), name.size());
+        nameBuffer[name.size()] = '\0';
+        fd = ::openat(parent->fd, nameBuffer, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    // no parent or out of descriptors, resolve the whole path instead
+    if(fd < 0 && (parent == nullptr || errno == EMFILE || errno == ENFILE)) {
+        fd = ::open(fullPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    if(fd < 0) return false;
+
+    mState->dir = std::make_shared<DirectoryHandle>(fd);
+    mState->dirFd = fd;
+
+    if(mState->buffer.empty()) {
+        mState->buffer.resize(DIRENT_BUFFER_SIZE);
+    }
+
+    mState->fields = fields;
+    mState->bufferOffset = 0;
+    mState->bufferSize = 0;
+    return true;
+}
+
+std::shared_ptr<DirectoryHandle> DirectoryEnumerator::shareHandle() const {
+    return mState->dir;
+}
+
+bool DirectoryEnumerator::getIdentity(DirectoryIdentity& out) const {
+    struct stat st{};
+    if(mState->dirFd < 0 || fstat(mState->dirFd, &st) != 0) return false;
+
+    out.device = st.st_dev;
+    out.inode = st.st_ino;
+    return true;
+}
+
+size_t DirectoryEnumerator::next(SOARecord& out_DirectoryItems, size_t maxEntries) {
+    State& state = *mState;
+    const int fields = state.fields;
+
+    size_t numAdded = 0;
+
+    while(state.dirFd >= 0 && numAdded < maxEntries) {
+        if(state.bufferOffset >= state.bufferSize) {
+            long bytesRead = syscall(SYS_getdents64, state.dirFd, state.buffer.data(), state.buffer.size());
+            if(bytesRead <= 0) {
+                close();
+                break;
+            }
+
+            state.bufferOffset = 0;
+            state.bufferSize = bytesRead;
+        }
+
+        state.pendingStats.clear();
+
+        // first pass: names and whatever d_type already tells us
+        while(state.bufferOffset < state.bufferSize && numAdded < maxEntries) {
+            LinuxDirent64* entry = reinterpret_cast<LinuxDirent64*>(state.buffer.data() + state.bufferOffset);
+            state.bufferOffset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+            int attribute = 0;
+            if(entry->d_type == DT_DIR) {
+                attribute |= FileAttributes::DIRECTORY;
+            }
+
+            // dot files are the POSIX equivalent of FILE_ATTRIBUTE_HIDDEN
+            if(name[0] == '.') {
+                attribute |= FileAttributes::HIDDEN;
+            }
+
+            // symlinks are resolved so links to directories can be navigated into
+            bool needsType = entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK;
+            if(entry->d_type == DT_LNK) {
+                attribute |= FileAttributes::SYMLINK;
+            }
+
+            const size_t recordIdx = out_DirectoryItems.nameOffsets.size();
+            out_DirectoryItems.add(name, attribute, 0, 0);
+            numAdded++;
+
+            if(needsType || fields != ENUMERATE_NAME_AND_TYPE) {
+                state.pendingStats.push_back({ recordIdx, name, needsType });
+            }
+        }
+
+        // second pass: one dirfd-relative statx per entry that still needs metadata,
+        // asking only for the columns that were requested. The names still point into the current batch
+        for(const PendingStat& pending : state.pendingStats) {
+            const bool isDirectory = out_DirectoryItems.attributes[pending.recordIdx] & FileAttributes::DIRECTORY;
+
+            unsigned int mask = 0;
+            if(pending.needsType)                                   mask |= STATX_TYPE;
+            if(fields & ENUMERATE_LAST_MODIFIED)                    mask |= STATX_MTIME;
+            // the size column is blank for directories, don't ask for it
+            if((fields & ENUMERATE_SIZE) && !isDirectory)           mask |= STATX_TYPE | STATX_SIZE;
+
+            StatResult st{};
+            if(!StatAt(state.dirFd, pending.name, mask, st)) continue;
+
+            if(pending.needsType && st.isDirectory) {
+                out_DirectoryItems.attributes[pending.recordIdx] |= FileAttributes::DIRECTORY;
+            }
+
+            const bool resolvedIsDirectory = out_DirectoryItems.attributes[pending.recordIdx] & FileAttributes::DIRECTORY;
+
+            if(fields & ENUMERATE_LAST_MODIFIED) {
+                out_DirectoryItems.lastModifiedNumbers[pending.recordIdx] = UnixTimeToFileTime(st.mtimeSeconds, st.mtimeNanoseconds);
+            }
+
+            if((fields & ENUMERATE_SIZE) && !resolvedIsDirectory) {
+                out_DirectoryItems.sizes[pending.recordIdx] = st.size;
+            }
+        }
+    }
+
+    return numAdded;
+}
+
+bool DirectoryEnumerator::isDone() const {
+    return mState->dirFd < 0;
+}
+
+void DirectoryEnumerator::close() {
+    // moved from
+    if(mState == nullptr) return;
+
+    // the fd itself closes once shared handles are gone too
+    mState->dir.reset();
+    mState->dirFd = -1;
+}
+
+Timestamp fileTimeToLocalTimestamp(uint64_t fileTime) {
+    time_t t = static_cast<time_t>(fileTime / 10000000ULL) - static_cast<time_t>(FILETIME_UNIX_EPOCH_OFFSET);
+    struct tm localTime{};
+    localtime_r(&t, &localTime);
+
+    return Timestamp::fromLocalTime(localTime.tm_year + 1900, localTime.tm_mon + 1, localTime.tm_mday, localTime.tm_hour, localTime.tm_min, localTime.tm_sec);
+}
+
+uint64_t getCurrentFileTime() {
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return UnixTimeToFileTime(now.tv_sec, static_cast<uint32_t>(now.tv_nsec));
+}
+
+struct MappedFile::State {
+    const char* data = nullptr;
+    size_t      size = 0;
+    bool        isOpen = false;
+};
+
+MappedFile::MappedFile()
+    : mState(std::make_unique<State>()) {
+}
+
+MappedFile::~MappedFile() {
+    if(mState) close();
+}
+
+MappedFile::MappedFile(MappedFile&&) = default;
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    if(this != &other) {
+        if(mState) close();
+        mState = std::move(other.mState);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const Path& path) {
+    close();
+
+    const int fd = ::open(path.str().c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    struct stat st{};
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    // the mapping keeps the file alive on its own
+    void* data = nullptr;
+    if(st.st_size > 0) {
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(data == MAP_FAILED) return false;
+
+    mState->data = static_cast<const char*>(data);
+    mState->size = static_cast<size_t>(st.st_size);
+    mState->isOpen = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if(mState->data != nullptr) {
+        munmap(const_cast<char*>(mState->data), mState->size);
+    }
+    *mState = State{};
+}
+
+bool MappedFile::isOpen() const {
+    return mState->isOpen;
+}
+
+const char* MappedFile::data() const {
+    return mState->data;
+}
+
+size_t MappedFile::size() const {
+    return mState->size;
+}
+
+bool readFile(const Path& path, std::vector<char>& out_Data, uint64_t maxSize, uint64_t& out_Size) {
+    out_Data.clear();
+    out_Size = 0;
+
+    const int fd = ::open(path.str().c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    struct stat st{};
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    out_Size = static_cast<uint64_t>(st.st_size);
+    if(out_Size > maxSize) {
+        ::close(fd);
+        return true;
+    }
+
+    // a file that shrank since is cut short, one that grew is read up to the size it had
+    out_Data.resize(out_Size);
+    size_t numRead = 0;
+    while(numRead < out_Data.size()) {
+        const ssize_t result = ::read(fd, out_Data.data() + numRead, out_Data.size() - numRead);
+        if(result < 0 && errno == EINTR) continue;
+        if(result <= 0) break;
+        numRead += static_cast<size_t>(result);
+    }
+    out_Data.resize(numRead);
+    out_Size = numRead;
+
+    ::close(fd);
+    return true;
+}
+
+bool writeFileAtomically(const Path& path, const void* data, size_t size) {
+    const std::string tempPath = path.str() + ".tmp";
+
+    const int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) return false;
+
+    const char* bytes = static_cast<const char*>(data);
+    size_t written = 0;
+    while(written < size) {
+        const ssize_t result = ::write(fd, bytes + written, size - written);
+        if(result < 0 && errno == EINTR) continue;
+        if(result <= 0) break;
+        written += static_cast<size_t>(result);
+    }
+
+    const bool success = ::close(fd) == 0 && written == size;
+    if(!success || ::rename(tempPath.c_str(), path.str().c_str()) != 0) {
+        ::unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool removeFile(const Path& path) {
+    return ::unlink(path.str().c_str()) == 0;
+}
+
+bool createDirectory(const Path& path) {
+    return mkdir(path.str().c_str(), 0777) == 0;
+}
+
+Path getCurrentProcessPath() {
+    char fullPath[PATH_MAX];
+
+    char* result = getcwd(fullPath, PATH_MAX);
+    assert(result != nullptr && "Not enough space in buffer to retrieve full path");
+
+    return Path(std::string(fullPath));
+}
+
+bool doesPathExist(const Path& path) {
+    struct stat st{};
+    return stat(path.str().c_str(), &st) == 0;
+}
+
+bool getLastModifiedNumber(const Path& path, uint64_t& out_LastModifiedNumber) {
+    struct stat st{};
+    if(stat(path.str().c_str(), &st) != 0) return false;
+
+    out_LastModifiedNumber = UnixTimeToFileTime(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    return true;
+}
+
+bool getEntryInfo(const Path& directory, std::string_view name, EntryChange& out_Entry) {
+    Path fullPath = directory;
+    fullPath.appendName(name);
+
+    struct stat st{};
+    if(lstat(fullPath.str().c_str(), &st) != 0) return false;
+
+    out_Entry.attributes = 0;
+    out_Entry.lastModifiedNumber = 0;
+    out_Entry.size = 0;
+
+    if(name[0] == '.') {
+        out_Entry.attributes |= FileAttributes::HIDDEN;
+    }
+
+    // like the enumerator, a link takes type and metadata from its target and a dangling one stays blank
+    if(S_ISLNK(st.st_mode)) {
+        out_Entry.attributes |= FileAttributes::SYMLINK;
+        if(stat(fullPath.str().c_str(), &st) != 0) return true;
+    }
+
+    if(S_ISDIR(st.st_mode)) {
+        out_Entry.attributes |= FileAttributes::DIRECTORY;
+    } else {
+        out_Entry.size = st.st_size;
+    }
+
+    out_Entry.lastModifiedNumber = UnixTimeToFileTime(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    return true;
+}
+
+}
+
+#endif
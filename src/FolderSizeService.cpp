@@ -0,0 +1,188 @@
+#include "FolderSizeService.h"
+#include "FileSystem.h"
+#include "Path.h"
+
+#include <algorithm>
+#include <vector>
+
+FolderSizeService::FolderSizeService(size_t numThreads)
+    : mPool(numThreads) {
+    mThread = std::thread(&FolderSizeService::run, this);
+}
+
+FolderSizeService::~FolderSizeService() {
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        mAlive = false;
+    }
+    mCancel = true;
+    mWakeCondition.notify_all();
+    mThread.join();
+}
+
+bool FolderSizeService::lookup(const std::string& path, uint64_t lastModifiedNumber, uint64_t& out_Size) const {
+    std::scoped_lock<std::mutex> lock(mCacheMutex);
+
+    auto it = mCache.find(path);
+    if(it == mCache.end() || it->second.lastModifiedNumber != lastModifiedNumber) return false;
+
+    out_Size = it->second.size;
+    return true;
+}
+
+void FolderSizeService::request(const std::string& path, uint64_t lastModifiedNumber) {
+    uint64_t size;
+    if(lookup(path, lastModifiedNumber, size)) return;
+
+    {
+        std::scoped_lock<std::mutex> lock(mQueueMutex);
+        if(!mQueuedPaths.insert(path).second) return;
+        mQueue.push_front({ path, lastModifiedNumber });
+    }
+    mWakeCondition.notify_one();
+}
+
+void FolderSizeService::invalidate(const std::string& path) {
+    std::scoped_lock<std::mutex> lock(mCacheMutex);
+
+    std::string current = path;
+    while(!current.empty()) {
+        mCache.erase(current);
+
+        const size_t separator = current.find_last_of(Path::SEPARATOR);
+        if(separator == std::string::npos) break;
+
+        // keep the separator of a root ("/" or "C:\") so it's erased as well
+        const bool isRootSeparator = separator == 0 || (separator > 0 && current[separator - 1] == ':');
+        if(isRootSeparator && current.size() > separator + 1) {
+            current.resize(separator + 1);
+        } else {
+            current.resize(separator);
+        }
+    }
+}
+
+size_t FolderSizeService::numCachedDirectories() const {
+    std::scoped_lock<std::mutex> lock(mCacheMutex);
+    return mCache.size();
+}
+
+void FolderSizeService::run() {
+    while(true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mQueueMutex);
+            mWakeCondition.wait(lock, [this]() { return !mAlive || !mQueue.empty(); });
+
+            if(!mAlive) break;
+
+            request = std::move(mQueue.front());
+            mQueue.pop_front();
+            mQueuedPaths.erase(request.path);
+        }
+
+        uint64_t size;
+        if(lookup(request.path, request.lastModifiedNumber, size)) continue;
+
+        scan(request);
+        mNumCompletedScans++;
+    }
+}
+
+// one per directory the scan walked into, indexed by TraverseBatch::directoryId
+struct ScannedDirectory {
+    std::string path;
+    uint32_t    parentId = FileSystem::NO_TRAVERSE_PARENT;
+    uint64_t    lastModifiedNumber = 0;
+    // files directly inside plus cached totals of subdirectories that weren't walked into
+    uint64_t    size = 0;
+    int         depth = -1;
+};
+
+void FolderSizeService::scan(const Request& request) {
+    std::mutex scanMutex;
+    std::vector<ScannedDirectory> directories;
+    // modification times of subdirectories that are walked into, by (parent id, entry index)
+    std::unordered_map<uint64_t, uint64_t> childTimes;
+
+    auto xDirectory = [&](uint32_t directoryId) -> ScannedDirectory& {
+        if(directories.size() <= directoryId) {
+            directories.resize(directoryId + 1);
+        }
+        return directories[directoryId];
+    };
+
+    FileSystem::TraverseOptions options;
+    options.fields = FileSystem::ENUMERATE_SIZE | FileSystem::ENUMERATE_LAST_MODIFIED;
+    options.cancel = &mCancel;
+
+    // a subdirectory whose total is still valid is counted from the cache instead of walked again
+    options.descend = [&](const FileSystem::TraverseBatch& batch, size_t recordIdx) {
+        std::string childPath(batch.directory);
+        if(!childPath.empty() && childPath.back() != Path::SEPARATOR) {
+            childPath.push_back(Path::SEPARATOR);
+        }
+        childPath.append(batch.entries.getRecordName(recordIdx));
+
+        const uint64_t lastModifiedNumber = batch.entries.lastModifiedNumbers[recordIdx];
+
+        uint64_t cachedSize;
+        const bool isCached = lookup(childPath, lastModifiedNumber, cachedSize);
+
+        std::scoped_lock<std::mutex> lock(scanMutex);
+        if(isCached) {
+            xDirectory(batch.directoryId).size += cachedSize;
+            return false;
+        }
+
+        childTimes[(static_cast<uint64_t>(batch.directoryId) << 32) | recordIdx] = lastModifiedNumber;
+        return true;
+    };
+
+    const bool success = FileSystem::traverseDirectory(mPool, Path(request.path), options, [&](const FileSystem::TraverseBatch& batch) {
+        const FileSystem::SOARecord& entries = batch.entries;
+
+        uint64_t filesSize = 0;
+        for(size_t i = 0; i < entries.nameOffsets.size(); i++) {
+            if(!(entries.attributes[i] & FileSystem::FileAttributes::DIRECTORY)) {
+                filesSize += entries.sizes[i];
+            }
+        }
+
+        std::scoped_lock<std::mutex> lock(scanMutex);
+        ScannedDirectory& directory = xDirectory(batch.directoryId);
+        directory.path = std::string(batch.directory);
+        directory.parentId = batch.parentId;
+        directory.depth = batch.depth;
+        directory.size += filesSize;
+
+        if(batch.parentId == FileSystem::NO_TRAVERSE_PARENT) {
+            directory.lastModifiedNumber = request.lastModifiedNumber;
+        } else {
+            directory.lastModifiedNumber = childTimes[(static_cast<uint64_t>(batch.parentId) << 32) | batch.entryInParent];
+        }
+    });
+
+    if(!success || mCancel) return;
+
+    // deepest first so every directory has its subdirectories added in before it's added to its parent
+    std::vector<uint32_t> order;
+    order.reserve(directories.size());
+    for(uint32_t i = 0; i < directories.size(); i++) {
+        if(directories[i].depth >= 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) { return directories[lhs].depth > directories[rhs].depth; });
+
+    for(uint32_t id : order) {
+        const ScannedDirectory& directory = directories[id];
+        if(directory.parentId != FileSystem::NO_TRAVERSE_PARENT) {
+            directories[directory.parentId].size += directory.size;
+        }
+    }
+
+    std::scoped_lock<std::mutex> lock(mCacheMutex);
+    for(uint32_t id : order) {
+        ScannedDirectory& directory = directories[id];
+        mCache[std::move(directory.path)] = { directory.lastModifiedNumber, directory.size };
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "WorkStealingPool.h"
+
+// Computes recursive folder sizes in the background. Totals are cached per directory and stay valid as long as
+// the directory's modification time matches the one they were computed for, so rescans skip subdirectories
+// that didn't change. One instance is shared by all browser widgets
+class FolderSizeService {
+public:
+    // 0 threads means one per hardware thread
+    explicit FolderSizeService(size_t numThreads = 0);
+    ~FolderSizeService();
+
+    FolderSizeService(const FolderSizeService&) = delete;
+    FolderSizeService& operator=(const FolderSizeService&) = delete;
+
+    // cached total of `path`, if it was computed for the same `lastModifiedNumber`
+    bool lookup(const std::string& path, uint64_t lastModifiedNumber, uint64_t& out_Size) const;
+
+    // queues a recursive scan of `path` unless a valid total is cached or the path is queued already.
+    // Newer requests are served first, they're the ones the user is looking at
+    void request(const std::string& path, uint64_t lastModifiedNumber);
+
+    // drops the totals of `path` and every directory above it, call it when something inside `path` changed
+    void invalidate(const std::string& path);
+
+    // bumped whenever a scan finished, poll it to know when to look sizes up again
+    inline uint64_t numCompletedScans() const { return mNumCompletedScans.load(); }
+
+    size_t numCachedDirectories() const;
+
+private:
+    struct CacheEntry {
+        uint64_t lastModifiedNumber;
+        uint64_t size;
+    };
+
+    struct Request {
+        std::string path;
+        uint64_t    lastModifiedNumber;
+    };
+
+    void run();
+    void scan(const Request& request);
+
+    WorkStealingPool mPool;
+
+    mutable std::mutex                              mCacheMutex;
+    std::unordered_map<std::string, CacheEntry>     mCache;
+
+    std::mutex                      mQueueMutex;
+    std::condition_variable         mWakeCondition;
+    std::deque<Request>             mQueue;
+    std::unordered_set<std::string> mQueuedPaths;
+    bool                            mAlive = true;
+
+    // stops the scan in flight when shutting down
+    std::atomic<bool>       mCancel{ false };
+    std::atomic<uint64_t>   mNumCompletedScans{ 0 };
+
+    std::thread mThread;
+};
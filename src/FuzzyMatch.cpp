@@ -0,0 +1,370 @@
+#include "FuzzyMatch.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FUZZY_MATCH_SSE2
+    #include <emmintrin.h>
+#endif
+
+// fzf's scores, a gap has to be long before it outweighs a matched character's bonus
+static constexpr int SCORE_MATCH = 16;
+static constexpr int SCORE_GAP_START = -3;
+static constexpr int SCORE_GAP_EXTENSION = -1;
+static constexpr int BONUS_BOUNDARY = SCORE_MATCH / 2;
+static constexpr int BONUS_BOUNDARY_WHITE = BONUS_BOUNDARY + 2;
+static constexpr int BONUS_BOUNDARY_DELIMITER = BONUS_BOUNDARY + 1;
+static constexpr int BONUS_NON_WORD = SCORE_MATCH / 2;
+static constexpr int BONUS_CAMEL_123 = BONUS_BOUNDARY + SCORE_GAP_EXTENSION;
+static constexpr int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+static constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+// names scored by one task of a parallel match, whole words of the match bits so no two tasks write the same one
+static constexpr size_t PARALLEL_CHUNK_SIZE = 64 * 256;
+// longer patterns are looked for a byte at a time
+static constexpr size_t MAX_SIMD_PATTERN_LENGTH = 32;
+
+enum class CharClass : uint8_t {
+    White,
+    NonWord,
+    Delimiter,
+    Lower,
+    Upper,
+    // any byte of a multi byte UTF-8 sequence
+    Letter,
+    Number,
+    Count,
+};
+
+inline static char FoldAsciiChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+inline static CharClass ClassOf(unsigned char c) {
+    if(c >= 'a' && c <= 'z') return CharClass::Lower;
+    if(c >= 'A' && c <= 'Z') return CharClass::Upper;
+    if(c >= '0' && c <= '9') return CharClass::Number;
+    if(c >= 0x80) return CharClass::Letter;
+    if(c == ' ' || c == '\t') return CharClass::White;
+    if(c == '/' || c == '\\' || c == ',' || c == ':' || c == ';' || c == '|') return CharClass::Delimiter;
+    return CharClass::NonWord;
+}
+
+// bonus for matching a character of class `current` right after one of class `previous`
+inline static int BonusFor(CharClass previous, CharClass current) {
+    if(current > CharClass::Delimiter) {
+        if(previous == CharClass::White) return BONUS_BOUNDARY_WHITE;
+        if(previous == CharClass::Delimiter) return BONUS_BOUNDARY_DELIMITER;
+        if(previous == CharClass::NonWord) return BONUS_BOUNDARY;
+    }
+    if((previous == CharClass::Lower && current == CharClass::Upper) || (previous != CharClass::Number && current == CharClass::Number)) {
+        return BONUS_CAMEL_123;
+    }
+    if(current == CharClass::NonWord || current == CharClass::Delimiter) return BONUS_NON_WORD;
+    if(current == CharClass::White) return BONUS_BOUNDARY_WHITE;
+    return 0;
+}
+
+// looked up per byte of every matched window, worked out once
+struct ScoreTables {
+    std::array<CharClass, 256> classes;
+    std::array<std::array<int8_t, static_cast<size_t>(CharClass::Count)>, static_cast<size_t>(CharClass::Count)> bonuses;
+    // what a text byte is compared with the pattern as, with and without the case
+    std::array<char, 256> sameCase;
+    std::array<char, 256> foldedCase;
+
+    ScoreTables() {
+        for(size_t c = 0; c < 256; c++) {
+            classes[c] = ClassOf(static_cast<unsigned char>(c));
+            sameCase[c] = static_cast<char>(c);
+            foldedCase[c] = FoldAsciiChar(static_cast<char>(c));
+        }
+        for(size_t previous = 0; previous < bonuses.size(); previous++) {
+            for(size_t current = 0; current < bonuses.size(); current++) {
+                bonuses[previous][current] = static_cast<int8_t>(BonusFor(static_cast<CharClass>(previous), static_cast<CharClass>(current)));
+            }
+        }
+    }
+
+    inline CharClass classOf(char c) const { return classes[static_cast<unsigned char>(c)]; }
+    inline int bonus(CharClass previous, CharClass current) const { return bonuses[static_cast<size_t>(previous)][static_cast<size_t>(current)]; }
+};
+
+static const ScoreTables& Tables() {
+    static const ScoreTables tables;
+    return tables;
+}
+
+FuzzyPattern::FuzzyPattern(std::string_view query)
+    : mText(query) {
+    mIsCaseSensitive = std::any_of(mText.begin(), mText.end(), [](char c) { return c >= 'A' && c <= 'Z'; });
+}
+
+bool IsFuzzyRefinement(std::string_view previousQuery, std::string_view query) {
+    // a query that just gained an upper case letter is case sensitive now and matches even less, one that lost it
+    // matches names the previous one didn't
+    const FuzzyPattern previous(previousQuery);
+    const bool ignoresCase = !previous.isCaseSensitive();
+
+    size_t pos = 0;
+    for(char c : previous.text()) {
+        while(pos < query.size() && (ignoresCase ? FoldAsciiChar(query[pos]) : query[pos]) != c) {
+            pos++;
+        }
+        if(pos == query.size()) return false;
+        pos++;
+    }
+    return true;
+}
+
+// the pattern's characters as the scans compare them, 16 bytes at a time where SSE2 is around
+struct PatternBytes {
+    const std::string* text;
+    // sameCase or foldedCase of the ScoreTables
+    const char* textChars;
+    bool useSimd = false;
+#ifdef FUZZY_MATCH_SSE2
+    // per character the byte and what's or'ed into the text before comparing with it (0x20 for a letter when the
+    // case is ignored, see SubstringSearch)
+    __m128i values[MAX_SIMD_PATTERN_LENGTH];
+    __m128i caseBits[MAX_SIMD_PATTERN_LENGTH];
+#endif
+
+    explicit PatternBytes(const FuzzyPattern& fuzzyPattern)
+        : text(&fuzzyPattern.text()),
+          textChars(fuzzyPattern.isCaseSensitive() ? Tables().sameCase.data() : Tables().foldedCase.data()) {
+#ifdef FUZZY_MATCH_SSE2
+        useSimd = text->size() <= MAX_SIMD_PATTERN_LENGTH;
+        for(size_t i = 0; useSimd && i < text->size(); i++) {
+            const char c = (*text)[i];
+            const bool isLetter = c >= 'a' && c <= 'z';
+            values[i] = _mm_set1_epi8(c);
+            caseBits[i] = _mm_set1_epi8(!fuzzyPattern.isCaseSensitive() && isLetter ? 0x20 : 0);
+        }
+#endif
+    }
+
+    inline char textChar(char c) const { return textChars[static_cast<unsigned char>(c)]; }
+};
+
+// end of the first complete match of the pattern in `name` going left to right, 0 if there is none. `readable`
+// bytes from `name` on can be loaded, at least `length`
+inline static size_t ForwardMatchEnd(const char* name, size_t length, size_t readable, const PatternBytes& bytes) {
+    const std::string& text = *bytes.text;
+    size_t patternIdx = 0;
+    size_t pos = 0;
+
+#ifdef FUZZY_MATCH_SSE2
+    for(; bytes.useSimd && pos < length && pos + 16 <= readable; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(name + pos));
+        const uint32_t inName = length - pos >= 16 ? 0xFFFF : (uint32_t(1) << (length - pos)) - 1;
+
+        // every character of the pattern found in this block moves the next one's search past it
+        uint32_t from = 0;
+        while(patternIdx < text.size() && from < 16) {
+            const __m128i folded = _mm_or_si128(block, bytes.caseBits[patternIdx]);
+            const uint32_t found = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(folded, bytes.values[patternIdx]))) & inName & (~uint32_t(0) << from);
+            if(found == 0) break;
+
+            from = LowestSetBit(found) + 1;
+            patternIdx++;
+        }
+        if(patternIdx == text.size()) return pos + from;
+    }
+#endif
+
+    for(; pos < length; pos++) {
+        if(bytes.textChar(name[pos]) == text[patternIdx] && ++patternIdx == text.size()) {
+            return pos + 1;
+        }
+    }
+    return 0;
+}
+
+// start of the shortest window ending at `end` that still has the whole pattern in it
+inline static size_t MatchStart(const char* name, size_t end, const PatternBytes& bytes) {
+    const std::string& text = *bytes.text;
+
+    size_t start = end;
+    for(size_t patternIdx = text.size(); patternIdx > 0; ) {
+        start--;
+        if(bytes.textChar(name[start]) == text[patternIdx - 1]) {
+            patternIdx--;
+        }
+    }
+    return start;
+}
+
+// the most a window of `windowLength` bytes can score: every character matched on the best boundary and the gaps
+// in one piece
+inline static int MaxScore(size_t patternLength, size_t windowLength) {
+    const int gapLength = static_cast<int>(windowLength - patternLength);
+    const int gapPenalty = gapLength > 0 ? SCORE_GAP_START + (gapLength - 1) * SCORE_GAP_EXTENSION : 0;
+    return static_cast<int>(patternLength) * SCORE_MATCH + static_cast<int>(patternLength + 1) * BONUS_BOUNDARY_WHITE + gapPenalty;
+}
+
+inline static int ScoreWindow(const char* name, size_t start, size_t end, const PatternBytes& bytes) {
+    const ScoreTables& tables = Tables();
+    const std::string& text = *bytes.text;
+
+    int score = 0;
+    int firstBonus = 0;
+    size_t consecutive = 0;
+    bool inGap = false;
+    size_t patternIdx = 0;
+    CharClass previousClass = start > 0 ? tables.classOf(name[start - 1]) : CharClass::White;
+
+    for(size_t pos = start; pos < end; pos++) {
+        const CharClass charClass = tables.classOf(name[pos]);
+
+        if(bytes.textChar(name[pos]) == text[patternIdx]) {
+            score += SCORE_MATCH;
+            int bonus = tables.bonus(previousClass, charClass);
+            // a run keeps the bonus of the boundary it started at
+            if(consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                if(bonus >= BONUS_BOUNDARY && bonus > firstBonus) {
+                    firstBonus = bonus;
+                }
+                bonus = std::max({ bonus, firstBonus, BONUS_CONSECUTIVE });
+            }
+            score += patternIdx == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus;
+
+            inGap = false;
+            consecutive++;
+            patternIdx++;
+        } else {
+            score += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previousClass = charClass;
+    }
+    return score;
+}
+
+int FuzzyScore(std::string_view name, const FuzzyPattern& pattern) {
+    if(pattern.isEmpty()) return 0;
+
+    const PatternBytes bytes(pattern);
+    const size_t end = ForwardMatchEnd(name.data(), name.size(), name.size(), bytes);
+    if(end == 0) return FUZZY_NO_MATCH;
+    return ScoreWindow(name.data(), MatchStart(name.data(), end, bytes), end, bytes);
+}
+
+TopMatches::TopMatches(size_t capacity)
+    : mCapacity(capacity) {
+    mHeap.reserve(capacity);
+}
+
+// IsBetterMatch as the heap's "less" puts the worst match on top
+void TopMatches::pushHeap(const FuzzyMatch& match) {
+    mHeap.push_back(match);
+    std::push_heap(mHeap.begin(), mHeap.end(), IsBetterMatch);
+}
+
+void TopMatches::replaceWorst(const FuzzyMatch& match) {
+    std::pop_heap(mHeap.begin(), mHeap.end(), IsBetterMatch);
+    mHeap.back() = match;
+    std::push_heap(mHeap.begin(), mHeap.end(), IsBetterMatch);
+}
+
+void TopMatches::merge(const TopMatches& other) {
+    for(const FuzzyMatch& match : other.mHeap) {
+        push(match);
+    }
+}
+
+void TopMatches::clear() {
+    mHeap.clear();
+}
+
+void TopMatches::sorted(std::vector<FuzzyMatch>& out_Best) const {
+    out_Best = mHeap;
+    std::sort(out_Best.begin(), out_Best.end(), IsBetterMatch);
+}
+
+void FuzzyMatchNames(std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end, const FuzzyPattern& pattern,
+                     const BitSet* candidates, TopMatches& out_Best, BitSet* out_Matches) {
+    if(pattern.isEmpty()) {
+        for(size_t recordIdx = begin; recordIdx < end; recordIdx++) {
+            if(candidates != nullptr && !candidates->test(recordIdx)) continue;
+
+            out_Best.push({ static_cast<uint32_t>(recordIdx), 0, 0 });
+            if(out_Matches != nullptr) {
+                out_Matches->set(recordIdx);
+            }
+        }
+        return;
+    }
+
+    const PatternBytes bytes(pattern);
+
+    auto xMatch = [&](size_t recordIdx) {
+        const size_t offset = offsets[recordIdx];
+        // up to the NUL after the name
+        const size_t length = (recordIdx + 1 < offsets.size() ? offsets[recordIdx + 1] : arena.size()) - 1 - offset;
+        const char* name = arena.data() + offset;
+
+        const size_t matchEnd = ForwardMatchEnd(name, length, arena.size() - offset, bytes);
+        if(matchEnd == 0) return false;
+
+        // once the best are known most matches can't make it in, whatever the bonuses in their window
+        const size_t matchStart = MatchStart(name, matchEnd, bytes);
+        if(out_Best.isFull() && MaxScore(pattern.text().size(), matchEnd - matchStart) < out_Best.worst().score) return true;
+
+        out_Best.push({ static_cast<uint32_t>(recordIdx), ScoreWindow(name, matchStart, matchEnd, bytes), static_cast<uint32_t>(length) });
+        return true;
+    };
+
+    if(candidates != nullptr) {
+        for(size_t recordIdx = candidates->findNext(begin); recordIdx < end; recordIdx = candidates->findNext(recordIdx + 1)) {
+            if(!xMatch(recordIdx) && out_Matches != nullptr) {
+                out_Matches->unset(recordIdx);
+            }
+        }
+        return;
+    }
+
+    for(size_t recordIdx = begin; recordIdx < end; recordIdx++) {
+        if(xMatch(recordIdx) && out_Matches != nullptr) {
+            out_Matches->set(recordIdx);
+        }
+    }
+}
+
+void FuzzyMatchNames(WorkStealingPool& pool, std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end,
+                     const FuzzyPattern& pattern, const BitSet* candidates, TopMatches& out_Best, BitSet* out_Matches) {
+    if(begin >= end) return;
+
+    // chunks start at multiples of the chunk size so neighbours never share a word of the match bits
+    std::vector<size_t> chunkStarts = { begin };
+    for(size_t chunkStart = (begin / PARALLEL_CHUNK_SIZE + 1) * PARALLEL_CHUNK_SIZE; chunkStart < end; chunkStart += PARALLEL_CHUNK_SIZE) {
+        chunkStarts.push_back(chunkStart);
+    }
+    chunkStarts.push_back(end);
+
+    std::vector<TopMatches> chunkBest(chunkStarts.size() - 1, TopMatches(out_Best.capacity()));
+
+    WorkStealingPool::TaskGroup group;
+    for(size_t chunk = 0; chunk + 1 < chunkStarts.size(); chunk++) {
+        pool.submit(group, [&, chunk](size_t) {
+            FuzzyMatchNames(arena, offsets, chunkStarts[chunk], chunkStarts[chunk + 1], pattern, candidates, chunkBest[chunk], out_Matches);
+        });
+    }
+    pool.wait(group);
+
+    for(const TopMatches& best : chunkBest) {
+        out_Best.merge(best);
+    }
+}
+
+void FuzzyRank(const NameArena& names, std::string_view query, size_t maxResults, std::vector<FuzzyMatch>& out_Best) {
+    TopMatches best(std::min(maxResults, names.size()));
+    FuzzyMatchNames(std::string_view(names.arena.data(), names.arena.size()), names.offsets, 0, names.size(), FuzzyPattern(query), nullptr, best, nullptr);
+    best.sorted(out_Best);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BitSet.h"
+#include "SubstringSearch.h"
+
+class WorkStealingPool;
+
+static constexpr int FUZZY_NO_MATCH = INT32_MIN;
+
+// A query for fuzzy matching: its characters have to show up in a name in order, with anything in between.
+// Smart case like fzf, ASCII case is ignored unless the query has an upper case letter in it
+class FuzzyPattern {
+public:
+    explicit FuzzyPattern(std::string_view query);
+
+    inline bool isEmpty() const { return mText.empty(); }
+    inline bool isCaseSensitive() const { return mIsCaseSensitive; }
+    // folded to lower case when the case is ignored
+    inline const std::string& text() const { return mText; }
+
+private:
+    std::string mText;
+    bool mIsCaseSensitive = false;
+};
+
+// true if every name `query` matches is also matched by `previousQuery`, the previous matches are all a refined
+// search has to look at again
+bool IsFuzzyRefinement(std::string_view previousQuery, std::string_view query);
+
+// Score of `name` against `pattern`, FUZZY_NO_MATCH if it doesn't match. Scored like fzf's v1 algorithm: the
+// shortest window ending at the first complete match gets points per matched character, bonuses for matching right
+// after a space, a path separator, punctuation or a camelCase / digit boundary and for runs of matched characters,
+// and penalties for the gaps in between. An empty pattern matches everything with a score of 0
+int FuzzyScore(std::string_view name, const FuzzyPattern& pattern);
+
+struct FuzzyMatch {
+    uint32_t    index;
+    int32_t     score;
+    // of the matched name, shorter names win ties
+    uint32_t    length;
+};
+
+// higher score first, then the shorter name, then the earlier one
+inline bool IsBetterMatch(const FuzzyMatch& lhs, const FuzzyMatch& rhs) {
+    if(lhs.score != rhs.score) return lhs.score > rhs.score;
+    if(lhs.length != rhs.length) return lhs.length < rhs.length;
+    return lhs.index < rhs.index;
+}
+
+// The best `capacity` matches pushed so far, kept in a heap with the worst of them on top so a match that doesn't
+// make the cut costs one comparison. Nothing gets sorted until they're taken out
+class TopMatches {
+public:
+    explicit TopMatches(size_t capacity = 0);
+
+    inline size_t capacity() const { return mCapacity; }
+    inline size_t size() const { return mHeap.size(); }
+    inline bool isFull() const { return mHeap.size() == mCapacity; }
+    // the match a better one would push out, only while size() > 0
+    inline const FuzzyMatch& worst() const { return mHeap.front(); }
+
+    inline void push(const FuzzyMatch& match) {
+        if(mHeap.size() < mCapacity) {
+            pushHeap(match);
+        } else if(mCapacity > 0 && IsBetterMatch(match, mHeap.front())) {
+            replaceWorst(match);
+        }
+    }
+
+    void merge(const TopMatches& other);
+    void clear();
+
+    // best first
+    void sorted(std::vector<FuzzyMatch>& out_Best) const;
+
+private:
+    void pushHeap(const FuzzyMatch& match);
+    void replaceWorst(const FuzzyMatch& match);
+
+    std::vector<FuzzyMatch> mHeap;
+    size_t                  mCapacity;
+};
+
+// Scores the names [begin, end) of a name arena laid out like FindInNames wants it, pushes every match into
+// `out_Best` and sets its bit in `out_Matches` if that's given. With `candidates` only the names set in it are
+// scored and `out_Matches` has the others unset, the way NameFilter refines. Names that can't contain every
+// character of the pattern are thrown out 16 bytes at a time before anything gets scored
+void FuzzyMatchNames(std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end, const FuzzyPattern& pattern,
+                     const BitSet* candidates, TopMatches& out_Best, BitSet* out_Matches);
+
+// the same spread over the threads of `pool` in chunks of whole 64 bit words of `out_Matches`
+void FuzzyMatchNames(WorkStealingPool& pool, std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end,
+                     const FuzzyPattern& pattern, const BitSet* candidates, TopMatches& out_Best, BitSet* out_Matches);
+
+// the best `maxResults` names of a short list, best first. An empty query keeps them all in their order
+void FuzzyRank(const NameArena& names, std::string_view query, size_t maxResults, std::vector<FuzzyMatch>& out_Best);
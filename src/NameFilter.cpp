@@ -0,0 +1,375 @@
+#include "NameFilter.h"
+#include "FileSystem.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// records a background scan looks at between hand-offs to the UI thread, and the most hand-offs per scan. Each one
+// maps the matches so far onto every row, so they're kept few on big listings
+static constexpr size_t MIN_SCAN_CHUNK_SIZE = 16384;
+static constexpr size_t MAX_SCAN_CHUNKS = 8;
+
+// the names of a listing as the worker sees them, a copy so the UI thread can swap listings while it scans
+struct NameFilter::Names {
+    std::vector<char>       arena;
+    std::vector<uint32_t>   offsets;
+    // the records that aren't REMOVED when some are, a full scan only looks at these
+    BitSet                  live;
+};
+
+// everything below `mutex` is shared between the UI thread and the worker and guarded by it
+struct NameFilter::Worker {
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool alive = true;
+
+    // latest request from the UI thread
+    std::shared_ptr<const Names> names;
+    std::shared_ptr<const std::vector<size_t>> rows;
+    std::string query;
+    // the records to look at again when refining, all of them otherwise
+    BitSet candidates;
+    bool isRefining = false;
+    bool scanRequested = false;
+    // bumped by every request, the worker compares against it between chunks to drop stale scans
+    std::atomic<uint64_t> generation{ 0 };
+
+    // progress waiting for the next update()
+    bool hasProgress = false;
+    bool isDone = false;
+    uint64_t resultGeneration = 0;
+    BitSet rowMatches;
+    std::vector<size_t> bestRows;
+    BitSet recordMatches;
+    std::vector<FuzzyMatch> bestRecords;
+
+    ~Worker();
+
+    void run();
+    void scan(const Names& scanNames, const std::vector<size_t>& scanRows, const std::string& scanQuery, const BitSet* scanCandidates, bool scanIsRefining,
+              uint64_t scanGeneration);
+};
+
+// background scans share one pool, a scan only has it to itself while the user types
+inline static WorkStealingPool& SharedMatchPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+// Sets the bits of the records in [begin, end) whose name matches `pattern` and ranks them into `out_Best`. With
+// `candidates` only the records set in it are looked at and those that don't match anymore are unset,
+// `out_Matches` starts out as a copy of them
+inline static void MatchRecords(const std::vector<char>& arena, const std::vector<uint32_t>& offsets, const FuzzyPattern& pattern, size_t begin, size_t end,
+                                const BitSet* candidates, WorkStealingPool* pool, TopMatches& out_Best, BitSet& out_Matches) {
+    const std::string_view arenaView(arena.data(), arena.size());
+    if(pool != nullptr) {
+        FuzzyMatchNames(*pool, arenaView, offsets, begin, end, pattern, candidates, out_Best, &out_Matches);
+    } else {
+        FuzzyMatchNames(arenaView, offsets, begin, end, pattern, candidates, out_Best, &out_Matches);
+    }
+}
+
+// the records of `records` that aren't flagged REMOVED, empty if none are
+inline static void LiveRecords(const FileSystem::SOARecord& records, BitSet& out_Live) {
+    out_Live.reset(0);
+    if(records.numRemoved == 0) return;
+
+    const size_t numRecords = records.nameOffsets.size();
+    out_Live.reset(numRecords);
+    for(size_t record = 0; record < numRecords; record++) {
+        if(!(records.attributes[record] & FileSystem::FileAttributes::REMOVED)) out_Live.set(record);
+    }
+}
+
+// row `i` matches if record `indexes[i]` does, built a word at a time
+inline static void MapToRows(const BitSet& recordMatches, const std::vector<size_t>& indexes, BitSet& out_Rows) {
+    out_Rows.reset(indexes.size());
+    std::vector<uint64_t>& words = out_Rows.words();
+
+    for(size_t wordIdx = 0; wordIdx < words.size(); wordIdx++) {
+        const size_t first = wordIdx * 64;
+        const size_t last = std::min(first + 64, indexes.size());
+
+        uint64_t word = 0;
+        for(size_t row = first; row < last; row++) {
+            word |= static_cast<uint64_t>(recordMatches.test(indexes[row])) << (row - first);
+        }
+        words[wordIdx] = word;
+    }
+}
+
+// the rows of the best records, best first. One pass over the rows, the records are looked up by a bit first.
+// Records without a row are left out
+inline static void MapBestToRows(const std::vector<FuzzyMatch>& bestRecords, const std::vector<size_t>& indexes, std::vector<size_t>& out_Rows) {
+    out_Rows.assign(bestRecords.size(), BitSet::NPOS);
+    if(bestRecords.empty()) return;
+
+    size_t numRecords = 0;
+    std::unordered_map<size_t, size_t> rankOf;
+    for(size_t rank = 0; rank < bestRecords.size(); rank++) {
+        rankOf[bestRecords[rank].index] = rank;
+        numRecords = std::max(numRecords, static_cast<size_t>(bestRecords[rank].index) + 1);
+    }
+    BitSet isBest;
+    isBest.reset(numRecords);
+    for(const FuzzyMatch& match : bestRecords) {
+        isBest.set(match.index);
+    }
+
+    for(size_t row = 0; row < indexes.size(); row++) {
+        if(isBest.test(indexes[row])) {
+            out_Rows[rankOf[indexes[row]]] = row;
+        }
+    }
+    out_Rows.erase(std::remove(out_Rows.begin(), out_Rows.end(), BitSet::NPOS), out_Rows.end());
+}
+
+NameFilter::Worker::~Worker() {
+    {
+        std::scoped_lock<std::mutex> lock(mutex);
+        alive = false;
+        generation++;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void NameFilter::Worker::run() {
+    while(true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !alive || scanRequested; });
+
+        if(!alive) break;
+
+        scanRequested = false;
+        const std::shared_ptr<const Names> scanNames = std::move(names);
+        const std::shared_ptr<const std::vector<size_t>> scanRows = std::move(rows);
+        const std::string scanQuery = query;
+        BitSet scanCandidates;
+        std::swap(scanCandidates, candidates);
+        const bool scanIsRefining = isRefining;
+        const uint64_t scanGeneration = generation;
+        lock.unlock();
+
+        // a full scan still skips the removed records
+        const BitSet* candidatesToScan = scanIsRefining ? &scanCandidates : (scanNames->live.size() > 0 ? &scanNames->live : nullptr);
+        scan(*scanNames, *scanRows, scanQuery, candidatesToScan, scanIsRefining, scanGeneration);
+    }
+}
+
+void NameFilter::Worker::scan(const Names& scanNames, const std::vector<size_t>& scanRows, const std::string& scanQuery, const BitSet* scanCandidates, bool scanIsRefining,
+                              uint64_t scanGeneration) {
+    const size_t numRecords = scanNames.offsets.size();
+    const size_t chunkSize = std::max(MIN_SCAN_CHUNK_SIZE, (numRecords + MAX_SCAN_CHUNKS - 1) / MAX_SCAN_CHUNKS);
+
+    BitSet matches;
+    if(scanCandidates != nullptr) {
+        matches = *scanCandidates;
+    } else {
+        matches.reset(numRecords);
+    }
+
+    const FuzzyPattern pattern(scanQuery);
+    TopMatches best(MAX_BEST_MATCHES);
+
+    size_t begin = 0;
+    do {
+        if(scanGeneration != generation.load()) return;
+
+        const size_t end = std::min(begin + chunkSize, numRecords);
+        MatchRecords(scanNames.arena, scanNames.offsets, pattern, begin, end, scanCandidates, &SharedMatchPool(), best, matches);
+
+        // records past `end` are still unset in a full scan and still the candidates in a refinement, either way the
+        // rows show the matches known so far. A full scan of only the live records has them set, they're cut off
+        const BitSet* matchesSoFar = &matches;
+        BitSet scannedMatches;
+        if(!scanIsRefining && scanCandidates != nullptr && end < numRecords) {
+            scannedMatches = matches;
+            std::vector<uint64_t>& words = scannedMatches.words();
+            words[end / 64] &= (uint64_t(1) << (end % 64)) - 1;
+            std::fill(words.begin() + end / 64 + 1, words.end(), 0);
+            matchesSoFar = &scannedMatches;
+        }
+        BitSet rowMatchesSoFar;
+        MapToRows(*matchesSoFar, scanRows, rowMatchesSoFar);
+        std::vector<FuzzyMatch> bestSoFar;
+        best.sorted(bestSoFar);
+        std::vector<size_t> bestRowsSoFar;
+        MapBestToRows(bestSoFar, scanRows, bestRowsSoFar);
+
+        std::scoped_lock<std::mutex> lock(mutex);
+        if(scanGeneration != generation) return;
+
+        std::swap(rowMatches, rowMatchesSoFar);
+        std::swap(bestRows, bestRowsSoFar);
+        hasProgress = true;
+        resultGeneration = scanGeneration;
+        isDone = end == numRecords;
+        if(isDone) {
+            std::swap(recordMatches, matches);
+            std::swap(bestRecords, bestSoFar);
+        }
+
+        begin = end;
+    } while(begin < numRecords);
+}
+
+NameFilter::NameFilter()
+    : mWorker(std::make_unique<Worker>()) {
+    mWorker->thread = std::thread(&Worker::run, mWorker.get());
+}
+
+NameFilter::~NameFilter() = default;
+
+NameFilter::NameFilter(NameFilter&&) = default;
+NameFilter& NameFilter::operator=(NameFilter&&) = default;
+
+void NameFilter::setBackgroundThreshold(size_t numRecords) {
+    mBackgroundThreshold = numRecords;
+}
+
+void NameFilter::setQuery(std::string_view query, const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion) {
+    if(query.empty()) {
+        clear();
+        return;
+    }
+
+    // every name matching the new query matches the old one, only the old matches can still match. That takes all
+    // of them though, a scan still in flight doesn't know them yet
+    const bool canRefine = !mQuery.empty() && !mIsScanning && listingVersion == mListingVersion && IsFuzzyRefinement(mQuery, query);
+
+    mQuery = query;
+    startScan(records, listingVersion, orderVersion, canRefine);
+}
+
+void NameFilter::clear() {
+    mQuery.clear();
+    mRecordMatches.reset(0);
+    mRowMatches.reset(0);
+    mBestRecords.clear();
+    mBestRows.clear();
+    mIsScanning = false;
+
+    // drops a scan in flight
+    mWorker->generation++;
+}
+
+bool NameFilter::update(const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion) {
+    if(!isActive()) return false;
+
+    // the names changed or records moved around, matches by record mean nothing anymore
+    if(listingVersion != mListingVersion) {
+        startScan(records, listingVersion, orderVersion, false);
+        return true;
+    }
+
+    if(orderVersion != mOrderVersion) {
+        // the scan in flight maps onto the old rows
+        if(mIsScanning) {
+            startScan(records, listingVersion, orderVersion, false);
+        } else {
+            MapToRows(mRecordMatches, records.indexes, mRowMatches);
+            MapBestToRows(mBestRecords, records.indexes, mBestRows);
+            mOrderVersion = orderVersion;
+        }
+        return true;
+    }
+
+    if(!mIsScanning) return false;
+
+    Worker& worker = *mWorker;
+    std::scoped_lock<std::mutex> lock(worker.mutex);
+    if(!worker.hasProgress || worker.resultGeneration != worker.generation) return false;
+
+    std::swap(mRowMatches, worker.rowMatches);
+    std::swap(mBestRows, worker.bestRows);
+    if(worker.isDone) {
+        std::swap(mRecordMatches, worker.recordMatches);
+        std::swap(mBestRecords, worker.bestRecords);
+        mIsScanning = false;
+    }
+    worker.hasProgress = false;
+
+    return true;
+}
+
+void NameFilter::startScan(const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion, bool refine) {
+    mListingVersion = listingVersion;
+    mOrderVersion = orderVersion;
+
+    const size_t numRecords = records.nameOffsets.size();
+
+    // small listings are done before the frame goes on, nothing to hand over
+    if(numRecords < mBackgroundThreshold) {
+        mWorker->generation++;
+
+        BitSet matches;
+        if(refine) {
+            matches = mRecordMatches;
+        } else {
+            matches.reset(numRecords);
+        }
+
+        // removed records keep their slot but have no row, a full scan doesn't look at them
+        BitSet live;
+        if(!refine) {
+            LiveRecords(records, live);
+            if(live.size() > 0) matches = live;
+        }
+        const BitSet* candidates = refine ? &mRecordMatches : (live.size() > 0 ? &live : nullptr);
+
+        TopMatches best(MAX_BEST_MATCHES);
+        MatchRecords(records.nameArena, records.nameOffsets, FuzzyPattern(mQuery), 0, numRecords, candidates, nullptr, best, matches);
+
+        std::swap(mRecordMatches, matches);
+        MapToRows(mRecordMatches, records.indexes, mRowMatches);
+        best.sorted(mBestRecords);
+        MapBestToRows(mBestRecords, records.indexes, mBestRows);
+        mIsScanning = false;
+        return;
+    }
+
+    if(mNames == nullptr || mNamesVersion != listingVersion) {
+        auto names = std::make_shared<Names>();
+        names->arena = records.nameArena;
+        names->offsets = records.nameOffsets;
+        LiveRecords(records, names->live);
+        mNames = std::move(names);
+        mNamesVersion = listingVersion;
+    }
+
+    if(mRows == nullptr || mRowsListingVersion != listingVersion || mRowsOrderVersion != orderVersion) {
+        mRows = std::make_shared<const std::vector<size_t>>(records.indexes);
+        mRowsListingVersion = listingVersion;
+        mRowsOrderVersion = orderVersion;
+    }
+
+    {
+        std::scoped_lock<std::mutex> lock(mWorker->mutex);
+        mWorker->names = mNames;
+        mWorker->rows = mRows;
+        mWorker->query = mQuery;
+        mWorker->isRefining = refine;
+        if(refine) {
+            mWorker->candidates = mRecordMatches;
+        }
+        mWorker->scanRequested = true;
+        mWorker->hasProgress = false;
+        mWorker->generation++;
+    }
+    mWorker->wake.notify_one();
+
+    // a full scan shows matches as they're found, a refinement keeps the previous ones up until it gets to them
+    if(!refine) {
+        mRowMatches.reset(records.size());
+        mBestRows.clear();
+    }
+    mIsScanning = true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BitSet.h"
+#include "FuzzyMatch.h"
+
+namespace FileSystem {
+    struct SOARecord;
+}
+
+// Finds the rows of a listing whose name fuzzy matches a query (see FuzzyPattern), for BrowserWidget's highlight
+// search. Matches are kept per record so a re-sort only has to map them onto the new rows, and per row as a BitSet
+// the table reads from. The best scoring MAX_BEST_MATCHES of them are ranked for N / Shift+N to step through first,
+// past those they go through every match by row with nextMatch() / previousMatch().
+// A query that only adds characters to the previous one looks at the previous matches again and nothing else.
+// Listings of at least backgroundThreshold records are scanned on a worker thread spread over a pool, update()
+// picks the matches up chunk by chunk so the first ones show while the rest of the listing is still being looked at
+class NameFilter {
+public:
+    static constexpr size_t DEFAULT_BACKGROUND_THRESHOLD = 50000;
+    static constexpr size_t MAX_BEST_MATCHES = 256;
+
+    NameFilter();
+    ~NameFilter();
+
+    NameFilter(NameFilter&&);
+    NameFilter& operator=(NameFilter&&);
+
+    void setBackgroundThreshold(size_t numRecords);
+
+    // starts matching `query` against the names of `records`. The versions tell whether the records are still
+    // the ones the last query ran on (see DirectoryWatcher::listingVersion)
+    void setQuery(std::string_view query, const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion);
+    void clear();
+
+    // picks up what the worker found since the last call and follows the listing: a new listing is scanned again,
+    // a new order of the same one only moves the matches. Call once a frame before reading any matches, returns
+    // true if they changed
+    bool update(const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion);
+
+    inline bool isActive() const { return !mQuery.empty(); }
+    // true while rows past what was scanned so far may still turn out to match
+    inline bool isScanning() const { return mIsScanning; }
+    inline const std::string& query() const { return mQuery; }
+
+    inline bool isMatch(size_t row) const { return mRowMatches.test(row); }
+    inline size_t numMatches() const { return mRowMatches.count(); }
+    // first matching row at or after / at or before `row`, BitSet::NPOS if there is none
+    inline size_t nextMatch(size_t row) const { return mRowMatches.findNext(row); }
+    inline size_t previousMatch(size_t row) const { return mRowMatches.findPrevious(row); }
+
+    // the best matches found so far, best first
+    inline size_t numBestMatches() const { return mBestRows.size(); }
+    inline size_t bestMatch(size_t rank) const { return mBestRows[rank]; }
+
+private:
+    struct Worker;
+    struct Names;
+
+    void startScan(const FileSystem::SOARecord& records, uint64_t listingVersion, uint64_t orderVersion, bool refine);
+
+    std::unique_ptr<Worker> mWorker;
+
+    std::string mQuery;
+    BitSet mRecordMatches;
+    BitSet mRowMatches;
+    std::vector<FuzzyMatch> mBestRecords;
+    std::vector<size_t> mBestRows;
+    bool mIsScanning = false;
+    // versions of the listing the matches belong to
+    uint64_t mListingVersion = 0;
+    uint64_t mOrderVersion = 0;
+
+    // what the worker scans, copied from the listing once per version and shared with the scans that use them
+    std::shared_ptr<const Names> mNames;
+    uint64_t mNamesVersion = 0;
+    std::shared_ptr<const std::vector<size_t>> mRows;
+    uint64_t mRowsListingVersion = 0;
+    uint64_t mRowsOrderVersion = 0;
+
+    size_t mBackgroundThreshold = DEFAULT_BACKGROUND_THRESHOLD;
+};
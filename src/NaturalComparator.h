@@ -1,72 +1,333 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
 
-inline static int GetChunk(const std::string str, int start) {
-    if(start >= str.size()) return 1;
-    char startChar = str[start];
-    int length = 1;
+#include "UnicodeCaseFolding.h"
 
-    if(Util::isDigit(startChar)) {
-        // move until next char or end
-        while(start++ < str.size()) {
-            if(!Util::isDigit(str[start])) {
-                break;
-            }
-            length++;
-        }
-    } else {
-        // move until next digit or end
-        while(start++ < str.size()) {
-            if(Util::isDigit(str[start])) {
-                break;
-            }
-            length++;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define NATURAL_COMPARATOR_SSE2
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+// How text is compared apart from digit runs. Folding only affects the order, names that differ just in case
+// compare equal and keep the order they had
+enum class CaseFolding {
+    None,
+    // A-Z only, the rest of the name is compared byte by byte
+    Ascii,
+    // simple case folding of every code point, names that aren't valid UTF-8 have their stray bytes compared as they are
+    Unicode,
+};
+
+inline static bool IsAsciiDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// length of the common prefix of two buffers of at least `length` bytes, 16 bytes per step where SSE2 is around
+inline static size_t EqualPrefixLength(const char* lhs, const char* rhs, size_t length) {
+    size_t pos = 0;
+
+#ifdef NATURAL_COMPARATOR_SSE2
+    for(; pos + 16 <= length; pos += 16) {
+        const __m128i lhsBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + pos));
+        const __m128i rhsBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + pos));
+        const unsigned int differences = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(lhsBytes, rhsBytes))) & 0xFFFF;
+        if(differences != 0) {
+    #ifdef _MSC_VER
+            unsigned long firstDifference;
+            _BitScanForward(&firstDifference, differences);
+            return pos + firstDifference;
+    #else
+            return pos + __builtin_ctz(differences);
+    #endif
         }
     }
+#endif
 
-    return length;
+    while(pos < length && lhs[pos] == rhs[pos]) {
+        pos++;
+    }
+    return pos;
 }
 
-inline static bool NaturalComparator(const std::string& lhs, const std::string& rhs) {
-    if (lhs.empty())
-        return false;
-    if (rhs.empty())
-        return true;
+// decodes the code point at `str`, returns the number of bytes it takes or 0 if it's not valid UTF-8
+inline static size_t DecodeUtf8(const char* str, size_t length, uint32_t& out_CodePoint) {
+    const uint8_t lead = static_cast<uint8_t>(str[0]);
+    auto xContinuation = [&](size_t i) { return i < length && (static_cast<uint8_t>(str[i]) & 0xC0) == 0x80; };
 
-    int thisPos = 0;
-    int thatPos = 0;
+    if(lead < 0x80) {
+        out_CodePoint = lead;
+        return 1;
+    }
+    if(lead >= 0xC2 && lead <= 0xDF && xContinuation(1)) {
+        out_CodePoint = ((lead & 0x1F) << 6) | (str[1] & 0x3F);
+        return 2;
+    }
+    if(lead >= 0xE0 && lead <= 0xEF && xContinuation(1) && xContinuation(2)) {
+        out_CodePoint = ((lead & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+        // overlong forms and surrogates
+        if(out_CodePoint < 0x800 || (out_CodePoint >= 0xD800 && out_CodePoint <= 0xDFFF)) return 0;
+        return 3;
+    }
+    if(lead >= 0xF0 && lead <= 0xF4 && xContinuation(1) && xContinuation(2) && xContinuation(3)) {
+        out_CodePoint = ((lead & 0x07) << 18) | ((str[1] & 0x3F) << 12) | ((str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+        if(out_CodePoint < 0x10000 || out_CodePoint > 0x10FFFF) return 0;
+        return 4;
+    }
+    return 0;
+}
 
-    while(thisPos < lhs.size() && thatPos < rhs.size()) {
-        int thisChunkSize = GetChunk(lhs, thisPos);
-        int thatChunkSize = GetChunk(rhs, thatPos);
+inline static size_t EncodeUtf8(uint32_t codePoint, char* out) {
+    if(codePoint < 0x80) {
+        out[0] = static_cast<char>(codePoint);
+        return 1;
+    }
+    if(codePoint < 0x800) {
+        out[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+        out[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if(codePoint < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+        out[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+    out[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 4;
+}
 
-        if (Util::isDigit(lhs[thisPos]) && !Util::isDigit(rhs[thatPos])) {
-            return false;
+// Folds the character at `pos` of `str` into `out` (up to 4 bytes). Returns the bytes consumed, `out_Length` the
+// bytes written. Folded text is compared and stored as UTF-8 so byte order stays code point order
+inline static size_t FoldNext(std::string_view str, size_t pos, CaseFolding folding, char* out, size_t& out_Length) {
+    const char c = str[pos];
+
+    if(folding != CaseFolding::Unicode || static_cast<uint8_t>(c) < 0x80) {
+        out[0] = folding != CaseFolding::None && c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+        out_Length = 1;
+        return 1;
+    }
+
+    uint32_t codePoint;
+    const size_t numBytes = DecodeUtf8(str.data() + pos, str.size() - pos, codePoint);
+    if(numBytes == 0) {
+        out[0] = c;
+        out_Length = 1;
+        return 1;
+    }
+
+    out_Length = EncodeUtf8(FoldCodePoint(codePoint), out);
+    return numBytes;
+}
+
+// length of the text run starting at `pos`, up to the next digit or the end
+inline static size_t TextRunEnd(std::string_view str, size_t pos) {
+    while(pos < str.size() && !IsAsciiDigit(str[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+// Compares the text runs starting at `lhsPos` and `rhsPos` and moves both past them. A run that ends first sorts first
+inline static int CompareTextRuns(std::string_view lhs, size_t& lhsPos, std::string_view rhs, size_t& rhsPos, CaseFolding folding) {
+    const size_t lhsEnd = TextRunEnd(lhs, lhsPos);
+    const size_t rhsEnd = TextRunEnd(rhs, rhsPos);
+
+    if(folding == CaseFolding::None) {
+        const size_t lhsLength = lhsEnd - lhsPos;
+        const size_t rhsLength = rhsEnd - rhsPos;
+        const int order = memcmp(lhs.data() + lhsPos, rhs.data() + rhsPos, lhsLength < rhsLength ? lhsLength : rhsLength);
+        lhsPos = lhsEnd;
+        rhsPos = rhsEnd;
+        if(order != 0) return order;
+        return lhsLength == rhsLength ? 0 : (lhsLength < rhsLength ? -1 : 1);
+    }
+
+    char lhsFolded[4];
+    char rhsFolded[4];
+    size_t lhsFoldedLength = 0, lhsFoldedPos = 0;
+    size_t rhsFoldedLength = 0, rhsFoldedPos = 0;
+
+    while(true) {
+        if(lhsFoldedPos == lhsFoldedLength && lhsPos < lhsEnd) {
+            lhsPos += FoldNext(lhs, lhsPos, folding, lhsFolded, lhsFoldedLength);
+            lhsFoldedPos = 0;
         }
-        if (!Util::isDigit(lhs[thisPos]) && Util::isDigit(rhs[thatPos])) {
-            return true;
+        if(rhsFoldedPos == rhsFoldedLength && rhsPos < rhsEnd) {
+            rhsPos += FoldNext(rhs, rhsPos, folding, rhsFolded, rhsFoldedLength);
+            rhsFoldedPos = 0;
         }
 
-        if(Util::isDigit(lhs[thisPos]) && Util::isDigit(rhs[thatPos])) {
-            if(thisChunkSize == thatChunkSize) {
-                for(int i = 0; i < thisChunkSize; i++) {
-                    int res = lhs[thisPos + i] - rhs[thatPos + i];
-                    if(res != 0) return res > 0;
-                }
+        const bool lhsDone = lhsFoldedPos == lhsFoldedLength;
+        const bool rhsDone = rhsFoldedPos == rhsFoldedLength;
+        if(lhsDone || rhsDone) return lhsDone == rhsDone ? 0 : (lhsDone ? -1 : 1);
+
+        const uint8_t lhsByte = static_cast<uint8_t>(lhsFolded[lhsFoldedPos++]);
+        const uint8_t rhsByte = static_cast<uint8_t>(rhsFolded[rhsFoldedPos++]);
+        if(lhsByte != rhsByte) {
+            lhsPos = lhsEnd;
+            rhsPos = rhsEnd;
+            return lhsByte < rhsByte ? -1 : 1;
+        }
+    }
+}
+
+// Natural order, <0, 0 or >0 like strcmp, without allocating. Names are split into digit runs and text runs:
+// - digit runs compare by value however long they are ("file2" < "file10"), and come before text at the same place
+// - text runs compare byte by byte after `folding`, a run that ends first sorts first
+// - a name sorts before any longer name it is the start of
+// Runs equal in value only differ in leading zeros, those decide last and fewer zeros go first ("1" < "01" < "001")
+inline static int NaturalCompare(std::string_view lhs, std::string_view rhs, CaseFolding folding = CaseFolding::None) {
+    // skip whatever both start with, then back up to where the run that differs starts: digit runs have to be seen
+    // whole and folding must not start in the middle of a UTF-8 sequence
+    size_t pos = EqualPrefixLength(lhs.data(), rhs.data(), lhs.size() < rhs.size() ? lhs.size() : rhs.size());
+    while(pos > 0 && (IsAsciiDigit(lhs[pos - 1]) || (folding == CaseFolding::Unicode && static_cast<uint8_t>(lhs[pos - 1]) >= 0x80))) {
+        pos--;
+    }
+
+    size_t lhsPos = pos;
+    size_t rhsPos = pos;
+    // leading zeros of the first runs that differ only in them
+    int zerosOrder = 0;
+
+    while(true) {
+        const bool lhsDone = lhsPos >= lhs.size();
+        const bool rhsDone = rhsPos >= rhs.size();
+        if(lhsDone || rhsDone) {
+            if(lhsDone && rhsDone) return zerosOrder;
+            return lhsDone ? -1 : 1;
+        }
+
+        const bool lhsIsDigit = IsAsciiDigit(lhs[lhsPos]);
+        const bool rhsIsDigit = IsAsciiDigit(rhs[rhsPos]);
+        if(lhsIsDigit != rhsIsDigit) return lhsIsDigit ? -1 : 1;
+
+        if(!lhsIsDigit) {
+            const int order = CompareTextRuns(lhs, lhsPos, rhs, rhsPos, folding);
+            if(order != 0) return order;
+            continue;
+        }
+
+        const size_t lhsStart = lhsPos;
+        const size_t rhsStart = rhsPos;
+        while(lhsPos < lhs.size() && lhs[lhsPos] == '0') lhsPos++;
+        while(rhsPos < rhs.size() && rhs[rhsPos] == '0') rhsPos++;
+        const size_t lhsZeros = lhsPos - lhsStart;
+        const size_t rhsZeros = rhsPos - rhsStart;
+
+        const size_t lhsDigitsStart = lhsPos;
+        const size_t rhsDigitsStart = rhsPos;
+        while(lhsPos < lhs.size() && IsAsciiDigit(lhs[lhsPos])) lhsPos++;
+        while(rhsPos < rhs.size() && IsAsciiDigit(rhs[rhsPos])) rhsPos++;
+        const size_t lhsDigits = lhsPos - lhsDigitsStart;
+        const size_t rhsDigits = rhsPos - rhsDigitsStart;
+
+        // without leading zeros the longer number is the bigger one, equally long ones compare digit by digit
+        if(lhsDigits != rhsDigits) return lhsDigits < rhsDigits ? -1 : 1;
+        const int order = memcmp(lhs.data() + lhsDigitsStart, rhs.data() + rhsDigitsStart, lhsDigits);
+        if(order != 0) return order;
+
+        if(zerosOrder == 0 && lhsZeros != rhsZeros) {
+            zerosOrder = lhsZeros < rhsZeros ? -1 : 1;
+        }
+    }
+}
+
+// true if `lhs` sorts after `rhs`
+inline static bool NaturalComparator(std::string_view lhs, std::string_view rhs, CaseFolding folding = CaseFolding::None) {
+    return NaturalCompare(lhs, rhs, folding) > 0;
+}
+
+// Sort key tags, see AppendNaturalSortKey
+static constexpr char NATURAL_KEY_END   = 0x00;
+static constexpr char NATURAL_KEY_DIGIT = 0x01;
+static constexpr char NATURAL_KEY_TEXT  = 0x02;
+
+// digit run lengths and zero counts below this take two bytes, longer ones are escaped with it and take four more
+static constexpr size_t NATURAL_KEY_SHORT_LENGTH = 0xFFFF;
+
+// big endian so longer runs compare greater, and escaped lengths sort after every short one
+inline static char* AppendNaturalKeyLength(char* key, size_t length) {
+    const size_t shortLength = length < NATURAL_KEY_SHORT_LENGTH ? length : NATURAL_KEY_SHORT_LENGTH;
+    *key++ = static_cast<char>((shortLength >> 8) & 0xFF);
+    *key++ = static_cast<char>(shortLength & 0xFF);
+
+    if(shortLength == NATURAL_KEY_SHORT_LENGTH) {
+        for(int shift = 24; shift >= 0; shift -= 8) {
+            *key++ = static_cast<char>((length >> shift) & 0xFF);
+        }
+    }
+    return key;
+}
+
+// Appends a byte string whose plain (unsigned, memcmp) order is the order NaturalCompare sorts in with the same
+// `folding`. Every run starts with a tag so numbers come before text; digit runs drop their leading zeros and are
+// prefixed with their length so longer numbers sort after shorter ones, text runs are folded and end with a NUL so a
+// shorter run sorts first. After the end tag come the leading zero counts of every digit run, they only matter
+// when all else is equal. No key is a prefix of another, which means flipping every byte gives exactly the reverse order
+inline static void AppendNaturalSortKey(std::string_view name, std::vector<char>& out, CaseFolding folding = CaseFolding::None) {
+    // worst case is alternating one character runs, a digit takes 3 bytes plus 2 for its zero count and a text
+    // character 2 plus up to a byte more if folding makes it longer. Runs longer than 0xFFFF are at most one per
+    // 0xFFFF bytes, the 8 more bytes they take fit easily
+    const size_t start = out.size();
+    out.resize(start + name.size() * 5 + 16);
+    char* key = out.data() + start;
+
+    size_t pos = 0;
+    size_t numDigitRuns = 0;
+    while(pos < name.size()) {
+        if(IsAsciiDigit(name[pos])) {
+            while(pos < name.size() && name[pos] == '0') pos++;
+            const size_t digitsStart = pos;
+            while(pos < name.size() && IsAsciiDigit(name[pos])) pos++;
+
+            *key++ = NATURAL_KEY_DIGIT;
+            key = AppendNaturalKeyLength(key, pos - digitsStart);
+            memcpy(key, name.data() + digitsStart, pos - digitsStart);
+            key += pos - digitsStart;
+            numDigitRuns++;
+        } else {
+            const size_t end = TextRunEnd(name, pos);
+
+            *key++ = NATURAL_KEY_TEXT;
+            if(folding == CaseFolding::None) {
+                memcpy(key, name.data() + pos, end - pos);
+                key += end - pos;
+                pos = end;
             } else {
-                return thisChunkSize > thatChunkSize;
+                while(pos < end) {
+                    size_t foldedLength;
+                    pos += FoldNext(name, pos, folding, key, foldedLength);
+                    key += foldedLength;
+                }
             }
-        } else {
-            int res = lhs.compare(thisPos, thisChunkSize, rhs, thatPos, thatChunkSize);
-            if(res != 0) return res > 0;
+            *key++ = '\0';
         }
+    }
 
-        if (thatChunkSize == 0) return false;
-        if (thisChunkSize == 0) return true;
+    *key++ = NATURAL_KEY_END;
 
-        thisPos += thisChunkSize;
-        thatPos += thatChunkSize;
+    // second pass over the digit runs for their zeros, most names have none or one
+    for(pos = 0; numDigitRuns > 0 && pos < name.size();) {
+        if(!IsAsciiDigit(name[pos])) {
+            pos++;
+            continue;
+        }
+
+        const size_t runStart = pos;
+        while(pos < name.size() && name[pos] == '0') pos++;
+        key = AppendNaturalKeyLength(key, pos - runStart);
+        while(pos < name.size() && IsAsciiDigit(name[pos])) pos++;
     }
 
-    return lhs.size() > rhs.size();
-};
+    out.resize(key - out.data());
+}
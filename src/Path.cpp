@@ -58,7 +58,8 @@ void Path::parse() {
         if(mText[i] == '/') mText[i] = SEPARATOR;
     }
 
-    if(mText[mText.size() - 1] == SEPARATOR) mText.pop_back();
+    // keep a lone POSIX root "/" intact
+    if(mText.size() > 1 && mText[mText.size() - 1] == SEPARATOR) mText.pop_back();
 
     mSegments.clear();
 
@@ -68,13 +69,19 @@ void Path::parse() {
     size_t pos      = 0;
     size_t prevPos  = 0;
     while(pos <= mText.size()) {
-        if(mText[pos] == SEPARATOR || pos == mText.size()) {
+        if(pos == 0 && mText[pos] == SEPARATOR) {
+            // a leading separator is the root of a POSIX path, it becomes its own segment
+            mSegments.push_back(pathStr.substr(0, 1));
+        } else if(mText[pos] == SEPARATOR || pos == mText.size()) {
             // padding excludes SEPARATOR from the segments
             int padding = mSegments.empty() ? 0 : 1;
             size_t start = prevPos + padding;
             size_t length = pos - prevPos - padding;
             std::string_view segment(pathStr.substr(start, length));
 
+            // path is just the POSIX root
+            if(segment.empty() && pos == mText.size() && mText.size() == 1) break;
+
             assert(!segment.empty() && "Path segment is empty");
             mSegments.push_back(segment);
 
@@ -87,8 +94,8 @@ void Path::parse() {
     size_t driveRootIdx = pathStr.find(DRIVE_ROOT);
     char lastChar = pathStr.back();
 
-    // is "C:" or contains ":\\"
-    if(lastChar == ':' || driveRootIdx != std::string::npos) {
+    // is "C:" or contains ":\\" or starts at the POSIX root
+    if(lastChar == ':' || driveRootIdx != std::string::npos || pathStr.front() == '/') {
         mType = PathType::PATH_ABSOLUTE;
     } else {
         mType =PathType:: PATH_RELATIVE;
@@ -106,8 +113,9 @@ std::wstring Path::wstr() const {
 void Path::popSegment() {
     size_t idxOfLastSeparator = mText.find_last_of( SEPARATOR );
 
-    if(idxOfLastSeparator != std::string::npos) {
-        mText.erase(idxOfLastSeparator, std::string::npos);
+    if(idxOfLastSeparator != std::string::npos && mText.size() > 1) {
+        // popping back to the POSIX root keeps the root separator
+        mText.erase(idxOfLastSeparator == 0 ? 1 : idxOfLastSeparator, std::string::npos);
         parse();
     } else {
         mSegments.clear();
@@ -133,11 +141,15 @@ void Path::appendRelative(const Path& relativePath) {
     parse();
 }
 
-void Path::appendName(const std::string& name) {
+void Path::appendName(std::string_view name) {
     if(mText.empty()) {
-        mText += name + SEPARATOR;
+        mText += name;
+        mText += SEPARATOR;
+    } else if(mText.back() == SEPARATOR) {
+        mText += name;
     } else {
-        mText += SEPARATOR + name;
+        mText += SEPARATOR;
+        mText += name;
     }
     parse();
 }
@@ -161,7 +173,7 @@ void Path::toAbsolute() {
     std::string result("");
     for(auto segment : baseSegments) {
         result.append(segment);
-        result.append(std::string(1, SEPARATOR));
+        if(segment.back() != SEPARATOR) result.append(std::string(1, SEPARATOR));
     }
 
     mText = result;
@@ -219,10 +231,10 @@ std::string Path::getParentStr() {
 
     for(size_t i = 0; i < mSegments.size() - 1; i++) {
         result.append(mSegments[i]);
-        result.append(std::string(1, SEPARATOR));
+        if(mSegments[i].back() != SEPARATOR) result.append(std::string(1, SEPARATOR));
     }
 
-    result.pop_back();
+    if(result.size() > 1) result.pop_back();
 
     return result;
 }
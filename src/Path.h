@@ -1,11 +1,18 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Path 
 {
+public:
+#ifdef _WIN32
     inline static const char        SEPARATOR      = '\\';
+#else
+    inline static const char        SEPARATOR      = '/';
+#endif
+private:
     inline static const std::string CURRENT_PATH   = ".";
     inline static const std::string PARENT_PATH    = "..";
     inline static const std::string DRIVE_ROOT     = ":" + std::string(1, SEPARATOR);
@@ -28,7 +35,7 @@ public:
 
     void popSegment();
     void appendRelative(const Path&);
-    void appendName(const std::string&);
+    void appendName(std::string_view);
 
     void toAbsolute();
 
@@ -1,4 +1,9 @@
 #include "StringUtils.h"
+#include <cctype>
+#include <cstdint>
+
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
     #define WIN32_LEAN_AND_MEAN
 #endif
@@ -20,7 +25,82 @@ std::string Util::WstringToUtf8(const std::wstring& str) {
     return result;
 }
 
+#else
+
+// wchar_t holds a full code point on POSIX, so these are plain UTF-8 <-> UTF-32 conversions.
+// invalid sequences are replaced with U+FFFD
+std::wstring Util::Utf8ToWstring(const std::string& str) {
+    std::wstring result;
+    result.reserve(str.size());
+
+    size_t i = 0;
+    while(i < str.size()) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        uint32_t codePoint = 0xFFFD;
+        int length = 1;
+
+        if(c < 0x80) {
+            codePoint = c;
+        } else if((c >> 5) == 0x6) {
+            length = 2; codePoint = c & 0x1F;
+        } else if((c >> 4) == 0xE) {
+            length = 3; codePoint = c & 0x0F;
+        } else if((c >> 3) == 0x1E) {
+            length = 4; codePoint = c & 0x07;
+        }
+
+        if(length > 1) {
+            if(i + length > str.size()) {
+                codePoint = 0xFFFD;
+                length = 1;
+            } else {
+                for(int j = 1; j < length; j++) {
+                    unsigned char next = static_cast<unsigned char>(str[i + j]);
+                    if((next >> 6) != 0x2) {
+                        codePoint = 0xFFFD;
+                        length = j;
+                        break;
+                    }
+                    codePoint = (codePoint << 6) | (next & 0x3F);
+                }
+            }
+        }
+
+        result.push_back(static_cast<wchar_t>(codePoint));
+        i += length;
+    }
+
+    return result;
+}
+
+std::string Util::WstringToUtf8(const std::wstring& str) {
+    std::string result;
+    result.reserve(str.size());
+
+    for(wchar_t wc : str) {
+        uint32_t codePoint = static_cast<uint32_t>(wc);
+        if(codePoint < 0x80) {
+            result.push_back(static_cast<char>(codePoint));
+        } else if(codePoint < 0x800) {
+            result.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else if(codePoint < 0x10000) {
+            result.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        } else {
+            result.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    return result;
+}
+
+#endif
+
 bool Util::isDigit(char c) {
     return std::isdigit(static_cast<unsigned char>(c));
 }
-
@@ -0,0 +1,402 @@
+#include "SubstringSearch.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SUBSTRING_SEARCH_SSE2
+    #include <emmintrin.h>
+    // the AVX2 kernel is built for AVX2 on its own and only called when the CPU has it, the rest of the build stays
+    // at the baseline
+    #if defined(_MSC_VER) || defined(__GNUC__)
+        #define SUBSTRING_SEARCH_AVX2
+        #include <immintrin.h>
+        #ifdef _MSC_VER
+            #include <intrin.h>
+            #define SUBSTRING_SEARCH_TARGET_AVX2
+        #else
+            #define SUBSTRING_SEARCH_TARGET_AVX2 __attribute__((target("avx2")))
+        #endif
+    #endif
+#endif
+
+inline static char FoldAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+inline static bool IsAsciiLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline static int LowestSetBit32(uint32_t word) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, word);
+    return static_cast<int>(bit);
+#else
+    return __builtin_ctz(word);
+#endif
+}
+
+// One pass over the names [recordIdx, end) of an arena. Kernels find candidate positions, isMatchAt() confirms them
+// and markMatch() moves on to the next name
+struct SubstringScan {
+    const char* arena;
+    size_t arenaSize;
+    const uint32_t* offsets;
+    size_t numOffsets;
+    // folded to lower case when ignoring case
+    std::string needle;
+    bool ignoreCase;
+
+    // or'ed into a text byte before it's compared with the first / last byte of the needle, 0x20 for letters when
+    // ignoring case. Only 'A' and 'a' turn into 'a' that way, the filter lets nothing through that doesn't match
+    char firstCaseBit;
+    char lastCaseBit;
+
+    size_t recordIdx;
+    size_t end;
+    // candidates have to end before it, where the name after `end` starts
+    size_t limit;
+    BitSet* matches;
+    bool found = false;
+    // where the first match starts
+    size_t firstMatch = SIZE_MAX;
+
+    inline size_t nameStart(size_t idx) const {
+        return idx < numOffsets ? offsets[idx] : arenaSize;
+    }
+
+    inline bool isCandidate(size_t pos) const {
+        return static_cast<char>(arena[pos] | firstCaseBit) == needle.front() && static_cast<char>(arena[pos + needle.size() - 1] | lastCaseBit) == needle.back();
+    }
+
+    // the bytes between the first and the last one, the kernels already compared those
+    inline bool isMatchAt(size_t pos) const {
+        if(needle.size() <= 2) return true;
+
+        if(!ignoreCase) {
+            return memcmp(arena + pos + 1, needle.data() + 1, needle.size() - 2) == 0;
+        }
+        for(size_t i = 1; i + 1 < needle.size(); i++) {
+            if(FoldAscii(arena[pos + i]) != needle[i]) return false;
+        }
+        return true;
+    }
+
+    // marks the name the match at `pos` is in, returns where the next one starts
+    inline size_t markMatch(size_t pos) {
+        while(recordIdx + 1 < end && offsets[recordIdx + 1] <= pos) {
+            recordIdx++;
+        }
+        if(matches != nullptr) {
+            matches->set(recordIdx);
+        }
+        if(!found) firstMatch = pos;
+        found = true;
+
+        recordIdx++;
+        return recordIdx < end ? offsets[recordIdx] : limit;
+    }
+};
+
+static void ScanScalar(SubstringScan& scan, size_t pos) {
+    while(pos + scan.needle.size() <= scan.limit) {
+        if(scan.isCandidate(pos) && scan.isMatchAt(pos)) {
+            pos = scan.markMatch(pos);
+        } else {
+            pos++;
+        }
+    }
+}
+
+#ifdef SUBSTRING_SEARCH_SSE2
+static void ScanSse2(SubstringScan& scan, size_t pos) {
+    const size_t lastOffset = scan.needle.size() - 1;
+    const __m128i first = _mm_set1_epi8(scan.needle.front());
+    const __m128i last = _mm_set1_epi8(scan.needle.back());
+    const __m128i firstCaseBit = _mm_set1_epi8(scan.firstCaseBit);
+    const __m128i lastCaseBit = _mm_set1_epi8(scan.lastCaseBit);
+
+    // loads stay inside the arena, candidates inside the names scanned
+    while(pos + lastOffset + 16 <= scan.arenaSize && pos + lastOffset < scan.limit) {
+        const __m128i firstBytes = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(scan.arena + pos)), firstCaseBit);
+        const __m128i lastBytes = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(scan.arena + pos + lastOffset)), lastCaseBit);
+        uint32_t candidates = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firstBytes, first), _mm_cmpeq_epi8(lastBytes, last))));
+
+        size_t next = pos + 16;
+        while(candidates != 0) {
+            const size_t candidate = pos + LowestSetBit32(candidates);
+            if(candidate + lastOffset >= scan.limit) return;
+
+            if(scan.isMatchAt(candidate)) {
+                next = scan.markMatch(candidate);
+                break;
+            }
+            candidates &= candidates - 1;
+        }
+        pos = next;
+    }
+
+    ScanScalar(scan, pos);
+}
+#endif
+
+#ifdef SUBSTRING_SEARCH_AVX2
+SUBSTRING_SEARCH_TARGET_AVX2 static void ScanAvx2(SubstringScan& scan, size_t pos) {
+    const size_t lastOffset = scan.needle.size() - 1;
+    const __m256i first = _mm256_set1_epi8(scan.needle.front());
+    const __m256i last = _mm256_set1_epi8(scan.needle.back());
+    const __m256i firstCaseBit = _mm256_set1_epi8(scan.firstCaseBit);
+    const __m256i lastCaseBit = _mm256_set1_epi8(scan.lastCaseBit);
+
+    while(pos + lastOffset + 32 <= scan.arenaSize && pos + lastOffset < scan.limit) {
+        const __m256i firstBytes = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(scan.arena + pos)), firstCaseBit);
+        const __m256i lastBytes = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(scan.arena + pos + lastOffset)), lastCaseBit);
+        uint32_t candidates = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(firstBytes, first), _mm256_cmpeq_epi8(lastBytes, last))));
+
+        size_t next = pos + 32;
+        while(candidates != 0) {
+            const size_t candidate = pos + LowestSetBit32(candidates);
+            if(candidate + lastOffset >= scan.limit) return;
+
+            if(scan.isMatchAt(candidate)) {
+                next = scan.markMatch(candidate);
+                break;
+            }
+            candidates &= candidates - 1;
+        }
+        pos = next;
+    }
+
+    // what's left is less than a 32 byte step, at most one 16 byte one
+    ScanSse2(scan, pos);
+}
+#endif
+
+inline static bool CpuHasAvx2() {
+#if defined(SUBSTRING_SEARCH_AVX2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+
+    // the OS has to save the upper halves of the registers too
+    __cpuid(info, 1);
+    const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+    const bool hasAvx = (info[2] & (1 << 28)) != 0;
+    if(!hasOsxsave || !hasAvx || (_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(SUBSTRING_SEARCH_AVX2)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+SubstringKernel BestSubstringKernel() {
+    static const SubstringKernel best = []() {
+        if(CpuHasAvx2()) return SubstringKernel::Avx2;
+#ifdef SUBSTRING_SEARCH_SSE2
+        return SubstringKernel::Sse2;
+#else
+        return SubstringKernel::Scalar;
+#endif
+    }();
+    return best;
+}
+
+bool IsSubstringKernelSupported(SubstringKernel kernel) {
+    switch(kernel) {
+        case SubstringKernel::Scalar:
+            return true;
+        case SubstringKernel::Sse2:
+#ifdef SUBSTRING_SEARCH_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case SubstringKernel::Avx2:
+            return BestSubstringKernel() == SubstringKernel::Avx2;
+    }
+    return false;
+}
+
+// sets up a scan of names [begin, end) for `needle`, which isn't empty
+static void PrepareScan(SubstringScan& scan, std::string_view arena, const uint32_t* offsets, size_t numOffsets, size_t begin, size_t end,
+                        std::string_view needle, SubstringCase matchCase, BitSet* out_Matches) {
+    scan.arena = arena.data();
+    scan.arenaSize = arena.size();
+    scan.offsets = offsets;
+    scan.numOffsets = numOffsets;
+    scan.needle = needle;
+    scan.ignoreCase = matchCase == SubstringCase::AsciiInsensitive;
+    scan.firstCaseBit = 0;
+    scan.lastCaseBit = 0;
+    if(scan.ignoreCase) {
+        for(char& c : scan.needle) {
+            c = FoldAscii(c);
+        }
+        scan.firstCaseBit = IsAsciiLetter(scan.needle.front()) ? 0x20 : 0;
+        scan.lastCaseBit = IsAsciiLetter(scan.needle.back()) ? 0x20 : 0;
+    }
+    scan.recordIdx = begin;
+    scan.end = end;
+    scan.limit = scan.nameStart(end);
+    scan.matches = out_Matches;
+}
+
+static void RunScan(SubstringScan& scan, size_t pos, SubstringKernel kernel) {
+    switch(kernel) {
+#ifdef SUBSTRING_SEARCH_AVX2
+        case SubstringKernel::Avx2:
+            ScanAvx2(scan, pos);
+            break;
+#endif
+#ifdef SUBSTRING_SEARCH_SSE2
+        case SubstringKernel::Sse2:
+            ScanSse2(scan, pos);
+            break;
+#endif
+        default:
+            ScanScalar(scan, pos);
+            break;
+    }
+}
+
+// scans names [begin, end), returns whether any matched. `needle` isn't empty and has no NUL in it
+static bool Scan(std::string_view arena, const uint32_t* offsets, size_t numOffsets, size_t begin, size_t end, std::string_view needle,
+                 SubstringCase matchCase, BitSet* out_Matches, SubstringKernel kernel) {
+    SubstringScan scan;
+    PrepareScan(scan, arena, offsets, numOffsets, begin, end, needle, matchCase, out_Matches);
+    RunScan(scan, offsets[begin], kernel);
+    return scan.found;
+}
+
+void FindInNames(std::string_view arena, const uint32_t* offsets, size_t numOffsets, size_t begin, size_t end, std::string_view needle,
+                 SubstringCase matchCase, BitSet& out_Matches, SubstringKernel kernel) {
+    if(begin >= end) return;
+
+    if(needle.empty()) {
+        for(size_t recordIdx = begin; recordIdx < end; recordIdx++) {
+            out_Matches.set(recordIdx);
+        }
+        return;
+    }
+    // names end at a NUL, they can't contain one
+    if(needle.find('\0') != std::string_view::npos) return;
+
+    if(!IsSubstringKernelSupported(kernel)) {
+        kernel = SubstringKernel::Scalar;
+    }
+    Scan(arena, offsets, numOffsets, begin, end, needle, matchCase, &out_Matches, kernel);
+}
+
+void FindInNames(std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end, std::string_view needle,
+                 SubstringCase matchCase, BitSet& out_Matches, SubstringKernel kernel) {
+    FindInNames(arena, offsets.data(), offsets.size(), begin, end, needle, matchCase, out_Matches, kernel);
+}
+
+void FindInNames(std::string_view arena, const std::vector<uint32_t>& offsets, std::string_view needle, SubstringCase matchCase, BitSet& out_Matches) {
+    out_Matches.reset(offsets.size());
+    FindInNames(arena, offsets, 0, offsets.size(), needle, matchCase, out_Matches);
+}
+
+void FindInNames(const NameArena& names, std::string_view needle, SubstringCase matchCase, BitSet& out_Matches) {
+    FindInNames(std::string_view(names.arena.data(), names.arena.size()), names.offsets, needle, matchCase, out_Matches);
+}
+
+bool ContainsSubstring(std::string_view haystack, std::string_view needle, SubstringCase matchCase) {
+    if(needle.empty()) return true;
+    if(needle.size() > haystack.size()) return false;
+
+    // names are short, memchr for the first byte beats setting up a scan
+    if(matchCase == SubstringCase::Sensitive) {
+        return haystack.find(needle) != std::string_view::npos;
+    }
+
+    // the haystack as an arena of one name, the scan never reads past it
+    static const uint32_t SINGLE_NAME = 0;
+    return Scan(haystack, &SINGLE_NAME, 1, 0, 1, needle, matchCase, nullptr, BestSubstringKernel());
+}
+
+size_t FindSubstring(std::string_view text, std::string_view needle, size_t from, SubstringCase matchCase, SubstringKernel kernel) {
+    if(from > text.size() || needle.size() > text.size() - from) return std::string_view::npos;
+    if(needle.empty()) return from;
+
+    if(!IsSubstringKernelSupported(kernel)) {
+        kernel = SubstringKernel::Scalar;
+    }
+
+    // the text as one name without offsets, the scan stops at the first match it marks
+    SubstringScan scan;
+    PrepareScan(scan, text, nullptr, 0, 0, 1, needle, matchCase, nullptr);
+    RunScan(scan, from, kernel);
+    return scan.found ? scan.firstMatch : std::string_view::npos;
+}
+
+static size_t CountNewlinesScalar(const char* text, size_t size) {
+    size_t count = 0;
+    for(size_t i = 0; i < size; i++) {
+        count += text[i] == '\n';
+    }
+    return count;
+}
+
+#ifdef SUBSTRING_SEARCH_SSE2
+// every compare adds -1 to a byte counter, the counters are summed up before any of them can wrap
+static size_t CountNewlinesSse2(const char* text, size_t size) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t pos = 0;
+    while(pos + 16 <= size) {
+        __m128i counters = _mm_setzero_si128();
+        for(int block = 0; block < 255 && pos + 16 <= size; block++, pos += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(bytes, newline));
+        }
+        const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+    }
+    return count + CountNewlinesScalar(text + pos, size - pos);
+}
+#endif
+
+#ifdef SUBSTRING_SEARCH_AVX2
+SUBSTRING_SEARCH_TARGET_AVX2 static size_t CountNewlinesAvx2(const char* text, size_t size) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t pos = 0;
+    while(pos + 32 <= size) {
+        __m256i counters = _mm256_setzero_si256();
+        for(int block = 0; block < 255 && pos + 32 <= size; block++, pos += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(bytes, newline));
+        }
+        const __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+        count += static_cast<size_t>(_mm256_extract_epi64(sums, 0)) + static_cast<size_t>(_mm256_extract_epi64(sums, 1))
+            + static_cast<size_t>(_mm256_extract_epi64(sums, 2)) + static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+    }
+    return count + CountNewlinesSse2(text + pos, size - pos);
+}
+#endif
+
+size_t CountNewlines(std::string_view text, SubstringKernel kernel) {
+    if(!IsSubstringKernelSupported(kernel)) {
+        kernel = SubstringKernel::Scalar;
+    }
+
+    switch(kernel) {
+#ifdef SUBSTRING_SEARCH_AVX2
+        case SubstringKernel::Avx2:
+            return CountNewlinesAvx2(text.data(), text.size());
+#endif
+#ifdef SUBSTRING_SEARCH_SSE2
+        case SubstringKernel::Sse2:
+            return CountNewlinesSse2(text.data(), text.size());
+#endif
+        default:
+            return CountNewlinesScalar(text.data(), text.size());
+    }
+}
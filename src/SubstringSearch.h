@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BitSet.h"
+
+enum class SubstringCase {
+    Sensitive,
+    // A-Z match a-z, every other byte only itself
+    AsciiInsensitive,
+};
+
+// Which loop looks for candidates. Only one the CPU runs gets picked, the others are there to compare against
+enum class SubstringKernel {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+// the fastest kernel this CPU runs, looked up once
+SubstringKernel BestSubstringKernel();
+bool IsSubstringKernelSupported(SubstringKernel kernel);
+
+// Names stored back to back in one buffer, each NUL terminated and starting at its offset, offsets increasing.
+// That's the layout of SOARecord's name arena, this is for lists that aren't records
+struct NameArena {
+    std::vector<char>       arena;
+    std::vector<uint32_t>   offsets;
+
+    inline void clear() {
+        arena.clear();
+        offsets.clear();
+    }
+
+    inline void add(std::string_view name) {
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        arena.insert(arena.end(), name.begin(), name.end());
+        arena.push_back('\0');
+    }
+
+    inline size_t size() const { return offsets.size(); }
+};
+
+// Sets bit `i` of `out_Matches` for every name `i` in [begin, end) of `arena` that contains `needle`, bits of the
+// other names are left alone. The arena is scanned in one pass 16 / 32 bytes at a time, a position is only looked
+// at closer if it has the first and the last byte of the needle in the right places. A match can't run across the
+// NUL between two names, so every one found belongs to the name it starts in and the scan skips to the next name.
+// An empty needle matches every name, one with a NUL in it none
+void FindInNames(std::string_view arena, const std::vector<uint32_t>& offsets, size_t begin, size_t end, std::string_view needle,
+                 SubstringCase matchCase, BitSet& out_Matches, SubstringKernel kernel = BestSubstringKernel());
+
+// the same with offsets that aren't in a vector, like those of a mapped file
+void FindInNames(std::string_view arena, const uint32_t* offsets, size_t numOffsets, size_t begin, size_t end, std::string_view needle,
+                 SubstringCase matchCase, BitSet& out_Matches, SubstringKernel kernel = BestSubstringKernel());
+
+// the same over every name, `out_Matches` is reset to one bit per name first
+void FindInNames(std::string_view arena, const std::vector<uint32_t>& offsets, std::string_view needle, SubstringCase matchCase, BitSet& out_Matches);
+void FindInNames(const NameArena& names, std::string_view needle, SubstringCase matchCase, BitSet& out_Matches);
+
+// one name on its own, for going over a few candidates instead of the whole arena
+bool ContainsSubstring(std::string_view haystack, std::string_view needle, SubstringCase matchCase);
+
+// Where the first occurrence of `needle` at or after `from` starts in `text`, npos if there's none. The same scan as
+// FindInNames over text that isn't split into names, NULs and newlines are bytes like any other
+size_t FindSubstring(std::string_view text, std::string_view needle, size_t from, SubstringCase matchCase,
+                     SubstringKernel kernel = BestSubstringKernel());
+
+// the number of '\n' in `text`, 16 / 32 bytes at a time
+size_t CountNewlines(std::string_view text, SubstringKernel kernel = BestSubstringKernel());
@@ -0,0 +1,65 @@
+#include "TimestampCache.h"
+#include <stdio.h>
+
+static constexpr uint64_t TICKS_PER_SECOND  = 10000000ULL;
+static constexpr uint64_t TICKS_PER_DAY     = 24ULL * 60 * 60 * TICKS_PER_SECOND;
+
+FileSystem::Timestamp TimestampCache::toLocal(uint64_t fileTime) {
+    if(fileTime >= mDayStart && fileTime < mDayEnd) {
+        int secondOfDay = static_cast<int>((fileTime - mDayStart) / TICKS_PER_SECOND);
+        return FileSystem::Timestamp::fromLocalTime(mDay.year, mDay.month, mDay.day, 
+                secondOfDay / 3600, (secondOfDay / 60) % 60, secondOfDay % 60);
+    }
+
+    FileSystem::Timestamp result = FileSystem::fileTimeToLocalTimestamp(fileTime);
+    mNumConversions++;
+
+    // only take the fast path for this day if the UTC offset is the same all day (no DST switch). A switch earlier
+    // in the day moves dayStart off local midnight, one later moves the last second off 23:59:59. Both ends landing
+    // where they should means the offset is the same at both
+    uint64_t sinceMidnight = static_cast<uint64_t>(result.secondOfDay()) * TICKS_PER_SECOND + fileTime % TICKS_PER_SECOND;
+    if(fileTime >= sinceMidnight) {
+        uint64_t dayStart = fileTime - sinceMidnight;
+        FileSystem::Timestamp firstSecond = FileSystem::fileTimeToLocalTimestamp(dayStart);
+        FileSystem::Timestamp lastSecond = FileSystem::fileTimeToLocalTimestamp(dayStart + TICKS_PER_DAY - TICKS_PER_SECOND);
+        mNumConversions += 2;
+
+        const bool isSameDay = firstSecond.year == result.year && firstSecond.month == result.month && firstSecond.day == result.day
+            && lastSecond.year == result.year && lastSecond.month == result.month && lastSecond.day == result.day;
+        if(isSameDay && firstSecond.secondOfDay() == 0 && lastSecond.secondOfDay() == 24 * 60 * 60 - 1) {
+            mDayStart = dayStart;
+            mDayEnd = dayStart + TICKS_PER_DAY;
+            mDay = result;
+        }
+    }
+
+    return result;
+}
+
+const char* TimestampCache::format(size_t row, uint64_t fileTime) {
+    Slot& slot = mSlots[row % NUM_SLOTS];
+    if(slot.row == row && slot.fileTime == fileTime) {
+        return slot.text;
+    }
+
+    FileSystem::Timestamp timestamp = toLocal(fileTime);
+
+    snprintf(slot.text, TEXT_LENGTH, "%u-%02u-%02u  %02u:%02u %s",
+            timestamp.year,
+            timestamp.month,
+            timestamp.day,
+            timestamp.hour,
+            timestamp.minute,
+            timestamp.isPM ? "PM" : "AM");
+
+    slot.row = row;
+    slot.fileTime = fileTime;
+
+    return slot.text;
+}
+
+void TimestampCache::clear() {
+    for(Slot& slot : mSlots) {
+        slot.row = SIZE_MAX;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include "FileSystem.h"
+
+// Converts SOARecord::lastModifiedNumbers to local calendar time for the rows that are actually drawn.
+// Slots are keyed by row and validated by file time, so a re-sort or re-enumeration never shows stale text.
+// Directories tend to have lots of files modified on the same day, once a day has been converted
+// any other time on it is derived with integer math instead of another OS conversion.
+class TimestampCache {
+    static constexpr size_t NUM_SLOTS       = 256;
+    static constexpr size_t TEXT_LENGTH     = 40;
+
+    struct Slot {
+        size_t      row = SIZE_MAX;
+        uint64_t    fileTime = 0;
+        char        text[TEXT_LENGTH];
+    };
+
+public:
+    // returns "YYYY-MM-DD  hh:mm AM" for the file time shown at `row`
+    const char* format(size_t row, uint64_t fileTime);
+
+    FileSystem::Timestamp toLocal(uint64_t fileTime);
+
+    void clear();
+
+    inline size_t numConversions() const { return mNumConversions; }
+
+private:
+    std::array<Slot, NUM_SLOTS> mSlots;
+
+    // local day of the last conversion, as a [start, end) range of UTC file times
+    uint64_t mDayStart = 0;
+    uint64_t mDayEnd = 0;
+    FileSystem::Timestamp mDay{};
+
+    size_t mNumConversions = 0;
+};
@@ -0,0 +1,341 @@
+#include "WatchRegistry.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+    #include "Path.h"
+    #include "StringUtils.h"
+#endif
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <limits.h>
+    #include <unistd.h>
+    #include <sys/inotify.h>
+#endif
+
+#include <stdio.h>
+
+// entries showing up, going away or being renamed, and files that were written to. Listings get patched per
+// changed name so size and date updates are cheap enough to follow
+#ifdef _WIN32
+static constexpr DWORD WATCH_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+    | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+#endif
+#ifdef __linux__
+static constexpr uint32_t WATCH_FILTER = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB
+    | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+WatchRegistry::WatchRegistry() {
+#ifdef __linux__
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(mInotifyFd < 0) {
+        printf("inotify_init1 failed: %d\n", errno);
+    }
+#endif
+}
+
+WatchRegistry::~WatchRegistry() {
+    for(auto& [path, watch] : mWatches) {
+        closeWatch(path, watch);
+    }
+
+#ifdef __linux__
+    if(mInotifyFd >= 0) {
+        close(mInotifyFd);
+    }
+#endif
+}
+
+WatchRegistry& WatchRegistry::shared() {
+    static WatchRegistry registry;
+    return registry;
+}
+
+bool WatchRegistry::subscribe(const std::string& path, uint64_t& out_Generation) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    auto it = mWatches.find(path);
+
+    // the directory went away while it was watched, it may be back by now
+    if(it != mWatches.end() && it->second.handle == NO_HANDLE && it->second.numSubscribers == 0) {
+        mIdle.erase(it->second.idlePosition);
+        mWatches.erase(it);
+        it = mWatches.end();
+    }
+
+    if(it == mWatches.end()) {
+        Watch watch;
+        if(!openWatch(path, watch)) return false;
+
+        watch.generation = mNextGeneration++;
+        watch.completeSince = watch.generation;
+        it = mWatches.emplace(path, watch).first;
+    } else {
+        if(it->second.numSubscribers == 0) {
+            mIdle.erase(it->second.idlePosition);
+        }
+        // anything that happened while it was idle has to show up in the generation we hand out
+        pollWatches(path);
+    }
+
+    Watch& watch = it->second;
+    watch.numSubscribers++;
+    out_Generation = watch.generation;
+    return true;
+}
+
+void WatchRegistry::unsubscribe(const std::string& path) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    auto it = mWatches.find(path);
+    if(it == mWatches.end() || it->second.numSubscribers == 0) return;
+
+    Watch& watch = it->second;
+    if(--watch.numSubscribers > 0) return;
+
+    mIdle.push_front(path);
+    watch.idlePosition = mIdle.begin();
+
+    if(mIdle.size() > MAX_IDLE_WATCHES) {
+        auto oldest = mWatches.find(mIdle.back());
+        mIdle.pop_back();
+        closeWatch(oldest->first, oldest->second);
+        mWatches.erase(oldest);
+    }
+}
+
+uint64_t WatchRegistry::poll(const std::string& path) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    pollWatches(path);
+
+    auto it = mWatches.find(path);
+    return it != mWatches.end() ? it->second.generation : 0;
+}
+
+bool WatchRegistry::changesSince(const std::string& path, uint64_t generation, std::vector<std::string>& out_Names, uint64_t& out_Generation) {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    pollWatches(path);
+
+    auto it = mWatches.find(path);
+    if(it == mWatches.end()) return false;
+
+    const Watch& watch = it->second;
+    if(generation < watch.completeSince) return false;
+
+    for(auto change = watch.changes.rbegin(); change != watch.changes.rend() && change->first > generation; ++change) {
+        out_Names.push_back(change->second);
+    }
+
+    out_Generation = watch.generation;
+    return true;
+}
+
+void WatchRegistry::logChange(Watch& watch, std::string name) {
+    watch.generation = mNextGeneration++;
+    watch.changes.emplace_back(watch.generation, std::move(name));
+
+    if(watch.changes.size() > MAX_LOGGED_CHANGES) {
+        watch.completeSince = watch.changes.front().first;
+        watch.changes.pop_front();
+    }
+}
+
+void WatchRegistry::logUnknownChange(Watch& watch) {
+    watch.generation = mNextGeneration++;
+    watch.changes.clear();
+    watch.completeSince = watch.generation;
+}
+
+size_t WatchRegistry::numWatches() const {
+    std::scoped_lock<std::mutex> lock(mMutex);
+    return mWatches.size();
+}
+
+size_t WatchRegistry::numSubscribers(const std::string& path) const {
+    std::scoped_lock<std::mutex> lock(mMutex);
+
+    auto it = mWatches.find(path);
+    return it != mWatches.end() ? it->second.numSubscribers : 0;
+}
+
+#ifdef _WIN32
+
+// one outstanding ReadDirectoryChangesW per watch, its buffer has to stay put until the read completes
+struct PendingRead {
+    HANDLE      directory = INVALID_HANDLE_VALUE;
+    OVERLAPPED  overlapped{};
+    alignas(DWORD) char buffer[64 * 1024];
+};
+
+inline static bool IssueRead(PendingRead& read) {
+    return ReadDirectoryChangesW(read.directory, read.buffer, sizeof(read.buffer), FALSE, WATCH_FILTER, nullptr, &read.overlapped, nullptr);
+}
+
+bool WatchRegistry::openWatch(const std::string& path, Watch& out_Watch) {
+    HANDLE directory = CreateFileW(Path(path).wstr().data(), FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr
+            );
+    if(directory == INVALID_HANDLE_VALUE) return false;
+
+    PendingRead* read = new PendingRead();
+    read->directory = directory;
+    read->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    if(read->overlapped.hEvent == nullptr || !IssueRead(*read)) {
+        if(read->overlapped.hEvent != nullptr) CloseHandle(read->overlapped.hEvent);
+        CloseHandle(directory);
+        delete read;
+        return false;
+    }
+
+    out_Watch.handle = reinterpret_cast<intptr_t>(read);
+    return true;
+}
+
+void WatchRegistry::closeWatch(const std::string&, Watch& watch) {
+    if(watch.handle == NO_HANDLE) return;
+
+    PendingRead* read = reinterpret_cast<PendingRead*>(watch.handle);
+
+    // the read has to be finished before its buffer goes away
+    DWORD numBytes = 0;
+    CancelIoEx(read->directory, &read->overlapped);
+    GetOverlappedResult(read->directory, &read->overlapped, &numBytes, TRUE);
+
+    CloseHandle(read->overlapped.hEvent);
+    CloseHandle(read->directory);
+    delete read;
+
+    watch.handle = NO_HANDLE;
+}
+
+// every watch has its own read in flight, only the one asked about is checked
+void WatchRegistry::pollWatches(const std::string& path) {
+    auto it = mWatches.find(path);
+    if(it == mWatches.end()) return;
+
+    Watch& watch = it->second;
+    if(watch.handle == NO_HANDLE) return;
+
+    PendingRead* read = reinterpret_cast<PendingRead*>(watch.handle);
+    if(WaitForSingleObject(read->overlapped.hEvent, 0) != WAIT_OBJECT_0) return;
+
+    DWORD numBytes = 0;
+    const bool succeeded = GetOverlappedResult(read->directory, &read->overlapped, &numBytes, FALSE);
+    ResetEvent(read->overlapped.hEvent);
+
+    // zero bytes means the notifications didn't fit the buffer
+    if(!succeeded || numBytes == 0) {
+        logUnknownChange(watch);
+    } else {
+        const char* entry = read->buffer;
+        while(true) {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+            const std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+            logChange(watch, Util::WstringToUtf8(name));
+
+            if(info->NextEntryOffset == 0) break;
+            entry += info->NextEntryOffset;
+        }
+    }
+
+    // fails once the directory itself is gone
+    if(!succeeded || !IssueRead(*read)) {
+        logUnknownChange(watch);
+        closeWatch(path, watch);
+    }
+}
+
+#endif
+
+#ifdef __linux__
+
+bool WatchRegistry::openWatch(const std::string& path, Watch& out_Watch) {
+    if(mInotifyFd < 0) return false;
+
+    const int descriptor = inotify_add_watch(mInotifyFd, path.c_str(), WATCH_FILTER | IN_ONLYDIR);
+    if(descriptor < 0) return false;
+
+    // two paths leading to the same directory share a descriptor, see closeWatch
+    mPathsByDescriptor.emplace(descriptor, path);
+    out_Watch.handle = descriptor;
+    return true;
+}
+
+void WatchRegistry::closeWatch(const std::string& path, Watch& watch) {
+    if(watch.handle == NO_HANDLE) return;
+    const int descriptor = static_cast<int>(watch.handle);
+
+    auto range = mPathsByDescriptor.equal_range(descriptor);
+    for(auto it = range.first; it != range.second; ++it) {
+        if(it->second == path) {
+            mPathsByDescriptor.erase(it);
+            break;
+        }
+    }
+
+    // removing the descriptor would end the watch for the other paths as well
+    if(mPathsByDescriptor.count(descriptor) == 0) {
+        inotify_rm_watch(mInotifyFd, descriptor);
+    }
+}
+
+// all watches share one inotify queue, draining it settles every directory at once
+void WatchRegistry::pollWatches(const std::string&) {
+    if(mInotifyFd < 0) return;
+
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+
+    while(true) {
+        const ssize_t numRead = read(mInotifyFd, buffer, sizeof(buffer));
+        if(numRead <= 0) break;
+
+        for(ssize_t offset = 0; offset < numRead;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            // the queue overflowed, events were lost and any directory may have changed
+            if(event->mask & IN_Q_OVERFLOW) {
+                for(auto& [path, watch] : mWatches) {
+                    logUnknownChange(watch);
+                }
+                continue;
+            }
+
+            // an entry changed, events about the directory itself (no name) that don't end the watch don't matter
+            const bool isAboutEntry = event->len > 0 && event->name[0] != '\0';
+            const bool isWatchGone = event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT);
+            if(!isAboutEntry && !isWatchGone) continue;
+
+            auto range = mPathsByDescriptor.equal_range(event->wd);
+            for(auto it = range.first; it != range.second; ++it) {
+                auto watch = mWatches.find(it->second);
+                if(watch == mWatches.end()) continue;
+
+                if(isAboutEntry) {
+                    logChange(watch->second, event->name);
+                } else {
+                    logUnknownChange(watch->second);
+                }
+
+                // the directory is gone and the kernel dropped the watch, its descriptor may be handed out again
+                if(event->mask & IN_IGNORED) {
+                    watch->second.handle = NO_HANDLE;
+                }
+            }
+
+            if(event->mask & IN_IGNORED) {
+                mPathsByDescriptor.erase(event->wd);
+            }
+        }
+    }
+}
+
+#endif
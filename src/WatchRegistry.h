@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One change notification per directory, shared by everything showing it. Subscriptions are reference counted,
+// every change bumps the directory's generation and whoever polls next sees it, so a change is picked up once
+// no matter how many widgets show the directory. Generations are never reused, they double as DirectoryCache
+// change stamps that cost no system call to check.
+// Each watch also logs the names of the entries that changed, so a listing can be patched instead of re-enumerated.
+// Unsubscribed watches stay open for a while so going back to a directory can still trust its cached listing
+class WatchRegistry {
+public:
+    // watches kept open after their last subscriber left
+    static constexpr size_t MAX_IDLE_WATCHES = 64;
+    // changed names remembered per watch, anyone further behind enumerates again
+    static constexpr size_t MAX_LOGGED_CHANGES = 4096;
+
+    WatchRegistry();
+    ~WatchRegistry();
+
+    WatchRegistry(const WatchRegistry&) = delete;
+    WatchRegistry& operator=(const WatchRegistry&) = delete;
+
+    static WatchRegistry& shared();
+
+    // starts watching `path` or joins the existing watch. False if the directory can't be watched
+    bool subscribe(const std::string& path, uint64_t& out_Generation);
+    void unsubscribe(const std::string& path);
+
+    // generation of `path` after picking up pending notifications, 0 if it isn't watched
+    uint64_t poll(const std::string& path);
+
+    // appends the names of the entries of `path` that changed after `generation`, newest first and possibly repeated,
+    // and returns the generation that brings it up to. False when that isn't known (the log overflowed, the directory
+    // itself went away) and the caller has to enumerate again
+    bool changesSince(const std::string& path, uint64_t generation, std::vector<std::string>& out_Names, uint64_t& out_Generation);
+
+    // open watches, idle ones included
+    size_t numWatches() const;
+    size_t numSubscribers(const std::string& path) const;
+
+private:
+    // the watch ended because its directory went away
+    static constexpr intptr_t NO_HANDLE = -1;
+
+    struct Watch {
+        // outstanding ReadDirectoryChangesW on windows, inotify watch descriptor on linux
+        intptr_t    handle = NO_HANDLE;
+        uint64_t    generation = 0;
+        size_t      numSubscribers = 0;
+        std::list<std::string>::iterator idlePosition;
+
+        // changed names with the generation they were logged at, oldest first
+        std::deque<std::pair<uint64_t, std::string>> changes;
+        // changesSince can answer for any generation from this one on
+        uint64_t    completeSince = 0;
+    };
+
+    bool openWatch(const std::string& path, Watch& out_Watch);
+    void closeWatch(const std::string& path, Watch& watch);
+    void pollWatches(const std::string& path);
+
+    void logChange(Watch& watch, std::string name);
+    // something changed that the log can't describe
+    void logUnknownChange(Watch& watch);
+
+    mutable std::mutex                      mMutex;
+    std::unordered_map<std::string, Watch>  mWatches;
+    // idle watches, most recently left at the front
+    std::list<std::string>                  mIdle;
+    uint64_t                                mNextGeneration = 1;
+
+#ifdef __linux__
+    int mInotifyFd = -1;
+    std::unordered_multimap<int, std::string> mPathsByDescriptor;
+#endif
+};
@@ -0,0 +1,135 @@
+#include "WorkStealingPool.h"
+
+// lets submit() and wait() tell whether they're running on one of the pool's threads
+static thread_local WorkStealingPool*   tCurrentPool = nullptr;
+static thread_local size_t              tWorkerIdx = 0;
+
+WorkStealingPool::WorkStealingPool(size_t numThreads) {
+    if(numThreads == 0) {
+        numThreads = defaultThreadCount();
+    }
+
+    mQueues.reserve(numThreads);
+    for(size_t i = 0; i < numThreads; i++) {
+        mQueues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    mThreads.reserve(numThreads);
+    for(size_t i = 0; i < numThreads; i++) {
+        mThreads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::scoped_lock<std::mutex> lock(mSleepMutex);
+        mAlive = false;
+    }
+    mWakeCondition.notify_all();
+
+    for(std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+size_t WorkStealingPool::defaultThreadCount() {
+    const size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 4;
+}
+
+void WorkStealingPool::submit(TaskGroup& group, Task task) {
+    group.mPending++;
+
+    const size_t queueIdx = tCurrentPool == this ? tWorkerIdx : mNextQueue++ % mQueues.size();
+    {
+        WorkerQueue& queue = *mQueues[queueIdx];
+        std::scoped_lock<std::mutex> lock(queue.mutex);
+        queue.entries.push_back({ std::move(task), &group });
+        // counted under the queue lock so a thief can never take the entry before it's counted
+        mNumQueued++;
+    }
+
+    {
+        // taking the lock orders the increment before a sleeping worker re-checks it
+        std::scoped_lock<std::mutex> lock(mSleepMutex);
+    }
+    mWakeCondition.notify_one();
+}
+
+void WorkStealingPool::wait(TaskGroup& group) {
+    if(tCurrentPool == this) {
+        while(!group.isDone()) {
+            Entry entry;
+            if(popOrSteal(tWorkerIdx, entry)) {
+                execute(entry, tWorkerIdx);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        // the last decrement happens under the lock, once it's ours the task that did it is done notifying and the
+        // group can go away
+        std::scoped_lock<std::mutex> lock(group.mMutex);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(group.mMutex);
+    group.mDone.wait(lock, [&group]() { return group.isDone(); });
+}
+
+void WorkStealingPool::run(size_t workerIdx) {
+    tCurrentPool = this;
+    tWorkerIdx = workerIdx;
+
+    while(true) {
+        Entry entry;
+        if(popOrSteal(workerIdx, entry)) {
+            execute(entry, workerIdx);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mWakeCondition.wait(lock, [this]() { return !mAlive || mNumQueued.load() > 0; });
+
+        if(!mAlive && mNumQueued.load() == 0) break;
+    }
+
+    tCurrentPool = nullptr;
+}
+
+bool WorkStealingPool::popOrSteal(size_t workerIdx, Entry& out) {
+    {
+        WorkerQueue& own = *mQueues[workerIdx];
+        std::scoped_lock<std::mutex> lock(own.mutex);
+        if(!own.entries.empty()) {
+            out = std::move(own.entries.back());
+            own.entries.pop_back();
+            mNumQueued--;
+            return true;
+        }
+    }
+
+    // oldest task of a victim is usually the biggest chunk of remaining work (e.g. a shallow directory)
+    for(size_t i = 1; i < mQueues.size(); i++) {
+        WorkerQueue& victim = *mQueues[(workerIdx + i) % mQueues.size()];
+        std::scoped_lock<std::mutex> lock(victim.mutex);
+        if(!victim.entries.empty()) {
+            out = std::move(victim.entries.front());
+            victim.entries.pop_front();
+            mNumQueued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::execute(Entry& entry, size_t workerIdx) {
+    entry.task(workerIdx);
+
+    TaskGroup& group = *entry.group;
+    // decrement under the lock so a waiter can't return (and destroy the group) before the notify is done
+    std::scoped_lock<std::mutex> lock(group.mMutex);
+    if(--group.mPending == 0) {
+        group.mDone.notify_all();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. Workers pop their own deque from the back (newest first, so a
+// recursive job stays depth first and cache warm) and steal from the front of the others when they run dry.
+// Tasks are tracked per TaskGroup so independent jobs can share the pool and wait only on their own work.
+class WorkStealingPool {
+public:
+    // workerIdx is in [0, numThreads()), handy for indexing per thread scratch space
+    using Task = std::function<void(size_t workerIdx)>;
+
+    class TaskGroup {
+    public:
+        inline bool isDone() const { return mPending.load() == 0; }
+
+    private:
+        std::atomic<size_t>     mPending{ 0 };
+        std::mutex              mMutex;
+        std::condition_variable mDone;
+
+        friend class WorkStealingPool;
+    };
+
+    // 0 threads means one per hardware thread
+    explicit WorkStealingPool(size_t numThreads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // from one of the pool's own threads the task goes to that thread's deque, otherwise round robin
+    void submit(TaskGroup& group, Task task);
+
+    // blocks until every task of the group finished, including tasks the group's tasks submitted.
+    // Called from a worker it keeps running tasks instead of blocking, so nested waits can't deadlock
+    void wait(TaskGroup& group);
+
+    inline size_t numThreads() const { return mThreads.size(); }
+
+    static size_t defaultThreadCount();
+
+private:
+    struct Entry {
+        Task        task;
+        TaskGroup*  group = nullptr;
+    };
+
+    struct WorkerQueue {
+        std::mutex          mutex;
+        std::deque<Entry>   entries;
+    };
+
+    void run(size_t workerIdx);
+    bool popOrSteal(size_t workerIdx, Entry& out);
+    void execute(Entry& entry, size_t workerIdx);
+
+    std::vector<std::unique_ptr<WorkerQueue>>   mQueues;
+    std::vector<std::thread>                    mThreads;
+
+    std::atomic<size_t> mNumQueued{ 0 };
+    std::atomic<size_t> mNextQueue{ 0 };
+
+    std::mutex              mSleepMutex;
+    std::condition_variable mWakeCondition;
+    bool                    mAlive = true;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <string_view>
+
+// The byte wise natural comparator names were sorted with before NaturalCompare, kept as the reference the new
+// ordering is checked and benchmarked against. True if `lhs` sorts after `rhs`
+inline static int LegacyGetChunk(std::string_view str, int start) {
+    auto xIsDigit = [](char c) { return c >= '0' && c <= '9'; };
+
+    if(start >= str.size()) return 1;
+    char startChar = str[start];
+    int length = 1;
+
+    if(xIsDigit(startChar)) {
+        // move until next char or end
+        while(start++ < str.size()) {
+            if(!xIsDigit(str[start])) {
+                break;
+            }
+            length++;
+        }
+    } else {
+        // move until next digit or end
+        while(start++ < str.size()) {
+            if(xIsDigit(str[start])) {
+                break;
+            }
+            length++;
+        }
+    }
+
+    return length;
+}
+
+inline static bool LegacyNaturalComparator(std::string_view lhs, std::string_view rhs) {
+    auto xIsDigit = [](char c) { return c >= '0' && c <= '9'; };
+
+    if (lhs.empty())
+        return false;
+    if (rhs.empty())
+        return true;
+
+    int thisPos = 0;
+    int thatPos = 0;
+
+    while(thisPos < lhs.size() && thatPos < rhs.size()) {
+        int thisChunkSize = LegacyGetChunk(lhs, thisPos);
+        int thatChunkSize = LegacyGetChunk(rhs, thatPos);
+
+        if (xIsDigit(lhs[thisPos]) && !xIsDigit(rhs[thatPos])) {
+            return false;
+        }
+        if (!xIsDigit(lhs[thisPos]) && xIsDigit(rhs[thatPos])) {
+            return true;
+        }
+
+        if(xIsDigit(lhs[thisPos]) && xIsDigit(rhs[thatPos])) {
+            if(thisChunkSize == thatChunkSize) {
+                for(int i = 0; i < thisChunkSize; i++) {
+                    int res = lhs[thisPos + i] - rhs[thatPos + i];
+                    if(res != 0) return res > 0;
+                }
+            } else {
+                return thisChunkSize > thatChunkSize;
+            }
+        } else {
+            int res = lhs.compare(thisPos, thisChunkSize, rhs, thatPos, thatChunkSize);
+            if(res != 0) return res > 0;
+        }
+
+        if (thatChunkSize == 0) return false;
+        if (thisChunkSize == 0) return true;
+
+        thisPos += thisChunkSize;
+        thatPos += thatChunkSize;
+    }
+
+    return lhs.size() > rhs.size();
+};
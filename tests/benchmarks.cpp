@@ -0,0 +1,975 @@
+// Benchmarks are hidden from the default test run, run them with:
+//   xmake run tests "[benchmark]"
+
+#include <catch_amalgamated.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <thread>
+
+#include <FileSystem.h>
+#include <Path.h>
+#include <WorkStealingPool.h>
+#include <DirectoryTree.h>
+#include <DirectoryWatcher.h>
+#include <NameFilter.h>
+#include <SubstringSearch.h>
+#include <FuzzyMatch.h>
+#include <FileFinder.h>
+#include <FileIndex.h>
+#include <ContentSearch.h>
+#include <ContentIndex.h>
+#include <StringUtils.h>
+#include <NaturalComparator.h>
+#include "LegacyNaturalComparator.h"
+
+#include <algorithm>
+#include <random>
+
+namespace std_fs = std::filesystem;
+
+static const std_fs::path BENCHMARK_PATH = std_fs::current_path() / "BENCHMARK_TEMP";
+
+// creates (once) a directory with `count` empty files, reused across runs since the 1M case takes a while
+static std_fs::path getDirectoryWithFiles(size_t count) {
+    std_fs::path dir = BENCHMARK_PATH / (std::to_string(count) + "_files");
+
+    if(std_fs::exists(dir / std::to_string(count - 1))) return dir;
+
+    std_fs::create_directories(dir);
+    for(size_t i = 0; i < count; i++) {
+        std::ofstream outputFile((dir / std::to_string(i)).u8string());
+    }
+
+    return dir;
+}
+
+// creates (once) `numTop` directories with `numSub` subdirectories of `numFiles` empty files each
+static std_fs::path getDirectoryTree(size_t numTop, size_t numSub, size_t numFiles) {
+    std_fs::path root = BENCHMARK_PATH / ("tree_" + std::to_string(numTop) + "x" + std::to_string(numSub) + "x" + std::to_string(numFiles));
+    std_fs::path lastFile = root / std::to_string(numTop - 1) / std::to_string(numSub - 1) / std::to_string(numFiles - 1);
+
+    if(std_fs::exists(lastFile)) return root;
+
+    for(size_t top = 0; top < numTop; top++) {
+        for(size_t sub = 0; sub < numSub; sub++) {
+            std_fs::path dir = root / std::to_string(top) / std::to_string(sub);
+            std_fs::create_directories(dir);
+            for(size_t i = 0; i < numFiles; i++) {
+                std::ofstream outputFile((dir / std::to_string(i)).u8string());
+            }
+        }
+    }
+
+    return root;
+}
+
+TEST_CASE("Enumerate directory", "[.][benchmark]") {
+    for(size_t count : { 10000, 100000, 1000000 }) {
+        std_fs::path dir = getDirectoryWithFiles(count);
+        Path dirPath(dir.u8string());
+        const std::string suffix = " (" + std::to_string(count) + " entries)";
+
+        FileSystem::SOARecord records;
+
+        BENCHMARK("enumerateDirectory names + types" + suffix) {
+            FileSystem::enumerateDirectory(dirPath, records, FileSystem::ENUMERATE_NAME_AND_TYPE);
+            return records.size();
+        };
+
+        BENCHMARK("std::filesystem::directory_iterator names + types" + suffix) {
+            size_t numDirectories = 0;
+            for(const auto& entry : std_fs::directory_iterator(dir)) {
+                numDirectories += entry.is_directory();
+            }
+            return numDirectories;
+        };
+
+        BENCHMARK("enumerateDirectory all columns" + suffix) {
+            FileSystem::enumerateDirectory(dirPath, records, FileSystem::ENUMERATE_ALL);
+            return records.size();
+        };
+
+        BENCHMARK("std::filesystem::directory_iterator all columns" + suffix) {
+            uint64_t total = 0;
+            for(const auto& entry : std_fs::directory_iterator(dir)) {
+                total += entry.is_directory() ? 0 : entry.file_size();
+                total += entry.last_write_time().time_since_epoch().count();
+            }
+            return total;
+        };
+    }
+}
+
+TEST_CASE("SOARecord memory per entry", "[.][benchmark]") {
+    for(size_t count : { 10000, 100000, 1000000 }) {
+        std_fs::path dir = getDirectoryWithFiles(count);
+        Path dirPath(dir.u8string());
+        const std::string suffix = " (" + std::to_string(count) + " entries)";
+
+        FileSystem::SOARecord records;
+
+        auto start = std::chrono::steady_clock::now();
+        FileSystem::enumerateDirectory(dirPath, records);
+        std::chrono::duration<double, std::milli> coldTime = std::chrono::steady_clock::now() - start;
+        const double bytesPerEntry = static_cast<double>(records.memoryUsage()) / records.size();
+
+        WARN("cold enumerate" << suffix << ": " << coldTime.count() << " ms, " << bytesPerEntry << " bytes per entry");
+
+        // the record is reused, so these runs don't touch the allocator
+        BENCHMARK("re-enumerate into a reused record" + suffix) {
+            FileSystem::enumerateDirectory(dirPath, records);
+            return records.size();
+        };
+    }
+}
+
+TEST_CASE("Natural compare 1M pairs", "[.][benchmark]") {
+    // names as they come out of cameras, exports and builds: long shared prefixes with a counter in them
+    std::mt19937 random(3);
+    const std::vector<std::string> prefixes = { "IMG_", "Screenshot 2024-05-", "project_backup_final_v", "Quarterly Report FY2023 Q", "" };
+    std::vector<std::string> names;
+    for(size_t i = 0; i < 100000; i++) {
+        names.push_back(prefixes[random() % prefixes.size()] + std::to_string(random() % 5000) + (random() % 2 ? ".jpg" : ".JPG"));
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> pairs(1000000);
+    for(auto& [lhs, rhs] : pairs) {
+        lhs = random() % names.size();
+        rhs = random() % names.size();
+    }
+
+    BENCHMARK("legacy NaturalComparator (1M pairs)") {
+        size_t numGreater = 0;
+        for(const auto& [lhs, rhs] : pairs) {
+            numGreater += LegacyNaturalComparator(names[lhs], names[rhs]);
+        }
+        return numGreater;
+    };
+
+    for(CaseFolding folding : { CaseFolding::None, CaseFolding::Ascii, CaseFolding::Unicode }) {
+        const char* label = folding == CaseFolding::None ? "no folding" : folding == CaseFolding::Ascii ? "ASCII folding" : "Unicode folding";
+
+        BENCHMARK(std::string("NaturalCompare, ") + label + " (1M pairs)") {
+            size_t numGreater = 0;
+            for(const auto& [lhs, rhs] : pairs) {
+                numGreater += NaturalCompare(names[lhs], names[rhs], folding) > 0;
+            }
+            return numGreater;
+        };
+    }
+}
+
+TEST_CASE("Sort 1M by name", "[.][benchmark]") {
+    const size_t count = 1000000;
+
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        records.add("file_" + std::to_string(i), 0, 0, 0);
+    }
+
+    std::vector<size_t> shuffled = records.indexes;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+
+    auto start = std::chrono::steady_clock::now();
+    records.buildSortKeys();
+    std::chrono::duration<double, std::milli> keyTime = std::chrono::steady_clock::now() - start;
+    const double keyBytesPerEntry = static_cast<double>(records.sortKeyArena.size()) / count;
+
+    WARN("building sort keys for " << count << " names: " << keyTime.count() << " ms, " << keyBytesPerEntry << " bytes per key");
+
+    BENCHMARK("NaturalComparator stable_sort (1M file_N)") {
+        records.indexes = shuffled;
+        std::stable_sort(records.indexes.begin(), records.indexes.end(), [&](size_t lhs, size_t rhs) {
+            return NaturalComparator(records.getRecordName(rhs), records.getRecordName(lhs));
+        });
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sort keys memcmp stable_sort (1M file_N)") {
+        records.indexes = shuffled;
+        std::stable_sort(records.indexes.begin(), records.indexes.end(), [&](size_t lhs, size_t rhs) {
+            return records.getSortKey(lhs) < records.getSortKey(rhs);
+        });
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sortByName radix (1M file_N)") {
+        records.indexes = shuffled;
+        records.sortByName(FileSystem::SortDirection::Ascending);
+        return records.indexes[0];
+    };
+
+    REQUIRE(records.getName(0) == "file_1");
+    REQUIRE(records.getName(count - 1) == "file_1000000");
+}
+
+TEST_CASE("Sort 1M by size and date", "[.][benchmark]") {
+    const size_t count = 1000000;
+
+    // sizes spread over a few orders of magnitude, file times within a year
+    std::mt19937_64 random(7);
+    FileSystem::SOARecord records;
+    for(size_t i = 0; i < count; i++) {
+        records.add("file", 0, 133000000000000000ULL + random() % 315360000000000ULL, random() % (1ULL << (random() % 34)));
+    }
+
+    std::vector<size_t> shuffled = records.indexes;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+    BENCHMARK("stable_sort by size (1M)") {
+        records.indexes = shuffled;
+        std::stable_sort(records.indexes.begin(), records.indexes.end(), [&](size_t lhs, size_t rhs) {
+            return records.sizes[lhs] > records.sizes[rhs];
+        });
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sortBySize radix (1M)") {
+        records.indexes = shuffled;
+        records.sortBySize(FileSystem::SortDirection::Ascending);
+        return records.indexes[0];
+    };
+
+    BENCHMARK("stable_sort by date (1M)") {
+        records.indexes = shuffled;
+        std::stable_sort(records.indexes.begin(), records.indexes.end(), [&](size_t lhs, size_t rhs) {
+            return records.lastModifiedNumbers[lhs] > records.lastModifiedNumbers[rhs];
+        });
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sortByLastModified radix (1M)") {
+        records.indexes = shuffled;
+        records.sortByLastModified(FileSystem::SortDirection::Ascending);
+        return records.indexes[0];
+    };
+}
+
+TEST_CASE("Sort 1M by column and type", "[.][benchmark]") {
+    const size_t count = 1000000;
+
+    std::mt19937_64 random(11);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        const int attributes = random() % 10 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+        records.add("file_" + std::to_string(i), attributes, 133000000000000000ULL + random() % 315360000000000ULL, random() % (1ULL << (random() % 34)));
+    }
+    records.buildSortKeys();
+
+    std::vector<size_t> shuffled = records.indexes;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+    const std::vector<FileSystem::SortKey> byName = { { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending } };
+    const std::vector<FileSystem::SortKey> bySize = { { FileSystem::SortColumn::Size, FileSystem::SortDirection::Ascending } };
+    const std::vector<FileSystem::SortKey> bySizeThenName = { bySize[0], byName[0] };
+
+    BENCHMARK("sortByName then sortByType (1M)") {
+        records.indexes = shuffled;
+        records.sortByName(FileSystem::SortDirection::Ascending);
+        records.sortByType(FileSystem::SortDirection::Ascending);
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sort() by name and type (1M)") {
+        records.indexes = shuffled;
+        records.sort(byName, true);
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sortBySize then sortByType (1M)") {
+        records.indexes = shuffled;
+        records.sortBySize(FileSystem::SortDirection::Ascending);
+        records.sortByType(FileSystem::SortDirection::Ascending);
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sort() by size and type (1M)") {
+        records.indexes = shuffled;
+        records.sort(bySize, true);
+        return records.indexes[0];
+    };
+
+    BENCHMARK("sort() by size then name and type (1M)") {
+        records.indexes = shuffled;
+        records.sort(bySizeThenName, true);
+        return records.indexes[0];
+    };
+}
+
+TEST_CASE("Parallel sort by thread count", "[.][benchmark]") {
+    std::vector<size_t> threadCounts = { 1, 2 };
+    for(size_t numThreads = 4; numThreads <= std::max<size_t>(std::thread::hardware_concurrency(), 4); numThreads *= 2) {
+        threadCounts.push_back(numThreads);
+    }
+
+    const std::vector<FileSystem::SortKey> byName = { { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending } };
+    const std::vector<FileSystem::SortKey> bySize = { { FileSystem::SortColumn::Size, FileSystem::SortDirection::Ascending } };
+
+    for(size_t count : { 100000, 1000000, 5000000 }) {
+        std::mt19937_64 random(13);
+        FileSystem::SOARecord records;
+        for(size_t i = 1; i <= count; i++) {
+            const int attributes = random() % 10 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+            records.add("file_" + std::to_string(i), attributes, 133000000000000000ULL + random() % 315360000000000ULL, random() % (1ULL << (random() % 34)));
+        }
+        records.buildSortKeys();
+
+        std::vector<size_t> shuffled = records.indexes;
+        std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+        const std::string label = " (" + std::to_string(count / 1000) + "k)";
+        for(size_t numThreads : threadCounts) {
+            WorkStealingPool pool(numThreads);
+
+            BENCHMARK("sort() by name, " + std::to_string(numThreads) + " threads" + label) {
+                records.indexes = shuffled;
+                records.sort(byName, true, &pool, 0);
+                return records.indexes[0];
+            };
+
+            BENCHMARK("sort() by size, " + std::to_string(numThreads) + " threads" + label) {
+                records.indexes = shuffled;
+                records.sort(bySize, true, &pool, 0);
+                return records.indexes[0];
+            };
+        }
+    }
+}
+
+TEST_CASE("Patch 1M listing", "[.][benchmark]") {
+    const size_t count = 1000000;
+
+    std::mt19937_64 random(12);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        const int attributes = random() % 10 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+        records.add("file_" + std::to_string(i), attributes, 133000000000000000ULL + random() % 315360000000000ULL, random() % (1ULL << (random() % 34)));
+    }
+
+    const std::vector<FileSystem::SortKey> byName = { { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending } };
+    records.sort(byName, true);
+    // built once per listing, not per change
+    records.findRecord("file_1");
+
+    // one file showing up and going away again, what a save through a temporary file looks like
+    std::vector<FileSystem::EntryChange> added(1);
+    added[0].name = "file_500000.tmp";
+    added[0].exists = true;
+    added[0].size = 1234;
+    std::vector<FileSystem::EntryChange> removed = added;
+    removed[0].exists = false;
+
+    BENCHMARK("applyChanges one entry (1M)") {
+        records.applyChanges(added, byName, true);
+        records.applyChanges(removed, byName, true);
+        return records.size();
+    };
+
+    BENCHMARK("sort() again (1M)") {
+        records.sort(byName, true);
+        return records.indexes[0];
+    };
+}
+
+TEST_CASE("First rows of 1M listing", "[.][benchmark]") {
+    const size_t count = 1000000;
+    // about a screenful with a screenful either side, what the watcher asks for
+    const size_t numRows = 150;
+
+    std::mt19937_64 random(14);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        const int attributes = random() % 10 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+        records.add("file_" + std::to_string(i), attributes, 133000000000000000ULL + random() % 315360000000000ULL, random() % (1ULL << (random() % 34)));
+    }
+    records.buildSortKeys();
+
+    std::vector<size_t> shuffled = records.indexes;
+    std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+    const std::vector<FileSystem::SortKey> byName = { { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending } };
+    const std::vector<FileSystem::SortKey> bySize = { { FileSystem::SortColumn::Size, FileSystem::SortDirection::Ascending } };
+
+    for(const auto& [label, keys] : { std::make_pair("name", byName), std::make_pair("size", bySize) }) {
+        BENCHMARK(std::string("partialSort() top rows by ") + label) {
+            records.indexes = shuffled;
+            records.partialSort(keys, true, 0, numRows);
+            return records.indexes[0];
+        };
+
+        BENCHMARK(std::string("partialSort() middle rows by ") + label) {
+            records.indexes = shuffled;
+            records.partialSort(keys, true, count / 2, numRows);
+            return records.indexes[count / 2];
+        };
+
+        BENCHMARK(std::string("sort() by ") + label) {
+            records.indexes = shuffled;
+            records.sort(keys, true);
+            return records.indexes[0];
+        };
+    }
+}
+
+// What re-sorting costs the UI thread. Every frame calls update() the way BrowserWidget does while the sort column
+// changes every few frames, faster than a big listing sorts. Sorts superseded by a click are cancelled on the worker,
+// the table keeps the previous order until the newest one is done and no frame should go over its budget
+TEST_CASE("Frame times while re-sorting", "[.][benchmark]") {
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    const Milliseconds FRAME_BUDGET(1000.0 / 60.0);
+    const int NUM_CLICKS = 30;
+    const int FRAMES_PER_CLICK = 4;
+
+    const std::vector<std::vector<FileSystem::SortKey>> columns = {
+        { { SortColumn::LastModified, SortDirection::Ascending } },
+        { { SortColumn::Size, SortDirection::Ascending } },
+        { { SortColumn::Name, SortDirection::Descending } },
+        { { SortColumn::Name, SortDirection::Ascending } },
+    };
+
+    for(size_t count : { 100000, 1000000 }) {
+        std_fs::path dir = getDirectoryWithFiles(count);
+        const std::string suffix = " (" + std::to_string(count / 1000) + "k entries)";
+
+        DirectoryWatcher watcher;
+        watcher.setVisibleRows(0, 40);
+        watcher.changeDirectory(Path(dir.u8string()));
+        while(watcher.status() != DirectoryStatus::READY) {
+            watcher.update();
+            std::this_thread::sleep_for(FRAME_BUDGET);
+        }
+
+        std::vector<double> frameTimes;
+        const std::vector<FileSystem::SortKey>* lastKeys = nullptr;
+        std::chrono::steady_clock::time_point lastClick;
+
+        auto xFrame = [&](int frame) {
+            const auto frameStart = std::chrono::steady_clock::now();
+
+            if(frame < NUM_CLICKS * FRAMES_PER_CLICK && frame % FRAMES_PER_CLICK == 0) {
+                lastKeys = &columns[(frame / FRAMES_PER_CLICK) % columns.size()];
+                lastClick = frameStart;
+                watcher.setSort(*lastKeys);
+            }
+            watcher.update();
+            watcher.setVisibleRows(0, 40);
+
+            frameTimes.push_back(Milliseconds(std::chrono::steady_clock::now() - frameStart).count());
+            std::this_thread::sleep_until(frameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(FRAME_BUDGET));
+        };
+
+        int frame = 0;
+        for(; frame < NUM_CLICKS * FRAMES_PER_CLICK; frame++) {
+            xFrame(frame);
+        }
+
+        // keep drawing until the order of the last click shows up
+        FileSystem::SOARecord expected = watcher.mRecords;
+        expected.sort(*lastKeys, (*lastKeys)[0].direction == SortDirection::Ascending);
+        while(watcher.mRecords.indexes != expected.indexes && frame < 100000) {
+            xFrame(frame++);
+        }
+        const Milliseconds settleTime = std::chrono::steady_clock::now() - lastClick;
+
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        const double worst = sorted.back();
+        const double p99 = sorted[sorted.size() * 99 / 100];
+
+        WARN("UI thread per frame" << suffix << ": worst " << worst << " ms, p99 " << p99 << " ms over " << frameTimes.size()
+             << " frames, final order " << settleTime.count() << " ms after the last click");
+        CHECK(watcher.mRecords.indexes == expected.indexes);
+        CHECK(worst < FRAME_BUDGET.count());
+    }
+}
+
+TEST_CASE("Filter 1M names as you type", "[.][benchmark]") {
+    const size_t count = 1000000;
+    const char* words[] = { "report", "final", "draft", "image", "backup", "notes", "data", "v2" };
+
+    std::mt19937_64 random(15);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        records.add(std::string(words[random() % 8]) + "_" + words[random() % 8] + "_" + std::to_string(i) + ".txt", 0, 0, 0);
+    }
+    std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+
+    NameFilter filter;
+    filter.setBackgroundThreshold(SIZE_MAX);
+    uint64_t listingVersion = 1;
+
+    BENCHMARK("full scan \"report_dr\" (1M)") {
+        filter.clear();
+        filter.setQuery("report_dr", records, listingVersion, 1);
+        return filter.numMatches();
+    };
+
+    // what the keystroke after it costs
+    BENCHMARK("refine \"report_dr\" -> \"report_dra\" (1M)") {
+        filter.clear();
+        filter.setQuery("report_dr", records, listingVersion, 1);
+        filter.setQuery("report_dra", records, listingVersion, 1);
+        return filter.numMatches();
+    };
+
+    BENCHMARK("re-sort mapping (1M)") {
+        return filter.update(records, listingVersion, 2) && filter.update(records, listingVersion, 1);
+    };
+
+    // the UI thread only hands the query over, the first time for a listing it copies the names too
+    filter.setBackgroundThreshold(0);
+    BENCHMARK("hand a scan to the worker (1M)") {
+        filter.setQuery("report", records, listingVersion, 1);
+        filter.setQuery("data", records, listingVersion, 1);
+        return filter.isScanning();
+    };
+
+    BENCHMARK("background scan until done (1M)") {
+        filter.clear();
+        filter.setQuery("report_dr", records, listingVersion, 1);
+        while(filter.isScanning()) {
+            filter.update(records, listingVersion, 1);
+            std::this_thread::yield();
+        }
+        return filter.numMatches();
+    };
+}
+
+TEST_CASE("Substring search 1M names", "[.][benchmark]") {
+    const size_t count = 1000000;
+    const char* words[] = { "Report", "final", "Draft", "image", "BACKUP", "notes", "data", "v2" };
+
+    std::mt19937_64 random(16);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        records.add(std::string(words[random() % 8]) + "_" + words[random() % 8] + "_" + std::to_string(i) + ".txt", 0, 0, 0);
+    }
+    const std::string_view arena(records.nameArena.data(), records.nameArena.size());
+    WARN("arena: " << arena.size() / (1024 * 1024) << " MiB, best kernel: " << static_cast<int>(BestSubstringKernel()));
+
+    BitSet matches;
+    matches.reset(count);
+
+    // what NameFilter did before, one find() per name
+    BENCHMARK("string_view::find per name \"Report_Dr\"") {
+        size_t numMatches = 0;
+        for(size_t recordIdx = 0; recordIdx < count; recordIdx++) {
+            numMatches += records.getRecordName(recordIdx).find("Report_Dr") != std::string_view::npos;
+        }
+        return numMatches;
+    };
+
+    const std::pair<SubstringKernel, const char*> kernels[] = {
+        { SubstringKernel::Scalar, "scalar" },
+        { SubstringKernel::Sse2, "SSE2" },
+        { SubstringKernel::Avx2, "AVX2" },
+    };
+    for(const auto& [kernel, kernelName] : kernels) {
+        if(!IsSubstringKernelSupported(kernel)) continue;
+
+        BENCHMARK(std::string(kernelName) + " \"Report_Dr\"") {
+            FindInNames(arena, records.nameOffsets, 0, count, "Report_Dr", SubstringCase::Sensitive, matches, kernel);
+            return matches.words()[0];
+        };
+
+        BENCHMARK(std::string(kernelName) + " ignoring case \"report_dr\"") {
+            FindInNames(arena, records.nameOffsets, 0, count, "report_dr", SubstringCase::AsciiInsensitive, matches, kernel);
+            return matches.words()[0];
+        };
+
+        // the first and last byte show up in almost every name, most candidates need a closer look
+        BENCHMARK(std::string(kernelName) + " ignoring case \"a_d\"") {
+            FindInNames(arena, records.nameOffsets, 0, count, "a_d", SubstringCase::AsciiInsensitive, matches, kernel);
+            return matches.words()[0];
+        };
+    }
+}
+
+TEST_CASE("Fuzzy match 1M names", "[.][benchmark]") {
+    const size_t count = 1000000;
+    const char* words[] = { "Report", "final", "Draft", "image", "BACKUP", "notes", "data", "v2" };
+
+    std::mt19937_64 random(17);
+    FileSystem::SOARecord records;
+    for(size_t i = 1; i <= count; i++) {
+        records.add(std::string(words[random() % 8]) + "_" + words[random() % 8] + "_" + std::to_string(i) + ".txt", 0, 0, 0);
+    }
+    const std::string_view arena(records.nameArena.data(), records.nameArena.size());
+
+    WorkStealingPool pool;
+    WARN("threads: " << pool.numThreads());
+
+    // few matches / a quarter of the names / most of them
+    for(const char* query : { "rprtdrf9", "rpdr", "a_t" }) {
+        const FuzzyPattern pattern(query);
+        TopMatches best(100);
+        BitSet matches;
+        matches.reset(count);
+
+        BENCHMARK(std::string("one thread \"") + query + "\"") {
+            best.clear();
+            FuzzyMatchNames(arena, records.nameOffsets, 0, count, pattern, nullptr, best, &matches);
+            return best.size();
+        };
+
+        BENCHMARK(std::string("pool \"") + query + "\"") {
+            best.clear();
+            FuzzyMatchNames(pool, arena, records.nameOffsets, 0, count, pattern, nullptr, best, &matches);
+            return best.size();
+        };
+
+        WARN("\"" << query << "\": " << matches.count() << " matches");
+    }
+}
+
+TEST_CASE("Traverse directory tree", "[.][benchmark]") {
+    // ~100k files in ~1k directories
+    std_fs::path root = getDirectoryTree(32, 32, 100);
+    Path rootPath(root.u8string());
+
+    BENCHMARK("std::filesystem::recursive_directory_iterator") {
+        size_t numDirectories = 0;
+        for(const auto& entry : std_fs::recursive_directory_iterator(root)) {
+            numDirectories += entry.is_directory();
+        }
+        return numDirectories;
+    };
+
+    for(size_t numThreads = 1; numThreads <= WorkStealingPool::defaultThreadCount(); numThreads *= 2) {
+        WorkStealingPool pool(numThreads);
+
+        BENCHMARK("traverseDirectory " + std::to_string(numThreads) + " threads") {
+            std::atomic<size_t> numEntries{ 0 };
+            FileSystem::traverseDirectory(pool, rootPath, FileSystem::TraverseOptions{}, [&](const FileSystem::TraverseBatch& batch) {
+                numEntries += batch.entries.size();
+            });
+            return numEntries.load();
+        };
+    }
+}
+
+TEST_CASE("Directory tree memory per entry", "[.][benchmark]") {
+    std_fs::path root = getDirectoryTree(32, 32, 100);
+    Path rootPath(root.u8string());
+
+    WorkStealingPool pool;
+    FileSystem::DirectoryTree tree;
+    tree.build(pool, rootPath);
+
+    // what the same result cost as one Path per entry
+    size_t pathBytes = 0;
+    std::string pathStr;
+    for(uint32_t node = 0; node < tree.size(); node++) {
+        tree.buildPath(node, pathStr);
+        Path path(pathStr);
+        pathBytes += sizeof(Path) + path.str().capacity() + path.getSegments().capacity() * sizeof(std::string_view);
+    }
+
+    const double treeBytesPerEntry = static_cast<double>(tree.memoryUsage()) / tree.size();
+    const double pathBytesPerEntry = static_cast<double>(pathBytes) / tree.size();
+    WARN(tree.size() << " entries: " << treeBytesPerEntry << " bytes per tree node, " << pathBytesPerEntry << " bytes per Path");
+
+    BENCHMARK("DirectoryTree::build") {
+        tree.build(pool, rootPath);
+        return tree.size();
+    };
+
+    BENCHMARK("DirectoryTree::buildPath for every node") {
+        size_t totalLength = 0;
+        for(uint32_t node = 0; node < tree.size(); node++) {
+            tree.buildPath(node, pathStr);
+            totalLength += pathStr.size();
+        }
+        return totalLength;
+    };
+}
+
+TEST_CASE("Find in directory tree", "[.][benchmark]") {
+    std_fs::path root = getDirectoryTree(32, 32, 100);
+    Path rootPath(root.u8string());
+
+    // how long the results view stays empty, and how long until the whole tree was looked at
+    for(const std::vector<std::string>& args : std::vector<std::vector<std::string>>{ { "99" }, { "*7" }, { "re:^1[0-9]$" }, { "99", "mtime<1d" } }) {
+        FindQuery query;
+        REQUIRE(ParseFindQuery(args, FileSystem::getCurrentFileTime(), query));
+
+        FileFinder finder;
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(finder.start(rootPath, query));
+
+        std::chrono::duration<double, std::milli> firstResult{ 0 };
+        while(finder.isSearching()) {
+            finder.update();
+            if(firstResult.count() == 0 && finder.numResults() > 0) {
+                firstResult = std::chrono::steady_clock::now() - start;
+            }
+            std::this_thread::yield();
+        }
+        const std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+
+        WARN("find " << query.text << ": first result " << firstResult.count() << " ms, " << finder.numResults() << " results in "
+            << total.count() << " ms over " << finder.numDirectoriesSearched() << " directories");
+    }
+}
+
+TEST_CASE("File index of a directory tree", "[.][benchmark]") {
+    std_fs::path root = getDirectoryTree(32, 32, 100);
+    Path rootPath(root.u8string());
+    const Path indexPath((BENCHMARK_PATH / "file_index.idx").u8string());
+
+    WorkStealingPool pool;
+    FileSystem::DirectoryTree tree;
+    REQUIRE(tree.build(pool, rootPath));
+
+    // the index on its own, the walk is what "Traverse directory tree" measures
+    for(size_t numThreads = 1; numThreads <= WorkStealingPool::defaultThreadCount(); numThreads *= 2) {
+        WorkStealingPool buildPool(numThreads);
+
+        BENCHMARK("build from a walked tree, " + std::to_string(numThreads) + " threads") {
+            FileIndex index;
+            index.build(tree, &buildPool);
+            return index.imageSize();
+        };
+    }
+
+    FileIndex index;
+    REQUIRE(index.build(pool, rootPath));
+
+    BENCHMARK("save") {
+        return index.save(indexPath, &pool);
+    };
+
+    // what a start with a saved index costs instead of a walk
+    BENCHMARK("load") {
+        FileIndex loaded;
+        loaded.load(indexPath);
+        return loaded.numEntries();
+    };
+
+    FileIndex loaded;
+    REQUIRE(loaded.load(indexPath));
+    for(const char* needle : { "9", "99", "999", "no such name" }) {
+        std::vector<uint32_t> nodes;
+        BENCHMARK(std::string("substring \"") + needle + "\"") {
+            nodes.clear();
+            loaded.findSubstring(needle, SubstringCase::AsciiInsensitive, nodes, SIZE_MAX, &pool);
+            return nodes.size();
+        };
+
+        BENCHMARK(std::string("prefix \"") + needle + "\"") {
+            nodes.clear();
+            loaded.findPrefix(needle, SubstringCase::AsciiInsensitive, nodes);
+            return nodes.size();
+        };
+    }
+
+    // a directory of 100 files reported as changed, and queries with the changes next to the image
+    const std::string directory = rootPath.str() + Path::SEPARATOR + "0" + Path::SEPARATOR + "0";
+    REQUIRE(loaded.findPath(directory) != FileIndex::NO_NODE);
+    std::vector<std::string> names;
+    for(int i = 0; i < 100; i++) {
+        names.push_back(std::to_string(i));
+    }
+    BENCHMARK("apply 100 changes") {
+        return loaded.applyChanges(pool, directory, names);
+    };
+
+    BENCHMARK("rescan a directory of 100") {
+        return loaded.rescan(pool, directory);
+    };
+
+    std::vector<uint32_t> nodes;
+    BENCHMARK("substring \"99\" with changes") {
+        nodes.clear();
+        loaded.findSubstring("99", SubstringCase::AsciiInsensitive, nodes, SIZE_MAX, &pool);
+        return nodes.size();
+    };
+
+    WARN("file index of " << loaded.numEntries() << " entries: " << loaded.imageSize() / 1024 << " kB image, "
+        << loaded.changesMemoryUsage() / 1024 << " kB of changes after " << loaded.numChanges() << " of them");
+    std_fs::remove(indexPath.str());
+}
+
+// text files of a few hundred lines that look like source, a few with a line matching "needle_42"
+static std_fs::path getTextTree(size_t numTop, size_t numSub, size_t numFiles) {
+    std_fs::path root = BENCHMARK_PATH / ("text_tree_" + std::to_string(numTop) + "x" + std::to_string(numSub) + "x" + std::to_string(numFiles));
+    std_fs::path lastFile = root / std::to_string(numTop - 1) / std::to_string(numSub - 1) / (std::to_string(numFiles - 1) + ".cpp");
+
+    if(std_fs::exists(lastFile)) return root;
+
+    std::mt19937 rng(7);
+    for(size_t top = 0; top < numTop; top++) {
+        for(size_t sub = 0; sub < numSub; sub++) {
+            std_fs::path dir = root / std::to_string(top) / std::to_string(sub);
+            std_fs::create_directories(dir);
+            for(size_t i = 0; i < numFiles; i++) {
+                std::ofstream outputFile((dir / (std::to_string(i) + ".cpp")).u8string(), std::ios::binary);
+                for(int line = 0; line < 400; line++) {
+                    outputFile << "    const size_t value" << rng() % 1000 << " = computeSomething(input, " << rng() % 100 << "); // a comment\n";
+                }
+                if(rng() % 50 == 0) {
+                    outputFile << "    return needle_42;\n";
+                }
+            }
+        }
+    }
+
+    return root;
+}
+
+TEST_CASE("Grep text", "[.][benchmark]") {
+    // 16 MB of source-like lines with a match every 1000 of them
+    std::string text;
+    std::mt19937 rng(3);
+    for(int line = 0; text.size() < 16 * 1024 * 1024; line++) {
+        text += "    const size_t value" + std::to_string(rng() % 1000) + " = computeSomething(input, 42); // a comment";
+        text += line % 1000 == 999 ? " Needle_42\n" : "\n";
+    }
+    const double megabytes = text.size() / (1024.0 * 1024.0);
+
+    const std::pair<SubstringKernel, const char*> kernels[] = {
+        { SubstringKernel::Scalar, "scalar" },
+        { SubstringKernel::Sse2, "SSE2" },
+        { SubstringKernel::Avx2, "AVX2" },
+    };
+    for(const auto& [kernel, kernelName] : kernels) {
+        if(!IsSubstringKernelSupported(kernel)) continue;
+
+        BENCHMARK(std::string("CountNewlines ") + kernelName + " (" + std::to_string(static_cast<int>(megabytes)) + " MB)") {
+            return CountNewlines(text, kernel);
+        };
+    }
+
+    std::vector<GrepLineMatch> lines;
+    for(const std::vector<std::string>& args : std::vector<std::vector<std::string>>{ { "needle_42" }, { "Needle_42" }, { "re:Need[a-z]+_42" }, { "re:N[a-z]+_42" } }) {
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery(args, query));
+        GrepMatcher matcher(query);
+
+        BENCHMARK("searchText " + query.text) {
+            lines.clear();
+            return matcher.searchText(text, lines);
+        };
+    }
+}
+
+TEST_CASE("Grep in directory tree", "[.][benchmark]") {
+    std_fs::path root = getTextTree(16, 16, 40);
+    Path rootPath(root.u8string());
+
+    // how long the results view stays empty, and how fast the whole tree goes by
+    for(const std::vector<std::string>& args : std::vector<std::vector<std::string>>{ { "needle_42" }, { "re:need[a-z]+_42" }, { "needle_42", "files=*.h" } }) {
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery(args, query));
+
+        ContentSearcher searcher;
+        const auto start = std::chrono::steady_clock::now();
+        REQUIRE(searcher.start(rootPath, {}, query));
+
+        std::chrono::duration<double, std::milli> firstResult{ 0 };
+        while(searcher.isSearching()) {
+            searcher.update();
+            if(firstResult.count() == 0 && searcher.numResults() > 0) {
+                firstResult = std::chrono::steady_clock::now() - start;
+            }
+            std::this_thread::yield();
+        }
+        const std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+
+        WARN("grep " << query.text << ": first result " << firstResult.count() << " ms, " << searcher.numResults() << " lines in "
+            << total.count() << " ms over " << searcher.numFilesSearched() << " files, " << searcher.bytesPerSecond() / 1e9 << " GB/s");
+    }
+}
+
+TEST_CASE("Content index of a text tree", "[.][benchmark]") {
+    std_fs::path root = getTextTree(16, 16, 40);
+    Path rootPath(root.u8string());
+    const Path indexPath((BENCHMARK_PATH / "content_index.cidx").u8string());
+
+    WorkStealingPool pool;
+    ContentIndex::removeFiles(indexPath);
+
+    // from scratch every time, nothing left to pick up
+    BENCHMARK("build") {
+        ContentIndex index;
+        index.build(pool, rootPath, indexPath);
+        return index.imageSize();
+    };
+
+    BENCHMARK("load") {
+        ContentIndex loaded;
+        loaded.load(indexPath);
+        return loaded.numEntries();
+    };
+
+    ContentIndex index;
+    REQUIRE(index.load(indexPath));
+    for(const char* literal : { "needle_42", "computeSomething", "no such text" }) {
+        std::vector<uint32_t> files;
+        BENCHMARK(std::string("candidates \"") + literal + "\"") {
+            files.clear();
+            index.findCandidates(literal, files);
+            return files.size();
+        };
+    }
+
+    // grep answered from the index against one that walks and reads the whole tree
+    GrepQuery query;
+    REQUIRE(ParseGrepQuery({ "needle_42" }, query));
+    auto xGrep = [&](bool isListed) {
+        const auto start = std::chrono::steady_clock::now();
+        ContentSearcher searcher;
+        if(isListed) {
+            std::vector<uint32_t> candidates;
+            index.findCandidates(GrepMatcher(query).literal(), candidates);
+            std::vector<std::string> files;
+            for(uint32_t file : candidates) {
+                files.push_back(index.getPath(file));
+            }
+            REQUIRE(searcher.startListed(rootPath, std::move(files), query));
+        } else {
+            REQUIRE(searcher.start(rootPath, {}, query));
+        }
+        while(searcher.isSearching()) {
+            searcher.update();
+            std::this_thread::yield();
+        }
+        const std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+        WARN("grep " << query.text << (isListed ? " from the index: " : " walking: ") << searcher.numResults() << " lines in "
+            << total.count() << " ms over " << searcher.numFilesSearched() << " files");
+        return searcher.numResults();
+    };
+    REQUIRE(xGrep(true) == xGrep(false));
+
+    // a directory of 40 files copied in, as a watch would report it, and a rescan that finds nothing changed
+    const std_fs::path added = root / "added";
+    std_fs::copy(root / "0" / "0", added, std_fs::copy_options::overwrite_existing);
+    BENCHMARK("apply a new directory of 40 files") {
+        return index.applyChanges(pool, rootPath.str(), { "added" });
+    };
+
+    const std::string directory = rootPath.str() + Path::SEPARATOR + "0" + Path::SEPARATOR + "0";
+    BENCHMARK("rescan an unchanged directory of 40") {
+        return index.rescan(pool, directory);
+    };
+
+    BENCHMARK("save with changes") {
+        return index.save(indexPath, &pool);
+    };
+
+    uint64_t textSize = 0;
+    for(uint32_t file = 0; file < index.numFiles(); file++) {
+        if(!index.isRemoved(file)) textSize += index.getSize(file);
+    }
+    WARN("content index of " << index.numEntries() << " files, " << textSize / 1024 << " kB of text: " << index.imageSize() / 1024
+        << " kB image, " << index.numTrigrams() << " trigrams");
+    ContentIndex::removeFiles(indexPath);
+    std_fs::remove_all(added);
+}
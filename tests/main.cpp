@@ -1,6 +1,8 @@
 #include "StringUtils.h"
+#ifdef _WIN32
 #include <objbase.h>
 #include <combaseapi.h>
+#endif
 
 #include <catch_amalgamated.hpp>
 
@@ -10,9 +12,34 @@
 
 #include <FileSystem.h>
 #include <Path.h>
+#include <TimestampCache.h>
+#include <WorkStealingPool.h>
+#include <DirectoryTree.h>
+#include <FolderSizeService.h>
+#include <DirectoryCache.h>
+#include <DirectoryWatcher.h>
+#include <WatchRegistry.h>
+#include <NameFilter.h>
+#include <SubstringSearch.h>
+#include <FuzzyMatch.h>
+#include <FileFinder.h>
+#include <FileIndex.h>
+#include <ContentSearch.h>
+#include <ContentIndex.h>
+#include <ContentIndexService.h>
+#include <FileIndexService.h>
+#include <BitSet.h>
+#include <NaturalComparator.h>
+#include "LegacyNaturalComparator.h"
+#include <random>
+#include <map>
+#include <algorithm>
+#include <thread>
 #include <iostream>
 
 #include <chrono>
+#include <mutex>
+#include <atomic>
 
 namespace std_fs = std::filesystem;
 
@@ -57,10 +84,12 @@ void refreshTestDirectory(std_fs::path TEST_PATH) {
 }
 
 TEST_CASE( "File operations", "[simple]" ) {
+#ifdef _WIN32
     HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
     if(hr != S_OK) {
         printf("Failed to initialize COM library\n");
     }
+#endif
 
     // make a dummy test direcory
     std_fs::path TEST_PATH = std_fs::current_path() / "TEMP";
@@ -103,6 +132,183 @@ TEST_CASE( "File operations", "[simple]" ) {
         }
     }
 
+    SECTION("list sizes of files") {
+        std::ofstream(TEST_PATH / "three_bytes.txt") << "abc";
+        std_fs::create_directory(TEST_PATH / "folder");
+
+        FileSystem::SOARecord items;
+        REQUIRE(FileSystem::enumerateDirectory(TEST_PATH.u8string(), items));
+        REQUIRE(items.size() == 2);
+
+        for(size_t i = 0; i < items.size(); i++) {
+            if(items.isFile(i)) {
+                REQUIRE(items.getName(i) == "three_bytes.txt");
+                REQUIRE(items.getSize(i) == 3);
+            } else {
+                REQUIRE(items.getName(i) == "folder");
+            }
+            REQUIRE(items.getLastModifiedNumber(i) > 0);
+        }
+    }
+
+    SECTION("list names and types only") {
+        createFile(TEST_PATH / "file.txt");
+        std_fs::create_directory(TEST_PATH / "folder");
+
+        FileSystem::SOARecord items;
+        REQUIRE(FileSystem::enumerateDirectory(TEST_PATH.u8string(), items, FileSystem::ENUMERATE_NAME_AND_TYPE));
+        REQUIRE(items.size() == 2);
+
+        for(size_t i = 0; i < items.size(); i++) {
+            REQUIRE(items.isFile(i) == (items.getName(i) == "file.txt"));
+        }
+    }
+
+    SECTION("re-enumerating reuses name storage") {
+        for(int i = 0; i < 100; i++) {
+            createFile(TEST_PATH / ("file_" + std::to_string(i)));
+        }
+
+        FileSystem::SOARecord items;
+        REQUIRE(FileSystem::enumerateDirectory(TEST_PATH.u8string(), items));
+        REQUIRE(items.size() == 100);
+
+        const char* arena = items.nameArena.data();
+        const size_t memoryUsage = items.memoryUsage();
+
+        REQUIRE(FileSystem::enumerateDirectory(TEST_PATH.u8string(), items));
+        REQUIRE(items.size() == 100);
+        REQUIRE(items.nameArena.data() == arena);
+        REQUIRE(items.memoryUsage() == memoryUsage);
+
+        for(size_t i = 0; i < items.size(); i++) {
+            std::string_view name = items.getName(i);
+            REQUIRE(name.substr(0, 5) == "file_");
+            REQUIRE(name.data()[name.size()] == '\0');
+        }
+    }
+
+    SECTION("enumerate in chunks") {
+        std::vector<std::string> expectedNames;
+        for(int i = 0; i < 100; i++) {
+            expectedNames.push_back("file_" + std::to_string(i));
+            createFile(TEST_PATH / expectedNames.back());
+        }
+
+        FileSystem::SOARecord items;
+        FileSystem::DirectoryEnumerator enumerator;
+        REQUIRE(enumerator.open(TEST_PATH.u8string()));
+
+        size_t numChunks = 0;
+        while(!enumerator.isDone()) {
+            size_t numAdded = enumerator.next(items, 7);
+            REQUIRE(numAdded <= 7);
+            REQUIRE(items.size() <= 100);
+            numChunks++;
+        }
+
+        REQUIRE(numChunks >= 100 / 7);
+
+        std::vector<std::string> actualNames;
+        for(size_t i = 0; i < items.size(); i++) {
+            actualNames.push_back(std::string(items.getName(i)));
+        }
+        REQUIRE_THAT(actualNames, Catch::Matchers::UnorderedEquals(expectedNames));
+    }
+
+    SECTION("traverse tree in parallel") {
+        std::vector<std::string> expectedPaths;
+        for(int i = 0; i < 8; i++) {
+            std_fs::path dir = TEST_PATH / ("dir_" + std::to_string(i));
+            std_fs::create_directories(dir / "nested");
+            createFile(dir / "nested" / "file.txt");
+            expectedPaths.push_back(dir.u8string());
+            expectedPaths.push_back((dir / "nested").u8string());
+            expectedPaths.push_back((dir / "nested" / "file.txt").u8string());
+        }
+
+        WorkStealingPool pool(4);
+        FileSystem::DirectoryTree tree;
+        REQUIRE(tree.build(pool, Path(TEST_PATH.u8string())));
+        REQUIRE(tree.size() == expectedPaths.size() + 1);
+        REQUIRE(tree.getMaxDepth() == 3);
+
+        std::vector<std::string> actualPaths;
+        for(uint32_t node = 1; node < tree.size(); node++) {
+            // level order: parents come first and depths are contiguous
+            REQUIRE(tree.getParent(node) < node);
+            REQUIRE(tree.getDepth(node) >= tree.getDepth(node - 1));
+            actualPaths.push_back(tree.getPath(node));
+        }
+        REQUIRE_THAT(actualPaths, Catch::Matchers::UnorderedEquals(expectedPaths));
+
+        FileSystem::DirectoryTree::NodeRange files = tree.getDepthRange(3);
+        REQUIRE(files.end - files.begin == 8);
+        REQUIRE(tree.getName(files.begin) == "file.txt");
+
+        std::vector<uint32_t> subtree;
+        tree.forEachInSubtree(tree.getChildren(FileSystem::DirectoryTree::ROOT).begin, [&](uint32_t node) {
+            subtree.push_back(node);
+            return true;
+        });
+        REQUIRE(subtree.size() == 3);
+
+        std::vector<uint32_t> matches;
+        tree.search("nest", matches);
+        REQUIRE(matches.size() == 8);
+
+        REQUIRE_FALSE(tree.build(pool, Path((TEST_PATH / "missing").u8string())));
+    }
+
+    SECTION("traverse with depth limit and filter") {
+        std_fs::create_directories(TEST_PATH / "keep" / "deeper");
+        std_fs::create_directories(TEST_PATH / "node_modules" / "package");
+        createFile(TEST_PATH / "keep" / "deeper" / "too_deep.txt");
+
+        WorkStealingPool pool(2);
+        FileSystem::TraverseOptions options;
+        options.maxDepth = 1;
+        options.filter = [](std::string_view name, int) { return name != "node_modules"; };
+
+        std::mutex outputMutex;
+        std::vector<std::string> names;
+        int maxDepth = 0;
+        REQUIRE(FileSystem::traverseDirectory(pool, Path(TEST_PATH.u8string()), options, [&](const FileSystem::TraverseBatch& batch) {
+            std::scoped_lock<std::mutex> lock(outputMutex);
+            maxDepth = std::max(maxDepth, batch.depth);
+            for(size_t i = 0; i < batch.entries.size(); i++) {
+                names.push_back(std::string(batch.entries.getName(i)));
+            }
+        }));
+
+        REQUIRE(maxDepth == 1);
+        REQUIRE_THAT(names, Catch::Matchers::UnorderedEquals(std::vector<std::string>({ "keep", "deeper" })));
+    }
+
+#ifndef _WIN32
+    SECTION("traverse stops at symlink cycles") {
+        std_fs::create_directories(TEST_PATH / "a" / "b");
+        std_fs::create_directory_symlink(TEST_PATH / "a", TEST_PATH / "a" / "b" / "loop");
+
+        WorkStealingPool pool(2);
+        FileSystem::TraverseOptions options;
+
+        std::atomic<size_t> numDirectories{ 0 };
+        auto xCount = [&](const FileSystem::TraverseBatch&) { numDirectories++; };
+
+        // links aren't followed by default
+        REQUIRE(FileSystem::traverseDirectory(pool, Path(TEST_PATH.u8string()), options, xCount));
+        REQUIRE(numDirectories == 3);
+
+        // following them visits every real directory once
+        numDirectories = 0;
+        options.followSymlinks = true;
+        REQUIRE(FileSystem::traverseDirectory(pool, Path(TEST_PATH.u8string()), options, xCount));
+        REQUIRE(numDirectories == 3);
+    }
+#endif
+
+#ifdef _WIN32
     SECTION("delete file") {
         std_fs::path fileToDelete = TEST_PATH / "delete_me.txt";
 
@@ -251,11 +457,14 @@ TEST_CASE( "File operations", "[simple]" ) {
         REQUIRE_THAT(getFilenamesInDirectory(targetPath), Catch::Matchers::UnorderedEquals(std::vector<std::string>({ "test1.txt", "somefile" })));
         REQUIRE_THAT(getFilenamesInDirectory(TEST_PATH), Catch::Matchers::UnorderedEquals(std::vector<std::string>({ "target", "test1.txt" })));
     }
+#endif
 
     if(std_fs::exists(TEST_PATH)) {
         std_fs::remove_all(TEST_PATH);
     }
+#ifdef _WIN32
     CoUninitialize();
+#endif
 }
 
 TEST_CASE("Path", "[simple]") {
@@ -284,11 +493,35 @@ TEST_CASE("Path", "[simple]") {
         REQUIRE(path.getSegments().empty());
     }
 
+#ifdef _WIN32
     SECTION("Separator") {
         const std::string expected = "C:\\abs\\path";
         REQUIRE(Path("C:/abs/path").str()   == expected);
         REQUIRE(Path("C:\\abs\\path").str() == expected);
     }
+#else
+    SECTION("POSIX root") {
+        Path path("/home/user");
+        REQUIRE(path.getType() == Path::PathType::PATH_ABSOLUTE);
+
+        std::vector<std::string_view> expectedSegments = { "/", "home", "user" };
+        REQUIRE_THAT(path.getSegments(), Catch::Matchers::Equals(expectedSegments));
+
+        path.popSegment();
+        REQUIRE(path.str() == "/home");
+
+        path.popSegment();
+        REQUIRE(path.str() == "/");
+        REQUIRE(path.getSegmentCount() == 1);
+
+        path.appendName("tmp");
+        REQUIRE(path.str() == "/tmp");
+
+        path.popSegment();
+        path.popSegment();
+        REQUIRE(path.isEmpty());
+    }
+#endif
 
     SECTION("Convert to absolute") {
         std::string expectedAbsolute = std_fs::current_path().u8string();
@@ -367,6 +600,7 @@ TEST_CASE("Path", "[simple]") {
         REQUIRE_THAT(path.getSegments(), Catch::Matchers::Equals(expectedSegments));
     }
 
+#ifdef _WIN32
     SECTION("Append path") {
         Path path("C:/abs");
         Path rel("./relative/");
@@ -376,6 +610,7 @@ TEST_CASE("Path", "[simple]") {
         REQUIRE(path.str() == "C:\\abs\\relative");
         REQUIRE(path.getSegments().size() == 3);
     }
+#endif
 
     SECTION("File Extension") {
         const std::string txtExtension(".txt");
@@ -388,3 +623,2645 @@ TEST_CASE("Path", "[simple]") {
     }
 
 }
+
+TEST_CASE("Folder size service", "[simple]") {
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_FOLDER_SIZES";
+    refreshTestDirectory(TEST_PATH);
+
+    std_fs::create_directories(TEST_PATH / "a" / "b");
+    std::ofstream(TEST_PATH / "top.txt") << "12345";
+    std::ofstream(TEST_PATH / "a" / "a.txt") << "123";
+    std::ofstream(TEST_PATH / "a" / "b" / "b.txt") << "12";
+
+    FolderSizeService service(2);
+
+    auto xModifiedTime = [&](const std_fs::path& path) {
+        FileSystem::SOARecord records;
+        FileSystem::enumerateDirectory(Path(path.parent_path().u8string()), records);
+        for(size_t i = 0; i < records.size(); i++) {
+            if(records.getName(i) == path.filename().u8string()) return records.getLastModifiedNumber(i);
+        }
+        return uint64_t(0);
+    };
+
+    auto xWaitForSize = [&](const std_fs::path& path, uint64_t& out_Size) {
+        const std::string pathStr = Path(path.u8string()).str();
+        const uint64_t lastModified = xModifiedTime(path);
+        service.request(pathStr, lastModified);
+        for(int i = 0; i < 500; i++) {
+            if(service.lookup(pathStr, lastModified, out_Size)) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+
+    uint64_t size = 0;
+    REQUIRE(xWaitForSize(TEST_PATH / "a", size));
+    REQUIRE(size == 5);
+
+    // the subtree totals were cached along the way
+    REQUIRE(service.numCachedDirectories() == 2);
+
+    REQUIRE(xWaitForSize(TEST_PATH, size));
+    REQUIRE(size == 10);
+
+    // a new entry changes b's modification time, so its cached total no longer counts
+    std::ofstream(TEST_PATH / "a" / "b" / "more.txt") << "1234";
+    service.invalidate(Path((TEST_PATH / "a" / "b").u8string()).str());
+    REQUIRE(xWaitForSize(TEST_PATH, size));
+    REQUIRE(size == 14);
+
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Directory cache", "[simple]") {
+    auto xListing = [](size_t numEntries) {
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < numEntries; i++) {
+            records.add("entry_" + std::to_string(i), 0, i, 0);
+        }
+        return std::make_shared<const FileSystem::SOARecord>(std::move(records));
+    };
+
+    DirectoryCache cache;
+
+    SECTION("snapshots are valid for their change stamp only") {
+        DirectoryCache::Snapshot listing = xListing(3);
+        cache.insert("dir", 10, listing);
+
+        REQUIRE(cache.find("dir", 10) == listing);
+        REQUIRE(cache.find("dir", 11) == nullptr);
+        REQUIRE(cache.find("other", 10) == nullptr);
+        REQUIRE(cache.memoryUsage() == listing->memoryUsage());
+    }
+
+    SECTION("least recently used snapshots are evicted first") {
+        DirectoryCache::Snapshot first = xListing(100);
+        cache.setCapacity(first->memoryUsage() * 2);
+
+        cache.insert("first", 1, first);
+        cache.insert("second", 1, xListing(100));
+        REQUIRE(cache.find("first", 1) != nullptr);
+
+        cache.insert("third", 1, xListing(100));
+        REQUIRE(cache.numSnapshots() == 2);
+        REQUIRE(cache.find("first", 1) != nullptr);
+        REQUIRE(cache.find("second", 1) == nullptr);
+        REQUIRE(cache.find("third", 1) != nullptr);
+
+        // an evicted snapshot stays alive for whoever holds it
+        cache.setCapacity(0);
+        REQUIRE(cache.numSnapshots() == 0);
+        REQUIRE(cache.memoryUsage() == 0);
+        REQUIRE(first->size() == 100);
+    }
+
+    SECTION("concurrent acquires load a directory once") {
+        bool shouldLoad = false;
+        REQUIRE(cache.acquire("dir", 1, nullptr, shouldLoad) == nullptr);
+        REQUIRE(shouldLoad);
+
+        DirectoryCache::Snapshot listing = xListing(5);
+        DirectoryCache::Snapshot waited;
+        bool waiterShouldLoad = true;
+        std::thread waiter([&]() { waited = cache.acquire("dir", 1, nullptr, waiterShouldLoad); });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        cache.insert("dir", 1, listing);
+        waiter.join();
+
+        REQUIRE(waited == listing);
+        REQUIRE_FALSE(waiterShouldLoad);
+
+        // a changed directory goes back to the caller
+        REQUIRE(cache.acquire("dir", 2, nullptr, shouldLoad) == nullptr);
+        REQUIRE(shouldLoad);
+
+        // the old snapshot is kept when the reload doesn't happen
+        cache.abandon("dir");
+        REQUIRE(cache.find("dir", 1) == listing);
+    }
+
+    SECTION("cancelled acquires stop waiting") {
+        bool shouldLoad = false;
+        REQUIRE(cache.acquire("dir", 1, nullptr, shouldLoad) == nullptr);
+
+        REQUIRE(cache.acquire("dir", 1, []() { return true; }, shouldLoad) == nullptr);
+        REQUIRE_FALSE(shouldLoad);
+
+        cache.abandon("dir");
+        REQUIRE(cache.acquire("dir", 1, nullptr, shouldLoad) == nullptr);
+        REQUIRE(shouldLoad);
+    }
+}
+
+TEST_CASE("Watch registry", "[simple]") {
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_WATCHES";
+    refreshTestDirectory(TEST_PATH);
+    std_fs::create_directory(TEST_PATH / "sub");
+
+    const std::string path = Path(TEST_PATH.u8string()).str();
+    WatchRegistry registry;
+
+    // notifications may take a moment to arrive
+    auto xWaitForChange = [&](uint64_t generation) {
+        for(int i = 0; i < 200; i++) {
+            if(registry.poll(path) != generation) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+
+    SECTION("subscribers share one watch") {
+        uint64_t first = 0, second = 0;
+        REQUIRE(registry.subscribe(path, first));
+        REQUIRE(registry.subscribe(path, second));
+        REQUIRE(first == second);
+        REQUIRE(registry.numWatches() == 1);
+        REQUIRE(registry.numSubscribers(path) == 2);
+
+        // one change is one new generation, whoever polls it
+        std::ofstream(TEST_PATH / "new.txt") << "1";
+        REQUIRE(xWaitForChange(first));
+        const uint64_t changed = registry.poll(path);
+        REQUIRE(registry.poll(path) == changed);
+
+        // the watch outlives its subscribers so a revisit can trust what it cached
+        registry.unsubscribe(path);
+        registry.unsubscribe(path);
+        REQUIRE(registry.numSubscribers(path) == 0);
+        REQUIRE(registry.numWatches() == 1);
+
+        uint64_t again = 0;
+        REQUIRE(registry.subscribe(path, again));
+        REQUIRE(again == changed);
+        registry.unsubscribe(path);
+    }
+
+    SECTION("changes while idle show up on the next subscribe") {
+        uint64_t generation = 0;
+        REQUIRE(registry.subscribe(path, generation));
+        registry.unsubscribe(path);
+
+        std_fs::remove(TEST_PATH / "sub");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        uint64_t again = 0;
+        REQUIRE(registry.subscribe(path, again));
+        REQUIRE(again != generation);
+        registry.unsubscribe(path);
+    }
+
+    SECTION("changed entries are logged by name") {
+        uint64_t generation = 0;
+        REQUIRE(registry.subscribe(path, generation));
+
+        std::vector<std::string> names;
+        uint64_t current = 0;
+        REQUIRE(registry.changesSince(path, generation, names, current));
+        REQUIRE(names.empty());
+        REQUIRE(current == generation);
+
+        std::ofstream(TEST_PATH / "new.txt") << "1";
+        std_fs::remove(TEST_PATH / "sub");
+        REQUIRE(xWaitForChange(generation));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        REQUIRE(registry.changesSince(path, generation, names, current));
+        REQUIRE(current == registry.poll(path));
+        REQUIRE(std::find(names.begin(), names.end(), "new.txt") != names.end());
+        REQUIRE(std::find(names.begin(), names.end(), "sub") != names.end());
+
+        // nothing new since then
+        names.clear();
+        REQUIRE(registry.changesSince(path, current, names, current));
+        REQUIRE(names.empty());
+
+        // from before the watch existed nothing is known
+        REQUIRE_FALSE(registry.changesSince(path, 0, names, current));
+        registry.unsubscribe(path);
+    }
+
+    SECTION("missing directories can't be watched") {
+        uint64_t generation = 0;
+        REQUIRE_FALSE(registry.subscribe(Path((TEST_PATH / "missing").u8string()).str(), generation));
+        REQUIRE(registry.poll(Path((TEST_PATH / "missing").u8string()).str()) == 0);
+    }
+
+    SECTION("watchers on the same directory all pick up a change") {
+        std::vector<DirectoryWatcher> watchers(2);
+        for(DirectoryWatcher& watcher : watchers) {
+            watcher.changeDirectory(Path(path));
+        }
+
+        auto xWaitFor = [&](size_t numEntries) {
+            for(int i = 0; i < 500; i++) {
+                bool done = true;
+                for(DirectoryWatcher& watcher : watchers) {
+                    watcher.update();
+                    done &= watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == numEntries;
+                }
+                if(done) return true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return false;
+        };
+
+        REQUIRE(xWaitFor(1));
+        REQUIRE(WatchRegistry::shared().numSubscribers(path) == 2);
+
+        std::ofstream(TEST_PATH / "new.txt") << "1";
+        REQUIRE(xWaitFor(2));
+
+        std_fs::remove(TEST_PATH / "new.txt");
+        REQUIRE(xWaitFor(1));
+        for(DirectoryWatcher& watcher : watchers) {
+            REQUIRE(watcher.mRecords.getName(0) == "sub");
+        }
+
+        watchers.clear();
+        REQUIRE(WatchRegistry::shared().numSubscribers(path) == 0);
+    }
+
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Natural sort keys", "[simple]") {
+    std::vector<std::string> names = {
+        "", "a", "A", "b", "ab", "a b", "a-1", "a.txt", "a1", "a01", "a001", "a1b", "a1a", "a2", "a10", "a9",
+        "1", "01", "10", "2", "007", "1a", "10a", "file_1", "file_2", "file_10", "file_", "file", "~x",
+        "99999999999999999999", "100000000000000000000", "x\xC3\xA9", "x\xC3\xA8", "x1.2.3", "x1.10.3",
+    };
+
+    // random names over a small alphabet hit equal prefixes and digit runs of every length
+    std::mt19937 random(1234);
+    const std::string alphabet = "aaB.-_0123456789";
+    for(int i = 0; i < 3000; i++) {
+        std::string name;
+        const int length = random() % 8;
+        for(int c = 0; c < length; c++) {
+            name.push_back(alphabet[random() % alphabet.size()]);
+        }
+        names.push_back(name);
+    }
+
+    auto xKey = [](std::string_view name) {
+        std::vector<char> key;
+        AppendNaturalSortKey(name, key);
+        return std::string(key.begin(), key.end());
+    };
+
+    SECTION("keys compare like the comparator") {
+        for(size_t i = 0; i < 200; i++) {
+            for(size_t j = 0; j < names.size(); j++) {
+                const bool isGreater = NaturalComparator(names[i], names[j]);
+                const bool isKeyGreater = xKey(names[i]) > xKey(names[j]);
+                if(isGreater != isKeyGreater) FAIL(names[i] << " vs " << names[j]);
+            }
+        }
+    }
+
+    SECTION("sortByName matches the comparator") {
+        FileSystem::SOARecord records;
+        for(const std::string& name : names) {
+            records.add(name, 0, 0, 0);
+        }
+
+        for(FileSystem::SortDirection direction : { FileSystem::SortDirection::Ascending, FileSystem::SortDirection::Descending }) {
+            // listings fold case
+            std::vector<size_t> expected = records.indexes;
+            std::stable_sort(expected.begin(), expected.end(), [&](size_t lhs, size_t rhs) {
+                return direction == FileSystem::SortDirection::Ascending
+                    ? NaturalComparator(records.getRecordName(rhs), records.getRecordName(lhs), CaseFolding::Unicode)
+                    : NaturalComparator(records.getRecordName(lhs), records.getRecordName(rhs), CaseFolding::Unicode);
+            });
+
+            records.sortByName(direction);
+            REQUIRE(records.indexes == expected);
+        }
+
+        // records added after a sort get their keys on the next one
+        records.add("a0", 0, 0, 0);
+        records.sortByName(FileSystem::SortDirection::Ascending);
+        REQUIRE(records.sortKeyOffsets.size() == records.nameOffsets.size());
+    }
+}
+
+TEST_CASE("Natural compare", "[simple]") {
+    auto xSign = [](int order) { return (order > 0) - (order < 0); };
+
+    auto xKey = [](std::string_view name, CaseFolding folding) {
+        std::vector<char> key;
+        AppendNaturalSortKey(name, key, folding);
+        return std::string(key.begin(), key.end());
+    };
+
+    // random names over an alphabet with digits, case pairs, multi byte characters and stray bytes, many sharing
+    // a prefix longer than a SIMD block
+    std::mt19937 random(77);
+    const std::vector<std::string> pieces = {
+        "a", "A", "b", "B", "-", ".", " ", "0", "1", "2", "9", "00", "\xC3\xA4", "\xC3\x84", "\xCF\x83", "\xCF\x82", "\xCE\xA3",
+        "\xE2\x84\xAA", "k", "\xC8\xBA", "\xE2\xB1\xA5", "\xFF", "\xC3",
+    };
+    const std::string sharedPrefix = "Quarterly Report 2023 - Final_";
+
+    std::vector<std::string> names;
+    for(int i = 0; i < 1500; i++) {
+        std::string name = random() % 2 == 0 ? sharedPrefix : "";
+        const int length = random() % 7;
+        for(int p = 0; p < length; p++) {
+            name += pieces[random() % pieces.size()];
+        }
+        names.push_back(name);
+    }
+
+    SECTION("same order as the old comparator without leading zeros or folding") {
+        auto xHasLeadingZero = [](const std::string& name) {
+            for(size_t i = 0; i < name.size(); i++) {
+                if(name[i] == '0' && (i == 0 || !IsAsciiDigit(name[i - 1]))) return true;
+            }
+            return false;
+        };
+
+        for(size_t i = 0; i < 300; i++) {
+            if(xHasLeadingZero(names[i])) continue;
+            for(size_t j = 0; j < names.size(); j++) {
+                if(xHasLeadingZero(names[j])) continue;
+                if(LegacyNaturalComparator(names[i], names[j]) != NaturalComparator(names[i], names[j])) FAIL(names[i] << " vs " << names[j]);
+            }
+        }
+    }
+
+    SECTION("consistent and matching the sort keys in every mode") {
+        for(CaseFolding folding : { CaseFolding::None, CaseFolding::Ascii, CaseFolding::Unicode }) {
+            std::vector<std::string> keys;
+            for(const std::string& name : names) {
+                keys.push_back(xKey(name, folding));
+            }
+
+            for(size_t i = 0; i < 300; i++) {
+                for(size_t j = 0; j < names.size(); j++) {
+                    const int order = xSign(NaturalCompare(names[i], names[j], folding));
+                    if(order != -xSign(NaturalCompare(names[j], names[i], folding))) FAIL("not antisymmetric: " << names[i] << " vs " << names[j]);
+                    if(order != xSign(keys[i].compare(keys[j]))) FAIL("key differs: " << names[i] << " vs " << names[j]);
+                }
+            }
+
+            // a sorted list is ordered between every neighbour
+            std::vector<std::string> sorted = names;
+            std::sort(sorted.begin(), sorted.end(), [&](const std::string& lhs, const std::string& rhs) { return NaturalCompare(lhs, rhs, folding) < 0; });
+            for(size_t i = 1; i < sorted.size(); i++) {
+                REQUIRE(NaturalCompare(sorted[i - 1], sorted[i], folding) <= 0);
+            }
+        }
+    }
+
+    SECTION("leading zeros and long digit runs") {
+        REQUIRE(NaturalCompare("1", "01") < 0);
+        REQUIRE(NaturalCompare("01", "001") < 0);
+        REQUIRE(NaturalCompare("001", "2") < 0);
+        REQUIRE(NaturalCompare("0", "00") < 0);
+        REQUIRE(NaturalCompare("00", "1") < 0);
+        // zeros only decide when everything else is equal
+        REQUIRE(NaturalCompare("a01b", "a1c") < 0);
+        REQUIRE(NaturalCompare("a1b01", "a01b1") < 0);
+        REQUIRE(NaturalCompare("007", "10") < 0);
+
+        const std::string big = "123456789012345678901234567890";
+        REQUIRE(NaturalCompare(big, big + "1") < 0);
+        REQUIRE(NaturalCompare("x" + big, "x0" + big) < 0);
+        REQUIRE(NaturalCompare("x" + big + "1", "x" + big + "2") < 0);
+
+        // runs too long for a two byte length in the key
+        const std::string huge(70000, '7');
+        const std::string hugeAndOne = huge + "7";
+        REQUIRE(NaturalCompare(huge, hugeAndOne) < 0);
+        REQUIRE(xKey(huge, CaseFolding::None) < xKey(hugeAndOne, CaseFolding::None));
+        REQUIRE(xKey("9", CaseFolding::None) < xKey(huge, CaseFolding::None));
+        REQUIRE(xKey(std::string(70000, '0') + "1", CaseFolding::None) > xKey("01", CaseFolding::None));
+    }
+
+    SECTION("case folding") {
+        REQUIRE(NaturalCompare("Readme", "readme") < 0);
+        REQUIRE(NaturalCompare("Readme", "readme", CaseFolding::Ascii) == 0);
+        REQUIRE(NaturalCompare("README.md", "readme.txt", CaseFolding::Ascii) < 0);
+        REQUIRE(NaturalCompare("\xC3\x84pfel", "\xC3\xA4pfel", CaseFolding::Ascii) != 0);
+        REQUIRE(NaturalCompare("\xC3\x84pfel", "\xC3\xA4pfel", CaseFolding::Unicode) == 0);
+        // final sigma, the Kelvin sign and a letter whose lower case takes a byte more in UTF-8
+        REQUIRE(NaturalCompare("\xCE\xA3\xCE\x91\xCE\xA3", "\xCF\x83\xCE\xB1\xCF\x82", CaseFolding::Unicode) == 0);
+        REQUIRE(NaturalCompare("\xE2\x84\xAA", "k", CaseFolding::Unicode) == 0);
+        REQUIRE(NaturalCompare("\xC8\xBA", "\xE2\xB1\xA5", CaseFolding::Unicode) == 0);
+        REQUIRE(NaturalCompare("file 2.TXT", "File 10.txt", CaseFolding::Unicode) < 0);
+    }
+}
+
+TEST_CASE("Sort by size and date", "[simple]") {
+    std::mt19937_64 random(99);
+
+    for(size_t count : { 10, 5000 }) {
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < count; i++) {
+            // few distinct sizes so stability matters, file times that share their high bytes
+            const uint64_t size = (random() % 16) << (random() % 40);
+            const uint64_t lastModified = 133000000000000000ULL + random() % 1000000000ULL;
+            records.add("file", 0, lastModified, size);
+        }
+
+        for(FileSystem::SortDirection direction : { FileSystem::SortDirection::Ascending, FileSystem::SortDirection::Descending }) {
+            const bool largestFirst = direction == FileSystem::SortDirection::Ascending;
+
+            // start from a shuffled order, the sort has to keep it among equal values
+            std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+            std::vector<size_t> expected = records.indexes;
+            std::stable_sort(expected.begin(), expected.end(), [&](size_t lhs, size_t rhs) {
+                return largestFirst ? records.sizes[lhs] > records.sizes[rhs] : records.sizes[lhs] < records.sizes[rhs];
+            });
+            records.sortBySize(direction);
+            REQUIRE(records.indexes == expected);
+
+            std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+            expected = records.indexes;
+            std::stable_sort(expected.begin(), expected.end(), [&](size_t lhs, size_t rhs) {
+                return largestFirst
+                    ? records.lastModifiedNumbers[lhs] > records.lastModifiedNumbers[rhs]
+                    : records.lastModifiedNumbers[lhs] < records.lastModifiedNumbers[rhs];
+            });
+            records.sortByLastModified(direction);
+            REQUIRE(records.indexes == expected);
+        }
+    }
+}
+
+TEST_CASE("Multi column sort", "[simple]") {
+    std::mt19937_64 random(5);
+
+    // few distinct values per column so the secondary keys decide a lot of pairs
+    FileSystem::SOARecord records;
+    for(size_t i = 0; i < 3000; i++) {
+        const int attributes = random() % 4 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+        records.add("file" + std::to_string(random() % 20), attributes, random() % 5, random() % 7);
+    }
+
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    auto xCompare = [&](const FileSystem::SortKey& key, size_t lhs, size_t rhs) {
+        switch(key.column) {
+            case SortColumn::Name:
+                {
+                    if(NaturalComparator(records.getRecordName(rhs), records.getRecordName(lhs))) return key.direction == SortDirection::Ascending ? -1 : 1;
+                    if(NaturalComparator(records.getRecordName(lhs), records.getRecordName(rhs))) return key.direction == SortDirection::Ascending ? 1 : -1;
+                    return 0;
+                }
+            default:
+                {
+                    const std::vector<uint64_t>& values = key.column == SortColumn::Size ? records.sizes : records.lastModifiedNumbers;
+                    if(values[lhs] == values[rhs]) return 0;
+                    // ascending sizes and dates are largest first
+                    return (values[lhs] > values[rhs]) == (key.direction == SortDirection::Ascending) ? -1 : 1;
+                }
+        }
+    };
+
+    const std::vector<std::vector<FileSystem::SortKey>> specs = {
+        {},
+        { { SortColumn::Size, SortDirection::Ascending } },
+        { { SortColumn::LastModified, SortDirection::Descending } },
+        { { SortColumn::Name, SortDirection::Descending } },
+        { { SortColumn::Size, SortDirection::Descending }, { SortColumn::Name, SortDirection::Ascending } },
+        { { SortColumn::Name, SortDirection::Ascending }, { SortColumn::LastModified, SortDirection::Ascending } },
+        { { SortColumn::LastModified, SortDirection::Ascending }, { SortColumn::Size, SortDirection::Descending }, { SortColumn::Name, SortDirection::Descending } },
+    };
+
+    for(const std::vector<FileSystem::SortKey>& keys : specs) {
+        for(bool directoriesFirst : { true, false }) {
+            std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+
+            std::vector<size_t> expected = records.indexes;
+            std::stable_sort(expected.begin(), expected.end(), [&](size_t lhs, size_t rhs) {
+                const bool lhsFirst = ((records.attributes[lhs] & FileSystem::FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+                const bool rhsFirst = ((records.attributes[rhs] & FileSystem::FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+                if(lhsFirst != rhsFirst) return lhsFirst;
+
+                for(const FileSystem::SortKey& key : keys) {
+                    const int order = xCompare(key, lhs, rhs);
+                    if(order != 0) return order < 0;
+                }
+                return false;
+            });
+
+            records.sort(keys, directoriesFirst);
+            REQUIRE(records.indexes == expected);
+        }
+    }
+}
+
+TEST_CASE("Parallel sort", "[simple]") {
+    std::mt19937_64 random(21);
+
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    const std::vector<std::vector<FileSystem::SortKey>> specs = {
+        {},
+        { { SortColumn::Size, SortDirection::Ascending } },
+        { { SortColumn::Name, SortDirection::Descending } },
+        { { SortColumn::LastModified, SortDirection::Ascending }, { SortColumn::Name, SortDirection::Ascending } },
+    };
+
+    // an odd thread count leaves a run without a partner in the first merge round
+    WorkStealingPool pool(3);
+
+    for(size_t count : { 5, 1000, 20000 }) {
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < count; i++) {
+            const int attributes = random() % 4 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+            records.add("file" + std::to_string(random() % 50), attributes, random() % 5, random() % 7);
+        }
+
+        for(const std::vector<FileSystem::SortKey>& keys : specs) {
+            for(bool directoriesFirst : { true, false }) {
+                std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+                const std::vector<size_t> shuffled = records.indexes;
+
+                records.sort(keys, directoriesFirst);
+                const std::vector<size_t> expected = records.indexes;
+
+                // every record equal in some key, ties have to come out in the same order too
+                records.indexes = shuffled;
+                records.sort(keys, directoriesFirst, &pool, 0);
+                REQUIRE(records.indexes == expected);
+            }
+        }
+    }
+
+    SECTION("chunks deep enough to scatter") {
+        // chunks of the name radix sort are well past its comparison sort cutoff and go several bytes deep, each
+        // one scatters in its own part of the listing and mustn't spill into another's
+        WorkStealingPool widePool(7);
+
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < 30000; i++) {
+            const int attributes = random() % 8 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+            records.add("common_prefix_" + std::to_string(random() % 3) + "_" + std::to_string(random() % 100000), attributes, random() % 1000, random() % 1000);
+        }
+
+        for(const std::vector<FileSystem::SortKey>& keys : specs) {
+            for(bool directoriesFirst : { true, false }) {
+                std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+                const std::vector<size_t> shuffled = records.indexes;
+
+                records.sort(keys, directoriesFirst);
+                const std::vector<size_t> expected = records.indexes;
+
+                records.indexes = shuffled;
+                records.sort(keys, directoriesFirst, &widePool, 0);
+                REQUIRE(records.indexes == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Partial sort", "[simple]") {
+    std::mt19937_64 random(17);
+
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    const std::vector<std::vector<FileSystem::SortKey>> specs = {
+        { { SortColumn::Name, SortDirection::Ascending } },
+        { { SortColumn::Size, SortDirection::Ascending } },
+        { { SortColumn::LastModified, SortDirection::Descending }, { SortColumn::Name, SortDirection::Ascending } },
+    };
+
+    SECTION("rows in the window match the full sort") {
+        const size_t count = 3000;
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < count; i++) {
+            const int attributes = random() % 4 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+            records.add("file" + std::to_string(random() % 50), attributes, random() % 5, random() % 7);
+        }
+
+        // top of the listing, the middle, the bottom, a window running off the end and everything
+        const std::vector<std::pair<size_t, size_t>> windows = { { 0, 40 }, { 1500, 40 }, { count - 40, 40 }, { count - 10, 40 }, { 0, count } };
+
+        for(const std::vector<FileSystem::SortKey>& keys : specs) {
+            for(bool directoriesFirst : { true, false }) {
+                std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+                const std::vector<size_t> shuffled = records.indexes;
+
+                records.sort(keys, directoriesFirst);
+                const std::vector<size_t> expected = records.indexes;
+
+                for(auto [firstRow, numRows] : windows) {
+                    records.indexes = shuffled;
+                    records.partialSort(keys, directoriesFirst, firstRow, numRows);
+
+                    // ties too, or rows on screen would trade places once the full order arrives
+                    const size_t lastRow = std::min(firstRow + numRows, count);
+                    firstRow = lastRow - std::min(numRows, count);
+                    for(size_t row = firstRow; row < lastRow; row++) {
+                        REQUIRE(records.indexes[row] == expected[row]);
+                    }
+
+                    std::vector<size_t> sorted = records.indexes;
+                    std::sort(sorted.begin(), sorted.end());
+                    for(size_t i = 0; i < count; i++) {
+                        REQUIRE(sorted[i] == i);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("watchers end up with the full order") {
+        std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_PARTIAL_SORT";
+        refreshTestDirectory(TEST_PATH);
+        for(int i = 0; i < 30; i++) {
+            std::ofstream(TEST_PATH / ("file" + std::to_string(i) + ".txt")) << std::string(i % 7, 'x');
+        }
+
+        DirectoryWatcher watcher;
+        watcher.setPartialSortThreshold(1);
+        watcher.setVisibleRows(10, 5);
+        watcher.changeDirectory(Path(TEST_PATH.u8string()));
+
+        auto xWaitForOrder = [&](const std::vector<FileSystem::SortKey>& keys) {
+            for(int i = 0; i < 500; i++) {
+                watcher.update();
+                if(watcher.status() == DirectoryStatus::READY) {
+                    FileSystem::SOARecord expected = watcher.mRecords;
+                    expected.sort(keys, keys[0].direction == SortDirection::Ascending);
+                    if(expected.indexes == watcher.mRecords.indexes) return true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return false;
+        };
+
+        REQUIRE(xWaitForOrder({ DEFAULT_SORT_KEY }));
+        REQUIRE(watcher.mRecords.size() == 30);
+
+        const std::vector<FileSystem::SortKey> bySize = { { SortColumn::Size, SortDirection::Descending } };
+        watcher.setSort(bySize);
+        REQUIRE(xWaitForOrder(bySize));
+
+        std_fs::remove_all(TEST_PATH);
+    }
+}
+
+TEST_CASE("Cancelled sort", "[simple]") {
+    std::mt19937_64 random(23);
+
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    FileSystem::SOARecord records;
+    for(size_t i = 0; i < 20000; i++) {
+        records.add("file" + std::to_string(random() % 5000), 0, random() % 1000, random() % 100000);
+    }
+    std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+    const std::vector<size_t> shuffled = records.indexes;
+
+    const std::vector<std::vector<FileSystem::SortKey>> specs = {
+        { { SortColumn::Name, SortDirection::Ascending } },
+        { { SortColumn::Size, SortDirection::Ascending } },
+        { { SortColumn::LastModified, SortDirection::Descending }, { SortColumn::Name, SortDirection::Ascending } },
+    };
+
+    WorkStealingPool pool(3);
+    std::atomic<bool> cancel{ true };
+
+    // the order stays as it was, whichever path the sort takes
+    for(const std::vector<FileSystem::SortKey>& keys : specs) {
+        REQUIRE_FALSE(records.sort(keys, true, nullptr, FileSystem::PARALLEL_SORT_THRESHOLD, &cancel));
+        REQUIRE(records.indexes == shuffled);
+
+        REQUIRE_FALSE(records.sort(keys, true, &pool, 0, &cancel));
+        REQUIRE(records.indexes == shuffled);
+
+        REQUIRE_FALSE(records.partialSort(keys, true, 100, 50, &cancel));
+        REQUIRE(records.indexes == shuffled);
+    }
+
+    cancel = false;
+    for(const std::vector<FileSystem::SortKey>& keys : specs) {
+        records.indexes = shuffled;
+        records.sort(keys, true);
+        const std::vector<size_t> expected = records.indexes;
+
+        records.indexes = shuffled;
+        REQUIRE(records.sort(keys, true, &pool, 0, &cancel));
+        REQUIRE(records.indexes == expected);
+    }
+}
+
+TEST_CASE("Listing changes", "[simple]") {
+    std::mt19937_64 random(11);
+
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    struct Entry {
+        int         attributes;
+        uint64_t    lastModified;
+        uint64_t    size;
+    };
+
+    const std::vector<std::vector<FileSystem::SortKey>> specs = {
+        { { SortColumn::Name, SortDirection::Ascending } },
+        { { SortColumn::Size, SortDirection::Descending }, { SortColumn::Name, SortDirection::Descending } },
+        { { SortColumn::LastModified, SortDirection::Ascending } },
+    };
+
+    for(const std::vector<FileSystem::SortKey>& keys : specs) {
+        const bool directoriesFirst = keys[0].direction == SortDirection::Ascending;
+
+        // what the listing should hold, the order is checked separately
+        std::map<std::string, Entry> expected;
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < 2000; i++) {
+            const Entry entry = { random() % 4 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0, random() % 5, random() % 7 };
+            const std::string name = "file" + std::to_string(i);
+            expected[name] = entry;
+            records.add(name, entry.attributes, entry.lastModified, entry.size);
+        }
+        records.sort(keys, directoriesFirst);
+
+        auto xIsOrdered = [&](size_t lhs, size_t rhs) {
+            const bool lhsFirst = ((records.attributes[lhs] & FileSystem::FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+            const bool rhsFirst = ((records.attributes[rhs] & FileSystem::FileAttributes::DIRECTORY) != 0) == directoriesFirst;
+            if(lhsFirst != rhsFirst) return lhsFirst;
+
+            for(const FileSystem::SortKey& key : keys) {
+                if(key.column == SortColumn::Name) {
+                    const std::string_view lhsName = records.getRecordName(lhs);
+                    const std::string_view rhsName = records.getRecordName(rhs);
+                    if(NaturalComparator(rhsName, lhsName)) return key.direction == SortDirection::Ascending;
+                    if(NaturalComparator(lhsName, rhsName)) return key.direction == SortDirection::Descending;
+                } else {
+                    const std::vector<uint64_t>& values = key.column == SortColumn::Size ? records.sizes : records.lastModifiedNumbers;
+                    if(values[lhs] == values[rhs]) continue;
+                    return (values[lhs] > values[rhs]) == (key.direction == SortDirection::Ascending);
+                }
+            }
+            return true;
+        };
+
+        size_t numNew = 0;
+        size_t largestRecordCount = records.nameOffsets.size();
+        for(int round = 0; round < 40; round++) {
+            std::vector<FileSystem::EntryChange> changes;
+            for(int c = 0; c < 50; c++) {
+                FileSystem::EntryChange change;
+                const int kind = random() % 4;
+                if(kind == 0) {
+                    change.name = "new" + std::to_string(numNew++);
+                } else {
+                    // existing entries mostly, sometimes one that was removed or never existed
+                    change.name = "file" + std::to_string(random() % 2200);
+                }
+
+                change.exists = kind < 2;
+                change.attributes = random() % 4 == 0 ? FileSystem::FileAttributes::DIRECTORY : 0;
+                change.lastModifiedNumber = random() % 5;
+                change.size = random() % 7;
+
+                if(change.exists) {
+                    expected[change.name] = { change.attributes, change.lastModifiedNumber, change.size };
+                } else {
+                    expected.erase(change.name);
+                }
+                changes.push_back(change);
+            }
+
+            records.applyChanges(changes, keys, directoriesFirst);
+            largestRecordCount = std::max(largestRecordCount, records.nameOffsets.size());
+
+            REQUIRE(records.size() == expected.size());
+            REQUIRE(records.numRemoved * 4 <= records.nameOffsets.size());
+            for(size_t i = 0; i < records.size(); i++) {
+                const size_t recordIdx = records.indexes[i];
+                auto it = expected.find(std::string(records.getName(i)));
+                REQUIRE(it != expected.end());
+                REQUIRE(records.attributes[recordIdx] == it->second.attributes);
+                REQUIRE(records.lastModifiedNumbers[recordIdx] == it->second.lastModified);
+                REQUIRE(records.sizes[recordIdx] == it->second.size);
+                REQUIRE(records.findRecord(it->first) == recordIdx);
+
+                if(i > 0 && !xIsOrdered(records.indexes[i - 1], recordIdx)) FAIL("out of order at " << i);
+            }
+        }
+
+        // removals got compacted along the way
+        REQUIRE(records.nameOffsets.size() < largestRecordCount);
+
+        // a patched listing sorts the same as a fresh one
+        FileSystem::SOARecord copy = records;
+        std::vector<size_t> patched = records.indexes;
+        copy.sort(keys, directoriesFirst);
+        for(size_t i = 0; i < copy.size(); i++) {
+            if(!xIsOrdered(copy.indexes[i], patched[i]) || !xIsOrdered(patched[i], copy.indexes[i])) FAIL("differs at " << i);
+        }
+    }
+}
+
+TEST_CASE("Directory watcher", "[simple]") {
+    using FileSystem::SortColumn;
+    using FileSystem::SortDirection;
+
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_DIRECTORY_WATCHER";
+    refreshTestDirectory(TEST_PATH);
+
+    // sizes go the other way than the names, so the two orders differ everywhere
+    auto xCreateFiles = [&](const std_fs::path& directory, const std::string& prefix, int count) {
+        std_fs::create_directories(directory);
+        for(int i = 0; i < count; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "%s%04d.txt", prefix.c_str(), i);
+            std::ofstream(directory / name) << std::string(count - i, 'x');
+        }
+    };
+
+    // polls update() until `xIsDone`, running `xCheck` on every state the watcher goes through
+    auto xWaitFor = [](DirectoryWatcher& watcher, auto xIsDone, auto xCheck) {
+        for(int i = 0; i < 500; i++) {
+            watcher.update();
+            xCheck();
+            if(xIsDone()) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+    auto xNoCheck = []() {};
+
+    auto xIsSortedBy = [](const DirectoryWatcher& watcher, const std::vector<FileSystem::SortKey>& keys) {
+        FileSystem::SOARecord expected = watcher.mRecords;
+        expected.sort(keys, keys[0].direction == SortDirection::Ascending);
+        return expected.indexes == watcher.mRecords.indexes;
+    };
+
+    auto xFindRow = [](const DirectoryWatcher& watcher, std::string_view name) {
+        for(size_t i = 0; i < watcher.mRecords.size(); i++) {
+            if(watcher.mRecords.getName(i) == name) return i;
+        }
+        return SIZE_MAX;
+    };
+
+    const std::vector<FileSystem::SortKey> byName = { DEFAULT_SORT_KEY };
+    const std::vector<FileSystem::SortKey> byNameDescending = { { SortColumn::Name, SortDirection::Descending } };
+    const std::vector<FileSystem::SortKey> bySize = { { SortColumn::Size, SortDirection::Ascending } };
+    const std::vector<FileSystem::SortKey> bySizeDescending = { { SortColumn::Size, SortDirection::Descending } };
+
+    SECTION("only the newest request's results are published") {
+        const std_fs::path A_PATH = TEST_PATH / "a";
+        const std_fs::path B_PATH = TEST_PATH / "b";
+        xCreateFiles(A_PATH, "a", 10);
+        xCreateFiles(B_PATH, "b", 20);
+        const Path a(A_PATH.u8string());
+        const Path b(B_PATH.u8string());
+
+        DirectoryWatcher watcher;
+        watcher.changeDirectory(b);
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == 20; }, xNoCheck));
+
+        // a change in b has the next update() ask for a refresh
+        const uint64_t generation = WatchRegistry::shared().poll(b.str());
+        createFile(B_PATH / "b_new.txt");
+        for(int i = 0; i < 500 && WatchRegistry::shared().poll(b.str()) == generation; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(WatchRegistry::shared().poll(b.str()) != generation);
+
+        // a refresh, a load and a sort queued right behind each other, whatever the worker is in the middle of
+        // is left behind. Nothing of b shows up once the watcher moved to a, neither does the name order once
+        // it's sorted by size
+        watcher.update();
+        watcher.changeDirectory(a);
+        watcher.setSort(bySizeDescending);
+
+        const uint64_t listingVersion = watcher.listingVersion();
+        const uint64_t orderVersion = watcher.orderVersion();
+        bool wasSortedBySize = false;
+        auto xOnlyA = [&]() {
+            for(size_t i = 0; i < watcher.mRecords.size(); i++) {
+                REQUIRE(watcher.mRecords.getName(i)[0] == 'a');
+            }
+            if(watcher.status() == DirectoryStatus::READY && watcher.orderVersion() != orderVersion) {
+                REQUIRE(xIsSortedBy(watcher, bySizeDescending));
+            }
+            if(wasSortedBySize) {
+                REQUIRE(xIsSortedBy(watcher, bySizeDescending));
+            }
+            wasSortedBySize |= watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == 10 && xIsSortedBy(watcher, bySizeDescending);
+        };
+        REQUIRE(xWaitFor(watcher, [&]() { return wasSortedBySize; }, xOnlyA));
+        REQUIRE(watcher.mDirectory.str() == a.str());
+        REQUIRE(watcher.mRecords.getName(0) == "a0009.txt");
+        REQUIRE(watcher.listingVersion() > listingVersion);
+
+        // and nothing trickles in after
+        for(int i = 0; i < 10; i++) {
+            watcher.update();
+            xOnlyA();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    SECTION("a sort that's replaced never publishes its order") {
+        const std_fs::path C_PATH = TEST_PATH / "c";
+        xCreateFiles(C_PATH, "c", 3000);
+        const Path c(C_PATH.u8string());
+
+        DirectoryWatcher watcher;
+        watcher.changeDirectory(c);
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == 3000; }, xNoCheck));
+        REQUIRE(xIsSortedBy(watcher, byName));
+
+        for(int round = 0; round < 5; round++) {
+            // each one cancels the one before, only the last order ever reaches the records
+            const std::vector<FileSystem::SortKey>& last = round % 2 == 0 ? bySizeDescending : byName;
+            watcher.setSort(bySize);
+            watcher.setSort(byNameDescending);
+            watcher.setSort(last);
+
+            uint64_t orderVersion = watcher.orderVersion();
+            int numOrders = 0;
+            auto xOnlyLast = [&]() {
+                if(watcher.orderVersion() == orderVersion) return;
+                orderVersion = watcher.orderVersion();
+                numOrders++;
+                REQUIRE(xIsSortedBy(watcher, last));
+            };
+            REQUIRE(xWaitFor(watcher, [&]() { return numOrders > 0; }, xOnlyLast));
+
+            for(int i = 0; i < 10; i++) {
+                watcher.update();
+                xOnlyLast();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            REQUIRE(numOrders == 1);
+            REQUIRE(watcher.mRecords.size() == 3000);
+        }
+    }
+
+    SECTION("changes are patched into both buffers") {
+        const std_fs::path D_PATH = TEST_PATH / "d";
+        xCreateFiles(D_PATH, "d", 50);
+        const Path d(D_PATH.u8string());
+
+        DirectoryWatcher watcher;
+        watcher.changeDirectory(d);
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == 50; }, xNoCheck));
+        const uint64_t listingVersion = watcher.listingVersion();
+
+        createFile(D_PATH / "d_new.txt");
+        std_fs::remove(D_PATH / "d0000.txt");
+        std::ofstream(D_PATH / "d0010.txt") << std::string(100, 'x');
+
+        auto xIsPatched = [&]() {
+            const size_t changed = xFindRow(watcher, "d0010.txt");
+            return xFindRow(watcher, "d_new.txt") != SIZE_MAX && xFindRow(watcher, "d0000.txt") == SIZE_MAX
+                && changed != SIZE_MAX && watcher.mRecords.getSize(changed) == 100;
+        };
+        REQUIRE(xWaitFor(watcher, xIsPatched, xNoCheck));
+        REQUIRE(watcher.mRecords.size() == 50);
+        REQUIRE(watcher.listingVersion() > listingVersion);
+        // patched rather than listed again, the removed record keeps its slot
+        REQUIRE(watcher.mRecords.numRemoved == 1);
+        REQUIRE(xIsSortedBy(watcher, byName));
+
+        // the worker sorts its own copy, the order only fits these records if that copy got the same changes
+        watcher.setSort(bySizeDescending);
+        REQUIRE(xWaitFor(watcher, [&]() { return xIsSortedBy(watcher, bySizeDescending); }, xNoCheck));
+        REQUIRE(watcher.mRecords.getName(0) == "d_new.txt");
+        REQUIRE(watcher.mRecords.getName(49) == "d0010.txt");
+
+        // once more on top, the changes before aren't applied twice on either side
+        std_fs::remove(D_PATH / "d_new.txt");
+        createFile(D_PATH / "d_other.txt");
+        REQUIRE(xWaitFor(watcher, [&]() { return xFindRow(watcher, "d_new.txt") == SIZE_MAX && xFindRow(watcher, "d_other.txt") != SIZE_MAX; }, xNoCheck));
+        REQUIRE(watcher.mRecords.size() == 50);
+        REQUIRE(xIsSortedBy(watcher, bySizeDescending));
+
+        watcher.setSort(byName);
+        REQUIRE(xWaitFor(watcher, [&]() { return xIsSortedBy(watcher, byName); }, xNoCheck));
+        REQUIRE(watcher.mRecords.getName(0) == "d0001.txt");
+        REQUIRE(watcher.mRecords.getName(49) == "d_other.txt");
+    }
+
+    SECTION("a sort stopped after its rows went out leaves an order changes fit into") {
+        // sizes all over the place, the size order has nothing in common with either name order
+        const std_fs::path E_PATH = TEST_PATH / "e";
+        std_fs::create_directories(E_PATH);
+        const size_t count = 200;
+        for(size_t i = 0; i < count; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "e%04zu.txt", i);
+            std::ofstream(E_PATH / name) << std::string((i * 7919) % 100, 'x');
+        }
+        const Path e(E_PATH.u8string());
+
+        DirectoryWatcher watcher;
+        watcher.setParallelSortThreshold(1);
+        watcher.setPartialSortThreshold(1);
+        watcher.setVisibleRows(0, 20);
+        watcher.changeDirectory(e);
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.status() == DirectoryStatus::READY && watcher.mRecords.size() == count && xIsSortedBy(watcher, byName); }, xNoCheck));
+
+        // the rows on screen of a partial sort, the rest is in no particular order
+        auto xAreRowsSortedBy = [&](const std::vector<FileSystem::SortKey>& keys) {
+            FileSystem::SOARecord expected = watcher.mRecords;
+            expected.sort(keys, keys[0].direction == SortDirection::Ascending);
+            return std::equal(expected.indexes.begin(), expected.indexes.begin() + 20, watcher.mRecords.indexes.begin());
+        };
+
+        // full sorts run on pools kept busy until the test lets them go. A failed REQUIRE lets them go too, or the
+        // watcher would wait on them forever
+        struct HeldPool {
+            WorkStealingPool            pool{ 2 };
+            WorkStealingPool::TaskGroup group;
+            std::atomic<bool>           isHeld{ true };
+
+            HeldPool() {
+                for(size_t i = 0; i < pool.numThreads(); i++) {
+                    pool.submit(group, [this](size_t) {
+                        while(isHeld) {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                    });
+                }
+            }
+            ~HeldPool() { release(); }
+
+            void release() {
+                isHeld = false;
+                pool.wait(group);
+            }
+        };
+        HeldPool first;
+        HeldPool second;
+
+        watcher.setSortPool(&first.pool);
+        watcher.setSort(bySize);
+        const uint64_t orderVersion = watcher.orderVersion();
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.orderVersion() != orderVersion; }, xNoCheck));
+        REQUIRE(xAreRowsSortedBy(bySize));
+        REQUIRE_FALSE(xIsSortedBy(watcher, bySize));
+
+        // a change the worker gets to right after the size order is stopped, before the sort that stopped it. It's
+        // still sorted by name and patches the change in by name, the records it's patched into on this side have to
+        // be in that order too rather than the partial one by size
+        const uint64_t generation = WatchRegistry::shared().poll(e.str());
+        createFile(E_PATH / "e_new.txt");
+        for(int i = 0; i < 500 && WatchRegistry::shared().poll(e.str()) == generation; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(WatchRegistry::shared().poll(e.str()) != generation);
+        watcher.update();
+
+        // the next sort waits in one go on the second pool, its order doesn't cover up the patched one
+        watcher.setPartialSortThreshold(SIZE_MAX);
+        watcher.setSortPool(&second.pool);
+        watcher.setSort(byNameDescending);
+        first.release();
+
+        REQUIRE(xWaitFor(watcher, [&]() { return watcher.mRecords.size() == count + 1; }, xNoCheck));
+        REQUIRE(xIsSortedBy(watcher, byName));
+        REQUIRE(watcher.mRecords.getName(count) == "e_new.txt");
+
+        second.release();
+        REQUIRE(xWaitFor(watcher, [&]() { return xIsSortedBy(watcher, byNameDescending); }, xNoCheck));
+        REQUIRE(watcher.mRecords.getName(0) == "e_new.txt");
+    }
+
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Name filter", "[simple]") {
+    std::mt19937_64 random(29);
+
+    SECTION("bit set finds the next and previous set bit") {
+        for(size_t numBits : { 1, 63, 64, 65, 1000 }) {
+            BitSet bits;
+            bits.reset(numBits);
+            std::vector<bool> expected(numBits);
+            for(size_t i = 0; i < numBits; i++) {
+                if(random() % 17 == 0) {
+                    bits.set(i);
+                    expected[i] = true;
+                }
+            }
+
+            for(size_t from = 0; from <= numBits; from++) {
+                size_t next = BitSet::NPOS;
+                for(size_t i = from; i < numBits; i++) {
+                    if(expected[i]) { next = i; break; }
+                }
+                REQUIRE(bits.findNext(from) == next);
+
+                size_t previous = BitSet::NPOS;
+                for(size_t i = std::min(from, numBits - 1) + 1; i-- > 0;) {
+                    if(expected[i]) { previous = i; break; }
+                }
+                REQUIRE(bits.findPrevious(from) == previous);
+            }
+
+            REQUIRE(bits.count() == static_cast<size_t>(std::count(expected.begin(), expected.end(), true)));
+        }
+    }
+
+    const char* syllables[] = { "ab", "cd", "abc", "x", "y", "_", "." };
+
+    FileSystem::SOARecord records;
+    for(size_t i = 0; i < 5000; i++) {
+        std::string name;
+        for(int s = 0, numSyllables = 1 + random() % 5; s < numSyllables; s++) {
+            name += syllables[random() % 7];
+        }
+        records.add(name, 0, 0, 0);
+    }
+    std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+
+    // the query's characters in order, nothing in the queries below has an upper case letter
+    auto xIsSubsequence = [](std::string_view name, std::string_view query) {
+        size_t pos = 0;
+        for(char c : query) {
+            pos = name.find(c, pos);
+            if(pos == std::string_view::npos) return false;
+            pos++;
+        }
+        return true;
+    };
+
+    auto xExpectMatches = [&](const NameFilter& filter, std::string_view query) {
+        size_t numMatches = 0;
+        for(size_t row = 0; row < records.size(); row++) {
+            const bool isMatch = xIsSubsequence(records.getName(row), query);
+            REQUIRE(filter.isMatch(row) == isMatch);
+            numMatches += isMatch;
+        }
+        REQUIRE(filter.numMatches() == numMatches);
+
+        // the best ones are matches too, ranked by score
+        const FuzzyPattern pattern(query);
+        REQUIRE(filter.numBestMatches() == std::min(numMatches, NameFilter::MAX_BEST_MATCHES));
+        for(size_t rank = 0; rank < filter.numBestMatches(); rank++) {
+            REQUIRE(filter.isMatch(filter.bestMatch(rank)));
+            if(rank > 0) {
+                REQUIRE(FuzzyScore(records.getName(filter.bestMatch(rank - 1)), pattern) >= FuzzyScore(records.getName(filter.bestMatch(rank)), pattern));
+            }
+        }
+    };
+
+    auto xWaitForScan = [](NameFilter& filter, const FileSystem::SOARecord& listing, uint64_t listingVersion, uint64_t orderVersion) {
+        for(int i = 0; i < 500 && filter.isScanning(); i++) {
+            filter.update(listing, listingVersion, orderVersion);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return !filter.isScanning();
+    };
+
+    for(size_t threshold : { NameFilter::DEFAULT_BACKGROUND_THRESHOLD, size_t(0) }) {
+        const bool isBackground = threshold == 0;
+        DYNAMIC_SECTION((isBackground ? "background" : "inline") << " scans") {
+            NameFilter filter;
+            filter.setBackgroundThreshold(threshold);
+            uint64_t listingVersion = 1;
+            uint64_t orderVersion = 1;
+
+            // typing a query out narrows the matches down, then going back widens them again
+            for(std::string_view query : { "a", "ab", "abc", "abcx", "ab", "y_" }) {
+                filter.setQuery(query, records, listingVersion, orderVersion);
+                REQUIRE(filter.isScanning() == isBackground);
+                REQUIRE(xWaitForScan(filter, records, listingVersion, orderVersion));
+                xExpectMatches(filter, query);
+            }
+
+            // N and Shift+N step through the rows in order
+            std::vector<size_t> forward;
+            for(size_t row = filter.nextMatch(0); row != BitSet::NPOS; row = filter.nextMatch(row + 1)) {
+                forward.push_back(row);
+            }
+            std::vector<size_t> backward;
+            for(size_t row = filter.previousMatch(records.size()); row != BitSet::NPOS; row = row > 0 ? filter.previousMatch(row - 1) : BitSet::NPOS) {
+                backward.push_back(row);
+            }
+            std::reverse(backward.begin(), backward.end());
+            REQUIRE(forward.size() == filter.numMatches());
+            REQUIRE(forward == backward);
+
+            // a new order moves the matches along without scanning again
+            std::shuffle(records.indexes.begin(), records.indexes.end(), random);
+            REQUIRE(filter.update(records, listingVersion, ++orderVersion));
+            REQUIRE_FALSE(filter.isScanning());
+            xExpectMatches(filter, "y_");
+
+            // other entries are scanned again
+            records.add("zzy_zz", 0, 0, 0);
+            REQUIRE(filter.update(records, ++listingVersion, orderVersion));
+            REQUIRE(xWaitForScan(filter, records, listingVersion, orderVersion));
+            xExpectMatches(filter, "y_");
+
+            filter.clear();
+            REQUIRE_FALSE(filter.isActive());
+            REQUIRE(filter.nextMatch(0) == BitSet::NPOS);
+        }
+    }
+
+    SECTION("removed records don't match") {
+        // few enough removed that they stay flagged instead of being compacted away
+        FileSystem::SOARecord listing;
+        listing.add("alpha.txt", 0, 0, 0);
+        listing.add("report_old.txt", 0, 0, 0);
+        for(int i = 0; i < 20; i++) {
+            listing.add("other" + std::to_string(i), 0, 0, 0);
+        }
+        const std::vector<FileSystem::SortKey> keys = { { FileSystem::SortColumn::Name, FileSystem::SortDirection::Ascending } };
+        listing.sort(keys, true);
+
+        FileSystem::EntryChange removed;
+        removed.name = "report_old.txt";
+        listing.applyChanges({ removed }, keys, true);
+        REQUIRE(listing.numRemoved == 1);
+
+        for(size_t threshold : { NameFilter::DEFAULT_BACKGROUND_THRESHOLD, size_t(0) }) {
+            NameFilter filter;
+            filter.setBackgroundThreshold(threshold);
+
+            filter.setQuery("report", listing, 1, 1);
+            REQUIRE(xWaitForScan(filter, listing, 1, 1));
+            REQUIRE(filter.numMatches() == 0);
+            REQUIRE(filter.numBestMatches() == 0);
+
+            // a match next to the removed one, the best ones are all rows
+            filter.setQuery("t", listing, 2, 1);
+            REQUIRE(xWaitForScan(filter, listing, 2, 1));
+            REQUIRE(filter.numMatches() == 21);
+            REQUIRE(filter.numBestMatches() == 21);
+            for(size_t rank = 0; rank < filter.numBestMatches(); rank++) {
+                REQUIRE(filter.isMatch(filter.bestMatch(rank)));
+                REQUIRE(listing.getName(filter.bestMatch(rank)) != "report_old.txt");
+            }
+        }
+    }
+}
+
+TEST_CASE("Substring search", "[simple]") {
+    std::mt19937_64 random(31);
+
+    // mixed case, a few bytes past ASCII and names longer than a 32 byte step so every kernel gets to run its loop
+    const char* pieces[] = { "ab", "AB", "aB", "c", "Ca", "x", "_", ".", "\xC3\xA9", "0", "abcabcabcabcabcabcabc" };
+    const size_t numPieces = sizeof(pieces) / sizeof(pieces[0]);
+
+    FileSystem::SOARecord records;
+    for(size_t i = 0; i < 3000; i++) {
+        std::string name;
+        for(int p = 0, numParts = 1 + random() % 8; p < numParts; p++) {
+            name += pieces[random() % numPieces];
+        }
+        records.add(name, 0, 0, 0);
+    }
+    const std::string_view arena(records.nameArena.data(), records.nameArena.size());
+
+    auto xFold = [](std::string str) {
+        for(char& c : str) {
+            if(c >= 'A' && c <= 'Z') c |= 0x20;
+        }
+        return str;
+    };
+
+    auto xContains = [&](std::string_view name, std::string_view needle, SubstringCase matchCase) {
+        if(matchCase == SubstringCase::Sensitive) return name.find(needle) != std::string_view::npos;
+        return xFold(std::string(name)).find(xFold(std::string(needle))) != std::string::npos;
+    };
+
+    for(SubstringKernel kernel : { SubstringKernel::Scalar, SubstringKernel::Sse2, SubstringKernel::Avx2 }) {
+        if(!IsSubstringKernelSupported(kernel)) continue;
+
+        DYNAMIC_SECTION("kernel " << static_cast<int>(kernel)) {
+            for(SubstringCase matchCase : { SubstringCase::Sensitive, SubstringCase::AsciiInsensitive }) {
+                for(std::string_view needle : { "a", "C", "ab", "Ab", "abc", "cabc", "b_c", "\xC3\xA9", "_x.", "abcabcabcabcabcabcabcab", "zz" }) {
+                    // a range of names in the middle, the bits around it stay what they were
+                    const size_t begin = random() % records.size();
+                    const size_t end = begin + random() % (records.size() - begin + 1);
+
+                    BitSet matches;
+                    matches.reset(records.size());
+                    matches.set(0);
+                    FindInNames(arena, records.nameOffsets, begin, end, needle, matchCase, matches, kernel);
+
+                    for(size_t recordIdx = 0; recordIdx < records.size(); recordIdx++) {
+                        const bool isInRange = recordIdx >= begin && recordIdx < end;
+                        const bool expected = recordIdx == 0 || (isInRange && xContains(records.getRecordName(recordIdx), needle, matchCase));
+                        REQUIRE(matches.test(recordIdx) == expected);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("every name at once") {
+        BitSet matches;
+        FindInNames(arena, records.nameOffsets, "", SubstringCase::Sensitive, matches);
+        REQUIRE(matches.count() == records.size());
+
+        FindInNames(arena, records.nameOffsets, std::string_view("a\0b", 3), SubstringCase::Sensitive, matches);
+        REQUIRE(matches.count() == 0);
+
+        // matching the end of one name and the start of the next doesn't count
+        NameArena names;
+        names.add("xab");
+        names.add("cd");
+        names.add("ABCD");
+        FindInNames(names, "bc", SubstringCase::AsciiInsensitive, matches);
+        REQUIRE(matches.size() == 3);
+        REQUIRE(matches.count() == 1);
+        REQUIRE(matches.test(2));
+    }
+
+    SECTION("one name") {
+        REQUIRE(ContainsSubstring("Report_Final.txt", "final", SubstringCase::AsciiInsensitive));
+        REQUIRE_FALSE(ContainsSubstring("Report_Final.txt", "final", SubstringCase::Sensitive));
+        REQUIRE(ContainsSubstring("Report_Final.txt", "", SubstringCase::Sensitive));
+        REQUIRE_FALSE(ContainsSubstring("ab", "abc", SubstringCase::AsciiInsensitive));
+        // '@' and '`' only differ in the bit case folding sets
+        REQUIRE_FALSE(ContainsSubstring("`x@", "@X`", SubstringCase::AsciiInsensitive));
+        REQUIRE_FALSE(ContainsSubstring("@x`", "`X@", SubstringCase::AsciiInsensitive));
+        REQUIRE(ContainsSubstring("a long name with the match at the very END", "the very end", SubstringCase::AsciiInsensitive));
+    }
+
+    SECTION("text") {
+        // the arena as one text, NULs and newlines in it are bytes like any other
+        std::string text(arena);
+        for(size_t i = 0; i < text.size(); i += 1 + random() % 40) {
+            text[i] = '\n';
+        }
+
+        for(SubstringKernel kernel : { SubstringKernel::Scalar, SubstringKernel::Sse2, SubstringKernel::Avx2 }) {
+            if(!IsSubstringKernelSupported(kernel)) continue;
+
+            for(SubstringCase matchCase : { SubstringCase::Sensitive, SubstringCase::AsciiInsensitive }) {
+                const std::string haystack = matchCase == SubstringCase::Sensitive ? text : xFold(text);
+                for(std::string_view needle : std::vector<std::string_view>{ "a", "Ab", "c\n", "abcabcabcabcabcabcabcab", std::string_view("b\0", 2), "zz" }) {
+                    const std::string expectedNeedle = matchCase == SubstringCase::Sensitive ? std::string(needle) : xFold(std::string(needle));
+                    for(size_t from : { size_t(0), size_t(1), text.size() / 3, text.size() - 5 }) {
+                        REQUIRE(FindSubstring(text, needle, from, matchCase, kernel) == haystack.find(expectedNeedle, from));
+                    }
+                }
+            }
+
+            for(size_t begin : { size_t(0), size_t(3), size_t(17) }) {
+                const std::string_view part = std::string_view(text).substr(begin);
+                REQUIRE(CountNewlines(part, kernel) == static_cast<size_t>(std::count(part.begin(), part.end(), '\n')));
+            }
+        }
+
+        REQUIRE(FindSubstring("abc", "", 2, SubstringCase::Sensitive) == 2);
+        REQUIRE(FindSubstring("abc", "c", 4, SubstringCase::Sensitive) == std::string_view::npos);
+        // enough newlines that the byte counters of the vector kernels have to be summed up on the way
+        REQUIRE(CountNewlines(std::string(20000, '\n')) == 20000);
+    }
+}
+
+TEST_CASE("Fuzzy match", "[simple]") {
+    auto xScore = [](std::string_view name, std::string_view query) { return FuzzyScore(name, FuzzyPattern(query)); };
+
+    SECTION("scores") {
+        REQUIRE(xScore("foobar", "fb") != FUZZY_NO_MATCH);
+        REQUIRE(xScore("foobar", "bf") == FUZZY_NO_MATCH);
+        REQUIRE(xScore("foobar", "") == 0);
+
+        // path separators, punctuation and camelCase make boundaries worth more than the middle of a word
+        REQUIRE(xScore("foo/bar", "fb") > xScore("foobar", "fb"));
+        REQUIRE(xScore("foo_bar", "fb") > xScore("foobar", "fb"));
+        REQUIRE(xScore("fooBar", "fb") > xScore("foobar", "fb"));
+        REQUIRE(xScore("report 2", "r2") > xScore("reporta2", "r2"));
+        // a run beats the same characters spread out
+        REQUIRE(xScore("xabcx", "abc") > xScore("xaxbxcx", "abc"));
+        // the shortest window ending at the first complete match is scored, not the first "a" with a gap after it
+        REQUIRE(xScore("aab", "ab") == xScore("xab", "ab"));
+
+        // smart case, an upper case letter makes the query case sensitive
+        REQUIRE(xScore("FooBar", "fb") != FUZZY_NO_MATCH);
+        REQUIRE(xScore("FooBar", "fB") == FUZZY_NO_MATCH);
+        REQUIRE(xScore("fooBar", "fB") != FUZZY_NO_MATCH);
+
+        // names past a 16 byte step
+        REQUIRE(xScore("a_very_long_name_with_the_end_here.txt", "vlnteh") != FUZZY_NO_MATCH);
+        REQUIRE(xScore("a_very_long_name_with_the_end_here.txt", "vlnteq") == FUZZY_NO_MATCH);
+
+        REQUIRE(IsFuzzyRefinement("ab", "axb"));
+        REQUIRE(IsFuzzyRefinement("ab", "aB"));
+        REQUIRE_FALSE(IsFuzzyRefinement("ab", "ba"));
+        REQUIRE_FALSE(IsFuzzyRefinement("aB", "ab"));
+    }
+
+    std::mt19937_64 random(37);
+
+    SECTION("top matches are the best of all of them") {
+        std::vector<FuzzyMatch> all;
+        for(uint32_t i = 0; i < 5000; i++) {
+            all.push_back({ i, static_cast<int32_t>(random() % 100), static_cast<uint32_t>(random() % 20) });
+        }
+        std::sort(all.begin(), all.end(), IsBetterMatch);
+
+        for(size_t capacity : { 0, 1, 10, 5000, 6000 }) {
+            // in two halves merged, the way parallel matching collects them
+            TopMatches first(capacity);
+            TopMatches second(capacity);
+            for(size_t i = 0; i < all.size(); i++) {
+                (i % 2 == 0 ? first : second).push(all[(i * 7919) % all.size()]);
+            }
+            first.merge(second);
+
+            std::vector<FuzzyMatch> best;
+            first.sorted(best);
+            REQUIRE(best.size() == std::min(capacity, all.size()));
+            for(size_t i = 0; i < best.size(); i++) {
+                REQUIRE(best[i].index == all[i].index);
+            }
+        }
+    }
+
+    SECTION("names of an arena, on one thread or a pool") {
+        const char* pieces[] = { "ab", "AB", "c", "Cd", "_", ".", "/", "x", "0", "\xC3\xA9", "abcdabcdabcdabcdabcd" };
+        const size_t numPieces = sizeof(pieces) / sizeof(pieces[0]);
+
+        FileSystem::SOARecord records;
+        for(size_t i = 0; i < 40000; i++) {
+            std::string name;
+            for(int p = 0, numParts = 1 + random() % 6; p < numParts; p++) {
+                name += pieces[random() % numPieces];
+            }
+            records.add(name, 0, 0, 0);
+        }
+        const std::string_view arena(records.nameArena.data(), records.nameArena.size());
+        WorkStealingPool pool(3);
+
+        for(const char* query : { "a", "abc", "aBc", "c_x", "d.", "\xC3\xA9", "ababababab", "zz" }) {
+            const FuzzyPattern pattern(query);
+
+            std::vector<FuzzyMatch> expected;
+            for(size_t recordIdx = 0; recordIdx < records.size(); recordIdx++) {
+                const std::string_view name = records.getRecordName(recordIdx);
+                const int score = FuzzyScore(name, pattern);
+                if(score != FUZZY_NO_MATCH) {
+                    expected.push_back({ static_cast<uint32_t>(recordIdx), score, static_cast<uint32_t>(name.size()) });
+                }
+            }
+            std::sort(expected.begin(), expected.end(), IsBetterMatch);
+
+            for(bool isParallel : { false, true }) {
+                TopMatches best(50);
+                BitSet matches;
+                matches.reset(records.size());
+                if(isParallel) {
+                    FuzzyMatchNames(pool, arena, records.nameOffsets, 0, records.size(), pattern, nullptr, best, &matches);
+                } else {
+                    FuzzyMatchNames(arena, records.nameOffsets, 0, records.size(), pattern, nullptr, best, &matches);
+                }
+
+                REQUIRE(matches.count() == expected.size());
+                for(const FuzzyMatch& match : expected) {
+                    REQUIRE(matches.test(match.index));
+                }
+
+                std::vector<FuzzyMatch> sorted;
+                best.sorted(sorted);
+                REQUIRE(sorted.size() == std::min<size_t>(50, expected.size()));
+                for(size_t i = 0; i < sorted.size(); i++) {
+                    REQUIRE(sorted[i].index == expected[i].index);
+                    REQUIRE(sorted[i].score == expected[i].score);
+                }
+            }
+        }
+    }
+
+    SECTION("short lists") {
+        NameArena names;
+        for(const char* name : { "Desktop", "Documents", "Downloads", "Music" }) {
+            names.add(name);
+        }
+
+        std::vector<FuzzyMatch> best;
+        FuzzyRank(names, "", names.size(), best);
+        REQUIRE(best.size() == 4);
+        for(size_t i = 0; i < best.size(); i++) {
+            REQUIRE(best[i].index == i);
+        }
+
+        FuzzyRank(names, "dwn", names.size(), best);
+        REQUIRE(best.size() == 1);
+        REQUIRE(best[0].index == 2);
+
+        // the boundary at "m" of "Music" beats the one in the middle of "Documents"
+        FuzzyRank(names, "m", names.size(), best);
+        REQUIRE(best.size() == 2);
+        REQUIRE(best[0].index == 3);
+        REQUIRE(best[1].index == 1);
+    }
+}
+
+TEST_CASE("Find", "[simple]") {
+    SECTION("globs") {
+        REQUIRE(GlobMatch("main.cpp", "*.cpp", false));
+        REQUIRE(GlobMatch("main.cpp", "*", false));
+        REQUIRE(GlobMatch("main.cpp", "m??n.*", false));
+        REQUIRE_FALSE(GlobMatch("main.cpp", "*.c", false));
+        REQUIRE_FALSE(GlobMatch("main.cpp", "main", false));
+        // a * gives characters back to what follows it
+        REQUIRE(GlobMatch("a.b.c.txt", "*.*.txt", false));
+        REQUIRE(GlobMatch("aaab", "*a*b", false));
+        REQUIRE_FALSE(GlobMatch("aaa", "*a*b", false));
+
+        REQUIRE(GlobMatch("file7.txt", "file[0-9].txt", false));
+        REQUIRE_FALSE(GlobMatch("fileX.txt", "file[0-9].txt", false));
+        REQUIRE(GlobMatch("fileX.txt", "file[!0-9].txt", false));
+        REQUIRE(GlobMatch("b", "[abc]", false));
+        REQUIRE(GlobMatch("]", "[]]", false));
+        // an unclosed bracket is a plain one
+        REQUIRE(GlobMatch("a[b", "a[b", false));
+
+        REQUIRE(GlobMatch("README.md", "readme.*", true));
+        REQUIRE_FALSE(GlobMatch("README.md", "readme.*", false));
+        REQUIRE(GlobMatch("Q", "[a-z]", true));
+    }
+
+    const uint64_t second = 10000000ULL;
+    const uint64_t now = (1700000000ULL + 11644473600ULL) * second;
+
+    SECTION("queries") {
+        FindQuery query;
+        REQUIRE(ParseFindQuery({ "readme" }, now, query));
+        REQUIRE(query.kind == FindPatternKind::Substring);
+        REQUIRE_FALSE(query.isCaseSensitive);
+        REQUIRE_FALSE(query.hasSizeBound());
+        REQUIRE_FALSE(query.hasDateBound());
+        REQUIRE(query.useDefaultPrune);
+
+        REQUIRE(ParseFindQuery({ "*.Cpp", "size>10k", "size<2MB", "mtime<7d", "prune=build,out", "noprune" }, now, query));
+        REQUIRE(query.kind == FindPatternKind::Glob);
+        REQUIRE(query.isCaseSensitive);
+        REQUIRE(query.minSize == 10 * 1024 + 1);
+        REQUIRE(query.maxSize == 2 * 1024 * 1024 - 1);
+        REQUIRE(query.minLastModified == now - 7 * 24 * 60 * 60 * second);
+        REQUIRE(query.maxLastModified == UINT64_MAX);
+        REQUIRE(query.pruneNames == std::vector<std::string>{ "build", "out" });
+        REQUIRE_FALSE(query.useDefaultPrune);
+        REQUIRE(query.text == "*.Cpp size>10k size<2MB mtime<7d prune=build,out noprune");
+
+        REQUIRE(ParseFindQuery({ "re:^test_.*\\.py$", "mtime>90m" }, now, query));
+        REQUIRE(query.kind == FindPatternKind::Regex);
+        REQUIRE(query.pattern == "^test_.*\\.py$");
+        REQUIRE(query.maxLastModified == now - 90 * 60 * second);
+
+        // predicates alone look at every name
+        REQUIRE(ParseFindQuery({ "size>1G" }, now, query));
+        REQUIRE(query.pattern.empty());
+
+        REQUIRE_FALSE(ParseFindQuery({}, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "a", "b" }, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "a", "size>10q" }, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "a", "size<0" }, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "a", "size>2k", "size<1k" }, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "a", "mtime<" }, now, query));
+        REQUIRE_FALSE(ParseFindQuery({ "re:(unclosed" }, now, query));
+    }
+
+    SECTION("matching") {
+        FindQuery query;
+        REQUIRE(ParseFindQuery({ "*.txt", "size>100", "mtime<1h" }, now, query));
+        FindMatcher matcher(query);
+
+        REQUIRE(matcher.matchesName("notes.TXT"));
+        REQUIRE_FALSE(matcher.matchesName("notes.txt.bak"));
+        REQUIRE(matcher.matchesEntry(0, 101, now));
+        REQUIRE_FALSE(matcher.matchesEntry(0, 100, now));
+        REQUIRE_FALSE(matcher.matchesEntry(0, 101, now - 2 * 60 * 60 * second));
+        // directories have no size of their own
+        REQUIRE_FALSE(matcher.matchesEntry(FileSystem::FileAttributes::DIRECTORY, 101, now));
+
+        // the names of a listing in one go agree with one at a time
+        FileSystem::SOARecord entries;
+        for(const char* name : { "a.txt", "b.txt.old", "C.TXT", "txt", "longer_name_than_a_vector.txt" }) {
+            entries.add(name, 0, 0, 0);
+        }
+        for(const std::vector<std::string>& args : std::vector<std::vector<std::string>>{ { "*.txt" }, { "txt" }, { "TXT" }, { "re:^[a-c]\\." } }) {
+            REQUIRE(ParseFindQuery(args, now, query));
+            FindMatcher argsMatcher(query);
+
+            BitSet matches;
+            argsMatcher.matchNames(entries, matches);
+            REQUIRE(matches.size() == entries.size());
+            for(size_t i = 0; i < entries.size(); i++) {
+                REQUIRE(matches.test(i) == argsMatcher.matchesName(entries.getRecordName(i)));
+            }
+        }
+    }
+
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_FIND";
+    refreshTestDirectory(TEST_PATH);
+
+    std_fs::create_directories(TEST_PATH / "src" / "detail");
+    std_fs::create_directories(TEST_PATH / "node_modules" / "pkg");
+    std_fs::create_directories(TEST_PATH / ".git");
+    createFile(TEST_PATH / "src" / "main.cpp");
+    createFile(TEST_PATH / "src" / "main.h");
+    createFile(TEST_PATH / "src" / "detail" / "impl.cpp");
+    createFile(TEST_PATH / "node_modules" / "pkg" / "index.cpp");
+    createFile(TEST_PATH / ".git" / "hook.cpp");
+    std::ofstream(TEST_PATH / "big.cpp") << std::string(4096, 'x');
+
+    auto xWaitForFind = [](FileFinder& finder) {
+        for(int i = 0; i < 500 && finder.isSearching(); i++) {
+            finder.update();
+            if(finder.isSearching()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return !finder.isSearching();
+    };
+
+    auto xResultNames = [](const FileFinder& finder) {
+        std::vector<std::string> names;
+        for(size_t i = 0; i < finder.numResults(); i++) {
+            names.push_back(finder.resultPath(i).str().substr(finder.root().str().size() + 1));
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    };
+
+    auto xNative = [](std::string path) {
+        std::replace(path.begin(), path.end(), '/', Path::SEPARATOR);
+        return path;
+    };
+
+    const Path root(TEST_PATH.u8string());
+
+    SECTION("walks the tree and prunes") {
+        FileFinder finder;
+        FindQuery query;
+
+        REQUIRE(ParseFindQuery({ "*.cpp" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(finder.isActive());
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE_FALSE(finder.wasStopped());
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ "big.cpp", xNative("src/detail/impl.cpp"), xNative("src/main.cpp") });
+        // the root, src and detail
+        REQUIRE(finder.numDirectoriesSearched() == 3);
+
+        // a pruned directory still shows up when its name matches
+        REQUIRE(ParseFindQuery({ "node" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ "node_modules" });
+
+        REQUIRE(ParseFindQuery({ "*.cpp", "noprune", "prune=src" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ xNative(".git/hook.cpp"), "big.cpp", xNative("node_modules/pkg/index.cpp") });
+
+        finder.setPruneNames({});
+        REQUIRE(ParseFindQuery({ "index" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ xNative("node_modules/pkg/index.cpp") });
+
+        // sizes and dates are filled in and checked
+        REQUIRE(ParseFindQuery({ "*.cpp", "size>1k", "mtime<1h" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ "big.cpp" });
+        REQUIRE(finder.results().getSize(0) == 4096);
+        REQUIRE(finder.results().getLastModifiedNumber(0) > 0);
+
+        finder.clear();
+        REQUIRE_FALSE(finder.isActive());
+        REQUIRE(finder.numResults() == 0);
+
+        REQUIRE_FALSE(finder.start(Path(""), query));
+    }
+
+    SECTION("cancel") {
+        for(int i = 0; i < 200; i++) {
+            const std_fs::path dir = TEST_PATH / "many" / std::to_string(i);
+            std_fs::create_directories(dir);
+            createFile(dir / "leaf.cpp");
+        }
+
+        FileFinder finder;
+        FindQuery query;
+        REQUIRE(ParseFindQuery({ "leaf" }, FileSystem::getCurrentFileTime(), query));
+
+        // cancelled at once, whatever was found before stays and nothing comes in after
+        REQUIRE(finder.start(root, query));
+        finder.cancel();
+        REQUIRE(xWaitForFind(finder));
+        const size_t numFound = finder.numResults();
+        REQUIRE(numFound <= 200);
+        REQUIRE((finder.wasStopped() || numFound == 200));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        finder.update();
+        REQUIRE(finder.numResults() == numFound);
+
+        // a new find replaces one in flight, none of the old one's results show up
+        REQUIRE(finder.start(root, query));
+        REQUIRE(ParseFindQuery({ "main" }, FileSystem::getCurrentFileTime(), query));
+        REQUIRE(finder.start(root, query));
+        REQUIRE(xWaitForFind(finder));
+        REQUIRE(xResultNames(finder) == std::vector<std::string>{ xNative("src/main.cpp"), xNative("src/main.h") });
+
+        // the destructor stops a find in flight
+        REQUIRE(ParseFindQuery({ "leaf" }, FileSystem::getCurrentFileTime(), query));
+        FileFinder abandoned;
+        REQUIRE(abandoned.start(root, query));
+    }
+
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("File index", "[simple]") {
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_FILE_INDEX";
+    refreshTestDirectory(TEST_PATH);
+
+    std_fs::create_directories(TEST_PATH / "src" / "detail");
+    std_fs::create_directories(TEST_PATH / "docs");
+    createFile(TEST_PATH / "src" / "Main.cpp");
+    createFile(TEST_PATH / "src" / "main.h");
+    createFile(TEST_PATH / "src" / "detail" / "impl.cpp");
+    createFile(TEST_PATH / "docs" / "manual.md");
+    createFile(TEST_PATH / "README.md");
+
+    const std_fs::path INDEX_PATH = std_fs::current_path() / "TEMP_FILE_INDEX.idx";
+    std_fs::remove(INDEX_PATH);
+
+    WorkStealingPool pool(4);
+    const Path root(TEST_PATH.u8string());
+    const std::string rootStr = root.str();
+
+    auto xPaths = [&](const FileIndex& index, const std::vector<uint32_t>& nodes) {
+        std::vector<std::string> paths;
+        for(uint32_t node : nodes) {
+            std::string path = index.getPath(node).substr(rootStr.size() + 1);
+            std::replace(path.begin(), path.end(), Path::SEPARATOR, '/');
+            paths.push_back(path);
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    };
+
+    auto xSubstring = [&](const FileIndex& index, std::string_view needle, SubstringCase matchCase = SubstringCase::AsciiInsensitive) {
+        std::vector<uint32_t> nodes;
+        index.findSubstring(needle, matchCase, nodes, SIZE_MAX, &pool);
+        return xPaths(index, nodes);
+    };
+
+    auto xPrefix = [&](const FileIndex& index, std::string_view prefix, SubstringCase matchCase = SubstringCase::AsciiInsensitive) {
+        std::vector<uint32_t> nodes;
+        index.findPrefix(prefix, matchCase, nodes);
+        return xPaths(index, nodes);
+    };
+
+    auto xNative = [&](std::string path) {
+        std::replace(path.begin(), path.end(), '/', Path::SEPARATOR);
+        return rootStr + Path::SEPARATOR + path;
+    };
+
+    SECTION("builds, saves and maps") {
+        FileIndex index;
+        REQUIRE(index.isEmpty());
+        REQUIRE(index.build(pool, root));
+        REQUIRE_FALSE(index.isMapped());
+        // the root, 3 directories and 5 files
+        REQUIRE(index.numEntries() == 9);
+        REQUIRE(index.rootPath() == rootStr);
+
+        REQUIRE(xSubstring(index, "main") == std::vector<std::string>{ "src/Main.cpp", "src/main.h" });
+        REQUIRE(xSubstring(index, "main", SubstringCase::Sensitive) == std::vector<std::string>{ "src/main.h" });
+        REQUIRE(xSubstring(index, ".md") == std::vector<std::string>{ "README.md", "docs/manual.md" });
+        // the root's name is the whole path and doesn't match
+        REQUIRE(xSubstring(index, "TEMP_FILE_INDEX").empty());
+
+        REQUIRE(xPrefix(index, "ma") == std::vector<std::string>{ "docs/manual.md", "src/Main.cpp", "src/main.h" });
+        REQUIRE(xPrefix(index, "Ma", SubstringCase::Sensitive) == std::vector<std::string>{ "src/Main.cpp" });
+        REQUIRE(xPrefix(index, "d") == std::vector<std::string>{ "docs", "src/detail" });
+        REQUIRE(xPrefix(index, "zz").empty());
+
+        std::vector<uint32_t> limited;
+        index.findPrefix("", SubstringCase::AsciiInsensitive, limited, 3);
+        REQUIRE(limited.size() == 3);
+
+        const uint32_t impl = index.findPath(xNative("src/detail/impl.cpp"));
+        REQUIRE(impl != FileIndex::NO_NODE);
+        REQUIRE(index.getName(impl) == "impl.cpp");
+        REQUIRE(index.getPath(impl) == xNative("src/detail/impl.cpp"));
+        REQUIRE(index.isDirectory(index.getParent(impl)));
+        REQUIRE(index.findPath(rootStr) == FileIndex::ROOT);
+        REQUIRE(index.findPath(xNative("src/missing")) == FileIndex::NO_NODE);
+        REQUIRE(index.findPath(rootStr + "x") == FileIndex::NO_NODE);
+
+        REQUIRE(index.save(Path(INDEX_PATH.u8string()), &pool));
+        REQUIRE(index.isMapped());
+        REQUIRE(index.imageSize() == std_fs::file_size(INDEX_PATH));
+
+        FileIndex loaded;
+        REQUIRE(loaded.load(Path(INDEX_PATH.u8string())));
+        REQUIRE(loaded.isMapped());
+        REQUIRE(loaded.numEntries() == 9);
+        REQUIRE(loaded.rootPath() == rootStr);
+        REQUIRE(xSubstring(loaded, "main") == std::vector<std::string>{ "src/Main.cpp", "src/main.h" });
+        REQUIRE(xPrefix(loaded, "ma") == std::vector<std::string>{ "docs/manual.md", "src/Main.cpp", "src/main.h" });
+        REQUIRE(loaded.getPath(loaded.findPath(xNative("docs/manual.md"))) == xNative("docs/manual.md"));
+
+        // anything that isn't a complete index of this version is turned down
+        FileIndex broken;
+        std::ofstream(TEST_PATH / "not_an_index") << std::string(4096, 'x');
+        REQUIRE_FALSE(broken.load(Path((TEST_PATH / "not_an_index").u8string())));
+        REQUIRE_FALSE(broken.load(Path((TEST_PATH / "missing").u8string())));
+        REQUIRE(broken.isEmpty());
+
+        std_fs::resize_file(INDEX_PATH, std_fs::file_size(INDEX_PATH) - 8);
+        REQUIRE_FALSE(broken.load(Path(INDEX_PATH.u8string())));
+    }
+
+    SECTION("changes are patched in and saved") {
+        FileIndex index;
+        REQUIRE(index.build(pool, root));
+        REQUIRE(index.save(Path(INDEX_PATH.u8string()), &pool));
+
+        std_fs::remove_all(TEST_PATH / "src" / "detail");
+        std_fs::create_directories(TEST_PATH / "src" / "added" / "deeper");
+        createFile(TEST_PATH / "src" / "added" / "deeper" / "main_added.cpp");
+        createFile(TEST_PATH / "src" / "Mainly.txt");
+
+        REQUIRE(index.applyChanges(pool, root.str() + Path::SEPARATOR + "src", { "detail", "added", "Mainly.txt", "added" }));
+        REQUIRE_FALSE(index.applyChanges(pool, xNative("missing"), { "a" }));
+        // detail and impl.cpp went, added, deeper, main_added.cpp and Mainly.txt came
+        REQUIRE(index.numChanges() == 6);
+        REQUIRE(index.numEntries() == 9 - 2 + 4);
+        REQUIRE(index.findPath(xNative("src/detail/impl.cpp")) == FileIndex::NO_NODE);
+        REQUIRE(index.findPath(xNative("src/added/deeper/main_added.cpp")) != FileIndex::NO_NODE);
+
+        const std::vector<std::string> mains = { "src/Main.cpp", "src/Mainly.txt", "src/added/deeper/main_added.cpp", "src/main.h" };
+        REQUIRE(xSubstring(index, "main") == mains);
+        REQUIRE(xPrefix(index, "main") == mains);
+        REQUIRE(xSubstring(index, "impl").empty());
+
+        // a rescan finds what nobody reported
+        createFile(TEST_PATH / "docs" / "unreported.md");
+        REQUIRE(index.rescan(pool, xNative("docs")));
+        REQUIRE(xSubstring(index, ".md") == std::vector<std::string>{ "README.md", "docs/manual.md", "docs/unreported.md" });
+
+        // saving merges the changes into the file
+        REQUIRE(index.save(Path(INDEX_PATH.u8string()), &pool));
+        REQUIRE(index.numChanges() == 0);
+        REQUIRE(index.isMapped());
+
+        FileIndex loaded;
+        REQUIRE(loaded.load(Path(INDEX_PATH.u8string())));
+        REQUIRE(loaded.numEntries() == index.numEntries());
+        REQUIRE(xSubstring(loaded, "main") == mains);
+        REQUIRE(xPrefix(loaded, "main") == mains);
+        REQUIRE(xSubstring(loaded, ".md") == std::vector<std::string>{ "README.md", "docs/manual.md", "docs/unreported.md" });
+
+        // every node's children came out contiguous again
+        FileSystem::DirectoryTree tree;
+        REQUIRE(tree.build(pool, root));
+        REQUIRE(loaded.numNodes() == tree.size());
+        for(uint32_t node = 0; node < tree.size(); node++) {
+            REQUIRE(loaded.findPath(tree.getPath(node)) != FileIndex::NO_NODE);
+        }
+    }
+
+    SECTION("watches follow the disk") {
+        WatchRegistry registry;
+        FileIndex index;
+        REQUIRE(index.build(pool, root));
+        // the root, src, detail and docs
+        REQUIRE(index.watchTree(registry, 100) == 4);
+        REQUIRE(index.watchTree(registry, 100) == 4);
+
+        createFile(TEST_PATH / "src" / "detail" / "watched.cpp");
+        std_fs::remove(TEST_PATH / "README.md");
+
+        // notifications may take a moment to arrive
+        for(int i = 0; i < 200 && (index.findPath(xNative("src/detail/watched.cpp")) == FileIndex::NO_NODE ||
+                                   index.findPath(xNative("README.md")) != FileIndex::NO_NODE); i++) {
+            index.pollWatches(registry, pool);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(index.findPath(xNative("src/detail/watched.cpp")) != FileIndex::NO_NODE);
+        REQUIRE(index.findPath(xNative("README.md")) == FileIndex::NO_NODE);
+        REQUIRE(xSubstring(index, "watched") == std::vector<std::string>{ "src/detail/watched.cpp" });
+
+        index.unwatchAll(registry);
+        REQUIRE(index.numWatches() == 0);
+        REQUIRE(registry.numSubscribers(rootStr) == 0);
+    }
+
+    SECTION("subtrees past the watches are walked again") {
+        WatchRegistry registry;
+        FileIndex index;
+        REQUIRE(index.build(pool, root));
+        REQUIRE(index.watchTree(registry, 1) == 1);
+
+        auto xUnwatched = [&]() {
+            std::vector<std::string> unwatched = index.unwatchedDirectories();
+            std::sort(unwatched.begin(), unwatched.end());
+            return unwatched;
+        };
+        REQUIRE(xUnwatched() == std::vector<std::string>{ xNative("docs"), xNative("src") });
+
+        // a walk that finds what's indexed changes nothing
+        FileSystem::DirectoryTree tree;
+        REQUIRE(tree.build(pool, Path(xNative("src"))));
+        REQUIRE(index.applyTree(xNative("src"), tree) == 0);
+        REQUIRE(index.numChanges() == 0);
+
+        // nothing reports these
+        std_fs::remove(TEST_PATH / "src" / "detail" / "impl.cpp");
+        createFile(TEST_PATH / "src" / "detail" / "fresh.cpp");
+        std_fs::create_directories(TEST_PATH / "src" / "new");
+        createFile(TEST_PATH / "src" / "new" / "deep.cpp");
+
+        // impl.cpp went, fresh.cpp, new and deep.cpp came, the rest is kept as it was
+        REQUIRE(tree.build(pool, Path(xNative("src"))));
+        REQUIRE(index.applyTree(xNative("src"), tree) == 4);
+        REQUIRE(index.numEntries() == 9 - 1 + 3);
+        REQUIRE(xSubstring(index, ".cpp") == std::vector<std::string>{ "src/Main.cpp", "src/detail/fresh.cpp", "src/new/deep.cpp" });
+        REQUIRE(xPrefix(index, "main") == std::vector<std::string>{ "src/Main.cpp", "src/main.h" });
+
+        // a directory that went away takes everything below it along
+        std_fs::remove_all(TEST_PATH / "docs");
+        tree.build(pool, Path(xNative("docs")));
+        REQUIRE(index.applyTree(xNative("docs"), tree) == 2);
+        REQUIRE(index.findPath(xNative("docs")) == FileIndex::NO_NODE);
+        REQUIRE(xUnwatched() == std::vector<std::string>{ xNative("src") });
+
+        // a directory that shows up below a watched one isn't watched either
+        std_fs::create_directories(TEST_PATH / "later");
+        for(int i = 0; i < 200 && index.findPath(xNative("later")) == FileIndex::NO_NODE; i++) {
+            index.pollWatches(registry, pool);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(xUnwatched() == std::vector<std::string>{ xNative("later"), xNative("src") });
+
+        index.unwatchAll(registry);
+        REQUIRE(xUnwatched() == std::vector<std::string>{ rootStr });
+    }
+
+    SECTION("the service answers find") {
+        const std_fs::path SERVICE_PATH = std_fs::current_path() / "TEMP_FILE_INDEXES";
+        refreshTestDirectory(SERVICE_PATH);
+
+        std_fs::create_directories(TEST_PATH / ".git");
+        createFile(TEST_PATH / ".git" / "hook.cpp");
+
+        auto xWaitFor = [](auto xIsDone) {
+            for(int i = 0; i < 500 && !xIsDone(); i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return xIsDone();
+        };
+
+        {
+            FileIndexService service(Path(SERVICE_PATH.u8string()), 2);
+            // only the root is watched, the rest is walked again
+            service.setMaxWatchesPerIndex(1);
+            service.setUnwatchedRefreshInterval(std::chrono::milliseconds(10));
+
+            FindQuery query;
+            REQUIRE(ParseFindQuery({ "main" }, FileSystem::getCurrentFileTime(), query));
+
+            std::vector<std::string> paths;
+            REQUIRE_FALSE(service.findMatches(root, query, FileFinder::DefaultPruneNames(), paths));
+
+            service.request(rootStr);
+            REQUIRE(xWaitFor([&]() { return service.readyRoots() == std::vector<std::string>{ rootStr }; }));
+            REQUIRE(service.busyRoot().empty());
+            REQUIRE(std_fs::exists(service.indexPath(rootStr).str()));
+
+            auto xFind = [&](const Path& directory, const std::vector<std::string>& args) {
+                FindQuery query;
+                std::vector<std::string> paths;
+                if(!ParseFindQuery(args, FileSystem::getCurrentFileTime(), query)) return std::vector<std::string>{ "invalid" };
+                if(!service.findMatches(directory, query, FileFinder::DefaultPruneNames(), paths)) return std::vector<std::string>{ "no index" };
+
+                for(std::string& path : paths) {
+                    path = path.substr(rootStr.size() + 1);
+                    std::replace(path.begin(), path.end(), Path::SEPARATOR, '/');
+                }
+                std::sort(paths.begin(), paths.end());
+                return paths;
+            };
+
+            REQUIRE(xFind(root, { "main" }) == std::vector<std::string>{ "src/Main.cpp", "src/main.h" });
+            REQUIRE(xFind(root, { "Main" }) == std::vector<std::string>{ "src/Main.cpp" });
+            REQUIRE(xFind(root, { "*.cpp" }) == std::vector<std::string>{ "src/Main.cpp", "src/detail/impl.cpp" });
+            REQUIRE(xFind(root, { "re:^ma" }) == std::vector<std::string>{ "docs/manual.md", "src/main.h" });
+            REQUIRE(xFind(Path(xNative("src/detail")), { "*.cpp" }) == std::vector<std::string>{ "src/detail/impl.cpp" });
+            // the directory searched isn't a result of its own
+            REQUIRE(xFind(Path(xNative("src")), { "src" }).empty());
+
+            // pruned directories show up but aren't looked into, like a walk does
+            REQUIRE(xFind(root, { "*.cpp", "prune=detail" }) == std::vector<std::string>{ "src/Main.cpp" });
+            REQUIRE(xFind(root, { "detail", "prune=detail" }) == std::vector<std::string>{ "src/detail" });
+            REQUIRE(xFind(root, { "*.cpp", "noprune" }) == std::vector<std::string>{ ".git/hook.cpp", "src/Main.cpp", "src/detail/impl.cpp" });
+            // a pruned name above the directory searched doesn't count
+            REQUIRE(xFind(Path(xNative(".git")), { "hook" }) == std::vector<std::string>{ ".git/hook.cpp" });
+
+            REQUIRE(xFind(Path(rootStr + "x"), { "main" }) == std::vector<std::string>{ "no index" });
+            REQUIRE(xFind(Path(xNative("src/missing")), { "main" }) == std::vector<std::string>{ "no index" });
+
+            // no watch covers src, the walks pick this up
+            createFile(TEST_PATH / "src" / "later.txt");
+            REQUIRE(xWaitFor([&]() { return xFind(root, { "later" }) == std::vector<std::string>{ "src/later.txt" }; }));
+
+            // matches are looked up on disk for their sizes and dates, ones gone since aren't results
+            REQUIRE(ParseFindQuery({ "*.cpp" }, FileSystem::getCurrentFileTime(), query));
+            paths.clear();
+            REQUIRE(service.findMatches(root, query, FileFinder::DefaultPruneNames(), paths));
+            std_fs::remove(TEST_PATH / "src" / "detail" / "impl.cpp");
+
+            FileFinder finder;
+            REQUIRE(finder.startListed(root, query, paths));
+            REQUIRE(finder.isListed());
+            REQUIRE(finder.numListedPaths() == 2);
+            for(int i = 0; i < 500 && finder.isSearching(); i++) {
+                finder.update();
+                if(finder.isSearching()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            REQUIRE_FALSE(finder.isSearching());
+            REQUIRE(finder.numResults() == 1);
+            REQUIRE(finder.resultPath(0).str() == xNative("src/Main.cpp"));
+            REQUIRE(finder.results().getLastModifiedNumber(0) > 0);
+
+            service.drop(rootStr);
+            REQUIRE(xWaitFor([&]() { return service.readyRoots().empty() && !std_fs::exists(service.indexPath(rootStr).str()); }));
+        }
+
+        std_fs::remove_all(SERVICE_PATH);
+    }
+
+    std_fs::remove(INDEX_PATH);
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Grep", "[simple]") {
+    SECTION("queries") {
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "todo" }, query));
+        REQUIRE_FALSE(query.isRegex);
+        REQUIRE_FALSE(query.isCaseSensitive);
+        REQUIRE(query.useDefaultPrune);
+
+        REQUIRE(ParseGrepQuery({ "re:^#include", "files=*.cpp,*.h", "prune=build", "noprune" }, query));
+        REQUIRE(query.isRegex);
+        REQUIRE(query.pattern == "^#include");
+        REQUIRE(query.fileGlobs == std::vector<std::string>{ "*.cpp", "*.h" });
+        REQUIRE(query.pruneNames == std::vector<std::string>{ "build" });
+        REQUIRE_FALSE(query.useDefaultPrune);
+        REQUIRE(query.text == "re:^#include files=*.cpp,*.h prune=build noprune");
+
+        REQUIRE(ParseGrepQuery({ "TODO" }, query));
+        REQUIRE(query.isCaseSensitive);
+
+        REQUIRE_FALSE(ParseGrepQuery({}, query));
+        REQUIRE_FALSE(ParseGrepQuery({ "files=*.cpp" }, query));
+        REQUIRE_FALSE(ParseGrepQuery({ "a", "b" }, query));
+        REQUIRE_FALSE(ParseGrepQuery({ "re:(unclosed" }, query));
+    }
+
+    auto xLines = [](const GrepMatcher& matcher, std::string_view text, size_t maxLines = SIZE_MAX) {
+        std::vector<GrepLineMatch> lines;
+        matcher.searchText(text, lines, maxLines);
+
+        std::vector<std::string> found;
+        for(const GrepLineMatch& line : lines) {
+            REQUIRE(line.matchBegin >= line.lineBegin);
+            REQUIRE(line.matchEnd <= line.lineEnd);
+            found.push_back(std::to_string(line.lineNumber) + ":" + std::string(text.substr(line.lineBegin, line.lineEnd - line.lineBegin))
+                + "[" + std::string(text.substr(line.matchBegin, line.matchEnd - line.matchBegin)) + "]");
+        }
+        return found;
+    };
+
+    SECTION("lines") {
+        const std::string text = "int main() {\n    // TODO: one\r\n\n    return 0; // todo two, Todo three\n}\ntodo";
+
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "todo" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == std::vector<std::string>{
+            "2:    // TODO: one[TODO]", "4:    return 0; // todo two, Todo three[todo]", "6:todo[todo]" });
+        REQUIRE(xLines(GrepMatcher(query), text, 1).size() == 1);
+
+        REQUIRE(ParseGrepQuery({ "Todo" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == std::vector<std::string>{ "4:    return 0; // todo two, Todo three[Todo]" });
+
+        // with and without a literal to look for first
+        REQUIRE(ParseGrepQuery({ "re:return [0-9];" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == std::vector<std::string>{ "4:    return 0; // todo two, Todo three[return 0;]" });
+        REQUIRE(ParseGrepQuery({ "re:^[a-z]+$" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == std::vector<std::string>{ "6:todo[todo]" });
+        REQUIRE(ParseGrepQuery({ "re:(TODO|todo)" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).size() == 3);
+        // an optional character isn't part of the literal
+        REQUIRE(ParseGrepQuery({ "re:mains?\\(" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == std::vector<std::string>{ "1:int main() {[main(]" });
+        REQUIRE(ParseGrepQuery({ "re:ret{1,2}urn" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).size() == 1);
+
+        REQUIRE(ParseGrepQuery({ "nothing" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).empty());
+
+        GrepQuery files;
+        REQUIRE(ParseGrepQuery({ "x", "files=*.cpp,Makefile" }, files));
+        GrepMatcher matcher(files);
+        REQUIRE(matcher.matchesFileName("main.CPP"));
+        REQUIRE(matcher.matchesFileName("Makefile"));
+        REQUIRE_FALSE(matcher.matchesFileName("main.h"));
+
+        REQUIRE(LooksBinary(std::string_view("ab\0cd", 5)));
+        REQUIRE_FALSE(LooksBinary("plain text"));
+        // only the start is sniffed
+        REQUIRE_FALSE(LooksBinary(std::string(GREP_SNIFF_SIZE, 'x') + std::string(1, '\0')));
+    }
+
+    SECTION("long lines") {
+        // a minified file, std::regex over the whole line would run out of stack. needle_7 starts a window
+        std::string text = "short needle_1\n" + std::string(GREP_REGEX_WINDOW / 2 * 300, 'x') + "needle_7 foo then bar" + std::string(50000, 'y') + "\nend";
+
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "re:needle_[0-9]" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).size() == 2);
+        std::vector<GrepLineMatch> lines;
+        GrepMatcher(query).searchText(text, lines);
+        REQUIRE(lines[1].lineNumber == 2);
+        REQUIRE(lines[1].matchBegin == 15 + GREP_REGEX_WINDOW / 2 * 300);
+
+        REQUIRE(ParseGrepQuery({ "re:foo.*bar" }, query));
+        lines.clear();
+        REQUIRE(GrepMatcher(query).searchText(text, lines) == 1);
+        REQUIRE(text.substr(lines[0].matchBegin, lines[0].matchEnd - lines[0].matchBegin) == "foo then bar");
+
+        // anchors belong to the line, not to a window
+        REQUIRE(ParseGrepQuery({ "re:^needle" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).empty());
+        REQUIRE(ParseGrepQuery({ "re:^x" }, query));
+        lines.clear();
+        REQUIRE(GrepMatcher(query).searchText(text, lines) == 1);
+        REQUIRE(lines[0].matchBegin == lines[0].lineBegin);
+        REQUIRE(ParseGrepQuery({ "re:y$" }, query));
+        lines.clear();
+        REQUIRE(GrepMatcher(query).searchText(text, lines) == 1);
+        REQUIRE(lines[0].matchEnd == lines[0].lineEnd);
+        REQUIRE(ParseGrepQuery({ "re:\\bthen\\b" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).size() == 1);
+        REQUIRE(ParseGrepQuery({ "re:\\bneedle_7" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).empty());
+    }
+
+    SECTION("many lines") {
+        // line numbers stay right over stretches longer than the vector loops take in one go
+        std::string text;
+        std::vector<std::string> expected;
+        for(int line = 1; line <= 20000; line++) {
+            const bool hasMatch = line % 997 == 0;
+            text += hasMatch ? "needle " + std::to_string(line) : std::string(line % 50, 'x');
+            text += '\n';
+            if(hasMatch) expected.push_back(std::to_string(line) + ":needle " + std::to_string(line) + "[needle]");
+        }
+
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "needle" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == expected);
+        REQUIRE(ParseGrepQuery({ "re:^needle" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text) == expected);
+        REQUIRE(ParseGrepQuery({ "re:^n" }, query));
+        REQUIRE(xLines(GrepMatcher(query), text).size() == expected.size());
+    }
+
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_GREP";
+    refreshTestDirectory(TEST_PATH);
+
+    std_fs::create_directories(TEST_PATH / "src" / "detail");
+    std_fs::create_directories(TEST_PATH / "node_modules");
+    std::ofstream(TEST_PATH / "src" / "main.cpp") << "#include \"main.h\"\n// TODO: main\nint main() {}\n";
+    std::ofstream(TEST_PATH / "src" / "main.h") << "#pragma once\n// todo: header\n";
+    std::ofstream(TEST_PATH / "src" / "detail" / "impl.cpp") << "void impl() {}\n";
+    std::ofstream(TEST_PATH / "node_modules" / "dep.js") << "// TODO: pruned\n";
+    std::ofstream(TEST_PATH / "image.bin", std::ios::binary) << std::string("TODO\0\0binary", 12);
+    {
+        // mapped instead of read
+        std::ofstream big(TEST_PATH / "big.txt");
+        for(int line = 1; line <= 200000; line++) {
+            big << (line == 150000 ? "a todo far down\n" : "filler line of text\n");
+        }
+    }
+
+    auto xWaitForSearch = [](ContentSearcher& searcher) {
+        for(int i = 0; i < 500 && searcher.isSearching(); i++) {
+            searcher.update();
+            if(searcher.isSearching()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return !searcher.isSearching();
+    };
+
+    const Path root(TEST_PATH.u8string());
+
+    auto xResults = [&](const ContentSearcher& searcher) {
+        std::vector<std::string> results;
+        for(size_t i = 0; i < searcher.numResults(); i++) {
+            const GrepResult& result = searcher.result(i);
+            std::string file = searcher.filePath(result.file).substr(root.str().size() + 1);
+            std::replace(file.begin(), file.end(), Path::SEPARATOR, '/');
+            results.push_back(file + ":" + std::to_string(result.lineNumber) + ":"
+                + std::string(searcher.preview(i).substr(result.matchBegin, result.matchLength)));
+        }
+        std::sort(results.begin(), results.end());
+        return results;
+    };
+
+    SECTION("searches the tree") {
+        ContentSearcher searcher;
+        GrepQuery query;
+
+        REQUIRE(ParseGrepQuery({ "todo" }, query));
+        REQUIRE(searcher.start(root, {}, query));
+        REQUIRE(searcher.isActive());
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE_FALSE(searcher.wasStopped());
+        REQUIRE(xResults(searcher) == std::vector<std::string>{ "big.txt:150000:todo", "src/main.cpp:2:TODO", "src/main.h:2:todo" });
+        REQUIRE(searcher.numFilesSearched() == 5);
+        REQUIRE(searcher.numBinaryFilesSkipped() == 1);
+        REQUIRE(searcher.numBytesSearched() > 200000 * 20);
+
+        REQUIRE(ParseGrepQuery({ "TODO", "files=*.js,*.bin", "noprune" }, query));
+        REQUIRE(searcher.start(root, {}, query));
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE(xResults(searcher) == std::vector<std::string>{ "node_modules/dep.js:1:TODO" });
+
+        // only what's selected
+        REQUIRE(ParseGrepQuery({ "re:^#" }, query));
+        REQUIRE(searcher.start(root, { "src", "big.txt" }, query));
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE(xResults(searcher) == std::vector<std::string>{ "src/main.cpp:1:#", "src/main.h:1:#" });
+        REQUIRE(ParseGrepQuery({ "todo" }, query));
+        REQUIRE(searcher.start(Path((TEST_PATH / "src").u8string()), { "main.h" }, query));
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE(searcher.numResults() == 1);
+        REQUIRE(searcher.preview(0) == "// todo: header");
+
+        searcher.clear();
+        REQUIRE_FALSE(searcher.isActive());
+        REQUIRE(searcher.numResults() == 0);
+
+        REQUIRE_FALSE(searcher.start(Path(""), {}, query));
+    }
+
+    SECTION("long lines are cut around the match") {
+        std::ofstream(TEST_PATH / "long.txt") << std::string(1000, 'a') << "needle" << std::string(1000, 'b') << "\n";
+
+        ContentSearcher searcher;
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "needle", "files=long.txt" }, query));
+        REQUIRE(searcher.start(root, {}, query));
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE(searcher.numResults() == 1);
+        REQUIRE(searcher.preview(0).size() == ContentSearcher::MAX_PREVIEW_LENGTH);
+        REQUIRE(searcher.preview(0).substr(searcher.result(0).matchBegin, searcher.result(0).matchLength) == "needle");
+    }
+
+    SECTION("cancel") {
+        for(int i = 0; i < 200; i++) {
+            const std_fs::path dir = TEST_PATH / "many" / std::to_string(i);
+            std_fs::create_directories(dir);
+            std::ofstream(dir / "leaf.txt") << "leaf\n";
+        }
+
+        ContentSearcher searcher;
+        GrepQuery query;
+        REQUIRE(ParseGrepQuery({ "leaf" }, query));
+
+        // cancelled at once, whatever was found before stays and nothing comes in after
+        REQUIRE(searcher.start(root, {}, query));
+        searcher.cancel();
+        REQUIRE(xWaitForSearch(searcher));
+        const size_t numFound = searcher.numResults();
+        REQUIRE(numFound <= 200);
+        REQUIRE((searcher.wasStopped() || numFound == 200));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        searcher.update();
+        REQUIRE(searcher.numResults() == numFound);
+
+        // a new search replaces one in flight, none of the old one's results show up
+        REQUIRE(searcher.start(root, {}, query));
+        REQUIRE(ParseGrepQuery({ "header" }, query));
+        REQUIRE(searcher.start(root, {}, query));
+        REQUIRE(xWaitForSearch(searcher));
+        REQUIRE(xResults(searcher) == std::vector<std::string>{ "src/main.h:2:header" });
+
+        // the destructor stops a search in flight
+        REQUIRE(ParseGrepQuery({ "leaf" }, query));
+        ContentSearcher abandoned;
+        REQUIRE(abandoned.start(root, {}, query));
+    }
+
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Content index", "[simple]") {
+    std_fs::path TEST_PATH = std_fs::current_path() / "TEMP_CONTENT_INDEX";
+    refreshTestDirectory(TEST_PATH);
+
+    std_fs::create_directories(TEST_PATH / "src" / "detail");
+    std_fs::create_directories(TEST_PATH / "node_modules");
+    std::ofstream(TEST_PATH / "src" / "main.cpp") << "#include \"main.h\"\nint main() { return Answer(); }\n";
+    std::ofstream(TEST_PATH / "src" / "main.h") << "#pragma once\nint Answer();\n";
+    std::ofstream(TEST_PATH / "src" / "detail" / "impl.cpp") << "int Answer() { return 42; }\n";
+    std::ofstream(TEST_PATH / "node_modules" / "dep.js") << "// Answer, pruned\n";
+    std::ofstream(TEST_PATH / "image.bin", std::ios::binary) << std::string("Answer\0\0binary", 14);
+    std::ofstream(TEST_PATH / "README.md") << "no code here\n";
+
+    const std_fs::path INDEX_PATH = std_fs::current_path() / "TEMP_CONTENT_INDEX.cidx";
+    ContentIndex::removeFiles(Path(INDEX_PATH.u8string()));
+
+    WorkStealingPool pool(4);
+    const Path root(TEST_PATH.u8string());
+    const std::string rootStr = root.str();
+    const Path indexPath(INDEX_PATH.u8string());
+
+    auto xNative = [&](std::string path) {
+        std::replace(path.begin(), path.end(), '/', Path::SEPARATOR);
+        return rootStr + Path::SEPARATOR + path;
+    };
+
+    auto xCandidates = [&](const ContentIndex& index, std::string_view literal) {
+        std::vector<uint32_t> files;
+        index.findCandidates(literal, files);
+
+        std::vector<std::string> paths;
+        for(uint32_t file : files) {
+            REQUIRE(index.getPath(file) == xNative(std::string(index.getRelativePath(file))));
+            std::string path(index.getRelativePath(file));
+            std::replace(path.begin(), path.end(), Path::SEPARATOR, '/');
+            paths.push_back(path);
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    };
+
+    const std::vector<std::string> answers = { "src/detail/impl.cpp", "src/main.cpp", "src/main.h" };
+
+    SECTION("builds, queries and loads") {
+        ContentIndex index;
+        REQUIRE(index.isEmpty());
+        REQUIRE(index.build(pool, root, indexPath));
+        REQUIRE(index.isMapped());
+        REQUIRE(index.imageSize() == std_fs::file_size(INDEX_PATH));
+        REQUIRE(index.rootPath() == rootStr);
+        // node_modules is pruned
+        REQUIRE(index.numEntries() == 5);
+        REQUIRE(index.numTrigrams() > 0);
+
+        REQUIRE(xCandidates(index, "Answer") == answers);
+        // trigrams are folded, the candidates of either case are the same
+        REQUIRE(xCandidates(index, "ANSWER") == answers);
+        REQUIRE(xCandidates(index, "return 42") == std::vector<std::string>{ "src/detail/impl.cpp" });
+        REQUIRE(xCandidates(index, "xyz123").empty());
+        // too short to rule anything out, the binary file is left out all the same
+        REQUIRE(xCandidates(index, "in") == std::vector<std::string>{ "README.md", "src/detail/impl.cpp", "src/main.cpp", "src/main.h" });
+
+        const uint32_t image = index.findFile("image.bin");
+        REQUIRE(image != ContentIndex::NO_FILE);
+        REQUIRE(index.getFlags(image) & ContentIndex::FILE_BINARY);
+        REQUIRE(index.getSize(image) == 14);
+        REQUIRE(index.findFile(xNative("src/main.h").substr(rootStr.size() + 1)) != ContentIndex::NO_FILE);
+        REQUIRE(index.findFile("node_modules/dep.js") == ContentIndex::NO_FILE);
+
+        std::string_view relative;
+        REQUIRE(index.toRelative(xNative("src/detail"), relative));
+        REQUIRE(relative == xNative("src/detail").substr(rootStr.size() + 1));
+        REQUIRE(index.toRelative(rootStr, relative));
+        REQUIRE(relative.empty());
+        REQUIRE_FALSE(index.toRelative(rootStr + "x", relative));
+
+        ContentIndex loaded;
+        REQUIRE(loaded.load(indexPath));
+        REQUIRE(loaded.numEntries() == 5);
+        REQUIRE(loaded.rootPath() == rootStr);
+        REQUIRE(xCandidates(loaded, "answer") == answers);
+
+        ContentIndex broken;
+        std::ofstream(TEST_PATH / "not_an_index") << std::string(4096, 'x');
+        REQUIRE_FALSE(broken.load(Path((TEST_PATH / "not_an_index").u8string())));
+        REQUIRE(broken.isEmpty());
+
+        // a stopped build writes no index
+        ContentIndex cancelled;
+        const std::atomic<bool> cancel{ true };
+        const Path cancelledPath((TEST_PATH / "cancelled.cidx").u8string());
+        REQUIRE_FALSE(cancelled.build(pool, root, cancelledPath, &cancel));
+        REQUIRE_FALSE(std_fs::exists(TEST_PATH / "cancelled.cidx"));
+    }
+
+    SECTION("changes are patched in and saved") {
+        ContentIndex index;
+        REQUIRE(index.build(pool, root, indexPath));
+
+        std::ofstream(TEST_PATH / "src" / "detail" / "impl.cpp") << "int Question();\n";
+        std_fs::create_directories(TEST_PATH / "src" / "added");
+        std::ofstream(TEST_PATH / "src" / "added" / "new.cpp") << "int again = Answer();\n";
+        std_fs::remove(TEST_PATH / "README.md");
+
+        REQUIRE(index.applyChanges(pool, xNative("src/detail"), { "impl.cpp" }));
+        REQUIRE(index.applyChanges(pool, xNative("src"), { "added", "main.cpp" }));
+        REQUIRE(index.applyChanges(pool, rootStr, { "README.md" }));
+        REQUIRE_FALSE(index.applyChanges(pool, rootStr + "x", { "a" }));
+        REQUIRE(index.numChanges() > 0);
+        REQUIRE(index.numEntries() == 5);
+        REQUIRE(index.findFile("README.md") == ContentIndex::NO_FILE);
+
+        const std::vector<std::string> changedAnswers = { "src/added/new.cpp", "src/main.cpp", "src/main.h" };
+        REQUIRE(xCandidates(index, "answer") == changedAnswers);
+        REQUIRE(xCandidates(index, "question") == std::vector<std::string>{ "src/detail/impl.cpp" });
+
+        // a rescan finds what nobody reported
+        std::ofstream(TEST_PATH / "unreported.txt") << "Answer nobody reported\n";
+        REQUIRE(index.rescan(pool, rootStr));
+        REQUIRE(xCandidates(index, "nobody") == std::vector<std::string>{ "unreported.txt" });
+
+        REQUIRE(index.save(indexPath, &pool));
+        REQUIRE(index.numChanges() == 0);
+        REQUIRE(index.isMapped());
+        REQUIRE(xCandidates(index, "question") == std::vector<std::string>{ "src/detail/impl.cpp" });
+
+        ContentIndex loaded;
+        REQUIRE(loaded.load(indexPath));
+        REQUIRE(loaded.numEntries() == 6);
+        REQUIRE(xCandidates(loaded, "answer") == std::vector<std::string>{ "src/added/new.cpp", "src/main.cpp", "src/main.h", "unreported.txt" });
+        REQUIRE(xCandidates(loaded, "in").size() == 5);
+    }
+
+    SECTION("a build picks up the parts of one that was stopped") {
+        ContentIndex index;
+        REQUIRE(index.build(pool, root, indexPath));
+        index.clear();
+
+        // what a stopped build leaves behind has the same layout as an index
+        std_fs::copy_file(INDEX_PATH, INDEX_PATH.u8string() + ".part0", std_fs::copy_options::overwrite_existing);
+        std_fs::remove(INDEX_PATH);
+
+        // a file the same size and time on disk is taken from the part as is, one that changed is read again
+        const std_fs::path header = TEST_PATH / "src" / "main.h";
+        const auto headerTime = std_fs::last_write_time(header);
+        std::ofstream(header) << "#pragma once\nint Qnswer();\n";
+        std_fs::last_write_time(header, headerTime);
+        std::ofstream(TEST_PATH / "src" / "detail" / "impl.cpp") << "int Question();\n";
+
+        REQUIRE(index.build(pool, root, indexPath));
+        REQUIRE(index.numEntries() == 5);
+        REQUIRE(xCandidates(index, "answer") == std::vector<std::string>{ "src/main.cpp", "src/main.h" });
+        REQUIRE(xCandidates(index, "question") == std::vector<std::string>{ "src/detail/impl.cpp" });
+        REQUIRE_FALSE(std_fs::exists(INDEX_PATH.u8string() + ".part0"));
+    }
+
+    SECTION("the service answers grep") {
+        const std_fs::path SERVICE_PATH = std_fs::current_path() / "TEMP_CONTENT_INDEXES";
+        refreshTestDirectory(SERVICE_PATH);
+
+        auto xWaitFor = [](auto xIsDone) {
+            for(int i = 0; i < 500 && !xIsDone(); i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return xIsDone();
+        };
+
+        {
+            ContentIndexService service(Path(SERVICE_PATH.u8string()), 2);
+            GrepQuery query;
+            REQUIRE(ParseGrepQuery({ "answer" }, query));
+
+            std::vector<std::string> files;
+            REQUIRE_FALSE(service.findCandidates(root, {}, query, files));
+
+            service.request(rootStr);
+            REQUIRE(xWaitFor([&]() { return service.readyRoots() == std::vector<std::string>{ rootStr }; }));
+            REQUIRE(service.busyRoot().empty());
+            REQUIRE(std_fs::exists(service.indexPath(rootStr).str()));
+
+            auto xFiles = [&](const Path& directory, const std::vector<std::string>& names, const GrepQuery& query) {
+                std::vector<std::string> files;
+                REQUIRE(service.findCandidates(directory, names, query, files));
+                for(std::string& file : files) {
+                    file = file.substr(rootStr.size() + 1);
+                    std::replace(file.begin(), file.end(), Path::SEPARATOR, '/');
+                }
+                std::sort(files.begin(), files.end());
+                return files;
+            };
+
+            REQUIRE(xFiles(root, {}, query) == answers);
+            REQUIRE(xFiles(Path(xNative("src")), { "main.h", "detail" }, query) == std::vector<std::string>{ "src/detail/impl.cpp", "src/main.h" });
+            REQUIRE(xFiles(Path(xNative("src/detail")), {}, query) == std::vector<std::string>{ "src/detail/impl.cpp" });
+
+            GrepQuery narrowed;
+            REQUIRE(ParseGrepQuery({ "answer", "files=*.h" }, narrowed));
+            REQUIRE(xFiles(root, {}, narrowed) == std::vector<std::string>{ "src/main.h" });
+            REQUIRE(ParseGrepQuery({ "answer", "prune=detail" }, narrowed));
+            REQUIRE(xFiles(root, {}, narrowed) == std::vector<std::string>{ "src/main.cpp", "src/main.h" });
+            // a pruned name above the directory searched doesn't count
+            REQUIRE(xFiles(Path(xNative("src/detail")), {}, narrowed) == std::vector<std::string>{ "src/detail/impl.cpp" });
+
+            // the index doesn't have what noprune would turn up
+            REQUIRE(ParseGrepQuery({ "answer", "noprune" }, narrowed));
+            REQUIRE_FALSE(service.findCandidates(root, {}, narrowed, files));
+            REQUIRE_FALSE(service.findCandidates(Path(rootStr + "x"), {}, query, files));
+
+            // the candidates are searched for real
+            files.clear();
+            REQUIRE(service.findCandidates(root, {}, query, files));
+            ContentSearcher searcher;
+            REQUIRE(searcher.startListed(root, files, query));
+            REQUIRE(searcher.isListed());
+            REQUIRE(searcher.numListedFiles() == 3);
+            for(int i = 0; i < 500 && searcher.isSearching(); i++) {
+                searcher.update();
+                if(searcher.isSearching()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            REQUIRE_FALSE(searcher.isSearching());
+            REQUIRE(searcher.numFilesSearched() == 3);
+            REQUIRE(searcher.numResults() == 3);
+
+            service.drop(rootStr);
+            REQUIRE(xWaitFor([&]() { return service.readyRoots().empty() && !std_fs::exists(service.indexPath(rootStr).str()); }));
+        }
+
+        std_fs::remove_all(SERVICE_PATH);
+    }
+
+    ContentIndex::removeFiles(Path(INDEX_PATH.u8string()));
+    std_fs::remove_all(TEST_PATH);
+}
+
+TEST_CASE("Timestamp cache", "[simple]") {
+    // 2023-06-15 09:30:00 UTC in 100ns ticks since 1601
+    const uint64_t base = (1686821400ULL + 11644473600ULL) * 10000000ULL;
+    const uint64_t minute = 60ULL * 10000000ULL;
+
+    auto xSameTimestamp = [](const FileSystem::Timestamp& lhs, const FileSystem::Timestamp& rhs) {
+        return lhs.year == rhs.year && lhs.month == rhs.month && lhs.day == rhs.day
+            && lhs.hour == rhs.hour && lhs.minute == rhs.minute && lhs.isPM == rhs.isPM;
+    };
+
+    SECTION("same day fast path matches the OS conversion") {
+        TimestampCache cache;
+        for(uint64_t i = 0; i < 3 * 24 * 60; i += 7) {
+            const uint64_t fileTime = base + i * minute;
+            REQUIRE(xSameTimestamp(cache.toLocal(fileTime), FileSystem::fileTimeToLocalTimestamp(fileTime)));
+        }
+
+        // one day conversion (plus its DST check) per day instead of one per minute
+        REQUIRE(cache.numConversions() < 3 * 24 * 60 / 7);
+    }
+
+    SECTION("days with a DST switch") {
+        // the OS conversion uses the system's zone on windows, TZ elsewhere
+#ifndef _WIN32
+        const char* previousZone = getenv("TZ");
+        const std::string savedZone = previousZone != nullptr ? previousZone : "";
+        setenv("TZ", "America/New_York", 1);
+        tzset();
+#endif
+
+        // 2026-03-08 11:00 and 2026-11-01 09:00 New York time, after the switches at 2 AM
+        const uint64_t hour = 60 * minute;
+        for(uint64_t switchDay : { (1772982000ULL + 11644473600ULL) * 10000000ULL, (1793541600ULL + 11644473600ULL) * 10000000ULL }) {
+            // a time after the switch is converted first, the times before it that day and the evening before mustn't
+            // be derived from it
+            TimestampCache cache;
+            for(uint64_t fileTime = switchDay; fileTime > switchDay - 36 * hour; fileTime -= 10 * minute) {
+                REQUIRE(xSameTimestamp(cache.toLocal(fileTime), FileSystem::fileTimeToLocalTimestamp(fileTime)));
+            }
+            for(uint64_t fileTime = switchDay - 36 * hour; fileTime < switchDay + 36 * hour; fileTime += 10 * minute) {
+                REQUIRE(xSameTimestamp(cache.toLocal(fileTime), FileSystem::fileTimeToLocalTimestamp(fileTime)));
+            }
+        }
+
+#ifndef _WIN32
+        if(previousZone != nullptr) {
+            setenv("TZ", savedZone.c_str(), 1);
+        } else {
+            unsetenv("TZ");
+        }
+        tzset();
+#endif
+    }
+
+    SECTION("rows are re-formatted when their file time changes") {
+        TimestampCache cache;
+        std::string first = cache.format(0, base);
+        REQUIRE(std::string(cache.format(0, base)) == first);
+        REQUIRE(std::string(cache.format(0, base + 24 * 60 * minute)) != first);
+    }
+}
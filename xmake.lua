@@ -89,25 +89,54 @@ target("tests")
         "src"
         )
 
-    if is_mode("debug") then
-      set_symbols("debug")
-      add_cxflags("/EHsc", "/Zi", "/MTd", "/DEBUG:FULL")
-      add_ldflags("/LTCG")
+    -- the tests also build on linux against the POSIX enumeration backend
+    if is_plat("windows") then
+      if is_mode("debug") then
+        set_symbols("debug")
+        add_cxflags("/EHsc", "/Zi", "/MTd", "/DEBUG:FULL")
+        add_ldflags("/LTCG")
+      else
+        add_cxflags("/EHsc", "/MT")
+        add_ldflags("/LTCG")
+        set_optimize("fastest")
+      end
+
+      add_ldflags("/SUBSYSTEM:CONSOLE")
+
+      add_links("user32", "gdi32", "shell32", "Ole32")
     else
-      add_cxflags("/EHsc", "/MT")
-      add_ldflags("/LTCG")
-      set_optimize("fastest")
-    end
+      if is_mode("debug") then
+        set_symbols("debug")
+      else
+        set_optimize("fastest")
+      end
 
-    add_ldflags("/SUBSYSTEM:CONSOLE")
-
-    add_links("user32", "gdi32", "shell32", "Ole32")
+      add_syslinks("pthread")
+    end
 
     add_files(
         "src/StringUtils.cpp",
         "src/FileSystem.cpp",
+        "src/FileSystemLinux.cpp",
         "src/Path.cpp",
+        "src/TimestampCache.cpp",
+        "src/WorkStealingPool.cpp",
+        "src/DirectoryTree.cpp",
+        "src/FolderSizeService.cpp",
+        "src/DirectoryCache.cpp",
+        "src/WatchRegistry.cpp",
+        "src/DirectoryWatcher.cpp",
+        "src/NameFilter.cpp",
+        "src/SubstringSearch.cpp",
+        "src/FuzzyMatch.cpp",
+        "src/FileFinder.cpp",
+        "src/FileIndex.cpp",
+        "src/ContentSearch.cpp",
+        "src/ContentIndex.cpp",
+        "src/ContentIndexService.cpp",
+        "src/FileIndexService.cpp",
         "tests/main.cpp",
+        "tests/benchmarks.cpp",
         "third_party/catch2/extras/catch_amalgamated.cpp"
     )
 